@@ -70,8 +70,11 @@
 #endif     // HAVE_SHMAT
 
 #include "app_data.h"
+#include "capture_log.h"
 #include "codecs.h"
 #include "frame.h"
+#include "resampler.h"
+#include "synth.h"
 #include "xvidcap-intl.h"
 
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
@@ -194,8 +197,23 @@ xvc_appdata_init (XVC_AppData * lapp)
     lapp->mouseWanted = 0;
     lapp->source = NULL;
     lapp->use_xdamage = -1;
+    lapp->verify_damage = 0;
+    lapp->store_delta = 0;
+    lapp->write_behind = 0;
+    lapp->write_behind_chunk = 0;
+    lapp->trace_file = NULL;
+    lapp->capture_log = NULL;
+    lapp->benchmark = NULL;
+    lapp->export_store = NULL;
+    lapp->transcode_store = NULL;
+    lapp->transcode_jobs = 0;
+#ifdef USE_FFMPEG
+    lapp->replay_time = 0;
+    lapp->replay_mem = 0;
+#endif     // USE_FFMPEG
 #ifdef HAVE_FFMPEG_AUDIO
     lapp->snddev = NULL;
+    lapp->resample_quality = XVC_RESAMPLE_MEDIUM;
 #endif     // HAVE_FFMPEG_AUDIO
 #ifdef HasVideo4Linux
     lapp->device = NULL;
@@ -227,22 +245,16 @@ xvc_appdata_init (XVC_AppData * lapp)
 }
 
 /**
- * \brief sets default values for XVC_AppData structure.
+ * \brief checks which X extensions the display supports and sets the
+ *      flags for using them
  *
- * @param lapp a pointer to a pre-existing XVC_AppData struct to set.
- * @see XVC_AppData
+ * @param lapp a pointer to the XVC_AppData struct to set the flags in,
+ *      its display must be set
  */
-void
-xvc_appdata_set_defaults (XVC_AppData * lapp)
+static void
+appdata_query_extensions (XVC_AppData * lapp)
 {
-#define DEBUGFUNCTION "xvc_appdata_set_defaults"
-    // initialize general options
-    // we need the display first
-    appdata_set_display (lapp);
-
-    // flags related settings
-    lapp->flags = FLG_ALWAYS_SHOW_RESULTS;
-
+#define DEBUGFUNCTION "appdata_query_extensions()"
 #ifdef HAVE_LIBXFIXES
     {
         int a, b;
@@ -335,6 +347,29 @@ xvc_appdata_set_defaults (XVC_AppData * lapp)
     if (!XShmQueryExtension (lapp->dpy))
         app->flags &= ~FLG_USE_SHM;
 #endif     // HAVE_SHMAT
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief sets default values for XVC_AppData structure.
+ *
+ * @param lapp a pointer to a pre-existing XVC_AppData struct to set.
+ * @see XVC_AppData
+ */
+void
+xvc_appdata_set_defaults (XVC_AppData * lapp)
+{
+#define DEBUGFUNCTION "xvc_appdata_set_defaults"
+    // initialize general options
+    // we need the display first
+    appdata_set_display (lapp);
+
+    // flags related settings
+    lapp->flags = FLG_ALWAYS_SHOW_RESULTS;
+
+    // without a display only the synth capture source can be used
+    if (lapp->dpy)
+        appdata_query_extensions (lapp);
 
     // capture source related stuff
 #ifdef HAVE_SHMAT
@@ -345,8 +380,23 @@ xvc_appdata_set_defaults (XVC_AppData * lapp)
 #ifdef HasVideo4Linux
     lapp->device = "/dev/video0";
 #endif     // HasVideo4Linux
+    lapp->verify_damage = 0;
+    lapp->store_delta = 0;
+    lapp->write_behind = 0;
+    lapp->write_behind_chunk = 0;
+    lapp->trace_file = NULL;
+    lapp->capture_log = NULL;
+    lapp->benchmark = NULL;
+    lapp->export_store = NULL;
+    lapp->transcode_store = NULL;
+    lapp->transcode_jobs = 0;
+#ifdef USE_FFMPEG
+    lapp->replay_time = 0;
+    lapp->replay_mem = 64;
+#endif     // USE_FFMPEG
 #ifdef HAVE_FFMPEG_AUDIO
     lapp->snddev = "/dev/dsp";
+    lapp->resample_quality = XVC_RESAMPLE_MEDIUM;
 #endif     // HAVE_FFMPEG_AUDIO
 
     lapp->mouseWanted = 1;
@@ -357,7 +407,9 @@ xvc_appdata_set_defaults (XVC_AppData * lapp)
     lapp->area->width = 192;
     lapp->area->height = 144;
     lapp->area->x = lapp->area->y = -1;
-    xvc_get_window_attributes (lapp->dpy, lapp->root_window, &(lapp->win_attr));
+    if (lapp->dpy)
+        xvc_get_window_attributes (lapp->dpy, lapp->root_window,
+                                   &(lapp->win_attr));
 
     // default mode of capture
 #ifdef USE_FFMPEG
@@ -461,6 +513,19 @@ void
 xvc_appdata_copy (XVC_AppData * tapp, const XVC_AppData * sapp)
 {
     tapp->use_xdamage = sapp->use_xdamage;
+    tapp->verify_damage = sapp->verify_damage;
+    tapp->store_delta = sapp->store_delta;
+    tapp->write_behind = sapp->write_behind;
+    tapp->write_behind_chunk = sapp->write_behind_chunk;
+    tapp->trace_file = (sapp->trace_file ? strdup (sapp->trace_file) : NULL);
+    tapp->capture_log =
+        (sapp->capture_log ? strdup (sapp->capture_log) : NULL);
+    tapp->benchmark = (sapp->benchmark ? strdup (sapp->benchmark) : NULL);
+    tapp->export_store =
+        (sapp->export_store ? strdup (sapp->export_store) : NULL);
+    tapp->transcode_store =
+        (sapp->transcode_store ? strdup (sapp->transcode_store) : NULL);
+    tapp->transcode_jobs = sapp->transcode_jobs;
     tapp->verbose = sapp->verbose;
     tapp->flags = sapp->flags;
     tapp->rescale = sapp->rescale;
@@ -479,8 +544,13 @@ xvc_appdata_copy (XVC_AppData * tapp, const XVC_AppData * sapp)
 #endif     // USE_XDAMAGE
 
     tapp->source = strdup (sapp->source);
+#ifdef USE_FFMPEG
+    tapp->replay_time = sapp->replay_time;
+    tapp->replay_mem = sapp->replay_mem;
+#endif     // USE_FFMPEG
 #ifdef HAVE_FFMPEG_AUDIO
     tapp->snddev = strdup (sapp->snddev);
+    tapp->resample_quality = sapp->resample_quality;
 #endif     // HAVE_FFMPEG_AUDIO
 #ifdef HasVideo4Linux
     tapp->device = strdup (sapp->device);
@@ -571,8 +641,11 @@ xvc_appdata_validate (XVC_AppData * lapp, int mode, int *rc)
         lapp->flags |= FLG_RUN_VERBOSE;
 
     // start: capture size
-    if ((lapp->area->width + lapp->area->x) > lapp->max_width ||
-        (lapp->area->height + lapp->area->y) > lapp->max_height) {
+    // generated frames can be of any size, even without a display
+    if (lapp->dpy && strncasecmp (lapp->source, XVC_SYNTH_SOURCE,
+                                  strlen (XVC_SYNTH_SOURCE)) != 0 &&
+        ((lapp->area->width + lapp->area->x) > lapp->max_width ||
+         (lapp->area->height + lapp->area->y) > lapp->max_height)) {
         errors = errorlist_append (6, errors, lapp);
         if (!errors) {
             *rc = -1;
@@ -599,10 +672,19 @@ xvc_appdata_validate (XVC_AppData * lapp, int mode, int *rc)
     else if (strcasecmp (app->source, "shm") == 0)
         lapp->flags |= FLG_USE_SHM;
 #endif     // HAVE_SHMAT
+    else if (strcasecmp (app->source, "auto") == 0)
+        lapp->flags |= FLG_AUTO_SOURCE;
     else if (strcasecmp (app->source, "dga") == 0)
         lapp->flags |= FLG_USE_DGA;
     else if (strstr (app->source, "v4l") != NULL)
         lapp->flags |= FLG_USE_V4L;
+    else if (strncasecmp (app->source, XVC_REPLAY_SOURCE,
+                          strlen (XVC_REPLAY_SOURCE)) == 0 &&
+             xvc_capture_log_probe (app->source + strlen (XVC_REPLAY_SOURCE),
+                                    NULL, NULL) == 0)
+        lapp->flags |= FLG_USE_REPLAY;
+    else if (xvc_synth_parse_source (app->source, NULL, NULL, NULL) == 0)
+        lapp->flags |= FLG_USE_SYNTH;
     else {
         errors = errorlist_append (8, errors, lapp);
         if (!errors) {
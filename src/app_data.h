@@ -99,15 +99,34 @@ enum XVC_Flags
  */
     FLG_LOCK_FOLLOWS_MOUSE = 8192,
 /** \brief run without frame around the capture area */
-    FLG_NOFRAME = 16384
+    FLG_NOFRAME = 16384,
+/** \brief replay a capture log instead of capturing from the X server */
+    FLG_USE_REPLAY = 32768,
+/** \brief replay a capture log as fast as possible instead of with the
+ *      timing it was recorded with */
+    FLG_MAX_SPEED = 65536,
+/** \brief generate test patterns instead of capturing from the X server */
+    FLG_USE_SYNTH = 131072,
+/** \brief pick the fastest way of capturing from the X server when a
+ *      recording starts */
+    FLG_AUTO_SOURCE = 262144,
+/** \brief write individual frames from a separate thread */
+    FLG_ASYNC_WRITE = 524288,
+/** \brief write xvs frame stores through a mapping of the file */
+    FLG_MMAP_WRITE = 1048576,
+/** \brief store the tiles that changed and compress the frames of xvs
+ *      frame stores */
+    FLG_STORE_COMPRESS = 2097152
 };
 
 #ifdef HAVE_SHMAT
 /** \brief shorthand for the sum of source flags */
-#define FLG_SOURCE (FLG_USE_DGA | FLG_USE_SHM | FLG_USE_V4L)
+#define FLG_SOURCE (FLG_USE_DGA | FLG_USE_SHM | FLG_USE_V4L | FLG_USE_REPLAY | \
+        FLG_USE_SYNTH | FLG_AUTO_SOURCE)
 #else      // HAVE_SHMAT
 /** \brief shorthand for the sum of source flags */
-#define FLG_SOURCE (FLG_USE_DGA | FLG_USE_V4L)
+#define FLG_SOURCE (FLG_USE_DGA | FLG_USE_V4L | FLG_USE_REPLAY | \
+        FLG_USE_SYNTH | FLG_AUTO_SOURCE)
 #endif     // HAVE_SHMAT
 
 /**
@@ -183,9 +202,56 @@ typedef struct
     /** \brief controls the use of the XDamage extension for screen capture
      * -1 == auto, 0 == off, 1 == on */
     int use_xdamage;
+    /** \brief check every verify_damage frames captured with Xdamage
+     *      against a full frame, 0 == off */
+    int verify_damage;
+    /** \brief for xvs frame stores, store a full frame every store_delta
+     *      frames and only the lines changed for the others, 0 == full
+     *      frames only */
+    int store_delta;
+    /** \brief MB of output that may be waiting to be written to disk with
+     *      write-behind, 0 == no write-behind */
+    int write_behind;
+    /** \brief size in MB of the chunks write-behind hands to the kernel,
+     *      0 == XVC_WB_CHUNK_MB */
+    int write_behind_chunk;
+    /** \brief file to write a Chrome trace of the capture pipeline to or
+     *      NULL for no trace */
+    char *trace_file;
+    /** \brief file to log the captured frames to for replaying them with
+     *      the replay source or NULL for no capture log */
+    char *capture_log;
+    /** \brief comma separated list of the patterns to run in benchmark
+     *      mode or NULL for a normal capture */
+    char *benchmark;
+    /** \brief xvs frame store to export frames from, optionally followed
+     *      by :first[-last], or NULL for a normal capture */
+    char *export_store;
+    /** \brief xvs frame store to encode to the capture target or NULL for
+     *      a normal capture */
+    char *transcode_store;
+    /** \brief number of processes encoding parts of a frame store at the
+     *      same time with transcode_store, 0 for one per CPU */
+    int transcode_jobs;
+#ifdef USE_FFMPEG
+    /**
+     * \brief keep only the last replay_time seconds of a multi-frame
+     *      capture in memory until a replay is requested through dbus,
+     *      0 writes the output file as usual
+     */
+    int replay_time;
+    /** \brief memory budget of the replay buffer in MB */
+    int replay_mem;
+#endif     // USE_FFMPEG
 #ifdef HAVE_FFMPEG_AUDIO
     /** \brief audio capture source */
     char *snddev;
+    /**
+     * \brief quality of the resampling of audio inputs
+     *
+     * @see XVC_ResampleQuality
+     */
+    int resample_quality;
 #endif     // HAVE_FFMPEG_AUDIO
 #ifdef HasVideo4Linux
     /** \brief v4l device to capture from */
@@ -0,0 +1,657 @@
+/**
+ * \file async_io.c
+ *
+ * This file contains writing files without waiting for the disk. Writes
+ * are copied into one of XVC_AIO_BUFFERS buffers, and a buffer that is
+ * full, or that is followed by a seek or a close, is handed on:
+ *
+ * - with liburing, the buffers are registered with an io_uring and
+ *   written with IORING_OP_WRITE_FIXED, completions are picked up
+ *   whenever a buffer is needed
+ * - otherwise, XVC_AIO_THREADS threads write them with pwrite ()
+ *
+ * Closing a file doesn't wait for its writes, the file descriptor is
+ * closed when the last of them completes. Completed writes are reported to
+ * write_behind.c.
+ * A seek waits for the writes of the file, so writes to the same part of
+ * a file, like a header patched by a muxer, land in order.
+ *
+ * The protocol XVC_AIO_PROTOCOL lets libavformat write through this.
+ */
+/*
+ * Copyright (C) 2003-07 Karl H. Beckers, Frankfurt
+ * EMail: khb@jarre-de-the.net
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif     // HAVE_CONFIG_H
+
+#define DEBUGFILE "async_io.c"
+#endif     // DOXYGEN_SHOULD_SKIP_THIS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif     // HAVE_LIBURING
+#ifdef USE_FFMPEG
+#include <ffmpeg/avformat.h>
+#endif     // USE_FFMPEG
+
+#include "async_io.h"
+#include "write_behind.h"
+#include "app_data.h"
+#include "trace.h"
+#include "xvidcap-intl.h"
+
+/**
+ * \brief a buffer collecting writes
+ */
+typedef struct XVC_AioBuf
+{
+    /** \brief the memory of the buffer */
+    char *data;
+    /** \brief number of bytes in the buffer */
+    size_t len;
+    /** \brief number of bytes written so far */
+    size_t done;
+    /** \brief file offset of the first byte */
+    int64_t offset;
+    /** \brief the file the buffer belongs to */
+    XVC_AioFile *file;
+    /** \brief index of the buffer for IORING_OP_WRITE_FIXED */
+    int index;
+    /** \brief errno of a failed write or 0 */
+    int error;
+    /** \brief next buffer in the free list or a queue */
+    struct XVC_AioBuf *next;
+} XVC_AioBuf;
+
+/**
+ * \brief a file written asynchronously
+ */
+struct XVC_AioFile
+{
+    /** \brief the file descriptor */
+    int fd;
+    /** \brief name of the file for error messages */
+    char *name;
+    /** \brief file offset the next write goes to */
+    int64_t pos;
+    /** \brief size of the file */
+    int64_t size;
+    /** \brief the buffer being filled or NULL */
+    XVC_AioBuf *cur;
+    /** \brief number of buffers of the file being written */
+    int in_flight;
+    /** \brief TRUE once the file was closed */
+    int closing;
+    /** \brief errno of the first failed write or 0 */
+    int error;
+};
+
+/** \brief protects everything below */
+static pthread_mutex_t aio_mutex = PTHREAD_MUTEX_INITIALIZER;
+/** \brief TRUE once the buffers are set up */
+static int aio_ready = FALSE;
+/** \brief the buffers and the memory they use */
+static XVC_AioBuf bufs[XVC_AIO_BUFFERS];
+static char *buf_mem = NULL;
+/** \brief buffers not in use */
+static XVC_AioBuf *free_list = NULL;
+/** \brief number of buffers being written */
+static int num_in_flight = 0;
+
+#ifdef HAVE_LIBURING
+/** \brief the ring the buffers are registered with */
+static struct io_uring ring;
+/** \brief TRUE if io_uring is used, FALSE if the threads write */
+static int use_ring = FALSE;
+#endif     // HAVE_LIBURING
+
+/** \brief the threads writing without io_uring */
+static pthread_t threads[XVC_AIO_THREADS];
+/** \brief buffers waiting for a thread, oldest first */
+static XVC_AioBuf *queue_head = NULL, *queue_tail = NULL;
+/** \brief buffers the threads are done with */
+static XVC_AioBuf *done_list = NULL;
+/** \brief signalled when a buffer was queued */
+static pthread_cond_t aio_queued = PTHREAD_COND_INITIALIZER;
+/** \brief signalled when a thread is done with a buffer */
+static pthread_cond_t aio_written = PTHREAD_COND_INITIALIZER;
+
+/**
+ * \brief writes the buffers queued, this runs in threads of their own
+ *
+ * @param arg not used
+ * @return NULL
+ */
+static void *
+write_thread (void *arg)
+{
+    XVC_AioBuf *b;
+    ssize_t n;
+
+    xvc_trace_thread_name ("aio write");
+    pthread_mutex_lock (&aio_mutex);
+    while (TRUE) {
+        while (!queue_head)
+            pthread_cond_wait (&aio_queued, &aio_mutex);
+        b = queue_head;
+        queue_head = b->next;
+        if (!queue_head)
+            queue_tail = NULL;
+        pthread_mutex_unlock (&aio_mutex);
+
+        b->error = 0;
+        while (b->done < b->len) {
+            n = pwrite (b->file->fd, b->data + b->done, b->len - b->done,
+                        b->offset + b->done);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0) {
+                b->error = (n < 0 ? errno : EIO);
+                break;
+            }
+            b->done += n;
+        }
+
+        pthread_mutex_lock (&aio_mutex);
+        b->next = done_list;
+        done_list = b;
+        pthread_cond_signal (&aio_written);
+    }
+    return NULL;
+}
+
+/**
+ * \brief sets up the buffers and io_uring or the threads writing, called
+ *      with aio_mutex held
+ *
+ * @return 0 on success or -1 on error
+ */
+static int
+aio_init ()
+{
+#define DEBUGFUNCTION "aio_init()"
+#ifdef HAVE_LIBURING
+    struct iovec iov[XVC_AIO_BUFFERS];
+#endif     // HAVE_LIBURING
+    int i, started = 0;
+
+    if (aio_ready)
+        return 0;
+    // aligned, so the buffers could also be used with O_DIRECT
+    if (posix_memalign ((void **) &buf_mem, 4096,
+                        (size_t) XVC_AIO_BUFFERS * XVC_AIO_BUF_SIZE) != 0) {
+        buf_mem = NULL;
+        fprintf (stderr, _("%s %s: Can't allocate the write buffers\n"),
+                 DEBUGFILE, DEBUGFUNCTION);
+        return -1;
+    }
+    free_list = NULL;
+    for (i = XVC_AIO_BUFFERS - 1; i >= 0; i--) {
+        bufs[i].data = buf_mem + (size_t) i * XVC_AIO_BUF_SIZE;
+        bufs[i].index = i;
+        bufs[i].next = free_list;
+        free_list = &bufs[i];
+    }
+
+#ifdef HAVE_LIBURING
+    for (i = 0; i < XVC_AIO_BUFFERS; i++) {
+        iov[i].iov_base = bufs[i].data;
+        iov[i].iov_len = XVC_AIO_BUF_SIZE;
+    }
+    if (io_uring_queue_init (XVC_AIO_BUFFERS, &ring, 0) == 0) {
+        if (io_uring_register_buffers (&ring, iov, XVC_AIO_BUFFERS) == 0)
+            use_ring = TRUE;
+        else
+            io_uring_queue_exit (&ring);
+    }
+    if (use_ring) {
+        aio_ready = TRUE;
+        return 0;
+    }
+#endif     // HAVE_LIBURING
+
+    for (i = 0; i < XVC_AIO_THREADS; i++) {
+        if (pthread_create (&threads[i], NULL, write_thread, NULL) == 0)
+            started++;
+    }
+    if (started == 0) {
+        fprintf (stderr, _("%s %s: Can't start the threads writing\n"),
+                 DEBUGFILE, DEBUGFUNCTION);
+        free (buf_mem);
+        buf_mem = NULL;
+        return -1;
+    }
+    aio_ready = TRUE;
+    return 0;
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief closes a file once it was closed and all its writes completed
+ *
+ * @param f the file
+ */
+static void
+finish_file (XVC_AioFile * f)
+{
+    if (xvc_wb_close (f->fd, f->name) < 0 && !f->error)
+        perror (f->name);
+    free (f->name);
+    free (f);
+}
+
+#ifdef HAVE_LIBURING
+/**
+ * \brief queues what is left of a buffer to the ring
+ *
+ * @param b the buffer
+ */
+static void
+ring_submit (XVC_AioBuf * b)
+{
+    struct io_uring_sqe *sqe;
+
+    // there are as many entries as buffers, so there is always one
+    sqe = io_uring_get_sqe (&ring);
+    io_uring_prep_write_fixed (sqe, b->file->fd, b->data + b->done,
+                               b->len - b->done, b->offset + b->done,
+                               b->index);
+    io_uring_sqe_set_data (sqe, b);
+    io_uring_submit (&ring);
+}
+#endif     // HAVE_LIBURING
+
+/**
+ * \brief hands a buffer on for writing
+ *
+ * @param b the buffer
+ */
+static void
+submit (XVC_AioBuf * b)
+{
+    b->done = 0;
+    b->file->in_flight++;
+    num_in_flight++;
+#ifdef HAVE_LIBURING
+    if (use_ring) {
+        ring_submit (b);
+        return;
+    }
+#endif     // HAVE_LIBURING
+    b->next = NULL;
+    if (queue_tail)
+        queue_tail->next = b;
+    else
+        queue_head = b;
+    queue_tail = b;
+    pthread_cond_signal (&aio_queued);
+}
+
+/**
+ * \brief returns a buffer that was written to the free list
+ *
+ * @param b the buffer
+ * @param error errno of a failed write or 0
+ */
+static void
+complete (XVC_AioBuf * b, int error)
+{
+    XVC_AioFile *f = b->file;
+
+    if (error && !f->error) {
+        f->error = error;
+        fprintf (stderr, "%s: %s\n", f->name, strerror (error));
+    } else if (!error) {
+        xvc_wb_add (f->fd, b->offset, b->len);
+    }
+    f->in_flight--;
+    num_in_flight--;
+    b->file = NULL;
+    b->next = free_list;
+    free_list = b;
+    if (f->closing && f->in_flight == 0)
+        finish_file (f);
+}
+
+/**
+ * \brief picks up the buffers that were written
+ *
+ * @param wait TRUE to wait for at least one buffer if none was written yet
+ */
+static void
+reap (int wait)
+{
+    XVC_AioBuf *b;
+
+#ifdef HAVE_LIBURING
+    if (use_ring) {
+        struct io_uring_cqe *cqe;
+        int res;
+
+        while ((wait ? io_uring_wait_cqe (&ring, &cqe) :
+                io_uring_peek_cqe (&ring, &cqe)) == 0) {
+            b = (XVC_AioBuf *) io_uring_cqe_get_data (cqe);
+            res = cqe->res;
+            io_uring_cqe_seen (&ring, cqe);
+            wait = FALSE;
+            if (res > 0 && b->done + res < b->len) {
+                // short write, queue the rest
+                b->done += res;
+                ring_submit (b);
+            } else {
+                complete (b, (res < 0 ? -res : (res == 0 ? EIO : 0)));
+            }
+        }
+        return;
+    }
+#endif     // HAVE_LIBURING
+    while (wait && !done_list)
+        pthread_cond_wait (&aio_written, &aio_mutex);
+    while (done_list) {
+        b = done_list;
+        done_list = b->next;
+        complete (b, b->error);
+    }
+}
+
+/**
+ * \brief hands the buffer being filled on for writing
+ *
+ * @param f the file
+ */
+static void
+flush_file (XVC_AioFile * f)
+{
+    if (!f->cur)
+        return;
+    if (f->cur->len > 0) {
+        submit (f->cur);
+    } else {
+        f->cur->file = NULL;
+        f->cur->next = free_list;
+        free_list = f->cur;
+    }
+    f->cur = NULL;
+}
+
+/**
+ * \brief opens a file for writing asynchronously, truncating it
+ *
+ * @param file the name of the file
+ * @return the file or NULL on error with errno set
+ */
+XVC_AioFile *
+xvc_aio_open (const char *file)
+{
+    XVC_AioFile *f;
+    int ok;
+
+    pthread_mutex_lock (&aio_mutex);
+    ok = (aio_init () == 0);
+    pthread_mutex_unlock (&aio_mutex);
+    if (!ok) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    f = calloc (1, sizeof (XVC_AioFile));
+    if (!f)
+        return NULL;
+    f->name = strdup (file);
+    f->fd = open (file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (f->fd < 0 || !f->name) {
+        int err = (f->fd < 0 ? errno : ENOMEM);
+
+        if (f->fd >= 0)
+            close (f->fd);
+        free (f->name);
+        free (f);
+        errno = err;
+        return NULL;
+    }
+    return f;
+}
+
+/**
+ * \brief writes to a file, only waiting if all buffers are in use
+ *
+ * @param f the file
+ * @param data what to write
+ * @param len number of bytes to write
+ * @return 0 on success or -1 if a write to the file failed before
+ */
+int
+xvc_aio_write (XVC_AioFile * f, const void *data, size_t len)
+{
+    const char *p = (const char *) data;
+    size_t n;
+    int ret;
+
+    pthread_mutex_lock (&aio_mutex);
+    while (len > 0 && !f->error) {
+        if (!f->cur) {
+            while (!free_list)
+                reap (TRUE);
+            f->cur = free_list;
+            free_list = f->cur->next;
+            f->cur->file = f;
+            f->cur->len = 0;
+            f->cur->offset = f->pos;
+        }
+        n = XVC_MIN (len, XVC_AIO_BUF_SIZE - f->cur->len);
+        memcpy (f->cur->data + f->cur->len, p, n);
+        f->cur->len += n;
+        f->pos += n;
+        if (f->pos > f->size)
+            f->size = f->pos;
+        p += n;
+        len -= n;
+        if (f->cur->len == XVC_AIO_BUF_SIZE)
+            flush_file (f);
+    }
+    ret = (f->error ? -1 : 0);
+    reap (FALSE);
+    pthread_mutex_unlock (&aio_mutex);
+    return ret;
+}
+
+/**
+ * \brief sets the file offset of the next write
+ *
+ * This waits for the writes to the file, so later writes to the same
+ * bytes can't be overtaken by earlier ones.
+ *
+ * @param f the file
+ * @param offset the offset
+ * @param whence SEEK_SET, SEEK_CUR or SEEK_END
+ * @return the new file offset or -1 on error
+ */
+int64_t
+xvc_aio_seek (XVC_AioFile * f, int64_t offset, int whence)
+{
+    int64_t pos;
+
+    switch (whence) {
+    case SEEK_SET:
+        pos = offset;
+        break;
+    case SEEK_CUR:
+        pos = f->pos + offset;
+        break;
+    case SEEK_END:
+        pos = f->size + offset;
+        break;
+    default:
+        return -1;
+    }
+    if (pos < 0)
+        return -1;
+
+    pthread_mutex_lock (&aio_mutex);
+    if (pos != f->pos) {
+        flush_file (f);
+        while (f->in_flight > 0)
+            reap (TRUE);
+        f->pos = pos;
+    }
+    pthread_mutex_unlock (&aio_mutex);
+    return pos;
+}
+
+/**
+ * \brief closes a file, the file descriptor is closed once the writes
+ *      pending complete
+ *
+ * @param f the file, not to be used afterwards
+ * @return 0 on success or -1 if a write to the file failed so far
+ */
+int
+xvc_aio_close (XVC_AioFile * f)
+{
+    int ret;
+
+    pthread_mutex_lock (&aio_mutex);
+    flush_file (f);
+    ret = (f->error ? -1 : 0);
+    f->closing = TRUE;
+    if (f->in_flight == 0)
+        finish_file (f);
+    reap (FALSE);
+    pthread_mutex_unlock (&aio_mutex);
+    return ret;
+}
+
+/**
+ * \brief waits for all writes pending to complete
+ */
+void
+xvc_aio_drain ()
+{
+    pthread_mutex_lock (&aio_mutex);
+    while (num_in_flight > 0)
+        reap (TRUE);
+    pthread_mutex_unlock (&aio_mutex);
+}
+
+#ifdef USE_FFMPEG
+/**
+ * \brief opens a file for libavformat
+ *
+ * @param h the URL context
+ * @param filename XVC_AIO_PROTOCOL: followed by the file name
+ * @param flags only URL_WRONLY is supported
+ * @return 0 on success or a negative error code
+ */
+static int
+aio_url_open (URLContext * h, const char *filename, int flags)
+{
+    XVC_AioFile *f;
+
+    if (flags != URL_WRONLY)
+        return AVERROR (EINVAL);
+    if (strncmp (filename, XVC_AIO_PROTOCOL ":",
+                 strlen (XVC_AIO_PROTOCOL ":")) == 0)
+        filename += strlen (XVC_AIO_PROTOCOL ":");
+    f = xvc_aio_open (filename);
+    if (!f)
+        return AVERROR (errno);
+    h->priv_data = f;
+    h->is_streamed = 0;
+    return 0;
+}
+
+/**
+ * \brief writes for libavformat
+ *
+ * @param h the URL context
+ * @param buf what to write
+ * @param size number of bytes to write
+ * @return size or a negative error code
+ */
+static int
+aio_url_write (URLContext * h, unsigned char *buf, int size)
+{
+    if (xvc_aio_write ((XVC_AioFile *) h->priv_data, buf, size) < 0)
+        return AVERROR_IO;
+    return size;
+}
+
+/**
+ * \brief seeks for libavformat
+ *
+ * @param h the URL context
+ * @param pos the offset
+ * @param whence SEEK_SET, SEEK_CUR or SEEK_END
+ * @return the new offset or a negative error code
+ */
+static offset_t
+aio_url_seek (URLContext * h, offset_t pos, int whence)
+{
+    return xvc_aio_seek ((XVC_AioFile *) h->priv_data, pos, whence);
+}
+
+/**
+ * \brief closes a file for libavformat
+ *
+ * @param h the URL context
+ * @return 0 on success or a negative error code
+ */
+static int
+aio_url_close (URLContext * h)
+{
+    return (xvc_aio_close ((XVC_AioFile *) h->priv_data) < 0 ?
+            AVERROR_IO : 0);
+}
+
+/** \brief the protocol for libavformat */
+static URLProtocol aio_protocol = {
+    XVC_AIO_PROTOCOL,
+    aio_url_open,
+    NULL,
+    aio_url_write,
+    aio_url_seek,
+    aio_url_close,
+};
+
+/**
+ * \brief makes XVC_AIO_PROTOCOL known to libavformat, only the first
+ *      call does anything
+ */
+void
+xvc_aio_register_protocol ()
+{
+    static int registered = FALSE;
+
+    if (registered)
+        return;
+    register_protocol (&aio_protocol);
+    registered = TRUE;
+}
+#endif     // USE_FFMPEG
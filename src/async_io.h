@@ -0,0 +1,53 @@
+/**
+ * \file async_io.h
+ */
+/*
+ * Copyright (C) 2003-07 Karl H. Beckers, Frankfurt
+ * EMail: khb@jarre-de-the.net
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef _xvc_ASYNC_IO_H__
+#define _xvc_ASYNC_IO_H__
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+#include <sys/types.h>
+#include <inttypes.h>
+#endif     // DOXYGEN_SHOULD_SKIP_THIS
+
+/** \brief size of the buffers writes are collected in */
+#define XVC_AIO_BUF_SIZE (1024 * 1024)
+/** \brief number of buffers, i. e. the most writes in flight */
+#define XVC_AIO_BUFFERS 16
+/** \brief number of threads writing if io_uring is not available */
+#define XVC_AIO_THREADS 2
+/** \brief name of the libavformat protocol writing through async_io.c */
+#define XVC_AIO_PROTOCOL "xvcaio"
+
+/** \brief a file written asynchronously */
+typedef struct XVC_AioFile XVC_AioFile;
+
+XVC_AioFile *xvc_aio_open (const char *file);
+int xvc_aio_write (XVC_AioFile * f, const void *data, size_t len);
+int64_t xvc_aio_seek (XVC_AioFile * f, int64_t offset, int whence);
+int xvc_aio_close (XVC_AioFile * f);
+void xvc_aio_drain ();
+
+#ifdef USE_FFMPEG
+void xvc_aio_register_protocol ();
+#endif     // USE_FFMPEG
+
+#endif     // _xvc_ASYNC_IO_H__
@@ -0,0 +1,124 @@
+/**
+ * \file audio_mixer.c
+ *
+ * This file contains the functions for mixing several signed 16 bit PCM
+ * streams into one. Samples are accumulated in a float buffer with a gain
+ * per source and saturated back to 16 bit at the end. With SSE2 available
+ * eight samples are processed at a time.
+ */
+/*
+ * Copyright (C) 2003-07 Karl H. Beckers, Frankfurt
+ * EMail: khb@jarre-de-the.net
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif     // HAVE_CONFIG_H
+
+#define DEBUGFILE "audio_mixer.c"
+#endif     // DOXYGEN_SHOULD_SKIP_THIS
+
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif     // __SSE2__
+
+#include "audio_mixer.h"
+
+/**
+ * \brief zeroes a mix accumulator
+ *
+ * @param acc the accumulator
+ * @param n number of samples (not sample frames) in acc
+ */
+void
+xvc_audio_mixer_clear (float *acc, int n)
+{
+    memset (acc, 0, n * sizeof (float));
+}
+
+/**
+ * \brief adds a PCM stream to a mix accumulator
+ *
+ * @param acc the accumulator
+ * @param src the samples to add
+ * @param n number of samples (not sample frames) to add
+ * @param gain factor to apply to src, 1.0 leaves the level unchanged
+ */
+void
+xvc_audio_mixer_add (float *acc, const int16_t * src, int n, float gain)
+{
+    int i = 0;
+
+#ifdef __SSE2__
+    __m128 g = _mm_set1_ps (gain);
+
+    for (; i + 8 <= n; i += 8) {
+        __m128i s = _mm_loadu_si128 ((const __m128i *) (src + i));
+
+        // sign extend the 16 bit samples to 32 bit by unpacking them into
+        // the upper halves and shifting back arithmetically
+        __m128i lo = _mm_srai_epi32 (_mm_unpacklo_epi16 (s, s), 16);
+        __m128i hi = _mm_srai_epi32 (_mm_unpackhi_epi16 (s, s), 16);
+        __m128 a0 = _mm_loadu_ps (acc + i);
+        __m128 a1 = _mm_loadu_ps (acc + i + 4);
+
+        a0 = _mm_add_ps (a0, _mm_mul_ps (_mm_cvtepi32_ps (lo), g));
+        a1 = _mm_add_ps (a1, _mm_mul_ps (_mm_cvtepi32_ps (hi), g));
+        _mm_storeu_ps (acc + i, a0);
+        _mm_storeu_ps (acc + i + 4, a1);
+    }
+#endif     // __SSE2__
+    for (; i < n; i++)
+        acc[i] += (float) src[i] * gain;
+}
+
+/**
+ * \brief converts a mix accumulator back to signed 16 bit PCM
+ *
+ * Samples out of range are clipped.
+ *
+ * @param dst buffer for the resulting samples
+ * @param acc the accumulator
+ * @param n number of samples (not sample frames)
+ */
+void
+xvc_audio_mixer_store (int16_t * dst, const float *acc, int n)
+{
+    int i = 0;
+
+#ifdef __SSE2__
+    for (; i + 8 <= n; i += 8) {
+        // cvtps rounds to nearest, packs saturates to the int16 range
+        __m128i lo = _mm_cvtps_epi32 (_mm_loadu_ps (acc + i));
+        __m128i hi = _mm_cvtps_epi32 (_mm_loadu_ps (acc + i + 4));
+
+        _mm_storeu_si128 ((__m128i *) (dst + i), _mm_packs_epi32 (lo, hi));
+    }
+#endif     // __SSE2__
+    for (; i < n; i++) {
+        float v = acc[i];
+
+        if (v > 32767.0f)
+            dst[i] = 32767;
+        else if (v < -32768.0f)
+            dst[i] = -32768;
+        else
+            dst[i] = (int16_t) (v < 0 ? v - 0.5f : v + 0.5f);
+    }
+}
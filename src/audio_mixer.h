@@ -0,0 +1,34 @@
+/**
+ * \file audio_mixer.h
+ */
+/*
+ * Copyright (C) 2003-07 Karl H. Beckers, Frankfurt
+ * EMail: khb@jarre-de-the.net
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef _xvc_AUDIO_MIXER_H__
+#define _xvc_AUDIO_MIXER_H__
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+#include <inttypes.h>
+#endif     // DOXYGEN_SHOULD_SKIP_THIS
+
+void xvc_audio_mixer_clear (float *acc, int n);
+void xvc_audio_mixer_add (float *acc, const int16_t * src, int n, float gain);
+void xvc_audio_mixer_store (int16_t * dst, const float *acc, int n);
+
+#endif     // _xvc_AUDIO_MIXER_H__
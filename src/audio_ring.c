@@ -0,0 +1,359 @@
+/**
+ * \file audio_ring.c
+ *
+ * This file contains a small timestamped PCM ring buffer decoupling the
+ * thread reading from the audio device from the thread encoding and
+ * muxing the audio stream.
+ */
+/*
+ * Copyright (C) 2003-07 Karl H. Beckers, Frankfurt
+ * EMail: khb@jarre-de-the.net
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif     // HAVE_CONFIG_H
+
+#define DEBUGFILE "audio_ring.c"
+#endif     // DOXYGEN_SHOULD_SKIP_THIS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+
+#include "audio_ring.h"
+#include "xvidcap-intl.h"
+
+/**
+ * \brief converts a number of bytes into the duration they represent
+ *
+ * @param ring the ring the bytes belong to
+ * @param bytes number of bytes
+ * @return duration in microseconds
+ */
+static int64_t
+bytes_to_usec (const XVC_AudioRing * ring, int bytes)
+{
+    return ((int64_t) bytes * 1000000) / ring->bytes_per_sec;
+}
+
+/**
+ * \brief copies bytes out of the ring and advances the read position
+ *
+ * The caller must hold the ring's mutex and make sure there are at least
+ * size bytes buffered.
+ *
+ * @param ring the ring to read from
+ * @param data buffer to copy to or NULL to just discard the bytes
+ * @param size number of bytes to consume
+ */
+static void
+consume (XVC_AudioRing * ring, uint8_t * data, int size)
+{
+    int first = ring->size - ring->rpos;
+
+    if (first > size)
+        first = size;
+    if (data) {
+        memcpy (data, ring->buf + ring->rpos, first);
+        if (size > first)
+            memcpy (data + first, ring->buf, size - first);
+    }
+    ring->rpos = (ring->rpos + size) % ring->size;
+    ring->fill -= size;
+    ring->rpts += bytes_to_usec (ring, size);
+}
+
+/**
+ * \brief creates a new audio ring
+ *
+ * @param ms capacity of the ring in milliseconds of audio
+ * @param sample_rate sample rate of the buffered audio
+ * @param channels number of interleaved channels
+ * @return pointer to the new ring or NULL on failure
+ */
+XVC_AudioRing *
+xvc_audio_ring_new (int ms, int sample_rate, int channels)
+{
+#define DEBUGFUNCTION "xvc_audio_ring_new()"
+    XVC_AudioRing *ring = NULL;
+
+    if (ms <= 0 || sample_rate <= 0 || channels <= 0)
+        return NULL;
+
+    ring = (XVC_AudioRing *) malloc (sizeof (XVC_AudioRing));
+    if (!ring) {
+        fprintf (stderr, _("%s %s: Can't allocate audio ring\n"),
+                 DEBUGFILE, DEBUGFUNCTION);
+        return NULL;
+    }
+    memset (ring, 0, sizeof (XVC_AudioRing));
+
+    ring->frame_bytes = channels * 2;
+    ring->bytes_per_sec = sample_rate * ring->frame_bytes;
+    ring->size = (int) (((int64_t) sample_rate * ms) / 1000) *
+        ring->frame_bytes;
+    if (ring->size < ring->frame_bytes)
+        ring->size = ring->frame_bytes;
+
+    ring->buf = (uint8_t *) malloc (ring->size);
+    if (!ring->buf) {
+        fprintf (stderr, _("%s %s: Can't allocate %i bytes for audio ring\n"),
+                 DEBUGFILE, DEBUGFUNCTION, ring->size);
+        free (ring);
+        return NULL;
+    }
+
+    pthread_mutex_init (&(ring->mutex), NULL);
+    pthread_cond_init (&(ring->readable), NULL);
+    pthread_cond_init (&(ring->writable), NULL);
+
+#ifdef DEBUG
+    printf ("%s %s: ring of %i bytes (%i ms)\n", DEBUGFILE, DEBUGFUNCTION,
+            ring->size, ms);
+#endif     // DEBUG
+
+    return ring;
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief frees an audio ring
+ *
+ * No thread must be using the ring any more when this is called.
+ *
+ * @param ring the ring to free
+ */
+void
+xvc_audio_ring_free (XVC_AudioRing * ring)
+{
+    if (!ring)
+        return;
+
+    pthread_cond_destroy (&(ring->writable));
+    pthread_cond_destroy (&(ring->readable));
+    pthread_mutex_destroy (&(ring->mutex));
+    if (ring->buf)
+        free (ring->buf);
+    free (ring);
+}
+
+/**
+ * \brief appends samples to the ring
+ *
+ * If there is not enough room, a non-blocking write drops the oldest
+ * samples buffered and counts an overrun, while a blocking write waits
+ * for the reader to make room (used for file and pipe input where we
+ * must not lose data).
+ *
+ * @param ring the ring to write to
+ * @param data the samples
+ * @param size number of bytes to write, rounded down to full sample frames
+ * @param pts capture time of the first sample in data (in microseconds)
+ * @param block wait for room instead of dropping old samples
+ * @return number of bytes written
+ */
+int
+xvc_audio_ring_write (XVC_AudioRing * ring, const uint8_t * data,
+                      int size, int64_t pts, int block)
+{
+    int written = 0;
+
+    size -= size % ring->frame_bytes;
+    // a single chunk larger than the whole ring can only keep its tail
+    if (size > ring->size) {
+        pthread_mutex_lock (&(ring->mutex));
+        ring->overruns++;
+        ring->dropped_bytes += size - ring->size;
+        pthread_mutex_unlock (&(ring->mutex));
+        pts += bytes_to_usec (ring, size - ring->size);
+        data += size - ring->size;
+        size = ring->size;
+    }
+
+    pthread_mutex_lock (&(ring->mutex));
+
+    if (ring->closed) {
+        pthread_mutex_unlock (&(ring->mutex));
+        return 0;
+    }
+
+    if (block) {
+        while (ring->size - ring->fill < size && !ring->closed)
+            pthread_cond_wait (&(ring->writable), &(ring->mutex));
+        if (ring->closed) {
+            pthread_mutex_unlock (&(ring->mutex));
+            return 0;
+        }
+    } else if (ring->size - ring->fill < size) {
+        int drop = size - (ring->size - ring->fill);
+
+        consume (ring, NULL, drop);
+        ring->overruns++;
+        ring->dropped_bytes += drop;
+    }
+
+    if (ring->fill == 0)
+        ring->rpts = pts;
+
+    while (written < size) {
+        int chunk = ring->size - ring->wpos;
+
+        if (chunk > size - written)
+            chunk = size - written;
+        memcpy (ring->buf + ring->wpos, data + written, chunk);
+        ring->wpos = (ring->wpos + chunk) % ring->size;
+        written += chunk;
+    }
+    ring->fill += size;
+    if (ring->fill > ring->max_fill)
+        ring->max_fill = ring->fill;
+
+    pthread_cond_signal (&(ring->readable));
+    pthread_mutex_unlock (&(ring->mutex));
+
+    return written;
+}
+
+/**
+ * \brief takes samples out of the ring
+ *
+ * Waits at most timeout_ms for data to become available.
+ *
+ * @param ring the ring to read from
+ * @param data buffer to copy the samples to
+ * @param size maximum number of bytes to read, rounded down to full
+ *      sample frames
+ * @param pts return pointer for the capture time of the first sample read,
+ *      may be NULL
+ * @param timeout_ms maximum time to wait for data in milliseconds
+ * @return number of bytes read, 0 on timeout or -1 if the ring has been
+ *      closed and is empty
+ */
+int
+xvc_audio_ring_read (XVC_AudioRing * ring, uint8_t * data, int size,
+                     int64_t * pts, int timeout_ms)
+{
+    struct timeval now;
+    struct timespec abstime;
+    int ret = 0;
+
+    size -= size % ring->frame_bytes;
+
+    gettimeofday (&now, NULL);
+    abstime.tv_sec = now.tv_sec + timeout_ms / 1000;
+    abstime.tv_nsec = (now.tv_usec + (timeout_ms % 1000) * 1000) * 1000;
+    if (abstime.tv_nsec >= 1000000000) {
+        abstime.tv_sec++;
+        abstime.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock (&(ring->mutex));
+    while (ring->fill == 0 && !ring->closed) {
+        if (pthread_cond_timedwait (&(ring->readable), &(ring->mutex),
+                                    &abstime) == ETIMEDOUT)
+            break;
+    }
+
+    if (ring->fill == 0) {
+        ret = (ring->closed ? -1 : 0);
+    } else {
+        ret = (size < ring->fill ? size : ring->fill);
+        if (pts)
+            *pts = ring->rpts;
+        consume (ring, data, ret);
+        pthread_cond_signal (&(ring->writable));
+    }
+    pthread_mutex_unlock (&(ring->mutex));
+
+    return ret;
+}
+
+/**
+ * \brief marks the ring as closed
+ *
+ * Writers are refused from now on, readers get the remaining data and
+ * then -1 from xvc_audio_ring_read ().
+ *
+ * @param ring the ring to close
+ */
+void
+xvc_audio_ring_close (XVC_AudioRing * ring)
+{
+    pthread_mutex_lock (&(ring->mutex));
+    ring->closed = 1;
+    pthread_cond_broadcast (&(ring->readable));
+    pthread_cond_broadcast (&(ring->writable));
+    pthread_mutex_unlock (&(ring->mutex));
+}
+
+/**
+ * \brief gets the current fill level of the ring
+ *
+ * @param ring the ring to query
+ * @return the amount of audio buffered in milliseconds
+ */
+int
+xvc_audio_ring_fill_ms (XVC_AudioRing * ring)
+{
+    int fill;
+
+    pthread_mutex_lock (&(ring->mutex));
+    fill = ring->fill;
+    pthread_mutex_unlock (&(ring->mutex));
+
+    return (int) (bytes_to_usec (ring, fill) / 1000);
+}
+
+/**
+ * \brief gets fill level and overrun counters of the ring in one go
+ *
+ * @param ring the ring to query
+ * @param fill_ms return pointer for the current fill level in milliseconds
+ * @param max_fill_ms return pointer for the highest fill level seen
+ * @param overruns return pointer for the number of writes that had to
+ *      drop samples
+ * @param dropped_ms return pointer for the amount of audio dropped in
+ *      milliseconds
+ */
+void
+xvc_audio_ring_get_status (XVC_AudioRing * ring, int *fill_ms,
+                           int *max_fill_ms, unsigned long *overruns,
+                           int *dropped_ms)
+{
+    pthread_mutex_lock (&(ring->mutex));
+    *fill_ms = (int) (bytes_to_usec (ring, ring->fill) / 1000);
+    *max_fill_ms = (int) (bytes_to_usec (ring, ring->max_fill) / 1000);
+    *overruns = ring->overruns;
+    *dropped_ms = (int) ((ring->dropped_bytes * 1000) / ring->bytes_per_sec);
+    pthread_mutex_unlock (&(ring->mutex));
+}
+
+/**
+ * \brief gets the capacity of the ring
+ *
+ * @param ring the ring to query
+ * @return the amount of audio the ring can hold in milliseconds
+ */
+int
+xvc_audio_ring_size_ms (const XVC_AudioRing * ring)
+{
+    return (int) (bytes_to_usec (ring, ring->size) / 1000);
+}
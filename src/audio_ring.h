@@ -0,0 +1,88 @@
+/**
+ * \file audio_ring.h
+ */
+/*
+ * Copyright (C) 2003-07 Karl H. Beckers, Frankfurt
+ * EMail: khb@jarre-de-the.net
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef _xvc_AUDIO_RING_H__
+#define _xvc_AUDIO_RING_H__
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+#include <sys/types.h>
+#include <inttypes.h>
+#include <pthread.h>
+#endif     // DOXYGEN_SHOULD_SKIP_THIS
+
+/**
+ * \brief a ring buffer of interleaved signed 16 bit PCM samples handed
+ *      from the audio capture thread to the audio encode thread
+ *
+ * The capture side never blocks unless asked to. If the encoder falls
+ * behind, the oldest samples are dropped and counted as an overrun. All
+ * sizes are in bytes and always a multiple of one sample frame (i. e.
+ * one sample for each channel).
+ */
+typedef struct _XVC_AudioRing
+{
+    /** \brief the actual sample memory */
+    uint8_t *buf;
+    /** \brief size of buf in bytes */
+    int size;
+    /** \brief read position in bytes */
+    int rpos;
+    /** \brief write position in bytes */
+    int wpos;
+    /** \brief number of bytes currently buffered */
+    int fill;
+    /** \brief highest fill level seen since the ring was created */
+    int max_fill;
+    /** \brief bytes per sample frame (channels * 2) */
+    int frame_bytes;
+    /** \brief bytes per second of audio */
+    int bytes_per_sec;
+    /** \brief capture time (in microseconds) of the sample at rpos */
+    int64_t rpts;
+    /** \brief number of writes that had to drop samples */
+    unsigned long overruns;
+    /** \brief total number of bytes dropped because of overruns */
+    int64_t dropped_bytes;
+    /** \brief set when the producer has finished, readers drain and stop */
+    int closed;
+    /** \brief protects everything above */
+    pthread_mutex_t mutex;
+    /** \brief signalled when data is written or the ring is closed */
+    pthread_cond_t readable;
+    /** \brief signalled when data is read or the ring is closed */
+    pthread_cond_t writable;
+} XVC_AudioRing;
+
+XVC_AudioRing *xvc_audio_ring_new (int ms, int sample_rate, int channels);
+void xvc_audio_ring_free (XVC_AudioRing * ring);
+int xvc_audio_ring_write (XVC_AudioRing * ring, const uint8_t * data,
+                          int size, int64_t pts, int block);
+int xvc_audio_ring_read (XVC_AudioRing * ring, uint8_t * data, int size,
+                         int64_t * pts, int timeout_ms);
+void xvc_audio_ring_close (XVC_AudioRing * ring);
+int xvc_audio_ring_fill_ms (XVC_AudioRing * ring);
+void xvc_audio_ring_get_status (XVC_AudioRing * ring, int *fill_ms,
+                                int *max_fill_ms, unsigned long *overruns,
+                                int *dropped_ms);
+int xvc_audio_ring_size_ms (const XVC_AudioRing * ring);
+
+#endif     // _xvc_AUDIO_RING_H__
@@ -0,0 +1,425 @@
+/**
+ * \file benchmark.c
+ *
+ * This file contains the --benchmark mode. It feeds generated frames
+ * through the same save functions a recording uses, for every combination
+ * of test pattern, XImage layout, file format and video codec, and prints
+ * frames per second, CPU time, peak memory use and output size as CSV.
+ *
+ * Every combination runs in a child process of its own, so CPU time and
+ * peak RSS are those of the one run, and a codec that bails out with
+ * exit () only fails its own row.
+ */
+/*
+ * Copyright (C) 2003-07 Karl H. Beckers, Frankfurt
+ * EMail: khb@jarre-de-the.net
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif     // HAVE_CONFIG_H
+
+#define DEBUGFILE "benchmark.c"
+#endif     // DOXYGEN_SHOULD_SKIP_THIS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <inttypes.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+#include "benchmark.h"
+#include "app_data.h"
+#include "codecs.h"
+#include "colors.h"
+#include "job.h"
+#include "stats.h"
+#include "synth.h"
+#include "xvidcap-intl.h"
+
+/**
+ * \brief what a child reports back about its run
+ */
+typedef struct
+{
+    /** \brief frames saved */
+    int frames;
+    /** \brief time spent saving them in ns */
+    int64_t elapsed;
+} BenchResult;
+
+/**
+ * \brief sets up the palette the 8 bit frames are drawn with
+ *
+ * @param job the job to set the colors of
+ */
+static void
+set_palette (Job * job)
+{
+    XColor *colors;
+    int ncolors;
+
+    ncolors = xvc_synth_get_colors (&colors);
+    if (!colors || !job->get_colors) {
+        free (colors);
+        return;
+    }
+    if (job->colors)
+        free (job->colors);
+    job->colors = colors;
+    job->ncolors = ncolors;
+    if (job->color_table)
+        free (job->color_table);
+    job->color_table = (*job->get_colors) (job->colors, job->ncolors);
+}
+
+/**
+ * \brief adds up the size of the files in a directory and removes them
+ *
+ * @param dir the directory
+ * @return the number of bytes the files took
+ */
+static int64_t
+collect_output (const char *dir)
+{
+    char file[PATH_MAX + 1];
+    struct dirent *ent;
+    struct stat st;
+    int64_t bytes = 0;
+    DIR *d;
+
+    d = opendir (dir);
+    if (!d)
+        return 0;
+    while ((ent = readdir (d)) != NULL) {
+        if (ent->d_name[0] == '.')
+            continue;
+        if (snprintf (file, sizeof (file), "%s/%s", dir, ent->d_name) >=
+            (int) sizeof (file))
+            continue;
+        if (stat (file, &st) == 0 && S_ISREG (st.st_mode))
+            bytes += st.st_size;
+        unlink (file);
+    }
+    closedir (d);
+    return bytes;
+}
+
+/**
+ * \brief saves the frames of a run, this runs in the child process
+ *
+ * @param fd the pipe to report the result through
+ * @param pattern the pattern to generate
+ * @param l the layout of the frames
+ * @param width width of the frames
+ * @param height height of the frames
+ * @param frames the number of frames to save
+ */
+static void
+run_child (int fd, XVC_SynthPattern pattern, const XVC_SynthLayout * l,
+           int width, int height, int frames)
+{
+#define DEBUGFUNCTION "run_child()"
+    Job *job = xvc_job_ptr ();
+    XVC_AppData *app = xvc_appdata_ptr ();
+    char file[PATH_MAX + 1];
+    XVC_SynthScene scene, *sc = &scene;
+    BenchResult res;
+    FILE *fp = NULL;
+    int64_t start;
+    int i;
+
+    if (xvc_synth_create_scene (sc, pattern, l, 1, width, height) < 0) {
+        fprintf (stderr, _("%s %s: Can't allocate frames\n"), DEBUGFILE,
+                 DEBUGFUNCTION);
+        _exit (1);
+    }
+    if (job->c_info)
+        free (job->c_info);
+    job->c_info = xvc_get_color_info (sc->frame);
+
+    res.frames = 0;
+    res.elapsed = 0;
+    xvc_stats_reset ();
+
+    // what the capture functions do, but without the X server
+    job->state = VC_REC | VC_START;
+    for (i = 0; i < frames; i++) {
+        if (i > 0)
+            xvc_synth_next_frame (sc);
+
+        start = xvc_stats_clock ();
+        if (app->current_mode == 0) {
+            snprintf (file, sizeof (file), job->file, job->pic_no);
+            fp = fopen (file, "wb");
+            if (!fp) {
+                fprintf (stderr, _("%s %s: Can't open %s: %s\n"), DEBUGFILE,
+                         DEBUGFUNCTION, file, strerror (errno));
+                _exit (1);
+            }
+        }
+        (*job->save) (fp, sc->frame);
+        job->state &= ~(VC_START);
+        if (app->current_mode == 0)
+            fclose (fp);
+        xvc_stats_add_stage (XVC_STAGE_FRAME, start);
+        xvc_stats_add_frame (pattern == XVC_SYNTH_STATIC && i > 0);
+        res.elapsed += xvc_stats_clock () - start;
+        job->pic_no++;
+    }
+    // writing the trailer and flushing the encoder is part of the cost
+    start = xvc_stats_clock ();
+    if (job->clean)
+        (*job->clean) ();
+    res.elapsed += xvc_stats_clock () - start;
+    res.frames = frames;
+    xvc_stats_stop ();
+    xvc_synth_free_scene (sc);
+
+    if (app->verbose > 1)
+        xvc_stats_print_summary (stderr);
+
+    if (write (fd, &res, sizeof (res)) != sizeof (res))
+        _exit (1);
+    _exit (0);
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief runs one combination of pattern, layout, format and codec and
+ *      prints the result as a line of CSV
+ *
+ * @param pattern the pattern to generate
+ * @param l the layout of the frames
+ * @param format the file format to save to
+ * @param codec the video codec to use
+ * @param dir the directory to write the output to
+ * @param opts the capture options from the command line
+ * @param frames the number of frames to save
+ * @return 0 on success or -1 if the run failed
+ */
+static int
+run_one (XVC_SynthPattern pattern, const XVC_SynthLayout * l, int format,
+         int codec, const char *dir, const XVC_CapTypeOptions * opts, int frames)
+{
+#define DEBUGFUNCTION "run_one()"
+    XVC_AppData *app = xvc_appdata_ptr ();
+    XVC_CapTypeOptions *cto;
+    BenchResult res;
+    struct rusage ru;
+    char file[PATH_MAX + 1];
+    int width, height, status = 0, fds[2], ok = FALSE, len;
+    int64_t bytes;
+    pid_t pid;
+
+    width = app->area->width & ~1;
+    height = app->area->height & ~1;
+#ifdef USE_FFMPEG
+    // DV only knows the PAL and NTSC frame sizes
+    if (codec == CODEC_DV) {
+        width = 720;
+        height = 576;
+    }
+    app->current_mode = (format >= CAP_MF ? 1 : 0);
+    app->replay_time = 0;
+    cto = (app->current_mode ? &(app->multi_frame) : &(app->single_frame));
+#else      // USE_FFMPEG
+    cto = &(app->single_frame);
+#endif     // USE_FFMPEG
+
+    if (app->current_mode == 0)
+        len = snprintf (file, sizeof (file), "%s/bench-%%04d.%s", dir,
+                        xvc_formats[format].extensions[0]);
+    else
+        len = snprintf (file, sizeof (file), "%s/bench.%s", dir,
+                        xvc_formats[format].extensions[0]);
+    if (len < 0 || len >= (int) sizeof (file)) {
+        fprintf (stderr, _("%s %s: The path to the output in %s is too "
+                           "long\n"), DEBUGFILE, DEBUGFUNCTION, dir);
+        return -1;
+    }
+    if (cto->file)
+        free (cto->file);
+    cto->file = strdup (file);
+    cto->target = format;
+    cto->targetCodec = codec;
+    cto->fps = opts->fps;
+    if (codec != CODEC_NONE && !xvc_codec_is_valid_fps (opts->fps, codec, 0))
+        cto->fps = xvc_codecs[codec].def_fps;
+    cto->quality = opts->quality;
+    cto->start_no = 0;
+    cto->step = 1;
+    cto->frames = 0;
+    cto->time = 0;
+#ifdef HAVE_FFMPEG_AUDIO
+    cto->audioWanted = 0;
+#endif     // HAVE_FFMPEG_AUDIO
+
+    // the job is set up here because this talks to the X server, which
+    // the child must not do on the connection it shares with us
+    xvc_job_set_from_app_data (app);
+    if (l->bits_per_pixel == 8)
+        set_palette (xvc_job_ptr ());
+
+    memset (&res, 0, sizeof (res));
+    memset (&ru, 0, sizeof (ru));
+    if (pipe (fds) < 0) {
+        fprintf (stderr, _("%s %s: Can't create pipe: %s\n"), DEBUGFILE,
+                 DEBUGFUNCTION, strerror (errno));
+        return -1;
+    }
+    fflush (stdout);
+    fflush (stderr);
+    pid = fork ();
+    if (pid == 0) {
+        close (fds[0]);
+        run_child (fds[1], pattern, l, width, height, frames);
+    }
+    close (fds[1]);
+    if (pid > 0) {
+        ok = (read (fds[0], &res, sizeof (res)) == sizeof (res));
+        while (wait4 (pid, &status, 0, &ru) < 0 && errno == EINTR);
+        ok = ok && WIFEXITED (status) && WEXITSTATUS (status) == 0;
+    } else {
+        fprintf (stderr, _("%s %s: Can't fork: %s\n"), DEBUGFILE,
+                 DEBUGFUNCTION, strerror (errno));
+    }
+    close (fds[0]);
+    bytes = collect_output (dir);
+
+    printf ("%s,%i,%s,%s,%i,%i,%i,%.2f,%.3f,%.3f,%li,%" PRId64 ",%s\n",
+            xvc_synth_pattern_names[pattern], l->bits_per_pixel,
+            xvc_formats[format].name, xvc_codecs[codec].name, width, height,
+            res.frames,
+            (res.elapsed > 0 ? res.frames * 1000000000.0 / res.elapsed : 0.0),
+            ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1000000.0,
+            ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1000000.0,
+            ru.ru_maxrss, bytes, (ok ? "ok" : "failed"));
+    fflush (stdout);
+
+    return (ok ? 0 : -1);
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief runs the benchmark and prints the results to stdout as CSV
+ *
+ * The frame size is taken from the capture area, the number of frames
+ * from the maximum frames to record and the frame rate and quality from
+ * the capture options. Codecs that don't support the frame rate use their
+ * default rate.
+ *
+ * @param patterns comma separated list of the patterns to run or "all"
+ * @param opts the capture options from the command line
+ * @return 0 if all runs succeeded, 1 otherwise
+ */
+int
+xvc_benchmark_run (const char *patterns, const XVC_CapTypeOptions * opts)
+{
+#define DEBUGFUNCTION "xvc_benchmark_run()"
+    XVC_AppData *app = xvc_appdata_ptr ();
+    int wanted[XVC_SYNTH_NUM_PATTERNS];
+    char dir[PATH_MAX + 1];
+    const char *p, *tmp;
+    int frames, failed = 0, format, codec, i;
+    unsigned int n;
+
+    for (i = 0; i < XVC_SYNTH_NUM_PATTERNS; i++)
+        wanted[i] = (strcmp (patterns, "all") == 0);
+    for (p = patterns; *p && strcmp (patterns, "all") != 0;) {
+        size_t len = strcspn (p, ",");
+
+        for (i = 0; i < XVC_SYNTH_NUM_PATTERNS; i++) {
+            if (strlen (xvc_synth_pattern_names[i]) == len &&
+                strncmp (p, xvc_synth_pattern_names[i], len) == 0)
+                break;
+        }
+        if (i == XVC_SYNTH_NUM_PATTERNS) {
+            fprintf (stderr,
+                     _("%s %s: Unknown benchmark pattern '%.*s', use one of "
+                       "static, text, noise, window or all\n"), DEBUGFILE,
+                     DEBUGFUNCTION, (int) len, p);
+            return 1;
+        }
+        wanted[i] = TRUE;
+        p += len;
+        if (*p == ',')
+            p++;
+    }
+
+    frames = (opts->frames > 0 ? opts->frames : XVC_BENCHMARK_FRAMES);
+    if ((app->area->width & ~1) < 2 || (app->area->height & ~1) < 2) {
+        fprintf (stderr, _("%s %s: Invalid frame size %ix%i\n"), DEBUGFILE,
+                 DEBUGFUNCTION, app->area->width, app->area->height);
+        return 1;
+    }
+
+    tmp = getenv ("TMPDIR");
+    if (snprintf (dir, sizeof (dir), "%s/xvidcap-bench-XXXXXX",
+                  (tmp && *tmp ? tmp : "/tmp")) >= (int) sizeof (dir)) {
+        fprintf (stderr, _("%s %s: TMPDIR is too long\n"), DEBUGFILE,
+                 DEBUGFUNCTION);
+        return 1;
+    }
+    if (!mkdtemp (dir)) {
+        fprintf (stderr, _("%s %s: Can't create directory %s: %s\n"),
+                 DEBUGFILE, DEBUGFUNCTION, dir, strerror (errno));
+        return 1;
+    }
+
+    printf ("pattern,bpp,format,codec,width,height,frames,fps,"
+            "cpu_user_s,cpu_sys_s,peak_rss_kb,output_bytes,status\n");
+    for (i = 0; i < XVC_SYNTH_NUM_PATTERNS; i++) {
+        if (!wanted[i])
+            continue;
+        for (n = 0; n < XVC_SYNTH_NUM_LAYOUTS; n++) {
+            for (format = CAP_XWD; format < NUMCAPS; format++) {
+                // formats without codecs like xwd are saved as they are
+                if (xvc_formats[format].num_allowed_vid_codecs == 0) {
+                    if (run_one (i, &xvc_synth_layouts[n], format,
+                                 CODEC_NONE, dir, opts, frames) < 0)
+                        failed++;
+                    continue;
+                }
+                for (codec = CODEC_NONE + 1; codec < NUMCODECS; codec++) {
+                    if (!xvc_is_valid_video_codec (format, codec))
+                        continue;
+                    if (run_one (i, &xvc_synth_layouts[n], format, codec,
+                                 dir, opts, frames) < 0)
+                        failed++;
+                }
+            }
+        }
+    }
+
+    rmdir (dir);
+    if (failed && app->verbose)
+        fprintf (stderr, _("%i benchmark runs failed\n"), failed);
+    return (failed ? 1 : 0);
+#undef DEBUGFUNCTION
+}
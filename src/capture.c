@@ -42,6 +42,8 @@
 #include <stdint.h>
 #endif     // HAVE_STDINT_H
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <limits.h>
 #include <sys/time.h>
 #include <time.h>
@@ -85,10 +87,16 @@
 #include <errno.h>
 
 #include "capture.h"
+#include "capture_log.h"
 #include "job.h"
 #include "app_data.h"
 #include "control.h"
+#include "damage_map.h"
 #include "frame.h"
+#include "pixels.h"
+#include "stats.h"
+#include "synth.h"
+#include "trace.h"
 
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
 extern int xvc_led_time;
@@ -101,12 +109,6 @@ extern int errno;
 /** \brief we need to get color information for processing the real mouse
  *      pointer. */
 #include "colors.h"
-
-/** \brief vectors used for alpha masking of real mouse pointer */
-static unsigned char top[65536];
-
-/** \brief vectors used for alpha masking of real mouse pointer */
-static unsigned char bottom[65536];
 #endif     // HAVE_LIBXFIXES
 
 #ifdef USE_XDAMAGE
@@ -116,6 +118,9 @@ static unsigned char bottom[65536];
 static XRectangle pointer_area;
 #endif     // USE_XDAMAGE
 
+/** \brief the test patterns generated by the synth capture source */
+static XVC_SynthScene synth_scene;
+
 /**
  * \brief function to find out where the mouse pointer is
  *
@@ -163,6 +168,143 @@ getCurrentPointerImage ()
 }
 #endif     // HAVE_LIBXFIXES
 
+#ifdef HAVE_LIBXFIXES
+/**
+ * \brief function to get the mouse pointer of the frame replayed last from
+ *      the capture log or generated last by the synth source. This mirrors
+ *      getCurrentPointerImage () and getCurrentPointer ().
+ *
+ * @param capfunc the capture source, either REPLAY or SYNTH
+ * @param x_cursor return pointer for the pointer image, if FLG_USE_XFIXES
+ *      is set. It remains valid until the next frame is replayed.
+ * @param x return pointer to write x coordinate to pre-existing int
+ * @param y return pointer to write y coordinate to pre-existing int
+ */
+static void
+getReplayPointer (enum captureFunctions capfunc, XFixesCursorImage ** x_cursor,
+                  int *x, int *y)
+#else      // HAVE_LIBXFIXES
+/**
+ * \brief function to get the mouse pointer position of the frame replayed
+ *      last from the capture log or generated last by the synth source.
+ *      This mirrors getCurrentPointer ().
+ *
+ * @param capfunc the capture source, either REPLAY or SYNTH
+ * @param x return pointer to write x coordinate to pre-existing int
+ * @param y return pointer to write y coordinate to pre-existing int
+ */
+static void
+getReplayPointer (enum captureFunctions capfunc, int *x, int *y)
+#endif     // HAVE_LIBXFIXES
+{
+    XVC_AppData *app = xvc_appdata_ptr ();
+    XVC_LogPointer pointer;
+
+    if (capfunc == SYNTH)
+        xvc_synth_pointer (&synth_scene, &pointer);
+    else
+        xvc_capture_log_replay_pointer (&pointer);
+
+#ifdef HAVE_LIBXFIXES
+    if (app->flags & FLG_USE_XFIXES) {
+        static XFixesCursorImage replay_cursor;
+
+        *x_cursor = NULL;
+        if (pointer.valid && pointer.pixels) {
+            replay_cursor.x = app->area->x + pointer.x;
+            replay_cursor.y = app->area->y + pointer.y;
+            replay_cursor.width = pointer.width;
+            replay_cursor.height = pointer.height;
+            replay_cursor.xhot = pointer.xhot;
+            replay_cursor.yhot = pointer.yhot;
+            replay_cursor.cursor_serial = pointer.serial;
+            replay_cursor.pixels = pointer.pixels;
+            *x_cursor = &replay_cursor;
+        }
+        return;
+    }
+#endif     // HAVE_LIBXFIXES
+
+    if (pointer.valid) {
+        *x = app->area->x + pointer.x;
+        *y = app->area->y + pointer.y;
+    } else {
+        // same as getCurrentPointer () when there is no pointer
+        *x = -1;
+        *y = -1;
+    }
+}
+
+#ifdef HAVE_LIBXFIXES
+/**
+ * \brief adds the frame just captured to the capture log, if one is being
+ *      written. This needs to be called before the mouse pointer is painted.
+ *
+ * @param image the frame as captured
+ * @param timestamp the time the capture of the frame started at
+ * @param rects the damaged areas relative to the capture area or NULL
+ * @param nrects the number of rects
+ * @param duplicated TRUE if nothing changed since the last frame
+ * @param x_cursor the pointer image, if FLG_USE_XFIXES is set
+ * @param x the x position of the pointer, if FLG_USE_XFIXES is not set
+ * @param y the y position of the pointer, if FLG_USE_XFIXES is not set
+ */
+static void
+logCapturedFrame (XImage * image, int64_t timestamp, XRectangle * rects,
+                  int nrects, int duplicated, XFixesCursorImage * x_cursor,
+                  int x, int y)
+#else      // HAVE_LIBXFIXES
+/**
+ * \brief adds the frame just captured to the capture log, if one is being
+ *      written. This needs to be called before the mouse pointer is painted.
+ *
+ * @param image the frame as captured
+ * @param timestamp the time the capture of the frame started at
+ * @param rects the damaged areas relative to the capture area or NULL
+ * @param nrects the number of rects
+ * @param duplicated TRUE if nothing changed since the last frame
+ * @param x the x position of the pointer
+ * @param y the y position of the pointer
+ */
+static void
+logCapturedFrame (XImage * image, int64_t timestamp, XRectangle * rects,
+                  int nrects, int duplicated, int x, int y)
+#endif     // HAVE_LIBXFIXES
+{
+    XVC_AppData *app = xvc_appdata_ptr ();
+    XVC_LogPointer pointer;
+
+    if (!xvc_capture_log_recording || !image)
+        return;
+
+    memset (&pointer, 0, sizeof (pointer));
+    if (app->mouseWanted > 0) {
+#ifdef HAVE_LIBXFIXES
+        if (app->flags & FLG_USE_XFIXES) {
+            if (x_cursor) {
+                pointer.valid = TRUE;
+                pointer.x = x_cursor->x - app->area->x;
+                pointer.y = x_cursor->y - app->area->y;
+                pointer.pixels = x_cursor->pixels;
+                pointer.width = x_cursor->width;
+                pointer.height = x_cursor->height;
+                pointer.xhot = x_cursor->xhot;
+                pointer.yhot = x_cursor->yhot;
+                pointer.serial = x_cursor->cursor_serial;
+            }
+        } else
+#endif     // HAVE_LIBXFIXES
+        if (x != -1 || y != -1) {
+            pointer.valid = TRUE;
+            pointer.x = x - app->area->x;
+            pointer.y = y - app->area->y;
+        }
+    }
+
+    xvc_capture_log_frame (image, timestamp, rects, nrects, duplicated,
+                           &pointer);
+}
+
 /**
  * Mouse painting helper function that applies an 'and' and 'or' mask pair to
  * '*dst' pixel. It actually draws a mouse pointer pixel to grabbed frame.
@@ -190,23 +332,6 @@ apply_masks (uint8_t * dst, uint32_t and, uint32_t or, int bits_per_pixel)
     }
 }
 
-/**
- * \brief Counts the bits set in a long word
- *
- * @param bits a long integer as a bitfield
- * @return the number of bits set
- */
-static int
-count_one_bits (long bits)
-{
-    int i, res = 0;
-    for (i = 0; i < (sizeof (long) * 8); i++) {
-        if ((bits & (0x1 << i)) > 0)
-            res++;
-    }
-    return res;
-}
-
 #ifdef USE_XDAMAGE
 /**
  * \brief Paints a mouse pointer in an X11 image.
@@ -276,11 +401,6 @@ paintMousePointer (XImage * image, int x, int y)
     Job *job = xvc_job_ptr ();
     XRectangle pArea = { 0, 0, 0, 0 };
 
-#ifdef HAVE_LIBXFIXES
-    unsigned char topp, botp;
-    unsigned long applied;
-#endif     // HAVE_LIBXFIXES
-
     // only paint a mouse pointer into the dummy frame if the position of
     // the mouse is within the rectangle defined by the capture frame
 
@@ -310,249 +430,79 @@ paintMousePointer (XImage * image, int x, int y)
         (y - app->area->y + cursor_height) >= 0 &&
         y < (app->area->height + app->area->y)
         ) {
-        uint8_t *im_data = (uint8_t *) image->data;
-        int bytes_per_pixel = image->bits_per_pixel >> 3;
-        int line;
-        uint32_t masks = 0;
-        int yoff = app->area->y - y;
-
-        /* Select correct masks and pixel size */
-        if (!app->flags & FLG_USE_XFIXES) {
-            if (image->bits_per_pixel == 8) {
-                masks = 1;
-            } else {
-                masks =
-                    (image->red_mask | image->green_mask | image->blue_mask);
-            }
-
-            // first: shift to right line
-            im_data +=
-                (image->bytes_per_line * XVC_MAX (0, (y - app->area->y)));
-
-            // then: shift to right pixel
-            im_data += (bytes_per_pixel * XVC_MAX (0, (x - app->area->x)));
-        }
-
-        /* Draw the cursor - proper loop */
-        for (line = XVC_MAX (0, yoff);
-             line < XVC_MIN (cursor_height,
-                             (app->area->y + image->height) - y); line++) {
-            uint8_t *cursor = im_data;
-            int column;
-            uint16_t bm_b;
-            uint16_t bm_w;
-            int xoff = app->area->x - x;
-            unsigned long *pix_pointer = NULL;
-
 #ifdef HAVE_LIBXFIXES
-            if (app->flags & FLG_USE_XFIXES)
-                pix_pointer = (line * my_x_cursor->width) + my_x_cursor->pixels;
+        if (app->flags & FLG_USE_XFIXES) {
+            xvc_pixels_blend_cursor (image, x - app->area->x,
+                                     y - app->area->y, my_x_cursor->pixels,
+                                     cursor_width, cursor_height,
+                                     job->c_info, job->color_table,
+                                     job->ncolors, (job->target == CAP_XWD ||
+                                                    job->target == CAP_XVS));
+        } else
 #endif     // HAVE_LIBXFIXES
-
+        {
+            uint8_t *im_data = (uint8_t *) image->data;
+            int bytes_per_pixel = image->bits_per_pixel >> 3;
+            int line;
+            uint32_t masks = 0;
+            int yoff = app->area->y - y;
+
+            /* Select correct masks and pixel size */
             if (!app->flags & FLG_USE_XFIXES) {
-                if (app->mouseWanted == 1) {
-                    bm_b = mousePointerBlack[line];
-                    bm_w = mousePointerWhite[line];
+                if (image->bits_per_pixel == 8) {
+                    masks = 1;
                 } else {
-                    bm_b = mousePointerWhite[line];
-                    bm_w = mousePointerBlack[line];
+                    masks = (image->red_mask | image->green_mask |
+                             image->blue_mask);
                 }
 
-                if (xoff > 0) {
-                    bm_b >>= xoff;
-                    bm_w >>= xoff;
-                }
+                // first: shift to right line
+                im_data += (image->bytes_per_line *
+                            XVC_MAX (0, (y - app->area->y)));
+
+                // then: shift to right pixel
+                im_data += (bytes_per_pixel *
+                            XVC_MAX (0, (x - app->area->x)));
             }
 
-            for (column = XVC_MAX (0, xoff);
-                 column < XVC_MIN (cursor_width,
-                                   (app->area->x + app->area->width) - x);
-                 column++) {
-#ifdef HAVE_LIBXFIXES
-                if (app->flags & FLG_USE_XFIXES) {
-                    int count;
-                    int rel_x = (x - app->area->x + column);
-                    int rel_y = (y - app->area->y + line);
-
-                    /** \brief alpha mask of the pointer pixel */
-                    int mask = (*pix_pointer & job->c_info->alpha_mask) >>
-                        job->c_info->alpha_shift;
-                    int shift, src_shift, src_mask;
-
-                    /* The manpage of XGetPixel say the return value is
-                     * "normalized". No idea what's meant by that, because
-                     * the values returned are definetely exactly as in the
-                     * XImage, i.e. a 8 bit palette element for PAL8 or a
-                     * 16bit RGB value for RGB16 expanded to a long */
-                    long pixel = XGetPixel (image, rel_x, rel_y);
-
-                    /* alpha masking on 8bit palette seems to have issues with
-                     * high transparencies. We just ignore those. */
-                    if (image->depth == 8) {
-                        if (mask < 10)
-                            mask = 0;
-                    }
-                    // shortcut
-                    if (mask == 0) {
-                        applied = pixel;    // | job->c_info->alpha_mask;
+            /* Draw the cursor - proper loop */
+            for (line = XVC_MAX (0, yoff);
+                 line < XVC_MIN (cursor_height,
+                                 (app->area->y + image->height) - y); line++) {
+                uint8_t *cursor = im_data;
+                int column;
+                uint16_t bm_b;
+                uint16_t bm_w;
+                int xoff = app->area->x - x;
+
+                if (!app->flags & FLG_USE_XFIXES) {
+                    if (app->mouseWanted == 1) {
+                        bm_b = mousePointerBlack[line];
+                        bm_w = mousePointerWhite[line];
                     } else {
-                        applied = 0;   //job->c_info->alpha_mask;
-
-                        /* if we're on PAL8 we want the actual RGB values from
-                         * the palette rather than the palette element. We can
-                         * safely ignore alpha, here. */
-                        if (image->depth == 8) {
-                            if (job->target != CAP_XWD) {
-                                pixel =
-                                    ((u_int32_t *) job->
-                                     color_table)[(pixel & 0x00FFFFFF)];
-                            } else {
-                                long opixel = pixel;
-
-                                pixel = (((XWDColor *) job->color_table)[(opixel
-                                                                          &
-                                                                          0x00FFFFFF)].
-                                         red & 0xFF00) << 16;
-                                pixel |=
-                                    (((XWDColor *) job->
-                                      color_table)[(opixel & 0x00FFFFFF)].
-                                     green & 0xFF00) << 8;
-                                pixel =
-                                    ((XWDColor *) job->
-                                     color_table)[(opixel & 0x00FFFFFF)].
-                                    blue & 0xFF00;
-                            }
-                        }
-                        // treat one color element at a time
-                        for (count = 2; count >= 0; count--) {
-                            shift = count * 8;
-
-                            /* if we don't have PAL8, we have RGB and need to
-                             * take native bit shifts and masks taken from X11
-                             * into account.
-                             * Otherwise we got the RGB values from the palette
-                             * where they are always 8 bit per color. */
-                            if (image->depth != 8) {
-                                switch (count) {
-                                case 2:
-                                    src_shift = job->c_info->red_shift;
-                                    src_mask = image->red_mask;
-                                    break;
-                                case 1:
-                                    src_shift = job->c_info->green_shift;
-                                    src_mask = image->green_mask;
-                                    break;
-                                default:
-                                    src_shift = job->c_info->blue_shift;
-                                    src_mask = image->blue_mask;
-                                }
-                            } else {
-                                src_shift = shift;
-                                src_mask = 0xFF << src_shift;
-                            }
-
-                            // alpha blending next
-                            topp =
-                                top[(mask << 8) +
-                                    ((*pix_pointer >> shift) & 0xFF)];
-                            botp =
-                                bottom[(mask << 8) +
-                                       (((pixel & src_mask) >> src_shift) &
-                                        0xFF)];
-
-                            applied |=
-                                ((topp +
-                                  botp) & (src_mask >> src_shift)) << src_shift;
-                        }
-
-                        /* if we have PAL8 we need to find the palette element
-                         * closest to the result of the alpha blending before
-                         * writing back to the XImage. We do this by calculating
-                         * the number of bits matching between the blended RGB
-                         * value and each palette entry until we find an exact
-                         * match. */
-                        if (image->depth == 8) {
-                            int elem = 0;
-                            int i = 0, delta = 0;
-                            int elem_delta;
-                            long ct_pixel;
-
-                            if (job->target != CAP_XWD)
-                                ct_pixel = ((u_int32_t *) job->color_table)[i];
-                            else {
-                                ct_pixel =
-                                    (((XWDColor *) job->color_table)[i].
-                                     red & 0xFF00) << 16;
-                                ct_pixel |=
-                                    (((XWDColor *) job->color_table)[i].
-                                     green & 0xFF00) << 8;
-                                ct_pixel =
-                                    ((XWDColor *) job->color_table)[i].
-                                    blue & 0xFF00;
-                            }
-
-                            elem_delta = count_one_bits ((applied &
-                                                          ct_pixel) &
-                                                         0x00FFFFFF);
-                            elem_delta +=
-                                count_one_bits ((~applied &
-                                                 ~ct_pixel) & 0x00FFFFFF);
-
-                            if (elem != applied) {
-                                for (i = 1; i < job->ncolors; i++) {
-                                    if (job->target != CAP_XWD)
-                                        ct_pixel =
-                                            ((u_int32_t *) job->color_table)[i];
-                                    else {
-                                        ct_pixel =
-                                            (((XWDColor *) job->color_table)[i].
-                                             red & 0xFF00) << 16;
-                                        ct_pixel |=
-                                            (((XWDColor *) job->color_table)[i].
-                                             green & 0xFF00) << 8;
-                                        ct_pixel =
-                                            ((XWDColor *) job->color_table)[i].
-                                            blue & 0xFF00;
-                                    }
-                                    delta =
-                                        count_one_bits ((applied &
-                                                         ct_pixel) &
-                                                        0x00FFFFFF);
-                                    delta +=
-                                        count_one_bits ((~applied &
-                                                         ~ct_pixel) &
-                                                        0x00FFFFFF);
-                                    if (delta > elem_delta) {
-                                        elem_delta = delta;
-                                        elem = i;
-                                        if (elem_delta == 24)
-                                            break;
-                                    }
-                                }
-                                applied = elem;
-                            }
-                        }
+                        bm_b = mousePointerWhite[line];
+                        bm_w = mousePointerBlack[line];
                     }
 
-                    // write pixel
-                    XPutPixel (image, rel_x, rel_y, applied);
-
-                    pix_pointer++;
-                } else {
-#endif     // HAVE_LIBXFIXES
+                    if (xoff > 0) {
+                        bm_b >>= xoff;
+                        bm_w >>= xoff;
+                    }
+                }
 
+                for (column = XVC_MAX (0, xoff);
+                     column < XVC_MIN (cursor_width,
+                                       (app->area->x + app->area->width) - x);
+                     column++) {
                     apply_masks (cursor, ~(masks * (bm_b & 1)),
                                  masks * (bm_w & 1), image->bits_per_pixel);
                     cursor += bytes_per_pixel;
                     bm_b >>= 1;
                     bm_w >>= 1;
-
-#ifdef HAVE_LIBXFIXES
                 }
-#endif     // HAVE_LIBXFIXES
-            }
 
-            im_data += image->bytes_per_line;
+                im_data += image->bytes_per_line;
+            }
         }
 
         // return the are covered by the mouse pointer
@@ -707,52 +657,124 @@ XGetZPixmapSHM (Display * dpy, Drawable d, XShmSegmentInfo * shminfo,
 #undef DEBUGFUNCTION
 }
 
+#ifdef USE_XDAMAGE
+/** \brief edge length of the tiles compared when checking a frame captured
+ *      with Xdamage */
+#define DAMAGE_TILE_SIZE 64
+/** \brief number of checks in a row finding stale tiles after which a
+ *      session stops using Xdamage */
+#define DAMAGE_MAX_FAILURES 3
+
 /**
- * \brief copies a small image into another larger image
+ * \brief the tiles a check of a frame captured with Xdamage found to
+ *      differ from a full frame
  *
- * @param needle pointer to the memory containing the small image
- * @param needle_x the x position of the small image within the larger image
- * @param needle_y the y position of the small image within the larger image
- * @param needle_width the width of the small image
- * @param needle_bytes_pl number of bytes per line in the small image (may be
- *      padded.)
- * @param needle_height the height of the small image
- * @param haystack pointer to the memory holding the larger image
- * @param haystack_width the width of the larger image
- * @param haystack_bytes_pl number of bytes per line in the larger image (may
- *      be padded.)
- * @param haystack_height the height of the larger image
- * @param bytes_per_pixel the number of bytes a pixel requires for
- *      representation, e.g. 4 for rgba, 1 for pal8. This requires the value
- *      to be identical for needle and haystack.
+ * A tile may differ because the screen changed between grabbing the damaged
+ * areas and the full frame. That damage is only known with the damage of
+ * the next frame, so the tiles are kept until then.
  */
-static void
-placeImageInImage (char *needle, int needle_x, int needle_y,
-                   int needle_width, int needle_bytes_pl, int needle_height,
-                   char *haystack, int haystack_width, int haystack_bytes_pl,
-                   int haystack_height, int bytes_per_pixel)
+typedef struct
 {
-#define DEBUGFUNCTION "placeImageInImage()"
-    char *h_cursor, *n_cursor;
-    int i;
+    /** \brief one byte per tile, row by row, TRUE if the tile differed */
+    char *tiles;
+    /** \brief number of bytes allocated for tiles */
+    int size;
+    /** \brief root window position and size of the area checked */
+    int x, y, width, height;
+    /** \brief TRUE while the tiles wait for the damage of the next frame */
+    int pending;
+} DamageCheck;
 
-    h_cursor =
-        haystack + ((needle_x * bytes_per_pixel) +
-                    (needle_y * haystack_bytes_pl));
-    n_cursor = needle;
-    for (i = 0; i < needle_height; i++) {
-        if (h_cursor + (needle_width * bytes_per_pixel) >
-            haystack + (haystack_height * haystack_bytes_pl)) {
-            fprintf (stderr, "%s %s: out of bounds ... clipped correctly?\n",
-                     DEBUGFILE, DEBUGFUNCTION);
-            break;
+/**
+ * \brief compares a frame put together from damaged areas with a full frame
+ *      tile by tile and copies the tiles that differ from the full frame
+ *
+ * The tiles that differed are remembered in check, for
+ * countStaleTiles () to tell which of them were stale.
+ *
+ * @param image the frame put together from damaged areas
+ * @param full the pixel data of the full frame, grabbed after the damaged
+ *      areas
+ * @param bpl the bytes per line in full
+ * @param check where the tiles that differed are remembered
+ * @return the number of tiles that differed
+ */
+static int
+repairDamagedImage (XImage * image, const char *full, int bpl,
+                    DamageCheck * check)
+{
+    XVC_AppData *app = xvc_appdata_ptr ();
+    int Bpp = image->bits_per_pixel >> 3;
+    int tx, ty, y, tile_bytes, tile_lines, t = 0;
+    int size = ((image->width + DAMAGE_TILE_SIZE - 1) / DAMAGE_TILE_SIZE) *
+        ((image->height + DAMAGE_TILE_SIZE - 1) / DAMAGE_TILE_SIZE);
+    int repaired = 0;
+
+    if (check->size < size) {
+        free (check->tiles);
+        check->tiles = (char *) malloc (size);
+        check->size = (check->tiles ? size : 0);
+    }
+    if (check->tiles)
+        memset (check->tiles, FALSE, size);
+
+    for (ty = 0; ty < image->height; ty += DAMAGE_TILE_SIZE) {
+        tile_lines = XVC_MIN (DAMAGE_TILE_SIZE, image->height - ty);
+        for (tx = 0; tx < image->width; tx += DAMAGE_TILE_SIZE, t++) {
+            tile_bytes = XVC_MIN (DAMAGE_TILE_SIZE, image->width - tx) * Bpp;
+            for (y = ty; y < ty + tile_lines; y++) {
+                if (memcmp (image->data + y * image->bytes_per_line +
+                            tx * Bpp, full + y * bpl + tx * Bpp,
+                            tile_bytes) != 0)
+                    break;
+            }
+            if (y == ty + tile_lines)
+                continue;
+            // the lines above the first difference are the same already
+            repaired++;
+            if (check->tiles)
+                check->tiles[t] = TRUE;
+            for (; y < ty + tile_lines; y++)
+                memcpy (image->data + y * image->bytes_per_line + tx * Bpp,
+                        full + y * bpl + tx * Bpp, tile_bytes);
         }
-        memcpy (h_cursor, n_cursor, needle_width * bytes_per_pixel);
-        h_cursor += haystack_bytes_pl;
-        n_cursor += needle_bytes_pl;
     }
-#undef DEBUGFUNCTION
+    check->x = app->area->x;
+    check->y = app->area->y;
+    check->width = image->width;
+    check->height = image->height;
+    check->pending = (check->tiles != NULL);
+    return repaired;
+}
+
+/**
+ * \brief counts the tiles of a check that differed without damage being
+ *      reported for them
+ *
+ * @param check the tiles of the last check
+ * @param damage the damage fetched after the check, in root window
+ *      coordinates
+ * @return the number of stale tiles
+ */
+static int
+countStaleTiles (DamageCheck * check, Region damage)
+{
+    int tx, ty, t = 0, stale = 0;
+
+    for (ty = 0; ty < check->height; ty += DAMAGE_TILE_SIZE) {
+        for (tx = 0; tx < check->width; tx += DAMAGE_TILE_SIZE, t++) {
+            if (check->tiles[t] &&
+                XRectInRegion (damage, check->x + tx, check->y + ty,
+                               XVC_MIN (DAMAGE_TILE_SIZE, check->width - tx),
+                               XVC_MIN (DAMAGE_TILE_SIZE,
+                                        check->height - ty)) == RectangleOut)
+                stale++;
+        }
+    }
+    check->pending = FALSE;
+    return stale;
 }
+#endif     // USE_XDAMAGE
 
 /**
  * \brief compute the output filename depending on current capture mode and
@@ -1069,6 +1091,290 @@ captureFrameCreatingImageSHM (Display * dpy, XShmSegmentInfo * shminfo)
 
 #endif     // HAVE_SHMAT
 
+/** \brief number of grabs timed per capture path when probing */
+#define PROBE_GRABS 5
+/** \brief longest wait in msecs between grabs of damaged areas when probing */
+#define PROBE_MAX_WAIT 100
+/** \brief set by probeErrorHandler if the X server reported an error, reset
+ *      before each capture path is probed */
+static int probe_error = FALSE;
+
+/**
+ * \brief X error handler used while probing, so a capture path failing does
+ *      not end the program
+ *
+ * @param dpy the display the error occured on
+ * @param err the error
+ * @return ignored
+ */
+static int
+probeErrorHandler (Display * dpy, XErrorEvent * err)
+{
+    probe_error = TRUE;
+    return 0;
+}
+
+/**
+ * \brief grabs part of the screen with one of the capture paths probed
+ *
+ * @param dpy a pointer to the display to read from
+ * @param capfunc X11 or SHM
+ * @param shminfo shared segment info for SHM, ignored otherwise
+ * @param shm_opcode the major opcode for the shm extension
+ * @param data a pointer to the chunk of memory to store the image
+ * @param x origin x coordinate
+ * @param y origin y coordinate
+ * @param width width of the area to grab
+ * @param height height of the area to grab
+ * @return we were successfull TRUE or FALSE
+ */
+static Boolean
+probeGrab (Display * dpy, enum captureFunctions capfunc, void *shminfo,
+           int shm_opcode, char *data, int x, int y, int width, int height)
+{
+    XVC_AppData *app = xvc_appdata_ptr ();
+
+    switch (capfunc) {
+#ifdef HAVE_SHMAT
+    case SHM:
+        return XGetZPixmapSHM (dpy, app->root_window,
+                               (XShmSegmentInfo *) shminfo, shm_opcode, data,
+                               x, y, width, height);
+#endif     // HAVE_SHMAT
+    case X11:
+    default:
+        return XGetZPixmap (dpy, app->root_window, data, x, y, width, height);
+    }
+}
+
+/**
+ * \brief picks the way of capturing for --source auto by timing a few grabs
+ *      of the capture area with every way available
+ *
+ * Full frames are grabbed with XGetImage, into an existing image with plain
+ * X11 and with shared memory. If Xdamage is in use, only the damaged areas
+ * are grabbed for a few frames and the frame put together from them is
+ * compared with a full frame at the end, because some compositing window
+ * managers do not report damage properly. The display must not be locked
+ * by the caller, but app->capturing_mutex must be held. Both are released
+ * while waiting for damage, so the damage event filter can record it.
+ *
+ * @param use_damage return pointer set to TRUE if grabbing only the damaged
+ *      areas was correct and faster than grabbing full frames
+ * @return the capture function for grabbing full frames
+ */
+static enum captureFunctions
+probeCaptureSource (int *use_damage)
+{
+#define DEBUGFUNCTION "probeCaptureSource()"
+    XVC_AppData *app = xvc_appdata_ptr ();
+    Display *dpy = app->dpy;
+    int (*old_handler) (Display *, XErrorEvent *);
+    enum captureFunctions best = X11;
+    void *best_shminfo = NULL;
+    char *best_data;
+    XImage *image;
+    int64_t start, t_getimage, t_x11, t_best;
+    int i;
+
+#ifdef HAVE_SHMAT
+    XShmSegmentInfo shminfo;
+    XImage *shm_image = NULL;
+    int shm_opcode = 0, shm_event_base = 0, shm_error_base = 0;
+    int64_t t_shm = -1;
+    int ok;
+#else      // HAVE_SHMAT
+    int shm_opcode = 0;
+#endif     // HAVE_SHMAT
+#ifdef USE_XDAMAGE
+    Job *job = xvc_job_ptr ();
+    XImage *frame = NULL;
+    DamageCheck check = { NULL, 0, 0, 0, 0, 0, FALSE };
+    int64_t t_damage = -1;
+    int stale = 0;
+#endif     // USE_XDAMAGE
+
+    *use_damage = FALSE;
+    XLockDisplay (dpy);
+    old_handler = XSetErrorHandler (probeErrorHandler);
+    probe_error = FALSE;
+
+    // XGetImage allocates a new image for every grab
+    start = xvc_stats_clock ();
+    image = createImage (dpy, app->area->width, app->area->height);
+    for (i = 1; i < PROBE_GRABS; i++) {
+        XDestroyImage (image);
+        image = createImage (dpy, app->area->width, app->area->height);
+    }
+    t_getimage = (xvc_stats_clock () - start) / PROBE_GRABS;
+
+    // plain X11 reads into an existing image
+    start = xvc_stats_clock ();
+    for (i = 0; i < PROBE_GRABS; i++)
+        XGetZPixmapToXImage (dpy, app->root_window, image, app->area->x,
+                             app->area->y);
+    t_best = t_x11 = (xvc_stats_clock () - start) / PROBE_GRABS;
+    best_data = image->data;
+
+#ifdef HAVE_SHMAT
+    // a remote X server cannot attach the segment, which is only reported
+    // asynchronously
+    if (XShmQueryExtension (dpy) &&
+        XQueryExtension (dpy, "MIT-SHM", &shm_opcode, &shm_event_base,
+                         &shm_error_base))
+        shm_image = XShmCreateImage (dpy, app->win_attr.visual,
+                                     app->win_attr.depth, ZPixmap, NULL,
+                                     &shminfo, app->area->width,
+                                     app->area->height);
+    if (shm_image) {
+        shminfo.shmid = shmget (IPC_PRIVATE,
+                                shm_image->bytes_per_line * shm_image->height,
+                                IPC_CREAT | 0777);
+        shminfo.shmaddr = (shminfo.shmid == -1 ? (char *) -1 :
+                           shmat (shminfo.shmid, 0, 0));
+        shminfo.readOnly = False;
+        if (shminfo.shmaddr == (char *) -1) {
+            XDestroyImage (shm_image);
+            shm_image = NULL;
+        } else {
+            shm_image->data = shminfo.shmaddr;
+            XShmAttach (dpy, &shminfo);
+            XSync (dpy, False);
+            shmctl (shminfo.shmid, IPC_RMID, 0);
+        }
+    }
+    if (shm_image && !probe_error) {
+        start = xvc_stats_clock ();
+        for (i = 0, ok = TRUE; i < PROBE_GRABS && ok; i++)
+            ok = XGetZPixmapSHM (dpy, app->root_window, &shminfo, shm_opcode,
+                                 shm_image->data, app->area->x, app->area->y,
+                                 app->area->width, app->area->height);
+        if (ok && !probe_error) {
+            t_shm = (xvc_stats_clock () - start) / PROBE_GRABS;
+            if (t_shm < t_best) {
+                best = SHM;
+                best_shminfo = &shminfo;
+                best_data = shm_image->data;
+                t_best = t_shm;
+            }
+        }
+    }
+#endif     // HAVE_SHMAT
+
+#ifdef USE_XDAMAGE
+    if (app->flags & FLG_USE_XDAMAGE) {
+        Region damaged_region;
+        int bpl, Bpp = image->bits_per_pixel >> 3;
+
+        // only errors from the damaged grabs count against them, not an
+        // XShmAttach failing on a remote server
+        XSync (dpy, False);
+        probe_error = FALSE;
+
+        // start from a full frame and forget the damage up to it
+        damaged_region = xvc_get_damage_region ();
+        XDestroyRegion (damaged_region);
+        frame = createImage (dpy, app->area->width, app->area->height);
+
+        t_damage = 0;
+        for (i = 0; i < PROBE_GRABS; i++) {
+            int rcount;
+
+            // let the damage events come in like between frames, the
+            // event filter needs both locks to add them to the Job
+            XUnlockDisplay (dpy);
+            pthread_mutex_unlock (&(app->capturing_mutex));
+            usleep (XVC_MIN (job->time_per_frame, PROBE_MAX_WAIT) * 1000);
+            pthread_mutex_lock (&(app->capturing_mutex));
+            XLockDisplay (dpy);
+
+            start = xvc_stats_clock ();
+            XSync (dpy, False);
+            damaged_region = xvc_get_damage_region ();
+            for (rcount = 0; rcount < damaged_region->numRects; rcount++) {
+                Box *r = &(damaged_region->rects[rcount]);
+                int x = XVC_MIN (r->x1, r->x2), y = XVC_MIN (r->y1, r->y2);
+                int width = abs (r->x1 - r->x2), height = abs (r->y1 - r->y2);
+
+                probeGrab (dpy, best, best_shminfo, shm_opcode, best_data,
+                           x, y, width, height);
+                // lines are aligned to 4-byte boundaries like in
+                // commonCapture ()
+                bpl = width * Bpp;
+                if (bpl % 4 > 0)
+                    bpl = (bpl / 4) * 4 + 4;
+                xvc_pixels_place_image (best_data, x - app->area->x,
+                                        y - app->area->y, width, bpl, height,
+                                        frame->data, frame->width,
+                                        frame->bytes_per_line, frame->height,
+                                        Bpp);
+            }
+            XDestroyRegion (damaged_region);
+            t_damage += xvc_stats_clock () - start;
+        }
+        t_damage /= PROBE_GRABS;
+
+        // now the frame put together must match the screen
+        probeGrab (dpy, best, best_shminfo, shm_opcode, best_data,
+                   app->area->x, app->area->y, app->area->width,
+                   app->area->height);
+        bpl = app->area->width * Bpp;
+        if (bpl % 4 > 0)
+            bpl = (bpl / 4) * 4 + 4;
+        repairDamagedImage (frame, best_data, bpl, &check);
+        XDestroyImage (frame);
+        // tiles that changed after the damaged grabs show up in the damage
+        // of the next frame
+        XUnlockDisplay (dpy);
+        pthread_mutex_unlock (&(app->capturing_mutex));
+        usleep (XVC_MIN (job->time_per_frame, PROBE_MAX_WAIT) * 1000);
+        pthread_mutex_lock (&(app->capturing_mutex));
+        XLockDisplay (dpy);
+        XSync (dpy, False);
+        damaged_region = xvc_get_damage_region ();
+        stale = (check.pending ? countStaleTiles (&check, damaged_region) : 0);
+        XDestroyRegion (damaged_region);
+        free (check.tiles);
+        XSync (dpy, False);
+        *use_damage = (stale == 0 && !probe_error && t_damage < t_best);
+    }
+#endif     // USE_XDAMAGE
+
+#ifdef HAVE_SHMAT
+    if (shm_image) {
+        XShmDetach (dpy, &shminfo);
+        XSync (dpy, False);
+        shmdt (shminfo.shmaddr);
+        XDestroyImage (shm_image);
+    }
+#endif     // HAVE_SHMAT
+    XDestroyImage (image);
+    XSetErrorHandler (old_handler);
+    XUnlockDisplay (dpy);
+
+    if (app->flags & FLG_RUN_VERBOSE) {
+        printf ("%s %s: %dx%d per frame: XGetImage %.2f ms, X11 %.2f ms",
+                DEBUGFILE, DEBUGFUNCTION, app->area->width, app->area->height,
+                t_getimage / 1000000.0, t_x11 / 1000000.0);
+#ifdef HAVE_SHMAT
+        if (t_shm >= 0)
+            printf (", SHM %.2f ms", t_shm / 1000000.0);
+        else
+            printf (", SHM not available");
+#endif     // HAVE_SHMAT
+#ifdef USE_XDAMAGE
+        if (t_damage >= 0)
+            printf (", damage %.2f ms (%i stale tiles)",
+                    t_damage / 1000000.0, stale);
+#endif     // USE_XDAMAGE
+        printf (", using %s%s\n", (best == X11 ? "X11" : "SHM"),
+                (*use_damage ? " with damage" : ""));
+    }
+
+    return best;
+#undef DEBUGFUNCTION
+}
+
 /**
  * \brief calculates in how many msecs the next capture is due based on fps
  *      and the duration of the previous capture.
@@ -1111,6 +1417,8 @@ checkCaptureDuration (long time, long time1)
             printf
                 ("missing %ld milli secs (%d needed per frame), pic no %d\n",
                  time, job->time_per_frame, job->pic_no);
+        if (job->time_per_frame > 0)
+            xvc_stats_add_dropped (-time / job->time_per_frame);
         time = 0;
     }
 
@@ -1135,6 +1443,8 @@ commonCapture (enum captureFunctions capfunc)
     struct timeval curr_time;   /* for measuring the duration of a frame
                                  * capture */
     static int shm_opcode = 0, shm_event_base = 0, shm_error_base = 0;
+    // the capture function picked by probing for --source auto
+    static enum captureFunctions auto_capfunc = X11;
 
 //    static XRectangle pointer_area;
 
@@ -1144,6 +1454,9 @@ commonCapture (enum captureFunctions capfunc)
     int full_cleanup = TRUE;
     int frame_moved = FALSE;
     int pointer_x = 0, pointer_y = 0;
+    int64_t stage_start = 0, frame_start = 0;   // for stage statistics
+    unsigned long req_start = 0;       // X requests sent for this frame
+    int duplicated = FALSE;
 
 #ifdef HAVE_LIBXFIXES
     XFixesCursorImage *x_cursor = NULL;
@@ -1152,6 +1465,11 @@ commonCapture (enum captureFunctions capfunc)
 #ifdef USE_XDAMAGE
     Region damaged_region;
     static XImage *dmg_image = NULL;
+    // frames captured with Xdamage, checks in a row that found stale tiles
+    // and whether the session gave up on Xdamage because of them
+    static int dmg_frames = 0, dmg_failures = 0, dmg_disabled = FALSE;
+    // the tiles of the last check, waiting for the damage of the next frame
+    static DamageCheck dmg_check = { NULL, 0, 0, 0, 0, 0, FALSE };
 
 #ifdef HAVE_SHMAT
     static XShmSegmentInfo dmg_shminfo;
@@ -1174,6 +1492,9 @@ commonCapture (enum captureFunctions capfunc)
 #endif     // USE_FFMPEG
         target = &(app->single_frame);
 
+    if (app->flags & FLG_AUTO_SOURCE)
+        capfunc = auto_capfunc;
+
     // we really cannot have external state changes
     // while we're reacting on state
     // frame moves, too, are evil
@@ -1189,8 +1510,9 @@ commonCapture (enum captureFunctions capfunc)
         // make sure the frame is actually moved before continuing with the
         // capture to avoid capturing the frame (this is not a guarantee with
         // compositing window managers, though)
-        XSync (app->dpy, False);
-    } else if ((app->flags & FLG_LOCK_FOLLOWS_MOUSE) != 0 &&
+        if (app->dpy)
+            XSync (app->dpy, False);
+    } else if (app->dpy && (app->flags & FLG_LOCK_FOLLOWS_MOUSE) != 0 &&
                xvc_is_frame_locked ()) {
         int px = 0, py = 0;
         int x = app->area->x, y = app->area->y;
@@ -1235,30 +1557,57 @@ commonCapture (enum captureFunctions capfunc)
                     DEBUGFUNCTION);
 #endif     // DEBUG
 
-            if (app->flags & FLG_RUN_VERBOSE)
-                printf ("%s %s: Stopped! pic_no=%d max_frames=%d\n",
-                        DEBUGFILE, DEBUGFUNCTION, job->pic_no, target->frames);
-
-            // we need to stop the capture to go through the necessary
-            // cleanup routines for writing a correct file. If we have
-            // autocontinue on we're setting a flag to let the cleanup
-            // code know we need
-            // to restart again afterwards
-            if (job->flags & FLG_AUTO_CONTINUE) {
-                job->state |= VC_CONTINUE;
-            }
+            if ((job->flags & FLG_AUTO_CONTINUE) && job->roll_over &&
+                !(job->state & VC_START)) {
+                // the output can continue in the next file on its own
+                // while we keep capturing
+                job->roll_over_requested = TRUE;
+            } else {
+                if (app->flags & FLG_RUN_VERBOSE)
+                    printf ("%s %s: Stopped! pic_no=%d max_frames=%d\n",
+                            DEBUGFILE, DEBUGFUNCTION, job->pic_no,
+                            target->frames);
+
+                // we need to stop the capture to go through the necessary
+                // cleanup routines for writing a correct file. If we have
+                // autocontinue on we're setting a flag to let the cleanup
+                // code know we need
+                // to restart again afterwards
+                if (job->flags & FLG_AUTO_CONTINUE) {
+                    job->state |= VC_CONTINUE;
+                }
 
+                goto CLEAN_CAPTURE;
+            }
+        }
+        // a replay ends with the capture log
+        if (capfunc == REPLAY && !(job->state & VC_START) &&
+            !xvc_capture_log_replay_pending ())
             goto CLEAN_CAPTURE;
+        // continue in the next file with this frame, keeping the encoder,
+        // image buffers and audio capture alive
+        if (job->roll_over_requested && !(job->state & VC_START)) {
+            if (app->flags & FLG_RUN_VERBOSE)
+                printf ("%s %s: Rolling over! pic_no=%d movie_no=%d\n",
+                        DEBUGFILE, DEBUGFUNCTION, job->pic_no,
+                        job->movie_no + 1);
+
+            job->roll_over_requested = FALSE;
+            job->movie_no += 1;
+            job->pic_no = target->start_no;
+            (*job->roll_over) ();
         }
         // take the time before starting the capture
         gettimeofday (&curr_time, NULL);
         time = curr_time.tv_sec * 1000 + curr_time.tv_usec / 1000;
+        frame_start = xvc_stats_clock ();
+        // the synth source may run without a display
+        req_start = (app->dpy ? XNextRequest (app->dpy) : 0);
 
-        // open the output file we need to do this for every frame for
-        // individual frame
-        // capture and only once for capture to movie
-        if ((app->current_mode == 0) ||
-            (app->current_mode > 0 && job->state & VC_START)) {
+        // open the output file once for capture to movie, the save
+        // functions open the files for individual frames themselves, so for
+        // those we only check if the first one can be written
+        if (job->state & VC_START) {
 
 #ifdef DEBUG
             printf ("%s %s: opening file for captured frame(s) ... state %i\n",
@@ -1297,20 +1646,17 @@ commonCapture (enum captureFunctions capfunc)
                     DEBUGFUNCTION);
 #endif     // DEBUG
 
+            xvc_stats_reset ();
+            // an auto-continued session keeps adding to the trace
+            if (app->trace_file && !xvc_trace_active &&
+                xvc_trace_start (app->trace_file) == 0)
+                xvc_trace_thread_name ("capture");
+
 #ifdef HAVE_LIBXFIXES
             // if we use xfixes, we need this for alpha blending of the mouse
             // pointer
-            if (app->flags & FLG_USE_XFIXES && app->mouseWanted > 0) {
-                unsigned int mask, color;
-
-                for (mask = 0; mask <= 255; mask++) {
-                    for (color = 0; color <= 255; color++) {
-                        top[(mask << 8) + color] = (color * (mask + 1)) >> 8;
-                        bottom[(mask << 8) + color] =
-                            (color * (256 - mask)) >> 8;
-                    }
-                }
-            }
+            if (app->flags & FLG_USE_XFIXES && app->mouseWanted > 0)
+                xvc_pixels_init_blend ();
 #endif     // HAVE_LIBXFIXES
 
 #ifdef USE_XDAMAGE_NONE
@@ -1320,9 +1666,26 @@ commonCapture (enum captureFunctions capfunc)
                 clip_region = XFixesCreateRegion (app->dpy, 0, 0);
             }
 #endif     // USE_XDAMAGE
+#ifdef USE_XDAMAGE
+            // every session gets to try Xdamage again
+            dmg_frames = dmg_failures = 0;
+            dmg_disabled = FALSE;
+            dmg_check.pending = FALSE;
+#endif     // USE_XDAMAGE
+
+            // probe again, the capture area may have changed
+            if (app->flags & FLG_AUTO_SOURCE) {
+                int use_damage;
+
+                capfunc = auto_capfunc = probeCaptureSource (&use_damage);
+#ifdef USE_XDAMAGE
+                dmg_disabled = !use_damage;
+#endif     // USE_XDAMAGE
+            }
 
             // lock the display for consistency
-            XLockDisplay (app->dpy);
+            if (app->dpy)
+                XLockDisplay (app->dpy);
 
             // capture the start frame with whatever function applicable
             switch (capfunc) {
@@ -1341,6 +1704,30 @@ commonCapture (enum captureFunctions capfunc)
 #endif     // USE_XDAMAGE
                 break;
 #endif     // HAVE_SHMAT
+            case SYNTH:
+                {
+                    XVC_SynthPattern pattern;
+                    const XVC_SynthLayout *layout;
+                    int speed;
+
+                    if (xvc_synth_parse_source (app->source, &pattern,
+                                                &layout, &speed) == 0 &&
+                        xvc_synth_create_scene (&synth_scene, pattern, layout,
+                                                speed, app->area->width,
+                                                app->area->height) == 0)
+                        image = synth_scene.frame;
+                }
+                break;
+            case REPLAY:
+                image = xvc_capture_log_replay_image (app->source +
+                                                      strlen
+                                                      (XVC_REPLAY_SOURCE));
+                if (image && !xvc_capture_log_replay_frame (image,
+                                                            &duplicated)) {
+                    XDestroyImage (image);
+                    image = NULL;
+                }
+                break;
             case X11:
             default:
                 image = captureFrameCreatingImage (app->dpy);
@@ -1354,15 +1741,43 @@ commonCapture (enum captureFunctions capfunc)
             }
 
             if (app->mouseWanted > 0) {
+                if (capfunc == REPLAY || capfunc == SYNTH)
 #ifdef HAVE_LIBXFIXES
-                if (app->flags & FLG_USE_XFIXES)
+                    getReplayPointer (capfunc, &x_cursor, &pointer_x,
+                                      &pointer_y);
+                else if (app->flags & FLG_USE_XFIXES)
                     x_cursor = getCurrentPointerImage ();
-                else
+#else      // HAVE_LIBXFIXES
+                    getReplayPointer (capfunc, &pointer_x, &pointer_y);
 #endif     // HAVE_LIBXFIXES
+                else
                     getCurrentPointer (&pointer_x, &pointer_y);
             }
             // now, we have captured all we need and can unlock the display
-            XUnlockDisplay (app->dpy);
+            if (app->dpy)
+                XUnlockDisplay (app->dpy);
+
+            // a capture log we cannot replay or frames we cannot allocate
+            // end the recording right here
+            if ((capfunc == REPLAY || capfunc == SYNTH) && !image) {
+                full_cleanup = FALSE;
+                goto CLEAN_CAPTURE;
+            }
+            // the capture area needs the size of the frames replayed
+            if (capfunc == REPLAY && (image->width != app->area->width ||
+                                      image->height != app->area->height))
+                xvc_frame_change (app->area->x, app->area->y, image->width,
+                                  image->height, FALSE, FALSE);
+            // an auto-continued session keeps adding to the capture log
+            if (app->capture_log && image && !xvc_capture_log_recording)
+                xvc_capture_log_start (app->capture_log, image);
+#ifdef HAVE_LIBXFIXES
+            logCapturedFrame (image, frame_start, NULL, 0, FALSE, x_cursor,
+                              pointer_x, pointer_y);
+#else      // HAVE_LIBXFIXES
+            logCapturedFrame (image, frame_start, NULL, 0, FALSE, pointer_x,
+                              pointer_y);
+#endif     // HAVE_LIBXFIXES
 
             // need to determine c_info from image FIRST
             if (!(job->c_info))
@@ -1392,8 +1807,10 @@ commonCapture (enum captureFunctions capfunc)
                 // we can allow state or frame changes after this
                 pthread_mutex_unlock (&(app->capturing_mutex));
                 // call the necessary XtoXYZ function to process the image
+                xvc_damage_map_clear (FALSE);
                 (*job->save) (fp, image);
                 job->state &= ~(VC_START);
+                xvc_stats_add_frame (FALSE);
             } else {
                 // we can allow state or frame changes after this
                 pthread_mutex_unlock (&(app->capturing_mutex));
@@ -1408,17 +1825,40 @@ commonCapture (enum captureFunctions capfunc)
                     DEBUGFILE, DEBUGFUNCTION);
 #endif     // DEBUG
 #ifdef USE_XDAMAGE
-            if (app->flags & FLG_USE_XDAMAGE && !frame_moved) {
+            if (app->flags & FLG_USE_XDAMAGE && !frame_moved && !dmg_disabled
+                && capfunc != REPLAY && capfunc != SYNTH) {
                 int num_dmg_rects, rcount;
                 Box *dmg_rects;
+                XRectangle *log_rects = NULL;
 
                 // then lock the display so we capture a consitent state
                 XLockDisplay (app->dpy);
+                stage_start = xvc_stats_clock ();
                 // sync the display
                 XSync (app->dpy, False);
                 // first get the consolidated region where stuff was damaged
                 // since the last frame
                 damaged_region = xvc_get_damage_region ();
+                // nothing damaged means we encode the last frame again
+                duplicated = (damaged_region->numRects == 0);
+                // the tiles the last check found to differ were stale
+                // unless damage was reported for them since
+                if (dmg_check.pending) {
+                    int stale = countStaleTiles (&dmg_check, damaged_region);
+
+                    if (stale > 0) {
+                        if (++dmg_failures >= DAMAGE_MAX_FAILURES)
+                            dmg_disabled = TRUE;
+                    } else
+                        dmg_failures = 0;
+                    xvc_stats_add_damage_check (stale, dmg_disabled);
+                    if (app->flags & FLG_RUN_VERBOSE && stale > 0)
+                        printf ("%s %s: repaired %i stale tiles in frame %i%s\n",
+                                DEBUGFILE, DEBUGFUNCTION, stale,
+                                job->pic_no - 1, (dmg_disabled ?
+                                                  ", capturing full frames from now on"
+                                                  : ""));
+                }
                 // add the last position of the mouse pointer to the damaged
                 // region
                 if (app->mouseWanted > 0) {
@@ -1460,6 +1900,12 @@ commonCapture (enum captureFunctions capfunc)
                 // get individual rectangles from the damaged region
                 dmg_rects = damaged_region->rects;
                 num_dmg_rects = damaged_region->numRects;
+                if (xvc_capture_log_recording && num_dmg_rects > 0)
+                    log_rects = (XRectangle *) malloc (num_dmg_rects *
+                                                       sizeof (XRectangle));
+                // the rectangles tell the frame store where to look for
+                // changes
+                xvc_damage_map_clear (TRUE);
 
                 // then iterate across them and capture the content of the
                 // rectangles
@@ -1501,17 +1947,67 @@ commonCapture (enum captureFunctions capfunc)
                          width * (image->bits_per_pixel >> 3));
                     // update the content of the damaged areas in the frame
                     // to encode
-                    placeImageInImage (dmg_image->data,
-                                       x - app->area->x,
-                                       y - app->area->y,
-                                       width,
-                                       bpl,
-                                       height, image->data,
-                                       image->width,
-                                       image->bytes_per_line,
-                                       image->height,
-                                       image->bits_per_pixel >> 3);
+                    xvc_pixels_place_image (dmg_image->data,
+                                            x - app->area->x,
+                                            y - app->area->y,
+                                            width,
+                                            bpl,
+                                            height, image->data,
+                                            image->width,
+                                            image->bytes_per_line,
+                                            image->height,
+                                            image->bits_per_pixel >> 3);
+                    xvc_damage_map_add (x - app->area->x, y - app->area->y,
+                                        width, height);
+                    if (log_rects) {
+                        log_rects[rcount].x = x - app->area->x;
+                        log_rects[rcount].y = y - app->area->y;
+                        log_rects[rcount].width = width;
+                        log_rects[rcount].height = height;
+                    }
                 }
+                // some compositing window managers report damage late or
+                // not at all, so check the frame against a full one now and
+                // then
+                if (app->verify_damage > 0 &&
+                    (++dmg_frames % app->verify_damage) == 0) {
+                    int bpl = image->width * (image->bits_per_pixel >> 3);
+
+                    // see above for the alignment of lines
+                    if (bpl % 4 > 0)
+                        bpl = (bpl / 4) * 4 + 4;
+                    switch (capfunc) {
+#ifdef HAVE_SHMAT
+                    case SHM:
+                        XGetZPixmapSHM (app->dpy, app->root_window,
+                                        &dmg_shminfo, shm_opcode,
+                                        dmg_image->data, app->area->x,
+                                        app->area->y, image->width,
+                                        image->height);
+                        break;
+#endif     // HAVE_SHMAT
+                    case X11:
+                    default:
+                        XGetZPixmap (app->dpy, app->root_window,
+                                     dmg_image->data, app->area->x,
+                                     app->area->y, image->width,
+                                     image->height);
+                    }
+                    // whether the tiles that differed were stale is known
+                    // with the damage of the next frame
+                    if (repairDamagedImage (image, dmg_image->data, bpl,
+                                            &dmg_check) > 0) {
+                        duplicated = FALSE;
+                        xvc_damage_map_clear (FALSE);
+                        // the rectangles miss the repaired tiles
+                        if (log_rects) {
+                            free (log_rects);
+                            log_rects = NULL;
+                        }
+                    }
+                }
+                xvc_stats_add_stage (XVC_STAGE_GRAB, stage_start);
+                stage_start = xvc_stats_clock ();
                 // save the current mouse pointer location for further
                 // reference during capture of next frame, only get it here
                 // for minimizing locking
@@ -1526,6 +2022,19 @@ commonCapture (enum captureFunctions capfunc)
                 // now we can release the lock on the display again
                 XUnlockDisplay (app->dpy);
 
+                // without log_rects the capture log compares whole lines
+#ifdef HAVE_LIBXFIXES
+                logCapturedFrame (image, frame_start, log_rects,
+                                  num_dmg_rects, duplicated, x_cursor,
+                                  pointer_x, pointer_y);
+#else      // HAVE_LIBXFIXES
+                logCapturedFrame (image, frame_start, log_rects,
+                                  num_dmg_rects, duplicated, pointer_x,
+                                  pointer_y);
+#endif     // HAVE_LIBXFIXES
+                if (log_rects)
+                    free (log_rects);
+
                 // paint the mouse pointer here, outside the lock
 #ifdef HAVE_LIBXFIXES
                 if (app->flags & FLG_USE_XFIXES)
@@ -1534,33 +2043,66 @@ commonCapture (enum captureFunctions capfunc)
 #endif     // HAVE_LIBXFIXES
                     pointer_area = paintMousePointer (image, NULL, pointer_x,
                                                       pointer_y);
+                // the pointer painted changes the frame, too
+                xvc_damage_map_add (pointer_area.x - app->area->x,
+                                    pointer_area.y - app->area->y,
+                                    pointer_area.width, pointer_area.height);
+                if (app->mouseWanted > 0)
+                    xvc_stats_add_stage (XVC_STAGE_CURSOR, stage_start);
                 XDestroyRegion (damaged_region);
             } else {
 #endif     // USE_XDAMAGE
 
+                // what changed is only known from Xdamage
+                xvc_damage_map_clear (FALSE);
                 // lock the display for consistency
-                XLockDisplay (app->dpy);
+                if (app->dpy)
+                    XLockDisplay (app->dpy);
 
+                stage_start = xvc_stats_clock ();
                 switch (capfunc) {
 #ifdef HAVE_SHMAT
                 case SHM:
                     captureFrameToImageSHM (app->dpy, image);
                     break;
 #endif     // HAVE_SHMAT
+                case REPLAY:
+                    xvc_capture_log_replay_frame (image, &duplicated);
+                    break;
+                case SYNTH:
+                    xvc_synth_next_frame (&synth_scene);
+                    duplicated = (synth_scene.pattern == XVC_SYNTH_STATIC);
+                    break;
                 case X11:
                 default:
                     captureFrameToImage (app->dpy, image);
                 }
+                xvc_stats_add_stage (XVC_STAGE_GRAB, stage_start);
+                stage_start = xvc_stats_clock ();
                 if (app->mouseWanted > 0) {
+                    if (capfunc == REPLAY || capfunc == SYNTH)
 #ifdef HAVE_LIBXFIXES
-                    if (app->flags & FLG_USE_XFIXES)
+                        getReplayPointer (capfunc, &x_cursor, &pointer_x,
+                                          &pointer_y);
+                    else if (app->flags & FLG_USE_XFIXES)
                         x_cursor = getCurrentPointerImage ();
-                    else
+#else      // HAVE_LIBXFIXES
+                        getReplayPointer (capfunc, &pointer_x, &pointer_y);
 #endif     // HAVE_LIBXFIXES
+                    else
                         getCurrentPointer (&pointer_x, &pointer_y);
                 }
                 // unlock display again
-                XUnlockDisplay (app->dpy);
+                if (app->dpy)
+                    XUnlockDisplay (app->dpy);
+
+#ifdef HAVE_LIBXFIXES
+                logCapturedFrame (image, frame_start, NULL, 0, duplicated,
+                                  x_cursor, pointer_x, pointer_y);
+#else      // HAVE_LIBXFIXES
+                logCapturedFrame (image, frame_start, NULL, 0, duplicated,
+                                  pointer_x, pointer_y);
+#endif     // HAVE_LIBXFIXES
 
                 if (app->mouseWanted > 0) {
 #ifdef USE_XDAMAGE
@@ -1580,6 +2122,7 @@ commonCapture (enum captureFunctions capfunc)
                     paintMousePointer (image, pointer_x, pointer_y);
 #endif     // HAVE_LIBXFIXES
 #endif     // USE_XDAMAGE
+                    xvc_stats_add_stage (XVC_STAGE_CURSOR, stage_start);
                 }
 #if USE_XDAMAGE
             }
@@ -1590,6 +2133,7 @@ commonCapture (enum captureFunctions capfunc)
 
             // call the necessary XtoXYZ function to process the image
             (*job->save) (fp, image);
+            xvc_stats_add_frame (duplicated);
         }
 
         // this again is for recording, no matter if first frame or any
@@ -1601,14 +2145,28 @@ commonCapture (enum captureFunctions capfunc)
                     DEBUGFILE, DEBUGFUNCTION);
 #endif     // DEBUG
 
-            fclose (fp);
+            if (fp)
+                fclose (fp);
+            fp = NULL;
         }
         // substract the time we needed for creating and saving the frame
         // to the file
+        xvc_stats_add_stage (XVC_STAGE_FRAME, frame_start);
+        if (app->dpy)
+            xvc_stats_add_requests (XNextRequest (app->dpy) - req_start);
         gettimeofday (&curr_time, NULL);
         time1 = (curr_time.tv_sec * 1000 + curr_time.tv_usec / 1000) - time;
 
         time = checkCaptureDuration (time, time1);
+        // a replay keeps the timing of the capture log unless it is meant
+        // to run as fast as possible
+        if (capfunc == REPLAY)
+            time = ((app->flags & FLG_MAX_SPEED) ? 0 :
+                    xvc_capture_log_replay_due ());
+        // generated frames keep the frame rate unless they are meant to
+        // measure throughput
+        else if (capfunc == SYNTH && (app->flags & FLG_MAX_SPEED))
+            time = 0;
         // time the next capture
 
 #ifdef DEBUG
@@ -1645,11 +2203,17 @@ commonCapture (enum captureFunctions capfunc)
         time = 0;
         orig_state = job->state;       // store state here, esp. VC_CONTINUE
         job->state = VC_STOP;
+        job->roll_over_requested = FALSE;
+        xvc_stats_stop ();
         // we can allow state or frame changes after this
         pthread_mutex_unlock (&(app->capturing_mutex));
 
         if (full_cleanup) {
-            if (image) {
+            if (capfunc == SYNTH) {
+                // the frame belongs to the scene
+                xvc_synth_free_scene (&synth_scene);
+                image = NULL;
+            } else if (image) {
                 XDestroyImage (image);
                 image = NULL;
             }
@@ -1663,11 +2227,33 @@ commonCapture (enum captureFunctions capfunc)
                 if (dmg_image)
                     XDestroyImage (dmg_image);
             }
+            free (dmg_check.tiles);
+            dmg_check.tiles = NULL;
+            dmg_check.size = 0;
+            dmg_check.pending = FALSE;
 #endif     // USE_XDAMAGE
 
             // clean up the save routines in xtoXXX.c
             if (job->clean)
                 (*job->clean) ();
+
+            // where did the time go?
+            if (app->flags & FLG_RUN_VERBOSE)
+                xvc_stats_print_summary (stdout);
+        }
+        // the save routines have stopped their threads, so the trace is
+        // complete unless we're continuing
+        if ((orig_state & VC_CONTINUE) == 0 && xvc_trace_active) {
+            if (xvc_trace_stop () == 0 && (app->flags & FLG_RUN_VERBOSE))
+                printf ("trace written to %s\n", app->trace_file);
+        }
+        // the same goes for the capture log
+        if ((orig_state & VC_CONTINUE) == 0) {
+            if (xvc_capture_log_recording && xvc_capture_log_stop () == 0 &&
+                (app->flags & FLG_RUN_VERBOSE))
+                printf ("capture log written to %s\n", app->capture_log);
+            if (capfunc == REPLAY)
+                xvc_capture_log_replay_stop ();
         }
         // set the sensitive stuff for the control panel if we don't
         // autocontinue
@@ -1740,6 +2326,34 @@ xvc_capture_shm ()
 
 #endif     /* HAVE_SHMAT */
 
+/**
+ * \brief function used for capturing. This one is used with source =
+ *      replay:file, i. e. when replaying a capture log
+ *
+ * @return the number of msecs in which the next capture is due
+ */
+long
+xvc_capture_replay ()
+{
+#define DEBUGFUNCTION "xvc_capture_replay()"
+    return commonCapture (REPLAY);
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief function used for capturing. This one is used with source =
+ *      synth, i. e. when generating test patterns instead of capturing
+ *
+ * @return the number of msecs in which the next capture is due
+ */
+long
+xvc_capture_synth ()
+{
+#define DEBUGFUNCTION "xvc_capture_synth()"
+    return commonCapture (SYNTH);
+#undef DEBUGFUNCTION
+}
+
 /*
  *
  *
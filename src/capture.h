@@ -44,6 +44,10 @@ enum captureFunctions
     /** \brief X11 with SHM extension */
     SHM,
 #endif     // HAVE_SHMAT
+    /** \brief replay of a capture log */
+    REPLAY,
+    /** \brief test patterns generated in memory */
+    SYNTH,
     /** \brief element counter */
     NUMFUNCTIONS
 };
@@ -52,6 +56,8 @@ enum captureFunctions
  * functions from capture.c
  */
 long xvc_capture_x11 ();
+long xvc_capture_replay ();
+long xvc_capture_synth ();
 
 #ifdef HAVE_SHMAT
 long xvc_capture_shm ();
@@ -0,0 +1,759 @@
+/**
+ * \file capture_log.c
+ *
+ * This file contains the recording and replaying of capture logs. A
+ * capture log keeps what commonCapture () got from the X server for each
+ * frame, i. e. the changed parts of the frame, the mouse pointer and the
+ * time the frame was captured at. Replaying it as capture source feeds
+ * exactly the same input through the mouse pointer painting and the
+ * save functions again, so changes to those can be compared without the
+ * noise of a live desktop.
+ *
+ * The file is written in the byte order of the recording machine:
+ *
+ * - a header of the magic "XVCLOG1\n" followed by 32 bit values for a
+ *   byte order mark, width, height, depth, bits_per_pixel,
+ *   bytes_per_line, byte_order and red, green and blue masks of the frames
+ * - for each frame a 64 bit time stamp in ns since the first frame, 32
+ *   bit flags and the number of rectangles that changed since the last
+ *   frame, each rectangle as 32 bit x, y, width and height followed by its
+ *   pixels without padding
+ * - if flagged, the position of the mouse pointer's hot spot relative to
+ *   the capture area and, if it changed, the pointer image as width,
+ *   height, xhot, yhot and ARGB pixels, all 32 bit
+ *
+ * If the X server reported damaged areas those are logged, otherwise the
+ * lines that differ from the last frame.
+ */
+/*
+ * Copyright (C) 2003-07 Karl H. Beckers, Frankfurt
+ * EMail: khb@jarre-de-the.net
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif     // HAVE_CONFIG_H
+
+#define DEBUGFILE "capture_log.c"
+#endif     // DOXYGEN_SHOULD_SKIP_THIS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+#include "capture_log.h"
+#include "app_data.h"
+#include "pixels.h"
+#include "stats.h"
+#include "xvidcap-intl.h"
+
+/** \brief identifies a capture log and its version */
+#define LOG_MAGIC "XVCLOG1\n"
+
+/** \brief written as is, reads differently on a machine with another byte
+ *      order */
+#define LOG_BYTE_ORDER_MARK 0x01020304
+
+/** \brief the frame is a duplicate of the previous one */
+#define LOG_DUPLICATED 1
+/** \brief the pointer position follows the rectangles */
+#define LOG_POINTER 2
+/** \brief a new pointer image follows the pointer position */
+#define LOG_POINTER_IMAGE 4
+
+/** \brief largest frame dimension accepted when reading a log */
+#define LOG_MAX_SIZE 16384
+
+/**
+ * \brief the header of a capture log
+ */
+typedef struct
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t depth;
+    uint32_t bits_per_pixel;
+    uint32_t bytes_per_line;
+    uint32_t byte_order;
+    uint32_t red_mask;
+    uint32_t green_mask;
+    uint32_t blue_mask;
+} LogHeader;
+
+int xvc_capture_log_recording = FALSE;
+
+/** \brief the log being written */
+static FILE *rec_fp = NULL;
+/** \brief name of the log being written */
+static char *rec_file = NULL;
+/** \brief header of the log being written */
+static LogHeader rec_header;
+/** \brief the frame as last logged, to find the changed lines */
+static char *rec_frame = NULL;
+/** \brief rec_frame holds a frame */
+static int rec_have_frame = FALSE;
+/** \brief space for the changed lines of a frame */
+static XRectangle *rec_bands = NULL;
+/** \brief time stamp of the first frame logged */
+static int64_t rec_start = 0;
+/** \brief serial of the last pointer image logged */
+static unsigned long rec_serial = 0;
+/** \brief a pointer image has been logged */
+static int rec_have_pointer_image = FALSE;
+
+/** \brief the log being replayed */
+static FILE *play_fp = NULL;
+/** \brief header of the log being replayed */
+static LogHeader play_header;
+/** \brief the frame as replayed so far, without the mouse pointer */
+static char *play_frame = NULL;
+/** \brief space to read a rectangle into */
+static char *play_rect = NULL;
+/** \brief the mouse pointer of the last frame replayed */
+static XVC_LogPointer play_pointer;
+/** \brief time stamp of the next frame, if play_have_next */
+static int64_t play_next = 0;
+/** \brief there is another frame to replay */
+static int play_have_next = FALSE;
+/** \brief play_start has been set */
+static int play_started = FALSE;
+/** \brief clock time a frame with time stamp 0 was due */
+static int64_t play_start = 0;
+
+/**
+ * \brief writes a 32 bit value to a capture log
+ *
+ * @param fp the log
+ * @param value the value to write
+ */
+static void
+put_u32 (FILE * fp, uint32_t value)
+{
+    fwrite (&value, sizeof (value), 1, fp);
+}
+
+/**
+ * \brief reads a 32 bit value from a capture log
+ *
+ * @param fp the log
+ * @param value returns the value read
+ * @return TRUE on success, FALSE at the end of the file
+ */
+static int
+get_u32 (FILE * fp, uint32_t * value)
+{
+    return (fread (value, sizeof (*value), 1, fp) == 1);
+}
+
+/**
+ * \brief reads and checks the header of a capture log
+ *
+ * @param fp the log
+ * @param file name of the log for error messages
+ * @param header returns the header
+ * @return 0 on success, -1 if this is no capture log we can read
+ */
+static int
+read_header (FILE * fp, const char *file, LogHeader * header)
+{
+#define DEBUGFUNCTION "read_header()"
+    char magic[sizeof (LOG_MAGIC) - 1];
+    uint32_t bom = 0;
+    int bytes_per_pixel;
+
+    if (fread (magic, sizeof (magic), 1, fp) != 1 ||
+        memcmp (magic, LOG_MAGIC, sizeof (magic)) != 0 ||
+        !get_u32 (fp, &bom) ||
+        fread (header, sizeof (LogHeader), 1, fp) != 1) {
+        fprintf (stderr, _("%s %s: %s is not a capture log\n"),
+                 DEBUGFILE, DEBUGFUNCTION, file);
+        return -1;
+    }
+    if (bom != LOG_BYTE_ORDER_MARK) {
+        fprintf (stderr,
+                 _("%s %s: %s was recorded on a machine with a different "
+                   "byte order\n"), DEBUGFILE, DEBUGFUNCTION, file);
+        return -1;
+    }
+
+    bytes_per_pixel = header->bits_per_pixel >> 3;
+    if (header->width < 1 || header->width > LOG_MAX_SIZE ||
+        header->height < 1 || header->height > LOG_MAX_SIZE ||
+        (header->bits_per_pixel != 8 && header->bits_per_pixel != 16 &&
+         header->bits_per_pixel != 24 && header->bits_per_pixel != 32) ||
+        header->bytes_per_line < header->width * bytes_per_pixel ||
+        header->bytes_per_line > header->width * bytes_per_pixel + 32) {
+        fprintf (stderr, _("%s %s: %s has an invalid frame format\n"),
+                 DEBUGFILE, DEBUGFUNCTION, file);
+        return -1;
+    }
+    return 0;
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief starts writing a capture log
+ *
+ * @param file the name of the log to write
+ * @param image the first frame of the session, giving the frame format
+ * @return 0 on success, -1 on error
+ */
+int
+xvc_capture_log_start (const char *file, const XImage * image)
+{
+#define DEBUGFUNCTION "xvc_capture_log_start()"
+    if (xvc_capture_log_recording)
+        return 0;
+
+    rec_header.width = image->width;
+    rec_header.height = image->height;
+    rec_header.depth = image->depth;
+    rec_header.bits_per_pixel = image->bits_per_pixel;
+    rec_header.bytes_per_line = image->bytes_per_line;
+    rec_header.byte_order = image->byte_order;
+    rec_header.red_mask = image->red_mask;
+    rec_header.green_mask = image->green_mask;
+    rec_header.blue_mask = image->blue_mask;
+
+    rec_frame = (char *) malloc (image->bytes_per_line * image->height);
+    rec_bands = (XRectangle *) malloc (image->height * sizeof (XRectangle));
+    if (!rec_frame || !rec_bands) {
+        fprintf (stderr, _("%s %s: Can't allocate capture log buffers\n"),
+                 DEBUGFILE, DEBUGFUNCTION);
+        goto FAIL;
+    }
+
+    rec_fp = fopen (file, "wb");
+    if (!rec_fp) {
+        fprintf (stderr, _("%s %s: Can't open capture log %s: %s\n"),
+                 DEBUGFILE, DEBUGFUNCTION, file, strerror (errno));
+        goto FAIL;
+    }
+    fwrite (LOG_MAGIC, sizeof (LOG_MAGIC) - 1, 1, rec_fp);
+    put_u32 (rec_fp, LOG_BYTE_ORDER_MARK);
+    fwrite (&rec_header, sizeof (LogHeader), 1, rec_fp);
+
+    rec_file = strdup (file);
+    rec_have_frame = FALSE;
+    rec_have_pointer_image = FALSE;
+    rec_start = 0;
+    xvc_capture_log_recording = TRUE;
+    return 0;
+
+  FAIL:
+    free (rec_frame);
+    free (rec_bands);
+    rec_frame = NULL;
+    rec_bands = NULL;
+    return -1;
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief finds the bands of lines that changed since the last frame logged
+ *
+ * @param image the frame to log
+ * @return the number of bands written to rec_bands
+ */
+static int
+find_changed_lines (const XImage * image)
+{
+    int bytes = image->width * (image->bits_per_pixel >> 3);
+    int y, n = 0;
+
+    if (!rec_have_frame) {
+        rec_bands[0].x = rec_bands[0].y = 0;
+        rec_bands[0].width = image->width;
+        rec_bands[0].height = image->height;
+        return 1;
+    }
+
+    for (y = 0; y < image->height; y++) {
+        if (memcmp (image->data + y * image->bytes_per_line,
+                    rec_frame + y * image->bytes_per_line, bytes) == 0)
+            continue;
+        if (n > 0 && rec_bands[n - 1].y + rec_bands[n - 1].height == y) {
+            rec_bands[n - 1].height++;
+        } else {
+            rec_bands[n].x = 0;
+            rec_bands[n].y = y;
+            rec_bands[n].width = image->width;
+            rec_bands[n].height = 1;
+            n++;
+        }
+    }
+    return n;
+}
+
+/**
+ * \brief clips a rectangle to a frame
+ *
+ * @param image the frame
+ * @param rect the rectangle to clip, changed in place
+ * @return TRUE if anything is left of the rectangle
+ */
+static int
+clip_rect (const XImage * image, XRectangle * rect)
+{
+    int x = (rect->x > 0 ? rect->x : 0);
+    int y = (rect->y > 0 ? rect->y : 0);
+    int right = rect->x + rect->width;
+    int bottom = rect->y + rect->height;
+
+    if (right > image->width)
+        right = image->width;
+    if (bottom > image->height)
+        bottom = image->height;
+    if (right <= x || bottom <= y)
+        return FALSE;
+
+    rect->x = x;
+    rect->y = y;
+    rect->width = right - x;
+    rect->height = bottom - y;
+    return TRUE;
+}
+
+/**
+ * \brief writes a rectangle of a frame to the log and remembers its content
+ *      for finding the changed lines of the next frame
+ *
+ * @param image the frame to log
+ * @param x left edge of the rectangle, clipped to the frame
+ * @param y top edge of the rectangle, clipped to the frame
+ * @param width width of the rectangle, clipped to the frame
+ * @param height height of the rectangle, clipped to the frame
+ */
+static void
+write_rect (const XImage * image, int x, int y, int width, int height)
+{
+    int bytes_per_pixel = image->bits_per_pixel >> 3;
+    int row;
+
+    put_u32 (rec_fp, x);
+    put_u32 (rec_fp, y);
+    put_u32 (rec_fp, width);
+    put_u32 (rec_fp, height);
+    for (row = y; row < y + height; row++) {
+        long offset = row * image->bytes_per_line + x * bytes_per_pixel;
+
+        fwrite (image->data + offset, width * bytes_per_pixel, 1, rec_fp);
+        memcpy (rec_frame + offset, image->data + offset,
+                width * bytes_per_pixel);
+    }
+}
+
+/**
+ * \brief adds a frame to the capture log being written. This needs to be
+ *      called before the mouse pointer is painted into the frame.
+ *
+ * @param image the frame as captured
+ * @param timestamp the time the capture of the frame started at as
+ *      returned by xvc_stats_clock ()
+ * @param rects the areas of the frame that changed relative to the capture
+ *      area, or NULL if not known
+ * @param nrects the number of rects
+ * @param duplicated TRUE if the frame is counted as a duplicate of the
+ *      previous one
+ * @param pointer the mouse pointer, NULL if there is none
+ */
+void
+xvc_capture_log_frame (const XImage * image, int64_t timestamp,
+                       const XRectangle * rects, int nrects, int duplicated,
+                       const XVC_LogPointer * pointer)
+{
+#define DEBUGFUNCTION "xvc_capture_log_frame()"
+    uint32_t flags = 0;
+    int i, n = 0;
+
+    if (!xvc_capture_log_recording)
+        return;
+
+    if (image->width != rec_header.width || image->height != rec_header.height
+        || image->bytes_per_line != rec_header.bytes_per_line) {
+        fprintf (stderr, _("%s %s: frame size changed, stopping the capture "
+                           "log\n"), DEBUGFILE, DEBUGFUNCTION);
+        xvc_capture_log_stop ();
+        return;
+    }
+
+    if (!rec_have_frame)
+        rec_start = timestamp;
+    if (!rects || !rec_have_frame) {
+        rects = rec_bands;
+        nrects = find_changed_lines (image);
+    }
+    // only count what is left after clipping
+    for (i = 0; i < nrects; i++) {
+        XRectangle clipped = rects[i];
+
+        if (clip_rect (image, &clipped))
+            n++;
+    }
+
+    if (duplicated)
+        flags |= LOG_DUPLICATED;
+    if (pointer && pointer->valid) {
+        flags |= LOG_POINTER;
+        if (pointer->pixels && (!rec_have_pointer_image ||
+                                pointer->serial != rec_serial))
+            flags |= LOG_POINTER_IMAGE;
+    }
+
+    timestamp -= rec_start;
+    fwrite (&timestamp, sizeof (timestamp), 1, rec_fp);
+    put_u32 (rec_fp, flags);
+    put_u32 (rec_fp, n);
+
+    for (i = 0; i < nrects; i++) {
+        XRectangle clipped = rects[i];
+
+        if (clip_rect (image, &clipped))
+            write_rect (image, clipped.x, clipped.y, clipped.width,
+                        clipped.height);
+    }
+    rec_have_frame = TRUE;
+
+    if (flags & LOG_POINTER) {
+        put_u32 (rec_fp, pointer->x);
+        put_u32 (rec_fp, pointer->y);
+    }
+    if (flags & LOG_POINTER_IMAGE) {
+        put_u32 (rec_fp, pointer->width);
+        put_u32 (rec_fp, pointer->height);
+        put_u32 (rec_fp, pointer->xhot);
+        put_u32 (rec_fp, pointer->yhot);
+        for (i = 0; i < pointer->width * pointer->height; i++)
+            put_u32 (rec_fp, pointer->pixels[i]);
+        rec_serial = pointer->serial;
+        rec_have_pointer_image = TRUE;
+    }
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief finishes the capture log being written
+ *
+ * @return 0 on success, -1 if the log could not be written completely
+ */
+int
+xvc_capture_log_stop ()
+{
+#define DEBUGFUNCTION "xvc_capture_log_stop()"
+    int ret = 0;
+
+    if (!xvc_capture_log_recording)
+        return 0;
+    xvc_capture_log_recording = FALSE;
+
+    if (ferror (rec_fp) || fclose (rec_fp) != 0) {
+        fprintf (stderr, _("%s %s: Can't write capture log %s: %s\n"),
+                 DEBUGFILE, DEBUGFUNCTION, rec_file, strerror (errno));
+        ret = -1;
+    }
+    rec_fp = NULL;
+    free (rec_file);
+    free (rec_frame);
+    free (rec_bands);
+    rec_file = NULL;
+    rec_frame = NULL;
+    rec_bands = NULL;
+    return ret;
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief checks if a file is a capture log that can be replayed
+ *
+ * @param file the name of the log
+ * @param width returns the width of the frames in the log, may be NULL
+ * @param height returns the height of the frames in the log, may be NULL
+ * @return 0 if the log can be replayed, -1 otherwise
+ */
+int
+xvc_capture_log_probe (const char *file, int *width, int *height)
+{
+#define DEBUGFUNCTION "xvc_capture_log_probe()"
+    FILE *fp;
+    LogHeader header;
+    int ret;
+
+    fp = fopen (file, "rb");
+    if (!fp) {
+        fprintf (stderr, _("%s %s: Can't open capture log %s: %s\n"),
+                 DEBUGFILE, DEBUGFUNCTION, file, strerror (errno));
+        return -1;
+    }
+    ret = read_header (fp, file, &header);
+    fclose (fp);
+
+    if (ret == 0 && width)
+        *width = header.width;
+    if (ret == 0 && height)
+        *height = header.height;
+    return ret;
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief reads the time stamp of the next frame to replay
+ */
+static void
+read_next_timestamp ()
+{
+    play_have_next =
+        (fread (&play_next, sizeof (play_next), 1, play_fp) == 1);
+}
+
+/**
+ * \brief creates an image for replaying a capture log into, opening the log
+ *      if it isn't open already. An open log continues where it was.
+ *
+ * @param file the name of the log
+ * @return the image or NULL on error
+ */
+XImage *
+xvc_capture_log_replay_image (const char *file)
+{
+#define DEBUGFUNCTION "xvc_capture_log_replay_image()"
+    XImage *image;
+    long size;
+
+    if (!play_fp) {
+        play_fp = fopen (file, "rb");
+        if (!play_fp) {
+            fprintf (stderr, _("%s %s: Can't open capture log %s: %s\n"),
+                     DEBUGFILE, DEBUGFUNCTION, file, strerror (errno));
+            return NULL;
+        }
+        if (read_header (play_fp, file, &play_header) < 0) {
+            xvc_capture_log_replay_stop ();
+            return NULL;
+        }
+        size = play_header.bytes_per_line * play_header.height;
+        play_frame = (char *) calloc (1, size);
+        play_rect = (char *) malloc (size);
+        if (!play_frame || !play_rect) {
+            fprintf (stderr, _("%s %s: Can't allocate capture log buffers\n"),
+                     DEBUGFILE, DEBUGFUNCTION);
+            xvc_capture_log_replay_stop ();
+            return NULL;
+        }
+        memset (&play_pointer, 0, sizeof (play_pointer));
+        play_started = FALSE;
+        read_next_timestamp ();
+    }
+
+    image = (XImage *) calloc (1, sizeof (XImage));
+    if (!image)
+        return NULL;
+    image->width = play_header.width;
+    image->height = play_header.height;
+    image->format = ZPixmap;
+    image->byte_order = play_header.byte_order;
+    image->bitmap_unit = 32;
+    image->bitmap_bit_order = play_header.byte_order;
+    image->bitmap_pad = 32;
+    image->depth = play_header.depth;
+    image->bits_per_pixel = play_header.bits_per_pixel;
+    image->bytes_per_line = play_header.bytes_per_line;
+    image->red_mask = play_header.red_mask;
+    image->green_mask = play_header.green_mask;
+    image->blue_mask = play_header.blue_mask;
+    image->data = (char *) malloc (image->bytes_per_line * image->height);
+    if (!image->data || !XInitImage (image)) {
+        free (image->data);
+        free (image);
+        return NULL;
+    }
+    memcpy (image->data, play_frame, image->bytes_per_line * image->height);
+    return image;
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief replays the next frame of the capture log
+ *
+ * @param image the image to replay into as created by
+ *      xvc_capture_log_replay_image ()
+ * @param duplicated returns TRUE if the frame was counted as a duplicate
+ *      when it was recorded
+ * @return TRUE if a frame was replayed, FALSE at the end of the log
+ */
+int
+xvc_capture_log_replay_frame (XImage * image, int *duplicated)
+{
+#define DEBUGFUNCTION "xvc_capture_log_replay_frame()"
+    int bytes_per_pixel = play_header.bits_per_pixel >> 3;
+    uint32_t flags, nrects, i;
+
+    if (!play_fp || !play_have_next)
+        return FALSE;
+    if (!play_started) {
+        play_start = xvc_stats_clock () - play_next;
+        play_started = TRUE;
+    }
+
+    if (!get_u32 (play_fp, &flags) || !get_u32 (play_fp, &nrects))
+        goto TRUNCATED;
+
+    for (i = 0; i < nrects; i++) {
+        uint32_t x, y, width, height;
+
+        if (!get_u32 (play_fp, &x) || !get_u32 (play_fp, &y) ||
+            !get_u32 (play_fp, &width) || !get_u32 (play_fp, &height))
+            goto TRUNCATED;
+        if (x + width > play_header.width || y + height > play_header.height) {
+            fprintf (stderr, _("%s %s: invalid rectangle in capture log\n"),
+                     DEBUGFILE, DEBUGFUNCTION);
+            play_have_next = FALSE;
+            return FALSE;
+        }
+        if (width * height == 0)
+            continue;
+        if (fread (play_rect, width * bytes_per_pixel * height, 1, play_fp)
+            != 1)
+            goto TRUNCATED;
+        xvc_pixels_place_image (play_rect, x, y, width,
+                                width * bytes_per_pixel, height, play_frame,
+                                play_header.width,
+                                play_header.bytes_per_line,
+                                play_header.height, bytes_per_pixel);
+    }
+
+    play_pointer.valid = ((flags & LOG_POINTER) != 0);
+    if (flags & LOG_POINTER) {
+        uint32_t x, y;
+
+        if (!get_u32 (play_fp, &x) || !get_u32 (play_fp, &y))
+            goto TRUNCATED;
+        play_pointer.x = (int32_t) x;
+        play_pointer.y = (int32_t) y;
+    }
+    if (flags & LOG_POINTER_IMAGE) {
+        uint32_t width, height, xhot, yhot, pixel;
+        unsigned long *pixels;
+
+        if (!get_u32 (play_fp, &width) || !get_u32 (play_fp, &height) ||
+            !get_u32 (play_fp, &xhot) || !get_u32 (play_fp, &yhot))
+            goto TRUNCATED;
+        if (width > LOG_MAX_SIZE || height > LOG_MAX_SIZE) {
+            fprintf (stderr, _("%s %s: invalid pointer in capture log\n"),
+                     DEBUGFILE, DEBUGFUNCTION);
+            play_have_next = FALSE;
+            return FALSE;
+        }
+        pixels = (unsigned long *) realloc (play_pointer.pixels,
+                                            (width * height + 1) *
+                                            sizeof (unsigned long));
+        if (!pixels) {
+            fprintf (stderr, _("%s %s: Can't allocate capture log buffers\n"),
+                     DEBUGFILE, DEBUGFUNCTION);
+            play_have_next = FALSE;
+            return FALSE;
+        }
+        play_pointer.pixels = pixels;
+        for (i = 0; i < width * height; i++) {
+            if (!get_u32 (play_fp, &pixel))
+                goto TRUNCATED;
+            pixels[i] = pixel;
+        }
+        play_pointer.width = width;
+        play_pointer.height = height;
+        play_pointer.xhot = xhot;
+        play_pointer.yhot = yhot;
+        play_pointer.serial++;
+    }
+
+    // the whole frame, so the pointer painted into image last time is
+    // gone
+    memcpy (image->data, play_frame, image->bytes_per_line * image->height);
+    *duplicated = ((flags & LOG_DUPLICATED) != 0);
+
+    read_next_timestamp ();
+    return TRUE;
+
+  TRUNCATED:
+    fprintf (stderr, _("%s %s: capture log ends in the middle of a frame\n"),
+             DEBUGFILE, DEBUGFUNCTION);
+    play_have_next = FALSE;
+    return FALSE;
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief gets the mouse pointer of the frame replayed last
+ *
+ * @param pointer returns the pointer, its pixels remain valid until the
+ *      next frame is replayed
+ */
+void
+xvc_capture_log_replay_pointer (XVC_LogPointer * pointer)
+{
+    *pointer = play_pointer;
+}
+
+/**
+ * \brief checks if there are frames left to replay
+ *
+ * @return TRUE if there is another frame in the capture log being replayed
+ */
+int
+xvc_capture_log_replay_pending ()
+{
+    return (play_fp && play_have_next);
+}
+
+/**
+ * \brief calculates when the next frame of the capture log is due to keep
+ *      the timing it was recorded with
+ *
+ * @return the number of msecs in which the next frame is due
+ */
+long
+xvc_capture_log_replay_due ()
+{
+    int64_t due;
+
+    if (!play_have_next || !play_started)
+        return 0;
+
+    due = play_start + play_next - xvc_stats_clock ();
+    return (due > 0 ? (long) (due / 1000000) : 0);
+}
+
+/**
+ * \brief closes the capture log being replayed
+ */
+void
+xvc_capture_log_replay_stop ()
+{
+    if (play_fp)
+        fclose (play_fp);
+    play_fp = NULL;
+    free (play_frame);
+    free (play_rect);
+    free (play_pointer.pixels);
+    play_frame = NULL;
+    play_rect = NULL;
+    memset (&play_pointer, 0, sizeof (play_pointer));
+    play_have_next = FALSE;
+}
@@ -0,0 +1,75 @@
+/**
+ * \file capture_log.h
+ */
+/*
+ * Copyright (C) 2003-07 Karl H. Beckers, Frankfurt
+ * EMail: khb@jarre-de-the.net
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef _xvc_CAPTURE_LOG_H__
+#define _xvc_CAPTURE_LOG_H__
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+#include <sys/types.h>
+#include <inttypes.h>
+#include <X11/Xlib.h>
+#endif     // DOXYGEN_SHOULD_SKIP_THIS
+
+/** \brief prefix of the capture source replaying a capture log, the file
+ *      name follows */
+#define XVC_REPLAY_SOURCE "replay:"
+
+/**
+ * \brief the mouse pointer as logged with a frame
+ */
+typedef struct
+{
+    /** \brief TRUE if the pointer position is known */
+    int valid;
+    /** \brief x position of the hot spot relative to the capture area */
+    int x;
+    /** \brief y position of the hot spot relative to the capture area */
+    int y;
+    /** \brief the pointer image in ARGB, one pixel per long, or NULL for
+     *      the dummy pointer */
+    unsigned long *pixels;
+    int width;
+    int height;
+    int xhot;
+    int yhot;
+    /** \brief changes whenever the pointer image changes */
+    unsigned long serial;
+} XVC_LogPointer;
+
+/** \brief TRUE while a capture log is being written */
+extern int xvc_capture_log_recording;
+
+int xvc_capture_log_start (const char *file, const XImage * image);
+void xvc_capture_log_frame (const XImage * image, int64_t timestamp,
+                            const XRectangle * rects, int nrects,
+                            int duplicated, const XVC_LogPointer * pointer);
+int xvc_capture_log_stop ();
+
+int xvc_capture_log_probe (const char *file, int *width, int *height);
+XImage *xvc_capture_log_replay_image (const char *file);
+int xvc_capture_log_replay_frame (XImage * image, int *duplicated);
+void xvc_capture_log_replay_pointer (XVC_LogPointer * pointer);
+int xvc_capture_log_replay_pending ();
+long xvc_capture_log_replay_due ();
+void xvc_capture_log_replay_stop ();
+
+#endif     // _xvc_CAPTURE_LOG_H__
@@ -316,6 +316,10 @@ static const char *extension_xwd[] = { "xwd" };
 
 #define len_extension_xwd (sizeof(extension_xwd) / sizeof(char*))
 
+static const char *extension_xvs[] = { "xvs" };
+
+#define len_extension_xvs (sizeof(extension_xvs) / sizeof(char*))
+
 #ifdef USE_FFMPEG
 static const char *extension_pgm[] = { "pgm" };
 
@@ -556,7 +560,19 @@ const XVC_FFormat xvc_formats[NUMCAPS] = {
      NULL,
      0,
      extension_xwd,
-     len_extension_xwd}
+     len_extension_xwd},
+    {
+     "xvs",
+     N_("xvidcap Frame Store"),
+     NULL,
+     CODEC_NONE,
+     NULL,
+     0,
+     AU_CODEC_NONE,
+     NULL,
+     0,
+     extension_xvs,
+     len_extension_xvs}
 #ifdef USE_FFMPEG
     , {
        "pgm",
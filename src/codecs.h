@@ -163,6 +163,7 @@ typedef enum
 {
     CAP_NONE,
     CAP_XWD,
+    CAP_XVS,
 #ifdef USE_FFMPEG
     CAP_PGM,
     CAP_PPM,
@@ -243,6 +244,10 @@ extern const XVC_FFormat xvc_formats[NUMCAPS];
 /** \brief compare two XVC_Fps values for a >= 0 */
 #define XVC_FPS_GTE_ZERO(a) ((float) a.num / (float) a.den >= 0 ? 1 : 0 )
 
+/** \brief the video codecs emit one intra frame every this many frames at
+ *      most */
+#define XVC_GOP_SIZE 50
+
 int xvc_trans_codec (XVC_CodecID xv_codec);
 int xvc_is_valid_video_codec (XVC_FFormatID format, XVC_CodecID codec);
 int xvc_is_valid_audio_codec (XVC_FFormatID format, XVC_AuCodecID codec);
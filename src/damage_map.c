@@ -0,0 +1,149 @@
+/**
+ * \file damage_map.c
+ *
+ * This file keeps the areas that changed in the frame just captured, as
+ * reported by Xdamage, so the code saving the frame can look at the tiles
+ * within them only rather than comparing the whole frame with the frame
+ * before.
+ *
+ * The capture thread sets the areas before handing the frame to the save
+ * function, which runs in the same thread.
+ */
+/*
+ * Copyright (C) 2003-07 Karl H. Beckers, Frankfurt
+ * EMail: khb@jarre-de-the.net
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif     // HAVE_CONFIG_H
+
+#define DEBUGFILE "damage_map.c"
+#endif     // DOXYGEN_SHOULD_SKIP_THIS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "damage_map.h"
+#include "app_data.h"
+
+/** \brief number of rectangles allocated at first */
+#define DAMAGE_MAP_CHUNK 64
+
+/** \brief the changed areas relative to the capture area */
+static XRectangle *rects = NULL;
+/** \brief number of changed areas */
+static int nrects = 0;
+/** \brief number of rectangles allocated */
+static int rects_size = 0;
+/** \brief TRUE if rects cover all changes since the frame before */
+static int rects_known = FALSE;
+
+/**
+ * \brief forgets the areas of the last frame
+ *
+ * @param known TRUE if all areas changing in the next frame will be added,
+ *      FALSE if they aren't known and the frame must be compared as a whole
+ */
+void
+xvc_damage_map_clear (int known)
+{
+    nrects = 0;
+    rects_known = known;
+}
+
+/**
+ * \brief adds a changed area of the frame just captured
+ *
+ * @param x left edge relative to the capture area
+ * @param y top edge relative to the capture area
+ * @param width width of the area
+ * @param height height of the area
+ */
+void
+xvc_damage_map_add (int x, int y, int width, int height)
+{
+    XRectangle *r;
+
+    if (!rects_known || width <= 0 || height <= 0)
+        return;
+    if (nrects == rects_size) {
+        r = realloc (rects, sizeof (XRectangle) *
+                     (rects_size ? rects_size * 2 : DAMAGE_MAP_CHUNK));
+        if (!r) {
+            // without the area the changes aren't known any more
+            rects_known = FALSE;
+            return;
+        }
+        rects = r;
+        rects_size = (rects_size ? rects_size * 2 : DAMAGE_MAP_CHUNK);
+    }
+    r = &rects[nrects++];
+    r->x = XVC_MAX (x, 0);
+    r->y = XVC_MAX (y, 0);
+    r->width = XVC_MAX (x + width - r->x, 0);
+    r->height = XVC_MAX (y + height - r->y, 0);
+}
+
+/**
+ * \brief marks the tiles of a frame that lie in the changed areas
+ *
+ * The tiles are tile_bytes of a line wide and tile_lines high, counting
+ * across the frame first like the tiles of a frame store. The tiles at the
+ * right and bottom edges may be cut to the frame.
+ *
+ * @param image the frame captured
+ * @param tile_bytes width of a tile in bytes
+ * @param tile_lines height of a tile in lines
+ * @param tiles one byte per tile, set to 1 for tiles that may have changed
+ *      and 0 for the others
+ * @return the number of tiles that may have changed or -1 if the changes
+ *      aren't known
+ */
+int
+xvc_damage_map_tiles (const XImage * image, int tile_bytes, int tile_lines,
+                      unsigned char *tiles)
+{
+    int Bpp = image->bits_per_pixel >> 3, across, down, i, tx, ty, x_end,
+        y_end, marked = 0;
+
+    if (!rects_known || Bpp < 1)
+        return -1;
+    across = (image->bytes_per_line + tile_bytes - 1) / tile_bytes;
+    down = (image->height + tile_lines - 1) / tile_lines;
+    memset (tiles, 0, across * down);
+
+    for (i = 0; i < nrects; i++) {
+        x_end = XVC_MIN (rects[i].x + rects[i].width, image->width);
+        y_end = XVC_MIN (rects[i].y + rects[i].height, image->height);
+        if (rects[i].x >= x_end || rects[i].y >= y_end)
+            continue;
+        for (ty = rects[i].y / tile_lines; ty <= (y_end - 1) / tile_lines;
+             ty++) {
+            for (tx = rects[i].x * Bpp / tile_bytes;
+                 tx <= (x_end * Bpp - 1) / tile_bytes; tx++) {
+                if (!tiles[ty * across + tx]) {
+                    tiles[ty * across + tx] = 1;
+                    marked++;
+                }
+            }
+        }
+    }
+    return marked;
+}
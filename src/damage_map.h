@@ -0,0 +1,35 @@
+/**
+ * \file damage_map.h
+ */
+/*
+ * Copyright (C) 2003-07 Karl H. Beckers, Frankfurt
+ * EMail: khb@jarre-de-the.net
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef _xvc_DAMAGE_MAP_H__
+#define _xvc_DAMAGE_MAP_H__
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+#include <X11/Xlib.h>
+#endif     // DOXYGEN_SHOULD_SKIP_THIS
+
+void xvc_damage_map_clear (int known);
+void xvc_damage_map_add (int x, int y, int width, int height);
+int xvc_damage_map_tiles (const XImage * image, int tile_bytes,
+                          int tile_lines, unsigned char *tiles);
+
+#endif     // _xvc_DAMAGE_MAP_H__
@@ -31,7 +31,10 @@
 #endif     // HAVE_CONFIG_H
 #endif     // DOXYGEN_SHOULD_SKIP_THIS
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <limits.h>                    // PATH_MAX
 #include <glade/glade.h>
 #include <gtk/gtktoggletoolbutton.h>
 #include <gtk/gtk.h>
@@ -41,10 +44,29 @@
 #include "xvidcap-dbus-glue.h"
 #include "app_data.h"
 #include "control.h"
+#include "stats.h"
+#ifdef USE_FFMPEG
+#include "xtoffmpeg.h"
+#endif     // USE_FFMPEG
 
 extern GtkWidget *xvc_ctrl_main_window;
 extern GtkWidget *xvc_tray_icon_menu;
 
+/** \brief the StatsUpdated signal is emitted at most this often (in ms) */
+#define STATS_SIGNAL_INTERVAL 1000
+
+/**
+ * \brief enumeration of the signals this class emits
+ */
+enum XVC_SERVER_SIGNALS
+{
+    STATS_UPDATED,
+    LAST_SIGNAL
+};
+
+/** \brief ids of the signals this class emits */
+static guint signals[LAST_SIGNAL] = { 0 };
+
 /*
  * forward declarations
  */
@@ -92,6 +114,14 @@ xvc_server_object_class_init (XvcServerObjectClass * klass)
 {
     GError *error = NULL;
 
+    // dbus-glib exports this as StatsUpdated
+    signals[STATS_UPDATED] = g_signal_new ("stats_updated",
+                                           G_OBJECT_CLASS_TYPE (klass),
+                                           G_SIGNAL_RUN_LAST, 0, NULL, NULL,
+                                           g_cclosure_marshal_VOID__BOXED,
+                                           G_TYPE_NONE, 1,
+                                           DBUS_TYPE_G_STRING_VALUE_HASHTABLE);
+
     /* Init the DBus connection, per-klass */
     klass->connection = dbus_g_bus_get (DBUS_BUS_SESSION, &error);
     if (klass->connection == NULL) {
@@ -106,6 +136,32 @@ xvc_server_object_class_init (XvcServerObjectClass * klass)
                                      &dbus_glib_xvc_server_object_info);
 }
 
+/**
+ * \brief emits the StatsUpdated signal if the statistics changed since it
+ *      was last emitted
+ *
+ * This is run every STATS_SIGNAL_INTERVAL ms, so the signal is rate-limited
+ * no matter how many frames are captured.
+ *
+ * @param server a pointer to an instance of this class
+ * @return gboolean TRUE to keep the timeout running
+ */
+static gboolean
+emit_stats_updated (XvcServerObject * server)
+{
+    static unsigned long last_serial = 0;
+    unsigned long serial = xvc_stats_serial ();
+    GHashTable *stats = NULL;
+
+    if (serial != last_serial) {
+        last_serial = serial;
+        xvc_dbus_get_stats (server, &stats, NULL);
+        g_signal_emit (server, signals[STATS_UPDATED], 0, stats);
+        g_hash_table_destroy (stats);
+    }
+    return TRUE;
+}
+
 /**
  * \brief object initializer for this GObject extension class
  *
@@ -138,6 +194,9 @@ xvc_server_object_init (XvcServerObject * server)
         g_error_free (error);
     }
     g_object_unref (driver_proxy);
+
+    g_timeout_add (STATS_SIGNAL_INTERVAL, (GSourceFunc) emit_stats_updated,
+                   server);
 }
 
 /**
@@ -260,3 +319,156 @@ xvc_dbus_pause (XvcServerObject * server, GError ** error)
 
     return TRUE;
 }
+
+/**
+ * \brief implementation of the save replay method for remote execution
+ *      through dbus
+ *
+ * This writes what the replay buffer holds to the next output file while
+ * the capture goes on. It only works when recording with --replay.
+ *
+ * @param server a pointer to an instance of this class
+ * @param filename return pointer for the name of the file written
+ * @param error pointer to a pointer to a GError
+ * @return gboolean
+ */
+gboolean
+xvc_dbus_save_replay (XvcServerObject * server, gchar ** filename,
+                      GError ** error)
+{
+#ifdef USE_FFMPEG
+    char file[PATH_MAX + 1];
+    int ret = xvc_ffmpeg_save_replay (file, sizeof (file));
+
+    switch (ret) {
+    case 0:
+        *filename = g_strdup (file);
+        return TRUE;
+    case ENOENT:
+        g_set_error (error, DBUS_GERROR, DBUS_GERROR_FAILED,
+                     "Not recording in replay mode");
+        break;
+    case ENODATA:
+        g_set_error (error, DBUS_GERROR, DBUS_GERROR_FAILED,
+                     "Nothing recorded for replay, yet");
+        break;
+    case EBUSY:
+        g_set_error (error, DBUS_GERROR, DBUS_GERROR_FAILED,
+                     "The last replay is still being saved");
+        break;
+    default:
+        g_set_error (error, DBUS_GERROR, DBUS_GERROR_FAILED,
+                     "Could not save replay: %s", g_strerror (ret));
+        break;
+    }
+#else
+    g_set_error (error, DBUS_GERROR, DBUS_GERROR_FAILED,
+                 "Replay is not supported by this binary");
+#endif     // USE_FFMPEG
+    return FALSE;
+}
+
+/**
+ * \brief frees a GValue allocated by stats_insert ()
+ *
+ * @param value the GValue to free
+ */
+static void
+stats_free_value (GValue * value)
+{
+    g_value_unset (value);
+    g_free (value);
+}
+
+/**
+ * \brief adds a new entry to the a{sv} dictionary of statistics
+ *
+ * @param stats the dictionary
+ * @param name the key, which is copied
+ * @param type the GType of the value
+ * @return the GValue to set the value with
+ */
+static GValue *
+stats_insert (GHashTable * stats, const char *name, GType type)
+{
+    GValue *value = g_new0 (GValue, 1);
+
+    g_value_init (value, type);
+    g_hash_table_insert (stats, g_strdup (name), value);
+    return value;
+}
+
+/**
+ * \brief implementation of the get stats method for remote execution
+ *      through dbus
+ *
+ * This returns the statistics of the current or, if not recording, the last
+ * capture session as a dictionary. Latencies are in microseconds and
+ * cover the whole session.
+ *
+ * @param server a pointer to an instance of this class
+ * @param stats return pointer for the dictionary of statistics
+ * @param error pointer to a pointer to a GError
+ * @return gboolean
+ */
+gboolean
+xvc_dbus_get_stats (XvcServerObject * server, GHashTable ** stats,
+                    GError ** error)
+{
+    XVC_Stats st;
+    char name[64];
+    int i;
+
+    xvc_stats_get (&st);
+
+    *stats = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                    (GDestroyNotify) stats_free_value);
+    g_value_set_boolean (stats_insert (*stats, "recording", G_TYPE_BOOLEAN),
+                         st.active);
+    g_value_set_double (stats_insert (*stats, "elapsed", G_TYPE_DOUBLE),
+                        st.elapsed);
+    g_value_set_uint64 (stats_insert (*stats, "frames_captured",
+                                      G_TYPE_UINT64), st.frames_captured);
+    g_value_set_uint64 (stats_insert (*stats, "frames_dropped",
+                                      G_TYPE_UINT64), st.frames_dropped);
+    g_value_set_uint64 (stats_insert (*stats, "frames_duplicated",
+                                      G_TYPE_UINT64), st.frames_duplicated);
+    g_value_set_uint64 (stats_insert (*stats, "x_requests", G_TYPE_UINT64),
+                        st.x_requests);
+
+    for (i = 0; i < XVC_STAGE_NUM; i++) {
+        const char *stage = xvc_stats_stage_name (i);
+
+        snprintf (name, sizeof (name), "%s_count", stage);
+        g_value_set_uint64 (stats_insert (*stats, name, G_TYPE_UINT64),
+                            st.stages[i].count);
+        snprintf (name, sizeof (name), "%s_mean_us", stage);
+        g_value_set_int (stats_insert (*stats, name, G_TYPE_INT),
+                         st.stages[i].mean / 1000);
+        snprintf (name, sizeof (name), "%s_p50_us", stage);
+        g_value_set_int (stats_insert (*stats, name, G_TYPE_INT),
+                         st.stages[i].p50 / 1000);
+        snprintf (name, sizeof (name), "%s_p90_us", stage);
+        g_value_set_int (stats_insert (*stats, name, G_TYPE_INT),
+                         st.stages[i].p90 / 1000);
+        snprintf (name, sizeof (name), "%s_p99_us", stage);
+        g_value_set_int (stats_insert (*stats, name, G_TYPE_INT),
+                         st.stages[i].p99 / 1000);
+        snprintf (name, sizeof (name), "%s_max_us", stage);
+        g_value_set_int (stats_insert (*stats, name, G_TYPE_INT),
+                         st.stages[i].max / 1000);
+    }
+
+    g_value_set_int (stats_insert (*stats, "audio_queue_ms", G_TYPE_INT),
+                     st.audio_queue_ms);
+    g_value_set_uint64 (stats_insert (*stats, "audio_overruns",
+                                      G_TYPE_UINT64), st.audio_overruns);
+    g_value_set_int64 (stats_insert (*stats, "replay_bytes", G_TYPE_INT64),
+                       st.replay_bytes);
+    g_value_set_double (stats_insert (*stats, "av_drift_ms", G_TYPE_DOUBLE),
+                        st.av_drift);
+    g_value_set_double (stats_insert (*stats, "bitrate", G_TYPE_DOUBLE),
+                        st.bitrate);
+
+    return TRUE;
+}
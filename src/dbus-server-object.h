@@ -34,6 +34,10 @@ extern "C"
     gboolean xvc_dbus_stop (XvcServerObject * server, GError ** error);
     gboolean xvc_dbus_start (XvcServerObject * server, GError ** error);
     gboolean xvc_dbus_pause (XvcServerObject * server, GError ** error);
+    gboolean xvc_dbus_save_replay (XvcServerObject * server,
+                                   gchar ** filename, GError ** error);
+    gboolean xvc_dbus_get_stats (XvcServerObject * server,
+                                 GHashTable ** stats, GError ** error);
 
 /*
  * macros
@@ -0,0 +1,1569 @@
+/**
+ * \file frame_store.c
+ *
+ * This file contains the xvs frame store. Rather than one file per frame,
+ * single-frame capture to a file ending in .xvs appends all frames to one
+ * file and writes an index of the frames when recording stops. The file
+ * is written in the byte order of the recording machine:
+ *
+ * - an XVC_StoreHeader with the magic "XVCSTOR1", a byte order mark and
+ *   the layout of the frames, followed by the color table as XWDColor
+ * - for each frame an XVC_StoreRecord with format, size, number,
+ *   dimensions and time stamp, followed by either the whole frame or, for
+ *   XVC_STORE_DELTA, the bands of lines that changed since the frame
+ *   before, each as 32 bit first line and number of lines followed by the
+ *   lines, or for XVC_STORE_TILES the tiles that changed, each as 32 bit
+ *   tile number followed by the tile's lines; with XVC_STORE_DEFLATE the
+ *   data is compressed with zlib
+ * - padding to 8 bytes and an XVC_StoreIndexEntry for each frame, the
+ *   header's frames and index_offset are set once the index is written
+ *
+ * If xvidcap didn't get to write the index, reading the store rebuilds it
+ * from the frames. With FLG_MMAP_WRITE set, the frames are copied into
+ * a mapping of the store rather than written, with FLG_ASYNC_WRITE set
+ * they are written through async_io.c. The export mode writes selected
+ * frames of a store to xwd or png files from a thread per CPU, the
+ * transcode mode encodes all frames to any other capture target.
+ */
+/*
+ * Copyright (C) 2003-07 Karl H. Beckers, Frankfurt
+ * EMail: khb@jarre-de-the.net
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif     // HAVE_CONFIG_H
+
+#define DEBUGFILE "frame_store.c"
+#endif     // DOXYGEN_SHOULD_SKIP_THIS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif     // HAVE_LIBZ
+
+#include "frame_store.h"
+#include "mmap_writer.h"
+#include "async_io.h"
+#include "write_behind.h"
+#include "app_data.h"
+#include "codecs.h"
+#include "colors.h"
+#include "damage_map.h"
+#include "job.h"
+#include "stats.h"
+#include "trace.h"
+#include "xvidcap-intl.h"
+#ifdef USE_FFMPEG
+# include "xtoffmpeg.h"
+#endif     // USE_FFMPEG
+
+/** \brief the magic at the start of a frame store */
+#define STORE_MAGIC "XVCSTOR1"
+/** \brief written in native byte order to detect foreign stores */
+#define STORE_BYTE_ORDER_MARK 0x01020304
+/** \brief number of index entries allocated at first */
+#define STORE_INDEX_CHUNK 256
+/** \brief maximum number of threads exporting frames */
+#define EXPORT_MAX_THREADS 8
+
+/*
+ * the store being recorded to
+ */
+/** \brief file descriptor of the store or -1 if none is open */
+static int store_fd = -1;
+/** \brief name of the store for error messages */
+static char store_path[PATH_MAX + 1];
+/** \brief header written at the start of the store */
+static XVC_StoreHeader store_head;
+/** \brief index of the frames written so far */
+static XVC_StoreIndexEntry *store_index = NULL;
+static int store_index_size = 0;
+/** \brief file offset to write the next frame to */
+static uint64_t store_offset = 0;
+/** \brief the frame before, to compare with for XVC_STORE_DELTA */
+static char *prev_frame = NULL;
+/** \brief the changed lines or tiles of the current frame */
+static char *delta_buf = NULL;
+/** \brief TRUE if FLG_STORE_COMPRESS was set when the store was started */
+static int store_compress = FALSE;
+/** \brief one byte per tile, marking the tiles the capture reported as
+ *      changed in the current frame */
+static unsigned char *damage_tiles = NULL;
+/** \brief the current frame compressed, if that isn't done in the
+ *      mapping */
+static char *zip_buf = NULL;
+/** \brief writes the frames if FLG_MMAP_WRITE is set */
+static XVC_MmapWriter *store_writer = NULL;
+/** \brief the store if FLG_ASYNC_WRITE is set, store_fd is -1 then */
+static XVC_AioFile *store_aio = NULL;
+/** \brief time the first frame was saved at */
+static int64_t store_start = 0;
+
+/**
+ * \brief writes all of a number of buffers, continuing where writev ()
+ *      stopped if it returns early
+ *
+ * @param fd the file descriptor to write to
+ * @param iov the buffers, modified while writing
+ * @param iovcnt number of buffers
+ * @param file name of the file for error messages
+ * @return 0 on success or -1 on error
+ */
+static int
+write_all (int fd, struct iovec *iov, int iovcnt, const char *file)
+{
+    ssize_t n;
+
+    while (iovcnt > 0) {
+        n = writev (fd, iov, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror (file);
+            return -1;
+        }
+        while (iovcnt > 0 && n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *) iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+/**
+ * \brief appends to the store being recorded to at store_offset
+ *
+ * @param iov the buffers to write, modified while writing
+ * @param iovcnt number of buffers
+ * @return 0 on success or -1 on error
+ */
+static int
+store_write (struct iovec *iov, int iovcnt)
+{
+    size_t len = 0;
+    int i;
+
+    if (!store_aio) {
+        for (i = 0; i < iovcnt; i++)
+            len += iov[i].iov_len;
+        if (write_all (store_fd, iov, iovcnt, store_path) < 0)
+            return -1;
+        xvc_wb_add (store_fd, store_offset, len);
+        return 0;
+    }
+    for (i = 0; i < iovcnt; i++) {
+        if (xvc_aio_write (store_aio, iov[i].iov_base, iov[i].iov_len) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/**
+ * \brief opens the store and writes the header and color table
+ *
+ * @param image the first frame
+ * @return 0 on success or -1 on error
+ */
+static int
+start_store (const XImage * image)
+{
+#define DEBUGFUNCTION "start_store()"
+    Job *job = xvc_job_ptr ();
+    XVC_AppData *app = xvc_appdata_ptr ();
+    struct iovec iov[2];
+    int ncolors = (job->color_table ? job->ncolors : 0);
+    size_t frame_size = image->bytes_per_line * image->height;
+    int mmap_write = (app->flags & FLG_MMAP_WRITE), need_delta, need_zip;
+
+    snprintf (store_path, sizeof (store_path), job->file, job->pic_no);
+    if (app->flags & FLG_ASYNC_WRITE && !(app->flags & FLG_MMAP_WRITE))
+        store_aio = xvc_aio_open (store_path);
+    else
+        store_fd = open (store_path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (store_fd < 0 && !store_aio) {
+        fprintf (stderr, _("%s %s: Can't open %s: %s\n"), DEBUGFILE,
+                 DEBUGFUNCTION, store_path, strerror (errno));
+        return -1;
+    }
+
+    memset (&store_head, 0, sizeof (store_head));
+    memcpy (store_head.magic, STORE_MAGIC, sizeof (store_head.magic));
+    store_head.byte_order_mark = STORE_BYTE_ORDER_MARK;
+    store_head.width = image->width;
+    store_head.height = image->height;
+    store_head.depth = image->depth;
+    store_head.bits_per_pixel = image->bits_per_pixel;
+    store_head.bytes_per_line = image->bytes_per_line;
+    store_head.image_byte_order = image->byte_order;
+    store_head.bitmap_unit = image->bitmap_unit;
+    store_head.bitmap_bit_order = image->bitmap_bit_order;
+    store_head.bitmap_pad = image->bitmap_pad;
+    store_head.red_mask = image->red_mask;
+    store_head.green_mask = image->green_mask;
+    store_head.blue_mask = image->blue_mask;
+    store_head.ncolors = ncolors;
+    store_head.key_interval = (app->store_delta > 0 ? app->store_delta : 1);
+
+    // the color table is byte swapped by xvc_xwd_get_color_table ()
+    iov[0].iov_base = &store_head;
+    iov[0].iov_len = sizeof (store_head);
+    iov[1].iov_base = job->color_table;
+    iov[1].iov_len = sizeof (XWDColor) * ncolors;
+    store_offset = 0;
+    if (store_write (iov, 2) < 0)
+        goto FAIL;
+    store_offset = sizeof (store_head) + sizeof (XWDColor) * ncolors;
+
+    store_compress = ((app->flags & FLG_STORE_COMPRESS) != 0);
+    // with a mapping the changes are collected right where they go,
+    // unless they are compressed to there
+    need_delta = (store_head.key_interval > 1 &&
+                  (!mmap_write || store_compress));
+#ifdef HAVE_LIBZ
+    need_zip = (store_compress && !mmap_write);
+#else
+    need_zip = FALSE;
+#endif     // HAVE_LIBZ
+
+    store_index_size = STORE_INDEX_CHUNK;
+    store_index = malloc (sizeof (XVC_StoreIndexEntry) * store_index_size);
+    if (store_head.key_interval > 1)
+        prev_frame = malloc (frame_size);
+    if (need_delta)
+        delta_buf = malloc (frame_size);
+    if (need_zip)
+        zip_buf = malloc (frame_size);
+    // without it the tiles are found by comparing the whole frame
+    if (store_compress && store_head.key_interval > 1)
+        damage_tiles = malloc (((image->bytes_per_line +
+                                 XVC_STORE_TILE_BYTES - 1) /
+                                XVC_STORE_TILE_BYTES) *
+                               ((image->height + XVC_STORE_TILE_LINES - 1) /
+                                XVC_STORE_TILE_LINES));
+    if (mmap_write)
+        store_writer = xvc_mmap_writer_start (store_fd, store_path,
+                                              store_offset, 0);
+    if (!store_index || (store_head.key_interval > 1 && !prev_frame) ||
+        (need_delta && !delta_buf) || (need_zip && !zip_buf) ||
+        (mmap_write && !store_writer)) {
+        fprintf (stderr, _("%s %s: Can't allocate the index for %s\n"),
+                 DEBUGFILE, DEBUGFUNCTION, store_path);
+        goto FAIL;
+    }
+    store_start = xvc_stats_clock ();
+    return 0;
+
+  FAIL:
+    xvc_frame_store_clean ();
+    return -1;
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief collects the bands of lines that differ from the frame before
+ *
+ * @param image the current frame
+ * @param out where to put the bands, room for the whole frame
+ * @return the number of bytes in out or -1 if they would be more than the
+ *      whole frame
+ */
+static long
+encode_delta (const XImage * image, char *out)
+{
+    int bpl = image->bytes_per_line, y = 0, lines;
+    long size = 0, frame_size = (long) bpl * image->height;
+    uint32_t band[2];
+
+    while (y < image->height) {
+        if (memcmp (prev_frame + y * bpl, image->data + y * bpl, bpl) == 0) {
+            y++;
+            continue;
+        }
+        for (lines = 1; y + lines < image->height &&
+             memcmp (prev_frame + (y + lines) * bpl,
+                     image->data + (y + lines) * bpl, bpl) != 0; lines++);
+        if (size + sizeof (band) + (long) lines * bpl >= frame_size)
+            return -1;
+        band[0] = y;
+        band[1] = lines;
+        memcpy (out + size, band, sizeof (band));
+        memcpy (out + size + sizeof (band), image->data + y * bpl,
+                lines * bpl);
+        size += sizeof (band) + lines * bpl;
+        y += lines;
+    }
+    return size;
+}
+
+/**
+ * \brief collects the tiles that differ from the frame before
+ *
+ * Each tile is stored as its 32 bit number, counting across the frame
+ * first, followed by its lines. The tiles at the right and bottom edges
+ * are cut to the frame.
+ *
+ * If the capture reported the changed areas, only the tiles within them
+ * are compared, so the cost follows the changed area rather than the frame
+ * size, and the tiles that changed are copied to the frame before right
+ * away.
+ *
+ * @param image the current frame
+ * @param damaged the tiles that may have changed as marked by
+ *      xvc_damage_map_tiles () or NULL to compare all tiles
+ * @param out where to put the tiles, room for the whole frame
+ * @return the number of bytes in out or -1 if they would be more than the
+ *      whole frame
+ */
+static long
+encode_tiles (const XImage * image, const unsigned char *damaged, char *out)
+{
+    int bpl = image->bytes_per_line, across, tx, ty, x, y, y0, y_end, w;
+    long size = 0, frame_size = (long) bpl * image->height;
+    uint32_t number;
+
+    across = (bpl + XVC_STORE_TILE_BYTES - 1) / XVC_STORE_TILE_BYTES;
+    for (ty = 0; ty * XVC_STORE_TILE_LINES < image->height; ty++) {
+        y0 = ty * XVC_STORE_TILE_LINES;
+        y_end = XVC_MIN (y0 + XVC_STORE_TILE_LINES, image->height);
+        // most rows of tiles don't change at all
+        if (!damaged) {
+            for (y = y0; y < y_end && memcmp (prev_frame + y * bpl,
+                                              image->data + y * bpl,
+                                              bpl) == 0; y++);
+            if (y == y_end)
+                continue;
+        }
+
+        for (tx = 0; tx < across; tx++) {
+            if (damaged && !damaged[ty * across + tx])
+                continue;
+            x = tx * XVC_STORE_TILE_BYTES;
+            w = XVC_MIN (XVC_STORE_TILE_BYTES, bpl - x);
+            for (y = y0; y < y_end && memcmp (prev_frame + y * bpl + x,
+                                              image->data + y * bpl + x,
+                                              w) == 0; y++);
+            if (y == y_end)
+                continue;
+            if (size + sizeof (number) + (long) w * (y_end - y0) >=
+                frame_size)
+                return -1;
+            number = ty * across + tx;
+            memcpy (out + size, &number, sizeof (number));
+            size += sizeof (number);
+            for (y = y0; y < y_end; y++) {
+                memcpy (out + size, image->data + y * bpl + x, w);
+                if (damaged)
+                    memcpy (prev_frame + y * bpl + x, out + size, w);
+                size += w;
+            }
+        }
+    }
+    return size;
+}
+
+/**
+ * \brief appends a frame to the store
+ *
+ * Every key_interval frames the whole frame is stored, the frames in
+ * between as the lines that changed, unless those make up the whole frame.
+ * With FLG_STORE_COMPRESS set, the tiles that changed are stored instead
+ * of the lines, and frames are compressed with zlib at its fastest level
+ * if that makes them smaller.
+ *
+ * @param fp file handle, not used, the store is opened here
+ * @param image the captured XImage to save
+ */
+void
+xvc_frame_store_save_frame (FILE * fp, XImage * image)
+{
+#define DEBUGFUNCTION "xvc_frame_store_save_frame()"
+    Job *job = xvc_job_ptr ();
+    XVC_StoreIndexEntry *entry;
+    struct iovec iov[2];
+    char *out = delta_buf, *enc, *data;
+    long size = -1, frame_size = image->bytes_per_line * image->height;
+    int64_t start = xvc_stats_clock ();
+    const unsigned char *damaged = NULL;
+    int n, prev_current = FALSE;
+
+    if (job->state & VC_START) {
+        xvc_frame_store_clean ();
+        if (start_store (image) < 0)
+            return;
+    }
+    if (store_fd < 0 && !store_aio)
+        return;
+
+    n = store_head.frames;
+    if (n == store_index_size) {
+        entry = realloc (store_index, sizeof (XVC_StoreIndexEntry) *
+                         store_index_size * 2);
+        if (!entry) {
+            fprintf (stderr, _("%s %s: Can't allocate the index for %s\n"),
+                     DEBUGFILE, DEBUGFUNCTION, store_path);
+            return;
+        }
+        store_index = entry;
+        store_index_size *= 2;
+    }
+    entry = &store_index[n];
+    if (store_writer) {
+        out = xvc_mmap_writer_reserve (store_writer,
+                                       sizeof (XVC_StoreRecord) + frame_size);
+        if (!out)
+            return;
+        out += sizeof (XVC_StoreRecord);
+    }
+
+    // frames to be compressed are collected apart and compressed to out
+    enc = (store_compress ? delta_buf : out);
+    if (prev_frame && (n % store_head.key_interval) != 0) {
+        if (damage_tiles &&
+            xvc_damage_map_tiles (image, XVC_STORE_TILE_BYTES,
+                                  XVC_STORE_TILE_LINES, damage_tiles) >= 0)
+            damaged = damage_tiles;
+        size = (store_compress ? encode_tiles (image, damaged, enc) :
+                encode_delta (image, enc));
+        // the tiles that changed have been copied to the frame before
+        prev_current = (damaged && size >= 0);
+    }
+    if (size >= 0) {
+        entry->record.format = (store_compress ? XVC_STORE_TILES :
+                                XVC_STORE_DELTA);
+        data = enc;
+    } else {
+        size = frame_size;
+        entry->record.format = XVC_STORE_RAW;
+        data = image->data;
+    }
+#ifdef HAVE_LIBZ
+    if (store_compress) {
+        char *zip = (store_writer ? out : zip_buf);
+        uLongf zip_size = size;
+
+        // compress2 () fails if the result doesn't fit into size bytes
+        if (compress2 ((Bytef *) zip, &zip_size, (Bytef *) data, size,
+                       Z_BEST_SPEED) == Z_OK && zip_size < size) {
+            entry->record.format |= XVC_STORE_DEFLATE;
+            data = zip;
+            size = zip_size;
+        }
+    }
+#endif     // HAVE_LIBZ
+    if (store_writer && data != out)
+        memcpy (out, data, size);
+    iov[1].iov_base = data;
+    if (prev_frame && !prev_current)
+        memcpy (prev_frame, image->data, frame_size);
+
+    entry->offset = store_offset;
+    entry->record.size = size;
+    entry->record.number = job->pic_no;
+    entry->record.width = image->width;
+    entry->record.height = image->height;
+    entry->record.timestamp = start - store_start;
+
+    if (store_writer) {
+        memcpy (out - sizeof (XVC_StoreRecord), &entry->record,
+                sizeof (XVC_StoreRecord));
+        xvc_mmap_writer_commit (store_writer, sizeof (XVC_StoreRecord) +
+                                size);
+    } else {
+        iov[0].iov_base = &entry->record;
+        iov[0].iov_len = sizeof (XVC_StoreRecord);
+        iov[1].iov_len = size;
+        if (store_write (iov, 2) < 0)
+            return;
+    }
+    store_offset += sizeof (XVC_StoreRecord) + size;
+    store_head.frames++;
+    xvc_stats_add_stage (XVC_STAGE_MUX, start);
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief writes the index, completes the header and closes the store
+ */
+void
+xvc_frame_store_clean ()
+{
+    static const char padding[8] = { 0 };
+    struct iovec iov[2];
+    int ok;
+
+    // the index is written after the frames in the mapping
+    if (store_writer &&
+        (xvc_mmap_writer_finish (store_writer) < 0 ||
+         lseek (store_fd, store_offset, SEEK_SET) < 0)) {
+        free (store_index);
+        store_index = NULL;
+    }
+    store_writer = NULL;
+    if ((store_fd >= 0 || store_aio) && store_index) {
+        // the index is aligned so it can be used where it is mapped
+        iov[0].iov_base = (void *) padding;
+        iov[0].iov_len = (8 - store_offset % 8) % 8;
+        iov[1].iov_base = store_index;
+        iov[1].iov_len = sizeof (XVC_StoreIndexEntry) * store_head.frames;
+        store_head.index_offset = store_offset + iov[0].iov_len;
+        ok = (store_write (iov, 2) == 0);
+        if (ok && store_aio) {
+            if (xvc_aio_seek (store_aio, 0, SEEK_SET) < 0 ||
+                xvc_aio_write (store_aio, &store_head,
+                               sizeof (store_head)) < 0)
+                fprintf (stderr, "%s: can't write the header\n", store_path);
+        } else if (ok && pwrite (store_fd, &store_head, sizeof (store_head),
+                                 0) != sizeof (store_head)) {
+            perror (store_path);
+        }
+    }
+    if (store_fd >= 0 && xvc_wb_close (store_fd, store_path) < 0)
+        perror (store_path);
+    store_fd = -1;
+    if (store_aio) {
+        xvc_aio_close (store_aio);
+        xvc_aio_drain ();
+    }
+    xvc_wb_drain ();
+    store_aio = NULL;
+
+    if (store_index)
+        free (store_index);
+    store_index = NULL;
+    if (prev_frame)
+        free (prev_frame);
+    prev_frame = NULL;
+    if (delta_buf)
+        free (delta_buf);
+    delta_buf = NULL;
+    if (zip_buf)
+        free (zip_buf);
+    zip_buf = NULL;
+    if (damage_tiles)
+        free (damage_tiles);
+    damage_tiles = NULL;
+}
+
+/**
+ * \brief rebuilds the index of a store that wasn't closed from the frames
+ *      that were written completely
+ *
+ * @param store the store mapped
+ * @return 0 on success or -1 if no memory could be allocated
+ */
+static int
+rebuild_index (XVC_FrameStore * store)
+{
+    const XVC_StoreHeader *h = store->header;
+    XVC_StoreIndexEntry *index = NULL, *tmp;
+    XVC_StoreRecord rec;
+    size_t offset, frame_size = h->bytes_per_line * h->height;
+    int size = 0, n = 0;
+
+    offset = sizeof (XVC_StoreHeader) + sizeof (XWDColor) * h->ncolors;
+    while (offset + sizeof (rec) <= store->size) {
+        memcpy (&rec, store->map + offset, sizeof (rec));
+        if ((rec.format & ~XVC_STORE_DEFLATE) > XVC_STORE_TILES ||
+            rec.size > frame_size || rec.width != h->width ||
+            rec.height != h->height ||
+            offset + sizeof (rec) + rec.size > store->size)
+            break;
+        if (n == size) {
+            size = (size ? size * 2 : STORE_INDEX_CHUNK);
+            tmp = realloc (index, sizeof (XVC_StoreIndexEntry) * size);
+            if (!tmp) {
+                free (index);
+                return -1;
+            }
+            index = tmp;
+        }
+        index[n].offset = offset;
+        index[n].record = rec;
+        n++;
+        offset += sizeof (rec) + rec.size;
+    }
+    store->index = index;
+    store->own_index = TRUE;
+    store->frames = n;
+    return 0;
+}
+
+/**
+ * \brief maps a frame store for reading
+ *
+ * @param file the name of the store
+ * @return the store or NULL on error
+ */
+XVC_FrameStore *
+xvc_frame_store_open (const char *file)
+{
+#define DEBUGFUNCTION "xvc_frame_store_open()"
+    XVC_FrameStore *store = NULL;
+    const XVC_StoreHeader *h;
+    struct stat st;
+    int fd;
+
+    fd = open (file, O_RDONLY);
+    if (fd < 0 || fstat (fd, &st) < 0) {
+        fprintf (stderr, _("%s %s: Can't open %s: %s\n"), DEBUGFILE,
+                 DEBUGFUNCTION, file, strerror (errno));
+        goto FAIL;
+    }
+    store = calloc (1, sizeof (XVC_FrameStore));
+    if (!store)
+        goto FAIL;
+    store->size = st.st_size;
+    if (store->size < sizeof (XVC_StoreHeader))
+        goto INVALID;
+    store->map = mmap (NULL, store->size, PROT_READ, MAP_SHARED, fd, 0);
+    if (store->map == MAP_FAILED) {
+        store->map = NULL;
+        fprintf (stderr, _("%s %s: Can't map %s: %s\n"), DEBUGFILE,
+                 DEBUGFUNCTION, file, strerror (errno));
+        goto FAIL;
+    }
+    close (fd);
+    fd = -1;
+
+    h = store->header = (const XVC_StoreHeader *) store->map;
+    if (memcmp (h->magic, STORE_MAGIC, sizeof (h->magic)) != 0 ||
+        h->byte_order_mark != STORE_BYTE_ORDER_MARK || h->width == 0 ||
+        h->height == 0 || h->bytes_per_line < h->width ||
+        h->key_interval == 0 || sizeof (XVC_StoreHeader) +
+        sizeof (XWDColor) * (uint64_t) h->ncolors > store->size)
+        goto INVALID;
+    store->colors = (const XWDColor *) (store->map + sizeof (XVC_StoreHeader));
+
+    if (h->index_offset > 0 && h->index_offset % 8 == 0 &&
+        h->index_offset + sizeof (XVC_StoreIndexEntry) *
+        (uint64_t) h->frames <= store->size) {
+        store->index =
+            (const XVC_StoreIndexEntry *) (store->map + h->index_offset);
+        store->frames = h->frames;
+    } else if (rebuild_index (store) < 0) {
+        goto FAIL;
+    }
+    return store;
+
+  INVALID:
+    fprintf (stderr, _("%s %s: %s is not a frame store\n"), DEBUGFILE,
+             DEBUGFUNCTION, file);
+  FAIL:
+    if (fd >= 0)
+        close (fd);
+    xvc_frame_store_close (store);
+    return NULL;
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief copies the tiles of an XVC_STORE_TILES frame to the frame before
+ *
+ * @param h the header of the store
+ * @param p the tiles
+ * @param size number of bytes of tiles
+ * @param data the frame before, updated
+ * @return 0 on success or -1 if the frame is damaged
+ */
+static int
+apply_tiles (const XVC_StoreHeader * h, const unsigned char *p, size_t size,
+             char *data)
+{
+    size_t pos = 0, bpl = h->bytes_per_line, x, w;
+    uint32_t number, across, y, y0, y_end;
+
+    across = (bpl + XVC_STORE_TILE_BYTES - 1) / XVC_STORE_TILE_BYTES;
+    while (pos + sizeof (number) <= size) {
+        memcpy (&number, p + pos, sizeof (number));
+        pos += sizeof (number);
+        x = (number % across) * XVC_STORE_TILE_BYTES;
+        w = XVC_MIN (XVC_STORE_TILE_BYTES, bpl - x);
+        y0 = (number / across) * XVC_STORE_TILE_LINES;
+        if (y0 >= h->height)
+            return -1;
+        y_end = XVC_MIN (y0 + XVC_STORE_TILE_LINES, h->height);
+        if (pos + w * (y_end - y0) > size)
+            return -1;
+        for (y = y0; y < y_end; y++) {
+            memcpy (data + y * bpl + x, p + pos, w);
+            pos += w;
+        }
+    }
+    return (pos == size ? 0 : -1);
+}
+
+/**
+ * \brief applies one frame of a store to the frame before
+ *
+ * @param store the store
+ * @param n the number of the frame in the store
+ * @param data the frame before, updated to frame n
+ * @param scratch a buffer of a whole frame to uncompress frames to,
+ *      allocated when first needed
+ * @return 0 on success or -1 if the frame is damaged
+ */
+static int
+apply_frame (const XVC_FrameStore * store, int n, char *data, char **scratch)
+{
+    const XVC_StoreIndexEntry *e = &store->index[n];
+    const unsigned char *p;
+    size_t pos = 0, size = e->record.size, bpl = store->header->bytes_per_line;
+    size_t frame_size = bpl * store->header->height;
+    uint32_t band[2], format = e->record.format;
+
+    if (e->offset + sizeof (XVC_StoreRecord) + size > store->size)
+        return -1;
+    p = store->map + e->offset + sizeof (XVC_StoreRecord);
+
+    if (format & XVC_STORE_DEFLATE) {
+#ifdef HAVE_LIBZ
+        uLongf len = frame_size;
+
+        if (!*scratch)
+            *scratch = malloc (frame_size);
+        if (!*scratch || uncompress ((Bytef *) * scratch, &len, p,
+                                     size) != Z_OK)
+            return -1;
+        p = (const unsigned char *) *scratch;
+        size = len;
+        format &= ~XVC_STORE_DEFLATE;
+#else
+        // can't be read without zlib
+        return -1;
+#endif     // HAVE_LIBZ
+    }
+
+    if (format == XVC_STORE_RAW) {
+        if (size != frame_size)
+            return -1;
+        memcpy (data, p, size);
+        return 0;
+    }
+    if (format == XVC_STORE_TILES)
+        return apply_tiles (store->header, p, size, data);
+    while (pos + sizeof (band) <= size) {
+        memcpy (band, p + pos, sizeof (band));
+        pos += sizeof (band);
+        if (band[0] + (uint64_t) band[1] > store->header->height ||
+            pos + band[1] * bpl > size)
+            return -1;
+        memcpy (data + band[0] * bpl, p + pos, band[1] * bpl);
+        pos += band[1] * bpl;
+    }
+    return (pos == size ? 0 : -1);
+}
+
+/**
+ * \brief reads a frame from a store
+ *
+ * Frames stored as changes are built from the last full frame before
+ * them, or from the frame already in data if that is closer.
+ *
+ * @param store the store
+ * @param n the number of the frame in the store, starting with 0
+ * @param data bytes_per_line * height bytes to read the frame to
+ * @param current the number of the frame in data or -1, set to n
+ * @return 0 on success or -1 if the frame can't be read
+ */
+int
+xvc_frame_store_read_frame (const XVC_FrameStore * store, int n, char *data,
+                            int *current)
+{
+    char *scratch = NULL;
+    int key, i, ret = 0;
+
+    if (n < 0 || n >= store->frames)
+        return -1;
+    for (key = n; key > 0 && (store->index[key].record.format &
+                              ~XVC_STORE_DEFLATE) != XVC_STORE_RAW; key--);
+    if ((store->index[key].record.format & ~XVC_STORE_DEFLATE) !=
+        XVC_STORE_RAW)
+        return -1;
+
+    i = (*current >= key && *current <= n ? *current + 1 : key);
+    *current = -1;
+    for (; i <= n && ret == 0; i++)
+        ret = apply_frame (store, i, data, &scratch);
+    if (scratch)
+        free (scratch);
+    if (ret == 0)
+        *current = n;
+    return ret;
+}
+
+/**
+ * \brief unmaps a store and frees it
+ *
+ * @param store the store, may be NULL
+ */
+void
+xvc_frame_store_close (XVC_FrameStore * store)
+{
+    if (!store)
+        return;
+    if (store->own_index)
+        free ((void *) store->index);
+    if (store->map)
+        munmap (store->map, store->size);
+    free (store);
+}
+
+/**
+ * \brief what a thread exporting frames works on
+ */
+typedef struct
+{
+    /** \brief the store to read from */
+    const XVC_FrameStore *store;
+    /** \brief file name pattern of the files to write */
+    const char *pattern;
+    /** \brief xwd header, file name and color table for xwd output or
+     *      NULL for png */
+    const char *prefix;
+    int prefix_len;
+    /** \brief the frames to export, first to last */
+    int first, last;
+    /** \brief number of frames that couldn't be exported */
+    int failed;
+    /** \brief the thread */
+    pthread_t tid;
+} XVC_ExportJob;
+
+/**
+ * \brief prepares the header, file name and color table written in front
+ *      of every exported xwd frame
+ *
+ * @param store the store exported
+ * @param pattern the file name pattern, used as the window name
+ * @param len set to the length of the prefix
+ * @return the prefix or NULL if it couldn't be allocated
+ */
+static char *
+make_xwd_prefix (const XVC_FrameStore * store, const char *pattern, int *len)
+{
+    const XVC_StoreHeader *h = store->header;
+    XWDFileHeader head;
+    int name_len = strlen (pattern) + 1, i;
+    CARD32 *word;
+    char *prefix;
+
+    memset (&head, 0, sizeof (head));
+    head.header_size = sizeof (head) + name_len;
+    head.file_version = XWD_FILE_VERSION;
+    head.pixmap_format = ZPixmap;
+    head.pixmap_depth = h->depth;
+    head.pixmap_width = h->width;
+    head.pixmap_height = h->height;
+    head.byte_order = h->image_byte_order;
+    head.bitmap_unit = h->bitmap_unit;
+    head.bitmap_bit_order = h->bitmap_bit_order;
+    head.bitmap_pad = h->bitmap_pad;
+    head.bits_per_pixel = h->bits_per_pixel;
+    head.bytes_per_line = h->bytes_per_line;
+    head.visual_class = (h->ncolors ? PseudoColor : TrueColor);
+    head.red_mask = h->red_mask;
+    head.green_mask = h->green_mask;
+    head.blue_mask = h->blue_mask;
+    head.bits_per_rgb = 8;
+    head.colormap_entries = (h->ncolors ? h->ncolors : 256);
+    head.ncolors = h->ncolors;
+    head.window_width = h->width;
+    head.window_height = h->height;
+    for (i = 0, word = (CARD32 *) & head; i < sizeof (head) / 4; i++)
+        word[i] = htonl (word[i]);
+
+    *len = sizeof (head) + name_len + sizeof (XWDColor) * h->ncolors;
+    prefix = malloc (*len);
+    if (!prefix)
+        return NULL;
+    memcpy (prefix, &head, sizeof (head));
+    memcpy (prefix + sizeof (head), pattern, name_len);
+    memcpy (prefix + sizeof (head) + name_len, store->colors,
+            sizeof (XWDColor) * h->ncolors);
+    return prefix;
+}
+
+#ifdef HAVE_LIBZ
+/**
+ * \brief stores a 32 bit value in network byte order
+ *
+ * @param p where to store the value
+ * @param v the value
+ */
+static void
+put_be32 (unsigned char *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+/**
+ * \brief converts a frame to 8 bit RGB lines, each preceded by the png
+ *      filter type 0
+ *
+ * @param store the store the frame comes from
+ * @param data the frame
+ * @param rgb (3 * width + 1) * height bytes to write to
+ */
+static void
+frame_to_rgb (const XVC_FrameStore * store, const char *data,
+              unsigned char *rgb)
+{
+    const XVC_StoreHeader *h = store->header;
+    const uint32_t masks[3] = { h->red_mask, h->green_mask, h->blue_mask };
+    int shifts[3], bpp = h->bits_per_pixel / 8, x, y, c, b;
+    unsigned char palette[256][3];
+    uint32_t pixel, max;
+    const unsigned char *p;
+
+    for (c = 0; c < 3; c++)
+        for (shifts[c] = 0; masks[c] && !(masks[c] & (1 << shifts[c]));
+             shifts[c]++);
+    // the color table is in network byte order
+    memset (palette, 0, sizeof (palette));
+    for (c = 0; c < h->ncolors; c++) {
+        pixel = ntohl (store->colors[c].pixel);
+        if (pixel < 256) {
+            palette[pixel][0] = ntohs (store->colors[c].red) >> 8;
+            palette[pixel][1] = ntohs (store->colors[c].green) >> 8;
+            palette[pixel][2] = ntohs (store->colors[c].blue) >> 8;
+        }
+    }
+
+    for (y = 0; y < h->height; y++) {
+        p = (const unsigned char *) data + y * h->bytes_per_line;
+        *rgb++ = 0;
+        for (x = 0; x < h->width; x++, p += bpp) {
+            pixel = 0;
+            for (b = 0; b < bpp; b++) {
+                if (h->image_byte_order == MSBFirst)
+                    pixel = (pixel << 8) | p[b];
+                else
+                    pixel |= p[b] << (8 * b);
+            }
+            if (h->ncolors) {
+                memcpy (rgb, palette[pixel & 0xff], 3);
+                rgb += 3;
+                continue;
+            }
+            for (c = 0; c < 3; c++) {
+                max = masks[c] >> shifts[c];
+                *rgb++ = (max ? ((pixel & masks[c]) >> shifts[c]) * 255 / max
+                          : 0);
+            }
+        }
+    }
+}
+
+/**
+ * \brief writes a png chunk
+ *
+ * @param fd the file descriptor to write to
+ * @param type the chunk type
+ * @param data the chunk data
+ * @param len length of the chunk data
+ * @param file name of the file for error messages
+ * @return 0 on success or -1 on error
+ */
+static int
+write_png_chunk (int fd, const char *type, unsigned char *data, uint32_t len,
+                 const char *file)
+{
+    unsigned char head[8], crc[4];
+    struct iovec iov[3];
+    uLong sum;
+
+    put_be32 (head, len);
+    memcpy (head + 4, type, 4);
+    sum = crc32 (crc32 (0L, Z_NULL, 0), head + 4, 4);
+    put_be32 (crc, (len ? crc32 (sum, data, len) : sum));
+    iov[0].iov_base = head;
+    iov[0].iov_len = sizeof (head);
+    iov[1].iov_base = data;
+    iov[1].iov_len = len;
+    iov[2].iov_base = crc;
+    iov[2].iov_len = sizeof (crc);
+    return write_all (fd, iov, 3, file);
+}
+
+/**
+ * \brief writes a frame as png file
+ *
+ * @param store the store the frame comes from
+ * @param data the frame
+ * @param rgb a buffer for the converted frame, see frame_to_rgb ()
+ * @param z a buffer for the compressed frame
+ * @param z_size size of the buffer for the compressed frame
+ * @param file the file to write
+ * @return 0 on success or -1 on error
+ */
+static int
+write_png (const XVC_FrameStore * store, const char *data,
+           unsigned char *rgb, unsigned char *z, uLong z_size,
+           const char *file)
+{
+    static const unsigned char signature[8] =
+        { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    const XVC_StoreHeader *h = store->header;
+    unsigned char ihdr[13] = { 0 };
+    int fd, ret = -1;
+
+    frame_to_rgb (store, data, rgb);
+    if (compress2 (z, &z_size, rgb, (3 * h->width + 1) * h->height,
+                   Z_DEFAULT_COMPRESSION) != Z_OK)
+        return -1;
+    put_be32 (ihdr, h->width);
+    put_be32 (ihdr + 4, h->height);
+    ihdr[8] = 8;                       // bit depth
+    ihdr[9] = 2;                       // RGB
+
+    fd = open (file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        perror (file);
+        return -1;
+    }
+    if (write (fd, signature, sizeof (signature)) == sizeof (signature) &&
+        write_png_chunk (fd, "IHDR", ihdr, sizeof (ihdr), file) == 0 &&
+        write_png_chunk (fd, "IDAT", z, z_size, file) == 0 &&
+        write_png_chunk (fd, "IEND", NULL, 0, file) == 0)
+        ret = 0;
+    if (close (fd) < 0)
+        ret = -1;
+    return ret;
+}
+#endif     // HAVE_LIBZ
+
+/**
+ * \brief exports a range of frames, this runs in a thread of its own
+ *
+ * @param arg the XVC_ExportJob
+ * @return NULL
+ */
+static void *
+export_thread (void *arg)
+{
+    XVC_ExportJob *ej = (XVC_ExportJob *) arg;
+    const XVC_StoreHeader *h = ej->store->header;
+    size_t frame_size = h->bytes_per_line * h->height;
+    char file[PATH_MAX + 1], *data;
+    struct iovec iov[2];
+    int current = -1, n, fd, ok;
+
+#ifdef HAVE_LIBZ
+    uLong z_size = compressBound ((3 * h->width + 1) * h->height);
+    unsigned char *rgb = NULL, *z = NULL;
+#endif     // HAVE_LIBZ
+
+    xvc_trace_thread_name ("export");
+    data = malloc (frame_size);
+#ifdef HAVE_LIBZ
+    if (!ej->prefix) {
+        rgb = malloc ((3 * h->width + 1) * h->height);
+        z = malloc (z_size);
+    }
+    if (!ej->prefix && (!rgb || !z)) {
+        free (data);
+        data = NULL;
+    }
+#endif     // HAVE_LIBZ
+    if (!data) {
+        ej->failed = ej->last - ej->first + 1;
+        goto DONE;
+    }
+
+    for (n = ej->first; n <= ej->last; n++) {
+        snprintf (file, sizeof (file), ej->pattern,
+                  ej->store->index[n].record.number);
+        ok = (xvc_frame_store_read_frame (ej->store, n, data, &current) == 0);
+        if (ok && ej->prefix) {
+            fd = open (file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+            iov[0].iov_base = (void *) ej->prefix;
+            iov[0].iov_len = ej->prefix_len;
+            iov[1].iov_base = data;
+            iov[1].iov_len = frame_size;
+            if (fd < 0)
+                perror (file);
+            ok = (fd >= 0 && write_all (fd, iov, 2, file) == 0);
+            if (fd >= 0 && close (fd) < 0)
+                ok = FALSE;
+        }
+#ifdef HAVE_LIBZ
+        else if (ok)
+            ok = (write_png (ej->store, data, rgb, z, z_size, file) == 0);
+#endif     // HAVE_LIBZ
+        if (!ok)
+            ej->failed++;
+    }
+
+  DONE:
+    free (data);
+#ifdef HAVE_LIBZ
+    free (rgb);
+    free (z);
+#endif     // HAVE_LIBZ
+    return NULL;
+}
+
+/**
+ * \brief writes frames from a store to xwd or png files, using a thread
+ *      per CPU
+ *
+ * @param file the store, optionally followed by :first[-last] to select
+ *      the frames to export, counted from 0
+ * @param pattern the file name pattern to write the frames to, the number
+ *      the frame was captured as is filled in, the extension selects xwd
+ *      or png
+ * @return 0 on success or 1 if any frame couldn't be exported
+ */
+int
+xvc_frame_store_export (const char *file, const char *pattern)
+{
+#define DEBUGFUNCTION "xvc_frame_store_export()"
+    XVC_AppData *app = xvc_appdata_ptr ();
+    XVC_ExportJob jobs[EXPORT_MAX_THREADS];
+    XVC_FrameStore *store;
+    char *name, *range, *ext, *prefix = NULL;
+    int first = 0, last = INT_MAX, prefix_len = 0, threads, failed = 0, i;
+    long cpus;
+
+    name = strdup (file);
+    if (!name)
+        return 1;
+    range = strrchr (name, ':');
+    if (range && range[1] >= '0' && range[1] <= '9') {
+        *range++ = '\0';
+        first = strtol (range, &range, 10);
+        if (*range == '-')
+            last = strtol (range + 1, NULL, 10);
+        else
+            last = first;
+    }
+
+    ext = strrchr (pattern, '.');
+    if (!ext || (strcasecmp (ext, ".xwd") != 0
+#ifdef HAVE_LIBZ
+                 && strcasecmp (ext, ".png") != 0
+#endif     // HAVE_LIBZ
+        )) {
+        fprintf (stderr, _("%s %s: Can't export to %s, use a file name "
+                           "ending in .xwd or .png\n"), DEBUGFILE,
+                 DEBUGFUNCTION, pattern);
+        free (name);
+        return 1;
+    }
+
+    store = xvc_frame_store_open (name);
+    free (name);
+    if (!store)
+        return 1;
+    if (last >= store->frames)
+        last = store->frames - 1;
+    if (first > last) {
+        fprintf (stderr, _("%s %s: No frames selected from %i frames\n"),
+                 DEBUGFILE, DEBUGFUNCTION, store->frames);
+        xvc_frame_store_close (store);
+        return 1;
+    }
+    if (strcasecmp (ext, ".xwd") == 0) {
+        prefix = make_xwd_prefix (store, pattern, &prefix_len);
+        if (!prefix) {
+            xvc_frame_store_close (store);
+            return 1;
+        }
+    }
+
+    cpus = sysconf (_SC_NPROCESSORS_ONLN);
+    threads = XVC_MIN (XVC_MAX (cpus, 1), EXPORT_MAX_THREADS);
+    threads = XVC_MIN (threads, last - first + 1);
+    // each thread gets consecutive frames so frames stored as changes
+    // need to be built only once
+    for (i = 0; i < threads; i++) {
+        jobs[i].store = store;
+        jobs[i].pattern = pattern;
+        jobs[i].prefix = prefix;
+        jobs[i].prefix_len = prefix_len;
+        jobs[i].first = first + (long) (last - first + 1) * i / threads;
+        jobs[i].last = first + (long) (last - first + 1) * (i + 1) /
+            threads - 1;
+        jobs[i].failed = 0;
+        if (pthread_create (&jobs[i].tid, NULL, export_thread, &jobs[i]) !=
+            0) {
+            jobs[i].tid = 0;
+            export_thread (&jobs[i]);
+        }
+    }
+    for (i = 0; i < threads; i++) {
+        if (jobs[i].tid)
+            pthread_join (jobs[i].tid, NULL);
+        failed += jobs[i].failed;
+    }
+
+    if (app->verbose)
+        printf (_("%i frames exported from %i frames with %i threads, "
+                  "%i failed\n"), last - first + 1 - failed, store->frames,
+                threads, failed);
+    free (prefix);
+    xvc_frame_store_close (store);
+    return (failed ? 1 : 0);
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief sets the palette of 8 bit frames to the color table of a store
+ *
+ * @param job the job to set the colors of
+ * @param store the store
+ */
+static void
+set_store_palette (Job * job, const XVC_FrameStore * store)
+{
+    XColor *colors;
+    int i, ncolors = store->header->ncolors;
+
+    if (ncolors == 0 || !job->get_colors)
+        return;
+    colors = (XColor *) calloc (ncolors, sizeof (XColor));
+    if (!colors)
+        return;
+    // the color table is stored as in xwd files, i. e. big endian
+    for (i = 0; i < ncolors; i++) {
+        colors[i].pixel = ntohl (store->colors[i].pixel);
+        colors[i].red = ntohs (store->colors[i].red);
+        colors[i].green = ntohs (store->colors[i].green);
+        colors[i].blue = ntohs (store->colors[i].blue);
+        colors[i].flags = store->colors[i].flags;
+    }
+    if (job->colors)
+        free (job->colors);
+    job->colors = colors;
+    job->ncolors = ncolors;
+    if (job->color_table)
+        free (job->color_table);
+    job->color_table = (*job->get_colors) (job->colors, job->ncolors);
+}
+
+/**
+ * \brief encodes a range of the frames of a store with the job set up
+ *
+ * @param store the store
+ * @param image an image of the store's frame size to read the frames into
+ * @param first number of the first frame in the store
+ * @param last number of the last frame in the store
+ * @return the number of frames encoded, last - first + 1 on success
+ */
+static int
+transcode_frames (const XVC_FrameStore * store, XImage * image, int first,
+                  int last)
+{
+#define DEBUGFUNCTION "transcode_frames()"
+    XVC_AppData *app = xvc_appdata_ptr ();
+    Job *job = xvc_job_ptr ();
+    char name[PATH_MAX + 1];
+    FILE *fp = NULL;
+    int64_t start;
+    int current = -1, i;
+
+    xvc_stats_reset ();
+    // what the capture functions do, but with the frames of the store
+    job->state = VC_REC | VC_START;
+    for (i = first; i <= last; i++) {
+        start = xvc_stats_clock ();
+        if (xvc_frame_store_read_frame (store, i, image->data, &current) < 0) {
+            fprintf (stderr, _("%s %s: Frame %i of the store is damaged\n"),
+                     DEBUGFILE, DEBUGFUNCTION, i);
+            break;
+        }
+        job->pic_no = store->index[i].record.number;
+        if (app->current_mode == 0) {
+            snprintf (name, sizeof (name), job->file, job->pic_no);
+            fp = fopen (name, "wb");
+            if (!fp) {
+                fprintf (stderr, _("%s %s: Can't open %s: %s\n"), DEBUGFILE,
+                         DEBUGFUNCTION, name, strerror (errno));
+                break;
+            }
+        }
+        (*job->save) (fp, image);
+        job->state &= ~(VC_START);
+        if (fp)
+            fclose (fp);
+        fp = NULL;
+        xvc_stats_add_stage (XVC_STAGE_FRAME, start);
+        xvc_stats_add_frame (FALSE);
+    }
+    // nothing was saved if the first frame failed
+    if (job->clean && !(job->state & VC_START))
+        (*job->clean) ();
+    xvc_stats_stop ();
+
+    return i - first;
+#undef DEBUGFUNCTION
+}
+
+#ifdef USE_FFMPEG
+/**
+ * \brief encodes the frames of a store in parts of whole GOPs at the same
+ *      time and joins the parts in the target file
+ *
+ * Every part starts with a keyframe and is encoded with the settings of
+ * the target, so the packets can be joined without encoding them again.
+ * xtoffmpeg keeps the encoder in globals, so each part is encoded by a
+ * child process of its own. As with the benchmark, the job is set up
+ * before forking because the child must not talk to the X server.
+ *
+ * @param store the store
+ * @param image an image of the store's frame size to read the frames into
+ * @param jobs the number of parts to encode at the same time
+ * @return the number of frames encoded, store->frames on success
+ */
+static int
+transcode_parts (const XVC_FrameStore * store, XImage * image, int jobs)
+{
+#define DEBUGFUNCTION "transcode_parts()"
+    XVC_AppData *app = xvc_appdata_ptr ();
+    Job *job = xvc_job_ptr ();
+    XVC_CapTypeOptions *cto = &(app->multi_frame);
+    char *file = cto->file, pattern[PATH_MAX + 1], name[PATH_MAX + 1];
+    char **parts;
+    int *first_frames;
+    pid_t *pids, pid;
+    int part_frames, n, i, last, next = 0, running = 0, status;
+    int failed = FALSE;
+
+    // a few parts per process even out parts that take longer to encode
+    part_frames = (store->frames + jobs * 4 - 1) / (jobs * 4);
+    part_frames = (part_frames + XVC_GOP_SIZE - 1) /
+        XVC_GOP_SIZE * XVC_GOP_SIZE;
+    n = (store->frames + part_frames - 1) / part_frames;
+
+    parts = (char **) calloc (n, sizeof (char *));
+    first_frames = (int *) calloc (n, sizeof (int));
+    pids = (pid_t *) calloc (n, sizeof (pid_t));
+    if (!parts || !first_frames || !pids) {
+        failed = TRUE;
+        goto DONE;
+    }
+
+    while (next < n || running > 0) {
+        if (next < n && running < jobs && !failed) {
+            snprintf (pattern, sizeof (pattern), "%s.%i.%s", file, next,
+                      xvc_formats[job->target].extensions[0]);
+            cto->file = pattern;
+            xvc_job_set_from_app_data (app);
+            set_store_palette (job, store);
+            snprintf (name, sizeof (name), job->file, job->movie_no);
+            parts[next] = strdup (name);
+            if (!parts[next]) {
+                failed = TRUE;
+                continue;
+            }
+            first_frames[next] = next * part_frames;
+            last = XVC_MIN (first_frames[next] + part_frames,
+                            store->frames) - 1;
+
+            fflush (stdout);
+            fflush (stderr);
+            pid = fork ();
+            if (pid == 0)
+                _exit (transcode_frames (store, image, first_frames[next],
+                                         last) ==
+                       last - first_frames[next] + 1 ? 0 : 1);
+            if (pid < 0) {
+                fprintf (stderr, _("%s %s: Can't fork: %s\n"), DEBUGFILE,
+                         DEBUGFUNCTION, strerror (errno));
+                failed = TRUE;
+            } else {
+                pids[next] = pid;
+                running++;
+            }
+            next++;
+            continue;
+        }
+        if (running == 0)
+            break;
+
+        pid = wait (&status);
+        if (pid < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        for (i = 0; i < next && pids[i] != pid; i++);
+        if (i == next)
+            continue;
+        running--;
+        if (!WIFEXITED (status) || WEXITSTATUS (status) != 0) {
+            fprintf (stderr, _("%s %s: Encoding %s failed\n"), DEBUGFILE,
+                     DEBUGFUNCTION, parts[i]);
+            failed = TRUE;
+        }
+    }
+
+    cto->file = file;
+    xvc_job_set_from_app_data (app);
+    if (!failed && xvc_ffmpeg_join (parts, first_frames, n) < 0)
+        failed = TRUE;
+    if (!failed && app->verbose)
+        printf (_("%i parts of up to %i frames encoded with %i processes\n"),
+                n, part_frames, jobs);
+
+  DONE:
+    cto->file = file;
+    if (parts) {
+        for (i = 0; i < n; i++) {
+            if (parts[i]) {
+                unlink (parts[i]);
+                free (parts[i]);
+            }
+        }
+        free (parts);
+    }
+    if (first_frames)
+        free (first_frames);
+    if (pids)
+        free (pids);
+
+    return (failed ? 0 : store->frames);
+#undef DEBUGFUNCTION
+}
+#endif     // USE_FFMPEG
+
+/**
+ * \brief encodes the frames of a store to the file format and codec of a
+ *      capture target
+ *
+ * The frames go through the same save functions one after the other as
+ * they would have during a recording, so with the frame rate and quality
+ * the store was recorded with, the result is the same as recording to the
+ * target directly. This lets a recording be stored cheaply and encoded
+ * when the CPU is free. Stores carry no audio, so the result has no
+ * audio stream either.
+ *
+ * @param file the store
+ * @param target the capture options to encode with, i. e. file, format,
+ *      codec, frame rate and quality. Audio is switched off in them.
+ * @return 0 on success or 1 on error
+ */
+int
+xvc_frame_store_transcode (const char *file, XVC_CapTypeOptions * target)
+{
+#define DEBUGFUNCTION "xvc_frame_store_transcode()"
+    XVC_AppData *app = xvc_appdata_ptr ();
+    Job *job = xvc_job_ptr ();
+    XVC_FrameStore *store;
+    const XVC_StoreHeader *h;
+    XImage *image;
+    int ret = 1, jobs, done;
+
+    if (target->target == CAP_XVS) {
+        fprintf (stderr, _("%s %s: Can't transcode to a frame store, use "
+                           "--export to write single frames\n"), DEBUGFILE,
+                 DEBUGFUNCTION);
+        return 1;
+    }
+    store = xvc_frame_store_open (file);
+    if (!store)
+        return 1;
+    h = store->header;
+
+    image = (XImage *) calloc (1, sizeof (XImage));
+    if (!image) {
+        xvc_frame_store_close (store);
+        return 1;
+    }
+    image->width = h->width;
+    image->height = h->height;
+    image->format = ZPixmap;
+    image->byte_order = h->image_byte_order;
+    image->bitmap_unit = h->bitmap_unit;
+    image->bitmap_bit_order = h->bitmap_bit_order;
+    image->bitmap_pad = h->bitmap_pad;
+    image->depth = h->depth;
+    image->bits_per_pixel = h->bits_per_pixel;
+    image->bytes_per_line = h->bytes_per_line;
+    image->red_mask = h->red_mask;
+    image->green_mask = h->green_mask;
+    image->blue_mask = h->blue_mask;
+    image->data = (char *) malloc (image->bytes_per_line * image->height);
+    if (!image->data || !XInitImage (image)) {
+        fprintf (stderr, _("%s %s: Can't allocate a frame\n"), DEBUGFILE,
+                 DEBUGFUNCTION);
+        goto DONE;
+    }
+
+#ifdef HAVE_FFMPEG_AUDIO
+    // there is no audio in a store, and the live input must not be
+    // recorded into an offline encode, neither here nor in the parts
+    target->audioWanted = 0;
+#endif     // HAVE_FFMPEG_AUDIO
+    xvc_job_set_from_app_data (app);
+    set_store_palette (job, store);
+    if (job->c_info)
+        free (job->c_info);
+    job->c_info = xvc_get_color_info (image);
+
+    jobs = app->transcode_jobs;
+    if (jobs < 1)
+        jobs = XVC_MAX (sysconf (_SC_NPROCESSORS_ONLN), 1);
+#ifdef USE_FFMPEG
+    // the parts are joined in a file, so not in single frames or a pipe
+    if (jobs > 1 && job->target >= CAP_MF &&
+        store->frames > XVC_GOP_SIZE &&
+        strcasecmp (job->file, "-") != 0 &&
+        strcasecmp (job->file, "pipe:") != 0)
+        done = transcode_parts (store, image, jobs);
+    else
+#endif     // USE_FFMPEG
+        done = transcode_frames (store, image, 0, store->frames - 1);
+    ret = (done == store->frames ? 0 : 1);
+
+    if (app->verbose)
+        printf (_("%i of %i frames transcoded to %s\n"), done, store->frames,
+                target->file);
+    if (app->verbose > 1)
+        xvc_stats_print_summary (stderr);
+
+  DONE:
+    free (image->data);
+    free (image);
+    xvc_frame_store_close (store);
+    return ret;
+#undef DEBUGFUNCTION
+}
@@ -0,0 +1,148 @@
+/**
+ * \file frame_store.h
+ */
+/*
+ * Copyright (C) 2003-07 Karl H. Beckers, Frankfurt
+ * EMail: khb@jarre-de-the.net
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef _xvc_FRAME_STORE_H__
+#define _xvc_FRAME_STORE_H__
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+#include <stdio.h>
+#include <sys/types.h>
+#include <inttypes.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/XWDFile.h>
+#endif     // DOXYGEN_SHOULD_SKIP_THIS
+
+#include "app_data.h"
+
+/** \brief a frame stored as it is */
+#define XVC_STORE_RAW 0
+/** \brief a frame stored as the lines that changed since the frame before */
+#define XVC_STORE_DELTA 1
+/** \brief a frame stored as the tiles that changed since the frame before */
+#define XVC_STORE_TILES 2
+/** \brief or'ed to the format of a frame whose data is compressed with
+ *      zlib */
+#define XVC_STORE_DEFLATE 0x100
+/** \brief width of the tiles of XVC_STORE_TILES in bytes */
+#define XVC_STORE_TILE_BYTES 256
+/** \brief height of the tiles of XVC_STORE_TILES in lines */
+#define XVC_STORE_TILE_LINES 16
+
+/**
+ * \brief the header of a frame store file, followed by the color table
+ */
+typedef struct
+{
+    /** \brief identifies the file as a frame store */
+    char magic[8];
+    /** \brief tells the byte order the file was written with */
+    uint32_t byte_order_mark;
+    /** \brief width of the frames */
+    uint32_t width;
+    /** \brief height of the frames */
+    uint32_t height;
+    /** \brief depth of the frames */
+    uint32_t depth;
+    /** \brief bits per pixel of the frames */
+    uint32_t bits_per_pixel;
+    /** \brief bytes per line of the frames */
+    uint32_t bytes_per_line;
+    /** \brief byte order of the pixels, LSBFirst or MSBFirst */
+    uint32_t image_byte_order;
+    /** \brief bitmap unit, bit order and padding of the frames */
+    uint32_t bitmap_unit, bitmap_bit_order, bitmap_pad;
+    /** \brief color masks of the frames */
+    uint32_t red_mask, green_mask, blue_mask;
+    /** \brief number of XWDColor entries following the header */
+    uint32_t ncolors;
+    /** \brief a full frame is stored every key_interval frames, 1 if
+     *      all frames are full frames */
+    uint32_t key_interval;
+    /** \brief number of frames in the index */
+    uint32_t frames;
+    /** \brief file offset of the index or 0 if the store wasn't closed */
+    uint64_t index_offset;
+} XVC_StoreHeader;
+
+/**
+ * \brief the header in front of each frame, also used in the index
+ */
+typedef struct
+{
+    /** \brief XVC_STORE_RAW, XVC_STORE_DELTA or XVC_STORE_TILES, possibly
+     *      with XVC_STORE_DEFLATE */
+    uint32_t format;
+    /** \brief number of bytes following the header */
+    uint32_t size;
+    /** \brief the number the frame was captured as */
+    uint32_t number;
+    /** \brief width and height of the frame */
+    uint16_t width, height;
+    /** \brief time the frame was captured in ns since the first frame */
+    int64_t timestamp;
+} XVC_StoreRecord;
+
+/**
+ * \brief an entry of the index at the end of a frame store file
+ */
+typedef struct
+{
+    /** \brief file offset of the frame's XVC_StoreRecord */
+    uint64_t offset;
+    /** \brief a copy of the frame's XVC_StoreRecord */
+    XVC_StoreRecord record;
+} XVC_StoreIndexEntry;
+
+/**
+ * \brief a frame store mapped for reading
+ */
+typedef struct
+{
+    /** \brief the file mapped */
+    unsigned char *map;
+    /** \brief size of the mapping */
+    size_t size;
+    /** \brief the header at the start of the mapping */
+    const XVC_StoreHeader *header;
+    /** \brief the color table following the header, big endian */
+    const XWDColor *colors;
+    /** \brief the index, in the mapping or rebuilt in memory */
+    const XVC_StoreIndexEntry *index;
+    /** \brief TRUE if the index was rebuilt and must be freed */
+    int own_index;
+    /** \brief number of frames in the store */
+    int frames;
+} XVC_FrameStore;
+
+void xvc_frame_store_save_frame (FILE * fp, XImage * image);
+void xvc_frame_store_clean ();
+
+XVC_FrameStore *xvc_frame_store_open (const char *file);
+int xvc_frame_store_read_frame (const XVC_FrameStore * store, int n,
+                                char *data, int *current);
+void xvc_frame_store_close (XVC_FrameStore * store);
+int xvc_frame_store_export (const char *file, const char *pattern);
+int xvc_frame_store_transcode (const char *file,
+                               XVC_CapTypeOptions * target);
+
+#endif     // _xvc_FRAME_STORE_H__
@@ -101,9 +101,10 @@ xvc_frame_get_capture_display ()
     } else {
         if (!xvc_dpy)
             gdpy = gdk_display_get_default ();
-        xvc_dpy = gdk_x11_display_get_xdisplay (gdpy);
+        // there is no display if gtk could not be initialized, which only
+        // the synth capture source can do without
+        xvc_dpy = (gdpy ? gdk_x11_display_get_xdisplay (gdpy) : NULL);
     }
-    g_assert (xvc_dpy);
     return xvc_dpy;
 #undef DEBUGFUNCTION
 }
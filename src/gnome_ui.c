@@ -1126,8 +1126,13 @@ timer_stop_recording ()
     Job *jobp = xvc_job_ptr ();
 
     if ((jobp->flags & FLG_AUTO_CONTINUE) != 0) {
-        xvc_job_merge_and_remove_state ((VC_STOP | VC_CONTINUE),
-                                        (VC_START | VC_REC));
+        // continue in the next file without stopping where the output
+        // supports that
+        if (jobp->roll_over)
+            xvc_job_request_roll_over ();
+        else
+            xvc_job_merge_and_remove_state ((VC_STOP | VC_CONTINUE),
+                                            (VC_START | VC_REC));
         return TRUE;
     } else {
         xvc_job_set_state (VC_STOP);
@@ -1700,7 +1705,9 @@ xvc_reset_ctrl_main_window_according_to_current_prefs ()
 
 /**
  * \brief does gui preintialization, mainly initializing thread libraries
- *      and calling gtk_init with the command line arguments
+ *      and calling gtk_init with the command line arguments. Failing to
+ *      open the display is not fatal here, because the synth capture
+ *      source can record without one.
  *
  * @param argc number of command line arguments
  * @param argv pointer to the command line arguments
@@ -1713,7 +1720,7 @@ xvc_init_pre (int argc, char **argv)
     g_thread_init (NULL);
     gdk_threads_init ();
 
-    gtk_init (&argc, &argv);
+    gtk_init_check (&argc, &argv);
     return TRUE;
 #undef DEBUGFUNCTION
 }
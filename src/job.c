@@ -41,6 +41,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <errno.h>
@@ -52,11 +53,13 @@
 #include "job.h"
 #include "capture.h"
 #include "xtoxwd.h"
+#include "frame_store.h"
 #include "frame.h"
 #include "colors.h"
 #include "codecs.h"
 #include "control.h"
 #include "app_data.h"
+#include "synth.h"
 #include "xvidcap-intl.h"
 #ifdef USE_FFMPEG
 # include "xtoffmpeg.h"
@@ -70,7 +73,9 @@ static void job_set_capture (void);
 /**
  * \brief set and check some parameters for the sound device
  *
- * @param snd the name of the audio input device or "-" for stdin
+ * @param snd the comma separated list of audio inputs, each a device, "-"
+ *      for stdin or "tone" for a generated sine wave, optionally followed
+ *      by \@gain
  * @param rate the sample rate
  * @param size the sample size
  * @param channels the number of channels to record
@@ -82,11 +87,25 @@ job_set_sound_dev (char *snd, int rate, int size, int channels)
     extern int errno;
     struct stat statbuf;
     int stat_ret;
+    char *copy, *tok, *save = NULL;
 
     job->snd_device = snd;
     if (job->flags & FLG_REC_SOUND) {
-        if (strcmp (snd, "-") != 0) {
-            stat_ret = stat (snd, &statbuf);
+        copy = strdup (snd);
+        for (tok = (copy ? strtok_r (copy, ",", &save) : NULL);
+             tok && (job->flags & FLG_REC_SOUND);
+             tok = strtok_r (NULL, ",", &save)) {
+            char *at = strrchr (tok, '@');
+
+            if (at)
+                *at = '\0';
+            // stdin and generated tones have nothing to check
+            if (strcmp (tok, "-") == 0 || strcmp (tok, "pipe:") == 0 ||
+                (strncmp (tok, "tone", 4) == 0 &&
+                 (tok[4] == '\0' || tok[4] == ':')))
+                continue;
+
+            stat_ret = stat (tok, &statbuf);
 
             if (stat_ret != 0) {
                 switch (errno) {
@@ -94,19 +113,20 @@ job_set_sound_dev (char *snd, int rate, int size, int channels)
                     fprintf (stderr,
                              _
                              ("Insufficient permission to access sound input from %s\n"),
-                             snd);
+                             tok);
                     fprintf (stderr, _("Sound disabled!\n"));
                     job->flags &= ~FLG_REC_SOUND;
                     break;
                 default:
                     fprintf (stderr,
-                             _("Error accessing sound input from %s\n"), snd);
+                             _("Error accessing sound input from %s\n"), tok);
                     fprintf (stderr, _("Sound disabled!\n"));
                     job->flags &= ~FLG_REC_SOUND;
                     break;
                 }
             }
         }
+        free (copy);
     }
 
     return;
@@ -144,6 +164,7 @@ job_new ()
     job->get_colors = (void *(*)(XColor *, int)) NULL;
     job->save = (void (*)(FILE *, XImage *)) NULL;
     job->clean = (void (*)(void)) NULL;
+    job->roll_over = (void (*)(void)) NULL;
     job->capture = (long (*)(void)) NULL;
 
     job->target = 0;
@@ -154,6 +175,7 @@ job_new ()
     job->color_table = NULL;
     job->colors = NULL;
     job->c_info = NULL;
+    job->roll_over_requested = FALSE;
 
 #ifdef USE_XDAMAGE
     job->dmg_region = XCreateRegion ();
@@ -200,7 +222,14 @@ xvc_job_set_colors ()
 #define DEBUGFUNCTION "xvc_job_set_colors()"
     XVC_AppData *app = xvc_appdata_ptr ();
 
-    job->ncolors = xvc_get_colors (app->dpy, &(app->win_attr), &(job->colors));
+    if ((app->flags & FLG_USE_SYNTH) || !app->dpy) {
+        // generated frames have a palette of their own
+        if (job->colors)
+            free (job->colors);
+        job->ncolors = xvc_synth_get_colors (&(job->colors));
+    } else
+        job->ncolors =
+            xvc_get_colors (app->dpy, &(app->win_attr), &(job->colors));
     if (job->get_colors) {
         if (job->color_table)
             free (job->color_table);
@@ -389,6 +418,7 @@ xvc_job_set_save_function (XVC_FFormatID type)
 #ifdef USE_FFMPEG
     if (type >= CAP_MF) {
         job->clean = xvc_ffmpeg_clean;
+        job->roll_over = xvc_ffmpeg_roll_over;
         if (job->targetCodec == CODEC_NONE) {
             job->targetCodec = CODEC_MF;
         }
@@ -396,6 +426,7 @@ xvc_job_set_save_function (XVC_FFormatID type)
         job->save = xvc_ffmpeg_save_frame;
     } else if (type >= CAP_FFM) {
         job->clean = xvc_ffmpeg_clean;
+        job->roll_over = NULL;
         if (job->targetCodec == CODEC_NONE) {
             job->targetCodec = CODEC_PGM;
         }
@@ -403,10 +434,16 @@ xvc_job_set_save_function (XVC_FFormatID type)
         job->save = xvc_ffmpeg_save_frame;
     } else
 #endif     // USE_FFMPEG
-    {
+    if (type == CAP_XVS) {
+        job->save = xvc_frame_store_save_frame;
+        job->get_colors = xvc_xwd_get_color_table;
+        job->clean = xvc_frame_store_clean;
+        job->roll_over = NULL;
+    } else {
         job->save = xvc_xwd_save_frame;
         job->get_colors = xvc_xwd_get_color_table;
-        job->clean = NULL;
+        job->clean = xvc_xwd_clean;
+        job->roll_over = NULL;
     }
 #undef DEBUGFUNCTION
 }
@@ -429,6 +466,12 @@ job_set_capture (void)
     case FLG_USE_DGA:
         job->capture = TCbCaptureDGA;
         break;
+    case FLG_USE_REPLAY:
+        job->capture = xvc_capture_replay;
+        break;
+    case FLG_USE_SYNTH:
+        job->capture = xvc_capture_synth;
+        break;
 #ifdef HasBTTV
     case FLG_USE_V4L:
         job->capture = TCbCaptureV4L;
@@ -462,6 +505,7 @@ xvc_job_dump ()
     printf ("get_colors = %p\n", job->get_colors);
     printf ("save = %p\n", job->save);
     printf ("clean = %p\n", job->clean);
+    printf ("roll_over = %p\n", job->roll_over);
     printf ("capture = %p\n", job->capture);
 
     printf ("ncolors = %i\n", job->ncolors);
@@ -635,6 +679,29 @@ xvc_job_keep_and_merge_state (int keep_state, int merge_state)
 #undef DEBUGFUNCTION
 }
 
+/**
+ * \brief asks the capture thread to continue recording in the next file
+ *      with the next frame captured
+ *
+ * This only has an effect if the current target supports rolling over.
+ */
+void
+xvc_job_request_roll_over ()
+{
+#define DEBUGFUNCTION "xvc_job_request_roll_over()"
+    XVC_AppData *app = xvc_appdata_ptr ();
+
+#ifdef DEBUG
+    printf ("%s %s: requesting roll-over in state %i\n", DEBUGFILE,
+            DEBUGFUNCTION, job->state);
+#endif     // DEBUG
+    pthread_mutex_lock (&(app->capturing_mutex));
+    if (job->roll_over)
+        job->roll_over_requested = TRUE;
+    pthread_mutex_unlock (&(app->capturing_mutex));
+#undef DEBUGFUNCTION
+}
+
 #ifdef USE_XDAMAGE
 //XserverRegion
 Region
@@ -97,6 +97,11 @@ typedef struct  //_job
     void (*save) (FILE *, XImage *);
     /** \brief function used to cleanup after a recording session */
     void (*clean) ();
+    /**
+     * \brief function used to continue a recording session in the next
+     *      file without cleaning up, NULL if the target doesn't support it
+     */
+    void (*roll_over) ();
     /** \brief function to capture the frames */
     long (*capture) ();
 
@@ -141,6 +146,9 @@ typedef struct  //_job
 
     /** \brief the last capture session returned this errno */
     int capture_returned_errno;
+    /** \brief set to have the capture continue in the next file with the
+     *      next frame, e. g. when max_time is reached with autocontinue */
+    int roll_over_requested;
 
     int frame_moved_x;
     int frame_moved_y;
@@ -159,6 +167,7 @@ void xvc_job_remove_state (int state);
 void xvc_job_merge_and_remove_state (int merge_state, int remove_state);
 void xvc_job_keep_state (int state);
 void xvc_job_keep_and_merge_state (int merge_state, int remove_state);
+void xvc_job_request_roll_over ();
 
 #ifdef USE_XDAMAGE
 //XserverRegion xvc_get_damage_region ();
@@ -31,6 +31,7 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <stdlib.h>
 #include <getopt.h>
 #include <signal.h>
@@ -52,6 +53,11 @@
 #include "codecs.h"
 #include "job.h"
 #include "frame.h"
+#include "resampler.h"
+#include "benchmark.h"
+#include "frame_store.h"
+#include "capture_log.h"
+#include "synth.h"
 #include "xvidcap-intl.h"
 
 typedef void (*sighandler_t) (int);
@@ -95,7 +101,14 @@ usage (char *prog)
     printf (_("[--quality #]    recording quality (1-100)\n"));
     printf (_("[--start_no #]   start number for the file names\n"));
 #ifdef HAVE_SHMAT
-    printf (_("[--source <src>] select input source: x11, shm\n"));
+    printf (_
+            ("[--source <src>] select input source: x11, shm, auto to pick the faster\n"
+             "\twhen recording starts, replay:<file> or\n"
+             "\tsynth[:<pattern>[:<bpp>[:<speed>]]] for generated test patterns\n"));
+#else      // HAVE_SHMAT
+    printf (_
+            ("[--source <src>] select input source: x11, auto, replay:<file> or\n"
+             "\tsynth[:<pattern>[:<bpp>[:<speed>]]] for generated test patterns\n"));
 #endif     // HAVE_SHMAT
     printf (_("[--file <file>]  file pattern, e.g. out%%03d.xwd\n"));
     printf (_("[--gui [yes|no]] turn on/off gui\n"));
@@ -113,6 +126,50 @@ usage (char *prog)
     printf (_
             ("[--format <format>] specify file format to override the extension in the filename\n"));
     printf (_("[--format-help]  list available file formats\n"));
+#ifdef USE_FFMPEG
+    printf (_
+            ("[--replay #]     keep only the last # seconds of a multi-frame capture in memory\n"
+             "\tand write them to a file when requested through dbus\n"));
+    printf (_("[--replay_mem #] memory to use for --replay in MB\n"));
+#endif     // USE_FFMPEG
+    printf (_
+            ("[--trace <file>] write a timeline of the capture pipeline in Chrome trace\n"
+             "\tformat to <file> when recording stops\n"));
+    printf (_
+            ("[--benchmark [<pattern>[,<pattern>...]]] save generated frames with every\n"
+             "\tformat and codec and print the throughput as CSV, patterns are\n"
+             "\tstatic, text, noise, window or all\n"));
+    printf (_
+            ("[--capture_log <file>] log the captured frames to <file> for replaying\n"
+             "\tthem with --source replay:<file>\n"));
+    printf (_
+            ("[--max_speed]    replay a capture log or generate frames as fast as\n"
+             "\tpossible rather than with the timing recorded or the frame rate\n"));
+    printf (_
+            ("[--verify_damage #] check every # frames captured with Xdamage against a\n"
+             "\tfull frame and capture full frames if the checks keep failing\n"));
+    printf (_
+            ("[--async_write]  write output asynchronously (io_uring or threads)\n"));
+    printf (_
+            ("[--store_delta #] store only the lines that changed in an xvs frame store,\n"
+             "\twith a full frame every # frames\n"));
+    printf (_
+            ("[--export <store>[:<first>[-<last>]]] write the frames of an xvs frame\n"
+             "\tstore to the xwd or png files given with --file and exit\n"));
+    printf (_
+            ("[--mmap_write]   write xvs frame stores through a memory mapping\n"));
+    printf (_
+            ("[--store_compress] store only the tiles that changed in an xvs frame store\n"
+             "\tand compress the frames\n"));
+    printf (_
+            ("[--transcode <store>] encode the frames of an xvs frame store to the file,\n"
+             "\tformat and codec given and exit\n"));
+    printf (_
+            ("[--transcode_jobs #] encode # parts of the store at the same time when\n"
+             "\ttranscoding to a multi-frame format (default: one per CPU)\n"));
+    printf (_
+            ("[--write_behind #[:#]] keep at most # MB of output waiting for the disk,\n"
+             "\tflushing it in chunks of the second # MB (default 8)\n"));
 #ifdef HAVE_FFMPEG_AUDIO
     printf
         (_
@@ -122,10 +179,14 @@ usage (char *prog)
     printf (_("[--audio [yes|no]] turn on/off audio capture\n"));
     printf
         (_
-         ("[--audio_in <src>] specify audio input device or '-' for pipe input\n"));
+         ("[--audio_in <src>[,<src>...]] specify audio input device or '-' for pipe input,\n"
+          "\tseveral inputs are mixed, append @<gain> to an input to scale its level,\n"
+          "\ttone[:<frequency>] generates a sine wave\n"));
     printf (_("[--audio_rate #] sample rate for audio capture\n"));
     printf (_("[--audio_bits #] bit rate for audio capture\n"));
     printf (_("[--audio_channels #] number of audio channels\n"));
+    printf (_
+            ("[--audio_resample fast|medium|high] quality of resampling audio inputs\n"));
 #endif     // HAVE_FFMPEG_AUDIO
 
     printf (_("Supported output formats:\n"));
@@ -265,6 +326,22 @@ parse_cli_options (XVC_CapTypeOptions * tmp_capture_options, int argc,
         {"auto", no_argument, NULL, 0},
         {"rescale", required_argument, NULL, 0},
         {"window", required_argument, NULL, 0},
+        {"audio_resample", required_argument, NULL, 0},
+        {"replay", required_argument, NULL, 0},
+        {"replay_mem", required_argument, NULL, 0},
+        {"trace", required_argument, NULL, 0},
+        {"benchmark", optional_argument, NULL, 0},
+        {"capture_log", required_argument, NULL, 0},
+        {"max_speed", no_argument, NULL, 0},
+        {"verify_damage", required_argument, NULL, 0},
+        {"async_write", no_argument, NULL, 0},
+        {"store_delta", required_argument, NULL, 0},
+        {"export", required_argument, NULL, 0},
+        {"mmap_write", no_argument, NULL, 0},
+        {"write_behind", required_argument, NULL, 0},
+        {"store_compress", no_argument, NULL, 0},
+        {"transcode", required_argument, NULL, 0},
+        {"transcode_jobs", required_argument, NULL, 0},
         {NULL, 0, NULL, 0},
     };
     int opt_index = 0, c;
@@ -302,6 +379,16 @@ parse_cli_options (XVC_CapTypeOptions * tmp_capture_options, int argc,
 #ifdef HAVE_SHMAT
                 app->source = strdup (optarg);
 #else
+                // replaying a capture log or generating frames needs no SHM
+                // and probing does without it
+                if (strcasecmp (optarg, "auto") == 0 ||
+                    strncasecmp (optarg, XVC_REPLAY_SOURCE,
+                                 strlen (XVC_REPLAY_SOURCE)) == 0 ||
+                    strncasecmp (optarg, XVC_SYNTH_SOURCE,
+                                 strlen (XVC_SYNTH_SOURCE)) == 0) {
+                    app->source = strdup (optarg);
+                    break;
+                }
                 fprintf (stderr,
                          _
                          ("Only 'x11' is supported as a capture source with this binary.\n"));
@@ -662,6 +749,82 @@ parse_cli_options (XVC_CapTypeOptions * tmp_capture_options, int argc,
                     capture_window = (Window) win_id;
                     break;
                 }
+            case 28:                  // audio_resample
+#ifdef HAVE_FFMPEG_AUDIO
+                {
+                    int q = xvc_resampler_quality_from_string (optarg);
+
+                    if (q < 0)
+                        usage (_argv[0]);
+                    app->resample_quality = q;
+                }
+#else
+                fprintf (stderr,
+                         _("Audio support not present in this binary.\n"));
+                usage (_argv[0]);
+#endif     // HAVE_FFMPEG_AUDIO
+                break;
+#ifdef USE_FFMPEG
+            case 29:                  // replay
+                app->replay_time = atoi (optarg);
+                if (app->replay_time < 0)
+                    usage (_argv[0]);
+                break;
+            case 30:                  // replay_mem
+                app->replay_mem = atoi (optarg);
+                if (app->replay_mem < 1)
+                    usage (_argv[0]);
+                break;
+#endif     // USE_FFMPEG
+            case 31:                  // trace
+                app->trace_file = strdup (optarg);
+                break;
+            case 32:                  // benchmark
+                app->benchmark = strdup (optarg ? optarg : "all");
+                break;
+            case 33:                  // capture_log
+                app->capture_log = strdup (optarg);
+                break;
+            case 34:                  // max_speed
+                app->flags |= FLG_MAX_SPEED;
+                break;
+            case 35:                  // verify_damage
+                app->verify_damage = atoi (optarg);
+                if (app->verify_damage < 0)
+                    usage (_argv[0]);
+                break;
+            case 36:                  // async_write
+                app->flags |= FLG_ASYNC_WRITE;
+                break;
+            case 37:                  // store_delta
+                app->store_delta = atoi (optarg);
+                if (app->store_delta < 0)
+                    usage (_argv[0]);
+                break;
+            case 38:                  // export
+                app->export_store = strdup (optarg);
+                break;
+            case 39:                  // mmap_write
+                app->flags |= FLG_MMAP_WRITE;
+                break;
+            case 40:                  // write_behind
+                app->write_behind_chunk = 0;
+                if (sscanf (optarg, "%d:%d", &app->write_behind,
+                            &app->write_behind_chunk) < 1 ||
+                    app->write_behind < 1 || app->write_behind_chunk < 0)
+                    usage (_argv[0]);
+                break;
+            case 41:                  // store_compress
+                app->flags |= FLG_STORE_COMPRESS;
+                break;
+            case 42:                  // transcode
+                app->transcode_store = strdup (optarg);
+                break;
+            case 43:                  // transcode_jobs
+                app->transcode_jobs = atoi (optarg);
+                if (app->transcode_jobs < 1)
+                    usage (_argv[0]);
+                break;
             default:
                 usage (_argv[0]);
                 break;
@@ -838,6 +1001,112 @@ xvc_signal_handler (int signal)
 #undef DEBUGFUNCTION
 }
 
+/** \brief set by SIGINT to stop a recording without display */
+static volatile sig_atomic_t headless_stop = FALSE;
+
+/**
+ * \brief signal handler stopping a recording without display
+ *
+ * @param signal the signal number to handle
+ */
+static void
+headless_signal_handler (int signal)
+{
+    headless_stop = TRUE;
+}
+
+/**
+ * \brief records from the synth capture source when there is no display
+ *
+ * Without a display there is neither a GUI nor a GTK main loop, so this
+ * runs the capture in the main thread the way the recording thread does
+ * with --gui no. Recording stops after the configured time or number of
+ * frames or on CTRL-C. With FLG_AUTO_CONTINUE, reaching the time continues
+ * in the next file instead.
+ *
+ * @param target pointer to the XVC_CapTypeOptions representing the
+ *      currently active capture mode within the global XVC_AppData struct
+ * @param errors the errors found when validating the options
+ * @return 0 on success or 1 on failure
+ */
+static int
+record_headless (XVC_CapTypeOptions * target, XVC_ErrorListItem * errors)
+{
+#undef DEBUGFUNCTION
+#define DEBUGFUNCTION "record_headless()"
+    XVC_ErrorListItem *err;
+    Job *job;
+    struct timeval curr_time;
+    long start_time, now, pause;
+    int failed = FALSE, restart = FALSE;
+
+    // there is nobody to resolve conflicting settings
+    for (err = errors; err != NULL; err = err->next) {
+        if (err->err->type != XVC_ERR_INFO || app->flags & FLG_RUN_VERBOSE)
+            xvc_error_write_msg (err->err->code, 0);
+        if (err->err->type != XVC_ERR_INFO)
+            failed = TRUE;
+    }
+    xvc_errorlist_delete (errors);
+    if (failed) {
+        fprintf (stderr,
+                 _("%s %s: You have specified some conflicting settings.\n"),
+                 DEBUGFILE, DEBUGFUNCTION);
+        return 1;
+    }
+
+    xvc_job_set_from_app_data (app);
+    job = xvc_job_ptr ();
+    if (app->current_mode > 0)
+        job->pic_no = target->start_no;
+    xvc_job_set_state (VC_REC | VC_START);
+    my_signal_add (SIGINT, headless_signal_handler);
+
+    gettimeofday (&curr_time, NULL);
+    start_time = curr_time.tv_sec * 1000 + curr_time.tv_usec / 1000;
+    while (TRUE) {
+        gettimeofday (&curr_time, NULL);
+        now = curr_time.tv_sec * 1000 + curr_time.tv_usec / 1000;
+        // stop or continue in the next file like the GUI's timer does
+        if ((job->state & VC_REC) && !headless_stop && target->time != 0 &&
+            now - start_time >= target->time * 1000 &&
+            (job->flags & FLG_AUTO_CONTINUE)) {
+            start_time = now;
+            if (job->roll_over) {
+                xvc_job_request_roll_over ();
+            } else {
+                // VC_CONTINUE would have the capture restart through the
+                // GUI's hooks, so the restart is done below instead
+                xvc_job_set_state (VC_STOP);
+                restart = TRUE;
+            }
+        } else if ((job->state & VC_REC) &&
+                   (headless_stop || (target->time != 0 &&
+                                      now - start_time >=
+                                      target->time * 1000)))
+            xvc_job_set_state (VC_STOP);
+
+        pause = (*job->capture) ();
+        if (job->state & VC_READY) {
+            if (!restart || headless_stop || job->capture_returned_errno != 0)
+                break;
+            restart = FALSE;
+            job->movie_no += 1;
+            job->pic_no = target->start_no;
+            xvc_job_set_state (VC_REC | VC_START);
+        } else if (pause > 0)
+            usleep (pause * 1000);
+    }
+
+    if (job->capture_returned_errno != 0) {
+        fprintf (stderr, _("%s %s: Error capturing: %s\n"), DEBUGFILE,
+                 DEBUGFUNCTION, strerror (job->capture_returned_errno));
+        return 1;
+    }
+    return 0;
+#undef DEBUGFUNCTION
+}
+
 /**
  * \brief prints the current settings, i.e. the stuff in the global
  *      XVC_AppData struct but only stepping into the XVC_CapTypeOptions
@@ -897,8 +1166,17 @@ print_current_settings (XVC_CapTypeOptions * target)
     printf (_(" time to capture = %i sec\n"), target->time);
     printf (_(" autocontinue = %s\n"),
             ((app->flags & FLG_AUTO_CONTINUE) ? "yes" : "no"));
+#ifdef USE_FFMPEG
+    if (app->replay_time > 0)
+        printf (_(" replay = last %i sec, at most %i MB\n"),
+                app->replay_time, app->replay_mem);
+#endif     // USE_FFMPEG
     printf (_(" input source = %s (%d)\n"), app->source,
             app->flags & FLG_SOURCE);
+    if (app->trace_file)
+        printf (_(" trace file = %s\n"), app->trace_file);
+    if (app->capture_log)
+        printf (_(" capture log = %s\n"), app->capture_log);
     printf (_(" capture pointer = %s\n"), mp);
 #ifdef HAVE_FFMPEG_AUDIO
     printf (_(" capture audio = %s\n"),
@@ -907,6 +1185,8 @@ print_current_settings (XVC_CapTypeOptions * target)
     printf (_(" - sample rate = %i\n"), target->sndrate);
     printf (_(" - bit rate = %i\n"), target->sndsize);
     printf (_(" - channels = %i\n"), target->sndchannels);
+    printf (_(" - resampling quality = %s\n"),
+            xvc_resampler_quality_name (app->resample_quality));
 #endif     // HAVE_FFMPEG_AUDIO
     printf (_(" animate command = %s\n"), target->play_cmd);
     printf (_(" make video command= %s\n"), target->video_cmd);
@@ -961,6 +1241,41 @@ main (int argc, char *argv[])
         }
     }
 
+    // benchmark mode saves generated frames without any GUI
+    if (app->benchmark) {
+        resultCode = xvc_benchmark_run (app->benchmark, target);
+        cleanup ();
+        return (resultCode);
+    }
+    // export mode writes frames from a frame store without any GUI
+    if (app->export_store) {
+        resultCode = xvc_frame_store_export (app->export_store, target->file);
+        cleanup ();
+        return (resultCode);
+    }
+    // transcode mode encodes the frames of a frame store without any GUI
+    if (app->transcode_store) {
+        resultCode = xvc_frame_store_transcode (app->transcode_store, target);
+        cleanup ();
+        return (resultCode);
+    }
+    // without a display only generated frames can be recorded, and only
+    // without GUI
+    if (!app->dpy) {
+        if (!(app->flags & FLG_USE_SYNTH) || !(app->flags & FLG_NOGUI)) {
+            fprintf (stderr,
+                     _
+                     ("%s %s: can't open display, only --source synth with --gui no works without one ... aborting\n"),
+                     DEBUGFILE, DEBUGFUNCTION);
+            exit (2);
+        }
+        if (app->verbose) {
+            print_current_settings (target);
+        }
+        resultCode = record_headless (target, errors_after_cli);
+        cleanup ();
+        return (resultCode);
+    }
     // these are the hooks for a GUI to create the GUI,
     // the selection frame, and do some initialization ...
     if (!xvc_ui_create ()) {
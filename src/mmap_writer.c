@@ -0,0 +1,266 @@
+/**
+ * \file mmap_writer.c
+ *
+ * This file contains writing a file through a shared mapping instead of
+ * write (). The file is extended by a chunk at a time with
+ * posix_fallocate () and the chunk is mapped, so frames can be built or
+ * copied right where they go in the file. Chunks that are full are handed
+ * to a thread which flushes them with msync (), drops them from the
+ * mapping and unmaps them, so the capture thread never waits for the disk
+ * unless the thread falls behind by XVC_MMAP_MAX_PENDING chunks.
+ */
+/*
+ * Copyright (C) 2003-07 Karl H. Beckers, Frankfurt
+ * EMail: khb@jarre-de-the.net
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif     // HAVE_CONFIG_H
+
+#define DEBUGFILE "mmap_writer.c"
+#endif     // DOXYGEN_SHOULD_SKIP_THIS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+
+#include "mmap_writer.h"
+#include "app_data.h"
+#include "trace.h"
+#include "xvidcap-intl.h"
+
+/**
+ * \brief flushes and unmaps the chunks handed over until stop is set and
+ *      no chunk is pending
+ *
+ * @param arg the XVC_MmapWriter
+ * @return NULL
+ */
+static void *
+flush_thread (void *arg)
+{
+    XVC_MmapWriter *w = (XVC_MmapWriter *) arg;
+    XVC_MmapChunk chunk;
+
+    xvc_trace_thread_name ("mmap flush");
+    while (TRUE) {
+        pthread_mutex_lock (&w->mutex);
+        while (w->num_pending == 0 && !w->stop)
+            pthread_cond_wait (&w->queued, &w->mutex);
+        if (w->num_pending == 0) {
+            pthread_mutex_unlock (&w->mutex);
+            break;
+        }
+        chunk = w->pending[0];
+        pthread_mutex_unlock (&w->mutex);
+
+        if (msync (chunk.addr, chunk.len, MS_SYNC) < 0)
+            perror (w->file);
+        // the pages are written, don't let them crowd the page cache
+        madvise (chunk.addr, chunk.len, MADV_DONTNEED);
+        munmap (chunk.addr, chunk.len);
+
+        pthread_mutex_lock (&w->mutex);
+        w->num_pending--;
+        memmove (w->pending, w->pending + 1,
+                 sizeof (XVC_MmapChunk) * w->num_pending);
+        pthread_cond_signal (&w->flushed);
+        pthread_mutex_unlock (&w->mutex);
+    }
+    return NULL;
+}
+
+/**
+ * \brief hands the current chunk to the flush thread, waiting if too many
+ *      are pending already
+ *
+ * @param w the writer
+ */
+static void
+retire_chunk (XVC_MmapWriter * w)
+{
+    if (!w->current.addr)
+        return;
+    pthread_mutex_lock (&w->mutex);
+    while (w->num_pending == XVC_MMAP_MAX_PENDING)
+        pthread_cond_wait (&w->flushed, &w->mutex);
+    w->pending[w->num_pending++] = w->current;
+    pthread_cond_signal (&w->queued);
+    pthread_mutex_unlock (&w->mutex);
+    w->current.addr = NULL;
+    w->current.len = 0;
+}
+
+/**
+ * \brief extends the file and maps the chunk that pos and the next size
+ *      bytes fall into
+ *
+ * @param w the writer
+ * @param size the number of bytes that must fit into the chunk
+ * @return 0 on success or -1 on error
+ */
+static int
+map_chunk (XVC_MmapWriter * w, size_t size)
+{
+#define DEBUGFUNCTION "map_chunk()"
+    long page = sysconf (_SC_PAGESIZE);
+    uint64_t start = w->pos - w->pos % page;
+    size_t len = w->chunk_size;
+    void *addr;
+    int err;
+
+    if (len < (w->pos - start) + size)
+        len = (w->pos - start) + size + page - 1;
+    len -= len % page;
+
+    if (start + len > w->allocated) {
+        err = posix_fallocate (w->fd, w->allocated,
+                               start + len - w->allocated);
+        // file systems without fallocate get a sparse file
+        if (err != 0 && ftruncate (w->fd, start + len) < 0)
+            err = errno;
+        else
+            err = 0;
+        if (err != 0) {
+            fprintf (stderr, _("%s %s: Can't extend %s: %s\n"), DEBUGFILE,
+                     DEBUGFUNCTION, w->file, strerror (err));
+            return -1;
+        }
+        w->allocated = start + len;
+    }
+
+    addr = mmap (NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, w->fd,
+                 start);
+    if (addr == MAP_FAILED) {
+        fprintf (stderr, _("%s %s: Can't map %s: %s\n"), DEBUGFILE,
+                 DEBUGFUNCTION, w->file, strerror (errno));
+        return -1;
+    }
+    w->current.addr = addr;
+    w->current.len = len;
+    w->map_offset = start;
+    return 0;
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief starts writing a file through mappings
+ *
+ * @param fd the file, opened for reading and writing
+ * @param file name of the file for error messages
+ * @param offset file offset to start writing at, everything before it is
+ *      kept
+ * @param chunk_size size of the chunks to extend and map the file by,
+ *      0 for XVC_MMAP_CHUNK
+ * @return the writer or NULL on error
+ */
+XVC_MmapWriter *
+xvc_mmap_writer_start (int fd, const char *file, uint64_t offset,
+                       size_t chunk_size)
+{
+    XVC_MmapWriter *w;
+
+    w = calloc (1, sizeof (XVC_MmapWriter));
+    if (!w)
+        return NULL;
+    w->fd = fd;
+    w->file = file;
+    w->chunk_size = (chunk_size > 0 ? chunk_size : XVC_MMAP_CHUNK);
+    w->pos = offset;
+    w->allocated = offset;
+    pthread_mutex_init (&w->mutex, NULL);
+    pthread_cond_init (&w->queued, NULL);
+    pthread_cond_init (&w->flushed, NULL);
+    if (pthread_create (&w->tid, NULL, flush_thread, w) != 0) {
+        pthread_mutex_destroy (&w->mutex);
+        pthread_cond_destroy (&w->queued);
+        pthread_cond_destroy (&w->flushed);
+        free (w);
+        return NULL;
+    }
+    return w;
+}
+
+/**
+ * \brief gets the place in the mapping the next size bytes go to
+ *
+ * @param w the writer
+ * @param size the maximum number of bytes that will be written
+ * @return a pointer to write to or NULL on error
+ */
+void *
+xvc_mmap_writer_reserve (XVC_MmapWriter * w, size_t size)
+{
+    if (!w->current.addr ||
+        w->pos + size > w->map_offset + w->current.len) {
+        retire_chunk (w);
+        if (map_chunk (w, size) < 0)
+            return NULL;
+    }
+    return w->current.addr + (w->pos - w->map_offset);
+}
+
+/**
+ * \brief marks bytes written to the place returned by
+ *      xvc_mmap_writer_reserve () as used
+ *
+ * @param w the writer
+ * @param size the number of bytes written, at most what was reserved
+ */
+void
+xvc_mmap_writer_commit (XVC_MmapWriter * w, size_t size)
+{
+    w->pos += size;
+}
+
+/**
+ * \brief waits for all chunks to be flushed, cuts the file down to what was
+ *      written and frees the writer
+ *
+ * @param w the writer
+ * @return the file offset after the last byte written or -1 on error
+ */
+int64_t
+xvc_mmap_writer_finish (XVC_MmapWriter * w)
+{
+    int64_t end = w->pos;
+
+    retire_chunk (w);
+    pthread_mutex_lock (&w->mutex);
+    w->stop = TRUE;
+    pthread_cond_signal (&w->queued);
+    pthread_mutex_unlock (&w->mutex);
+    pthread_join (w->tid, NULL);
+
+    if (ftruncate (w->fd, end) < 0) {
+        perror (w->file);
+        end = -1;
+    }
+    pthread_mutex_destroy (&w->mutex);
+    pthread_cond_destroy (&w->queued);
+    pthread_cond_destroy (&w->flushed);
+    free (w);
+    return end;
+}
@@ -0,0 +1,88 @@
+/**
+ * \file mmap_writer.h
+ */
+/*
+ * Copyright (C) 2003-07 Karl H. Beckers, Frankfurt
+ * EMail: khb@jarre-de-the.net
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef _xvc_MMAP_WRITER_H__
+#define _xvc_MMAP_WRITER_H__
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+#include <sys/types.h>
+#include <inttypes.h>
+#include <pthread.h>
+#endif     // DOXYGEN_SHOULD_SKIP_THIS
+
+/** \brief default size of the chunks a file is extended and mapped by */
+#define XVC_MMAP_CHUNK (64 * 1024 * 1024)
+/** \brief mappings that may wait to be flushed before writing waits */
+#define XVC_MMAP_MAX_PENDING 4
+
+/**
+ * \brief a part of the file that is mapped
+ */
+typedef struct
+{
+    /** \brief start of the mapping */
+    char *addr;
+    /** \brief length of the mapping */
+    size_t len;
+} XVC_MmapChunk;
+
+/**
+ * \brief a file written through a mapping
+ */
+typedef struct
+{
+    /** \brief the file, not closed by the writer */
+    int fd;
+    /** \brief name of the file for error messages */
+    const char *file;
+    /** \brief size of the chunks the file is extended and mapped by */
+    size_t chunk_size;
+    /** \brief the chunk mapped for writing */
+    XVC_MmapChunk current;
+    /** \brief file offset of the start of the current chunk */
+    uint64_t map_offset;
+    /** \brief file offset to write to next */
+    uint64_t pos;
+    /** \brief size the file has been extended to */
+    uint64_t allocated;
+    /** \brief chunks written and waiting for the flush thread */
+    XVC_MmapChunk pending[XVC_MMAP_MAX_PENDING];
+    int num_pending;
+    /** \brief set when the flush thread should end */
+    int stop;
+    /** \brief the thread flushing and unmapping the chunks written */
+    pthread_t tid;
+    /** \brief protects pending and stop */
+    pthread_mutex_t mutex;
+    /** \brief signalled when a chunk is pending or stop is set */
+    pthread_cond_t queued;
+    /** \brief signalled when the flush thread is done with a chunk */
+    pthread_cond_t flushed;
+} XVC_MmapWriter;
+
+XVC_MmapWriter *xvc_mmap_writer_start (int fd, const char *file,
+                                       uint64_t offset, size_t chunk_size);
+void *xvc_mmap_writer_reserve (XVC_MmapWriter * w, size_t size);
+void xvc_mmap_writer_commit (XVC_MmapWriter * w, size_t size);
+int64_t xvc_mmap_writer_finish (XVC_MmapWriter * w);
+
+#endif     // _xvc_MMAP_WRITER_H__
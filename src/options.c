@@ -40,6 +40,7 @@
 #include "job.h"
 #include "app_data.h"
 #include "codecs.h"
+#include "resampler.h"
 #include "xvidcap-intl.h"
 
 #define OPS_FILE ".xvidcaprc"
@@ -102,6 +103,11 @@ xvc_write_options_file ()
     fprintf (fp, _("# device to grab audio from\n"));
     fprintf (fp, "audio_in: %s\n",
              ((strcmp (app->snddev, "pipe:") == 0) ? "-" : app->snddev));
+    fprintf (fp,
+             _
+             ("# quality of audio resampling: fast, medium, or high\n"));
+    fprintf (fp, "audio_resample: %s\n",
+             xvc_resampler_quality_name (app->resample_quality));
 #endif     // HAVE_FFMPEG_AUDIO
     fprintf (fp,
              _
@@ -444,6 +450,17 @@ xvc_read_options_file ()
 #ifdef HAVE_FFMPEG_AUDIO
                 else if (strcasecmp (token, "audio_in") == 0) {
                     app->snddev = strdup (value);
+                } else if (strcasecmp (token, "audio_resample") == 0) {
+                    int q = xvc_resampler_quality_from_string (value);
+
+                    if (q >= 0)
+                        app->resample_quality = q;
+                    else {
+                        app->resample_quality = XVC_RESAMPLE_MEDIUM;
+                        fprintf (stderr,
+                                 _
+                                 ("reading unsupported audio_resample value from options file\nresetting to medium quality\n"));
+                    }
                 }
 #endif     // HAVE_FFMPEG_AUDIO
                 else if (strcasecmp (token, "mouse_wanted") == 0) {
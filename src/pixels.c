@@ -0,0 +1,435 @@
+/**
+ * \file pixels.c
+ *
+ * This file contains the per-pixel routines applied to captured frames,
+ * i. e. copying damaged areas into a frame, alpha blending the real mouse
+ * pointer and the conversions libswscale cannot do for us. They are kept
+ * apart from capture and encoding so xvidcap-pixel-bench can time them
+ * on generated images.
+ */
+/*
+ * Copyright (C) 1997-98 Rasca, Berlin
+ * Copyright (C) 2003-07 Karl H. Beckers, Frankfurt
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif     // HAVE_CONFIG_H
+
+#define DEBUGFILE "pixels.c"
+#endif     // DOXYGEN_SHOULD_SKIP_THIS
+
+#include <stdio.h>
+#include <string.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/XWDFile.h>
+
+#include "pixels.h"
+#include "app_data.h"
+
+/** \brief vectors used for alpha masking of real mouse pointer */
+static unsigned char top[65536];
+
+/** \brief vectors used for alpha masking of real mouse pointer */
+static unsigned char bottom[65536];
+
+/** \brief top and bottom have been filled */
+static int blend_ready = 0;
+
+/**
+ * \brief Counts the bits set in a long word
+ *
+ * @param bits a long integer as a bitfield
+ * @return the number of bits set
+ */
+static int
+count_one_bits (long bits)
+{
+    int i, res = 0;
+    for (i = 0; i < (sizeof (long) * 8); i++) {
+        if ((bits & (0x1 << i)) > 0)
+            res++;
+    }
+    return res;
+}
+
+/**
+ * \brief gets the RGB value of a palette entry
+ *
+ * @param color_table the color table of the job, XWDColor for xwd output,
+ *      u_int32_t otherwise
+ * @param i the palette entry
+ * @param xwd_colors TRUE if color_table is an XWDColor table
+ * @return the RGB value
+ */
+static long
+palette_pixel (const void *color_table, long i, int xwd_colors)
+{
+    long pixel;
+
+    if (!xwd_colors)
+        return ((const u_int32_t *) color_table)[i];
+
+    pixel = (((const XWDColor *) color_table)[i].red & 0xFF00) << 16;
+    pixel |= (((const XWDColor *) color_table)[i].green & 0xFF00) << 8;
+    pixel = ((const XWDColor *) color_table)[i].blue & 0xFF00;
+    return pixel;
+}
+
+/**
+ * \brief copies a small image into another larger image
+ *
+ * @param needle pointer to the memory containing the small image
+ * @param needle_x the x position of the small image within the larger image
+ * @param needle_y the y position of the small image within the larger image
+ * @param needle_width the width of the small image
+ * @param needle_bytes_pl number of bytes per line in the small image (may be
+ *      padded.)
+ * @param needle_height the height of the small image
+ * @param haystack pointer to the memory holding the larger image
+ * @param haystack_width the width of the larger image
+ * @param haystack_bytes_pl number of bytes per line in the larger image (may
+ *      be padded.)
+ * @param haystack_height the height of the larger image
+ * @param bytes_per_pixel the number of bytes a pixel requires for
+ *      representation, e.g. 4 for rgba, 1 for pal8. This requires the value
+ *      to be identical for needle and haystack.
+ */
+void
+xvc_pixels_place_image (const char *needle, int needle_x, int needle_y,
+                        int needle_width, int needle_bytes_pl,
+                        int needle_height, char *haystack, int haystack_width,
+                        int haystack_bytes_pl, int haystack_height,
+                        int bytes_per_pixel)
+{
+#define DEBUGFUNCTION "xvc_pixels_place_image()"
+    char *h_cursor;
+    const char *n_cursor;
+    int i;
+
+    h_cursor =
+        haystack + ((needle_x * bytes_per_pixel) +
+                    (needle_y * haystack_bytes_pl));
+    n_cursor = needle;
+    for (i = 0; i < needle_height; i++) {
+        if (h_cursor + (needle_width * bytes_per_pixel) >
+            haystack + (haystack_height * haystack_bytes_pl)) {
+            fprintf (stderr, "%s %s: out of bounds ... clipped correctly?\n",
+                     DEBUGFILE, DEBUGFUNCTION);
+            break;
+        }
+        memcpy (h_cursor, n_cursor, needle_width * bytes_per_pixel);
+        h_cursor += haystack_bytes_pl;
+        n_cursor += needle_bytes_pl;
+    }
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief fills the tables xvc_pixels_blend_cursor () uses for alpha
+ *      blending. This only does something the first time it is called.
+ */
+void
+xvc_pixels_init_blend ()
+{
+    unsigned int mask, color;
+
+    if (blend_ready)
+        return;
+
+    for (mask = 0; mask <= 255; mask++) {
+        for (color = 0; color <= 255; color++) {
+            top[(mask << 8) + color] = (color * (mask + 1)) >> 8;
+            bottom[(mask << 8) + color] = (color * (256 - mask)) >> 8;
+        }
+    }
+    blend_ready = 1;
+}
+
+/**
+ * \brief alpha blends an ARGB mouse pointer image as returned by XFixes
+ *      into an XImage. Parts of the pointer outside the image are clipped.
+ *      xvc_pixels_init_blend () must have been called before.
+ *
+ * @param image the XImage to paint the pointer into
+ * @param x the x position of the pointer's top left corner relative to the
+ *      image, may be negative
+ * @param y the y position of the pointer's top left corner relative to the
+ *      image, may be negative
+ * @param cursor the ARGB pixels of the pointer, one per long
+ * @param cursor_width the width of the pointer image
+ * @param cursor_height the height of the pointer image
+ * @param c_info color information about the image
+ * @param color_table the color table used for 8 bit palette images
+ * @param ncolors the number of entries in color_table
+ * @param xwd_colors TRUE if color_table is an XWDColor table as used for xwd
+ *      output, otherwise it contains u_int32_t RGB values
+ */
+void
+xvc_pixels_blend_cursor (XImage * image, int x, int y,
+                         const unsigned long *cursor, int cursor_width,
+                         int cursor_height, const ColorInfo * c_info,
+                         const void *color_table, int ncolors, int xwd_colors)
+{
+    int line, first_column = XVC_MAX (0, -x);
+    int last_column = XVC_MIN (cursor_width, image->width - x);
+    unsigned char topp, botp;
+    unsigned long applied;
+
+    for (line = XVC_MAX (0, -y);
+         line < XVC_MIN (cursor_height, image->height - y); line++) {
+        const unsigned long *pix_pointer =
+            cursor + (line * cursor_width) + first_column;
+        int column;
+
+        for (column = first_column; column < last_column; column++) {
+            int count;
+            int rel_x = x + column;
+            int rel_y = y + line;
+
+            /** \brief alpha mask of the pointer pixel */
+            int mask = (*pix_pointer & c_info->alpha_mask) >>
+                c_info->alpha_shift;
+            int shift, src_shift, src_mask;
+
+            /* The manpage of XGetPixel say the return value is
+             * "normalized". No idea what's meant by that, because
+             * the values returned are definetely exactly as in the
+             * XImage, i.e. a 8 bit palette element for PAL8 or a
+             * 16bit RGB value for RGB16 expanded to a long */
+            long pixel = XGetPixel (image, rel_x, rel_y);
+
+            /* alpha masking on 8bit palette seems to have issues with
+             * high transparencies. We just ignore those. */
+            if (image->depth == 8) {
+                if (mask < 10)
+                    mask = 0;
+            }
+            // shortcut
+            if (mask == 0) {
+                applied = pixel;
+            } else {
+                applied = 0;
+
+                /* if we're on PAL8 we want the actual RGB values from
+                 * the palette rather than the palette element. We can
+                 * safely ignore alpha, here. */
+                if (image->depth == 8)
+                    pixel = palette_pixel (color_table, pixel & 0x00FFFFFF,
+                                           xwd_colors);
+
+                // treat one color element at a time
+                for (count = 2; count >= 0; count--) {
+                    shift = count * 8;
+
+                    /* if we don't have PAL8, we have RGB and need to
+                     * take native bit shifts and masks taken from X11
+                     * into account.
+                     * Otherwise we got the RGB values from the palette
+                     * where they are always 8 bit per color. */
+                    if (image->depth != 8) {
+                        switch (count) {
+                        case 2:
+                            src_shift = c_info->red_shift;
+                            src_mask = image->red_mask;
+                            break;
+                        case 1:
+                            src_shift = c_info->green_shift;
+                            src_mask = image->green_mask;
+                            break;
+                        default:
+                            src_shift = c_info->blue_shift;
+                            src_mask = image->blue_mask;
+                        }
+                    } else {
+                        src_shift = shift;
+                        src_mask = 0xFF << src_shift;
+                    }
+
+                    // alpha blending next
+                    topp = top[(mask << 8) + ((*pix_pointer >> shift) & 0xFF)];
+                    botp = bottom[(mask << 8) +
+                                  (((pixel & src_mask) >> src_shift) & 0xFF)];
+
+                    applied |=
+                        ((topp + botp) & (src_mask >> src_shift)) << src_shift;
+                }
+
+                /* if we have PAL8 we need to find the palette element
+                 * closest to the result of the alpha blending before
+                 * writing back to the XImage. We do this by calculating
+                 * the number of bits matching between the blended RGB
+                 * value and each palette entry until we find an exact
+                 * match. */
+                if (image->depth == 8) {
+                    int elem = 0;
+                    int i = 0, delta = 0;
+                    int elem_delta;
+                    long ct_pixel;
+
+                    ct_pixel = palette_pixel (color_table, i, xwd_colors);
+                    elem_delta =
+                        count_one_bits ((applied & ct_pixel) & 0x00FFFFFF);
+                    elem_delta +=
+                        count_one_bits ((~applied & ~ct_pixel) & 0x00FFFFFF);
+
+                    if (elem != applied) {
+                        for (i = 1; i < ncolors; i++) {
+                            ct_pixel =
+                                palette_pixel (color_table, i, xwd_colors);
+                            delta =
+                                count_one_bits ((applied & ct_pixel) &
+                                                0x00FFFFFF);
+                            delta +=
+                                count_one_bits ((~applied & ~ct_pixel) &
+                                                0x00FFFFFF);
+                            if (delta > elem_delta) {
+                                elem_delta = delta;
+                                elem = i;
+                                if (elem_delta == 24)
+                                    break;
+                            }
+                        }
+                        applied = elem;
+                    }
+                }
+            }
+
+            // write pixel
+            XPutPixel (image, rel_x, rel_y, applied);
+
+            pix_pointer++;
+        }
+    }
+}
+
+/**
+ * \brief convert bgra32 to rgba32 in place
+ *
+ * needed on Solaris/SPARC because the ffmpeg version used doesn't know
+ * PIX_FMT_ABGR32, i.e. byte ordering is not taken care of
+ * @param image the XImage to convert
+ */
+void
+xvc_pixels_abgr32_to_argb32 (XImage * image)
+{
+#define DEBUGFUNCTION "xvc_pixels_abgr32_to_argb32()"
+    char *pdata, *counter;
+
+#ifdef DEBUG
+    printf ("%s %s: Entering with image %p\n", DEBUGFILE, DEBUGFUNCTION, image);
+#endif     // DEBUG
+
+    pdata = image->data;
+
+    for (counter = pdata;
+         counter < (pdata + (image->width * image->height * 4)); counter += 4) {
+        char swap;
+
+        if (image->byte_order) {       // MSBFirst has order argb -> abgr
+            // = rgba32
+            swap = *(counter + 1);
+            *(counter + 1) = *(counter + 3);
+            *(counter + 3) = swap;
+        } else {                       // LSBFirst has order bgra -> rgba
+            swap = *counter;
+            *counter = *(counter + 2);
+            *(counter + 2) = swap;
+        }
+    }
+
+#ifdef DEBUG
+    printf ("%s %s: Leaving\n", DEBUGFILE, DEBUGFUNCTION);
+#endif     // DEBUG
+
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief convert pal8 to rgb24
+ *
+ * libswscale does not support pal8 input atm
+ * @param image the XImage to convert
+ * @param color_table the color table as returned by
+ *      xvc_ffmpeg_get_color_table ()
+ * @param out where to write the packed RGB24 output, it needs to hold
+ *      width * height * 3 bytes
+ * \todo very current ffmpeg versions seem to make this unneccessary
+ */
+void
+xvc_pixels_pal8_to_rgb24 (const XImage * image, const u_int32_t * color_table,
+                          uint8_t * out)
+{
+    int y = 0, x = 0;
+    const uint8_t *in_cursor = NULL;
+
+    /**
+     * 8bit pseudo-color images may have lines padded by excess bytes
+     * these need to be removed before conversion
+     * \todo other formats might also have this problem
+     */
+    for (y = 0; y < image->height; y++) {
+        in_cursor = (uint8_t *) image->data + (y * image->bytes_per_line);
+        for (x = 0; x < image->width; x++) {
+            *out++ = ((color_table[*in_cursor] & 0x00FF0000) >> 16);
+            *out++ = ((color_table[*in_cursor] & 0x0000FF00) >> 8);
+            *out++ = (color_table[*in_cursor] & 0x000000FF);
+            in_cursor++;
+        }
+    }
+}
+
+/**
+ * \brief convert a 32 bit true color image to rgb24 using the image's
+ *      color masks, alpha is dropped
+ *
+ * @param image the XImage to convert
+ * @param c_info color information about the image
+ * @param out where to write the packed RGB24 output, it needs to hold
+ *      width * height * 3 bytes
+ */
+void
+xvc_pixels_rgb32_to_rgb24 (const XImage * image, const ColorInfo * c_info,
+                           uint8_t * out)
+{
+    int row, col;
+
+    register unsigned int
+        rm = image->red_mask,
+        gm = image->green_mask,
+        bm = image->blue_mask,
+        rs = c_info->red_shift,
+        gs = c_info->green_shift,
+        bs = c_info->blue_shift, *p32 = (unsigned int *) image->data;
+
+    for (row = 0; row < image->height; row++) {
+        for (col = 0; col < image->width; col++) {
+            *out++ = ((*p32 & rm) >> rs);
+            *out++ = ((*p32 & gm) >> gs);
+            *out++ = ((*p32 & bm) >> bs);
+            p32++;                     // ignore alpha values
+        }
+        //
+        // eat paded bytes, for better speed we use shifting,
+        // (bytes_per_line - bits_per_pixel / 8 * width ) / 4
+        //
+        p32 += (image->bytes_per_line - (image->bits_per_pixel >> 3)
+                * image->width) >> 2;
+    }
+}
@@ -0,0 +1,51 @@
+/**
+ * \file pixels.h
+ */
+/*
+ * Copyright (C) 2003-07 Karl H. Beckers, Frankfurt
+ * EMail: khb@jarre-de-the.net
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef _xvc_PIXELS_H__
+#define _xvc_PIXELS_H__
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+#include <sys/types.h>
+#include <inttypes.h>
+#include <X11/Xlib.h>
+#endif     // DOXYGEN_SHOULD_SKIP_THIS
+
+#include "colors.h"
+
+void xvc_pixels_place_image (const char *needle, int needle_x, int needle_y,
+                             int needle_width, int needle_bytes_pl,
+                             int needle_height, char *haystack,
+                             int haystack_width, int haystack_bytes_pl,
+                             int haystack_height, int bytes_per_pixel);
+void xvc_pixels_init_blend ();
+void xvc_pixels_blend_cursor (XImage * image, int x, int y,
+                              const unsigned long *cursor, int cursor_width,
+                              int cursor_height, const ColorInfo * c_info,
+                              const void *color_table, int ncolors,
+                              int xwd_colors);
+void xvc_pixels_abgr32_to_argb32 (XImage * image);
+void xvc_pixels_pal8_to_rgb24 (const XImage * image,
+                               const u_int32_t * color_table, uint8_t * out);
+void xvc_pixels_rgb32_to_rgb24 (const XImage * image,
+                                const ColorInfo * c_info, uint8_t * out);
+
+#endif     // _xvc_PIXELS_H__
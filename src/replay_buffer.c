@@ -0,0 +1,312 @@
+/**
+ * \file replay_buffer.c
+ *
+ * This file contains the in-memory buffer of encoded packets used for
+ * instant replay, i. e. recording continuously but only saving the last
+ * few minutes on request.
+ */
+/*
+ * Copyright (C) 2003-07 Karl H. Beckers, Frankfurt
+ * EMail: khb@jarre-de-the.net
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif     // HAVE_CONFIG_H
+
+#define DEBUGFILE "replay_buffer.c"
+#endif     // DOXYGEN_SHOULD_SKIP_THIS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "replay_buffer.h"
+#include "xvidcap-intl.h"
+
+/**
+ * \brief drops one reference to a packet and frees it with the last one
+ *
+ * The caller must hold the buffer's mutex.
+ *
+ * @param pkt the packet to unreference
+ */
+static void
+packet_unref (XVC_ReplayPacket * pkt)
+{
+    if (--pkt->refs <= 0)
+        free (pkt);
+}
+
+/**
+ * \brief removes the oldest packet from the buffer
+ *
+ * The caller must hold the buffer's mutex.
+ *
+ * @param rb the buffer to remove the packet from
+ */
+static void
+remove_head (XVC_ReplayBuffer * rb)
+{
+    XVC_ReplayPacket *pkt = rb->head;
+
+    rb->head = pkt->next;
+    if (!rb->head)
+        rb->tail = NULL;
+    rb->count--;
+    rb->bytes -= pkt->size;
+    packet_unref (pkt);
+}
+
+/**
+ * \brief removes the oldest group of pictures from the buffer, i. e. the
+ *      head packet and everything up to the next packet starting a group
+ *
+ * The caller must hold the buffer's mutex.
+ *
+ * @param rb the buffer to evict from
+ */
+static void
+evict_gop (XVC_ReplayBuffer * rb)
+{
+    remove_head (rb);
+    while (rb->head && !rb->head->gop_start)
+        remove_head (rb);
+    rb->gops--;
+    rb->evicted++;
+}
+
+/**
+ * \brief creates a new replay buffer
+ *
+ * @param max_bytes the amount of encoded data to keep at most
+ * @param max_secs the time span to keep at most in seconds or 0 to only
+ *      limit the buffer by max_bytes
+ * @return pointer to the new buffer or NULL on failure
+ */
+XVC_ReplayBuffer *
+xvc_replay_buffer_new (int64_t max_bytes, int max_secs)
+{
+#define DEBUGFUNCTION "xvc_replay_buffer_new()"
+    XVC_ReplayBuffer *rb = NULL;
+
+    if (max_bytes <= 0 || max_secs < 0)
+        return NULL;
+
+    rb = (XVC_ReplayBuffer *) malloc (sizeof (XVC_ReplayBuffer));
+    if (!rb) {
+        fprintf (stderr, _("%s %s: Can't allocate replay buffer\n"),
+                 DEBUGFILE, DEBUGFUNCTION);
+        return NULL;
+    }
+    memset (rb, 0, sizeof (XVC_ReplayBuffer));
+    rb->max_bytes = max_bytes;
+    rb->max_time = (int64_t) max_secs * 1000000;
+
+    pthread_mutex_init (&(rb->mutex), NULL);
+
+#ifdef DEBUG
+    printf ("%s %s: replay buffer of %lli bytes, %i secs\n", DEBUGFILE,
+            DEBUGFUNCTION, (long long) max_bytes, max_secs);
+#endif     // DEBUG
+
+    return rb;
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief frees a replay buffer and the packets in it
+ *
+ * Snapshots must have been released before.
+ *
+ * @param rb the buffer to free
+ */
+void
+xvc_replay_buffer_free (XVC_ReplayBuffer * rb)
+{
+    if (!rb)
+        return;
+
+    pthread_mutex_lock (&(rb->mutex));
+    while (rb->head)
+        remove_head (rb);
+    pthread_mutex_unlock (&(rb->mutex));
+
+    pthread_mutex_destroy (&(rb->mutex));
+    free (rb);
+}
+
+/**
+ * \brief appends a copy of an encoded packet to the buffer
+ *
+ * While the buffer is empty, packets not starting a group of pictures are
+ * dropped because they could not be decoded. Afterwards, whole groups of
+ * pictures are evicted from the front until the buffer is within its
+ * limits again.
+ *
+ * @param rb the buffer to append to
+ * @param stream_index index of the output stream the packet belongs to
+ * @param data the encoded data
+ * @param size size of data in bytes
+ * @param time presentation time of the packet in microseconds
+ * @param dts decoding time of the packet in microseconds
+ * @param flags the packet's flags
+ * @param gop_start TRUE if the packet is a video keyframe
+ * @return 0 on success, 1 if the packet was dropped, -1 on failure
+ */
+int
+xvc_replay_buffer_append (XVC_ReplayBuffer * rb, int stream_index,
+                          const uint8_t * data, int size, int64_t time,
+                          int64_t dts, int flags, int gop_start)
+{
+#define DEBUGFUNCTION "xvc_replay_buffer_append()"
+    XVC_ReplayPacket *pkt = NULL;
+
+    pkt = (XVC_ReplayPacket *) malloc (sizeof (XVC_ReplayPacket) + size);
+    if (!pkt) {
+        fprintf (stderr, _("%s %s: Can't allocate %i bytes for packet\n"),
+                 DEBUGFILE, DEBUGFUNCTION, size);
+        return -1;
+    }
+    pkt->next = NULL;
+    pkt->refs = 1;
+    pkt->stream_index = stream_index;
+    pkt->time = time;
+    pkt->dts = dts;
+    pkt->flags = flags;
+    pkt->gop_start = gop_start;
+    pkt->size = size;
+    pkt->data = (uint8_t *) (pkt + 1);
+    memcpy (pkt->data, data, size);
+
+    pthread_mutex_lock (&(rb->mutex));
+    if (!rb->head && !gop_start) {
+        rb->dropped++;
+        pthread_mutex_unlock (&(rb->mutex));
+        free (pkt);
+        return 1;
+    }
+    if (rb->tail)
+        rb->tail->next = pkt;
+    else
+        rb->head = pkt;
+    rb->tail = pkt;
+    rb->count++;
+    rb->bytes += size;
+    if (gop_start)
+        rb->gops++;
+
+    // this may evict the group the new packet belongs to if a single
+    // group of pictures exceeds the budget, the buffer then waits for the
+    // next keyframe. The time span never evicts the newest group, though.
+    while (rb->head &&
+           (rb->bytes > rb->max_bytes ||
+            (rb->max_time > 0 && rb->gops > 1 &&
+             time - rb->head->time > rb->max_time)))
+        evict_gop (rb);
+    pthread_mutex_unlock (&(rb->mutex));
+
+    return 0;
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief takes a reference to all packets currently buffered
+ *
+ * The packets stay valid until released with xvc_replay_buffer_release ()
+ * even if they are evicted from the buffer in the meantime. Capturing can
+ * go on while a snapshot is written out.
+ *
+ * @param rb the buffer to take the snapshot of
+ * @param count return pointer for the number of packets in the snapshot
+ * @return a newly allocated array of packets, oldest first, or NULL if the
+ *      buffer is empty or on failure
+ */
+XVC_ReplayPacket **
+xvc_replay_buffer_snapshot (XVC_ReplayBuffer * rb, int *count)
+{
+#define DEBUGFUNCTION "xvc_replay_buffer_snapshot()"
+    XVC_ReplayPacket **pkts = NULL, *pkt;
+    int i = 0;
+
+    *count = 0;
+    pthread_mutex_lock (&(rb->mutex));
+    if (rb->count > 0) {
+        pkts =
+            (XVC_ReplayPacket **) malloc (rb->count *
+                                          sizeof (XVC_ReplayPacket *));
+        if (pkts) {
+            for (pkt = rb->head; pkt; pkt = pkt->next) {
+                pkt->refs++;
+                pkts[i++] = pkt;
+            }
+            *count = i;
+        } else {
+            fprintf (stderr, _("%s %s: Can't allocate replay snapshot\n"),
+                     DEBUGFILE, DEBUGFUNCTION);
+        }
+    }
+    pthread_mutex_unlock (&(rb->mutex));
+
+    return pkts;
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief releases a snapshot taken with xvc_replay_buffer_snapshot ()
+ *
+ * @param rb the buffer the snapshot was taken of
+ * @param pkts the snapshot, which is freed
+ * @param count number of packets in the snapshot
+ */
+void
+xvc_replay_buffer_release (XVC_ReplayBuffer * rb, XVC_ReplayPacket ** pkts,
+                           int count)
+{
+    int i;
+
+    if (!pkts)
+        return;
+
+    pthread_mutex_lock (&(rb->mutex));
+    for (i = 0; i < count; i++)
+        packet_unref (pkts[i]);
+    pthread_mutex_unlock (&(rb->mutex));
+    free (pkts);
+}
+
+/**
+ * \brief gets the amount of data currently buffered
+ *
+ * @param rb the buffer to query
+ * @param bytes return pointer for the number of bytes buffered
+ * @param secs return pointer for the time span buffered in seconds
+ * @param evicted return pointer for the number of groups of pictures
+ *      evicted so far
+ */
+void
+xvc_replay_buffer_get_status (XVC_ReplayBuffer * rb, int64_t * bytes,
+                              int *secs, unsigned long *evicted)
+{
+    pthread_mutex_lock (&(rb->mutex));
+    *bytes = rb->bytes;
+    *secs = (rb->head ? (int) ((rb->tail->time - rb->head->time) / 1000000)
+             : 0);
+    *evicted = rb->evicted;
+    pthread_mutex_unlock (&(rb->mutex));
+}
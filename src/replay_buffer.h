@@ -0,0 +1,106 @@
+/**
+ * \file replay_buffer.h
+ */
+/*
+ * Copyright (C) 2003-07 Karl H. Beckers, Frankfurt
+ * EMail: khb@jarre-de-the.net
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef _xvc_REPLAY_BUFFER_H__
+#define _xvc_REPLAY_BUFFER_H__
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+#include <sys/types.h>
+#include <inttypes.h>
+#include <pthread.h>
+#endif     // DOXYGEN_SHOULD_SKIP_THIS
+
+/**
+ * \brief an encoded packet kept in the replay buffer
+ *
+ * The packet data follows the struct in the same allocation. Packets are
+ * reference counted so a snapshot being saved keeps them alive after they
+ * have been evicted from the buffer.
+ */
+typedef struct _XVC_ReplayPacket
+{
+    /** \brief next (newer) packet in the buffer */
+    struct _XVC_ReplayPacket *next;
+    /** \brief number of references held by the buffer and snapshots */
+    int refs;
+    /** \brief index of the output stream the packet belongs to */
+    int stream_index;
+    /** \brief presentation time in microseconds */
+    int64_t time;
+    /** \brief decoding time in microseconds, before time for packets
+     *      reordered by B-frames */
+    int64_t dts;
+    /** \brief packet flags as passed in (PKT_FLAG_KEY) */
+    int flags;
+    /** \brief TRUE if this packet starts a group of pictures */
+    int gop_start;
+    /** \brief size of data in bytes */
+    int size;
+    /** \brief the encoded data */
+    uint8_t *data;
+} XVC_ReplayPacket;
+
+/**
+ * \brief a buffer of the most recent encoded packets of a capture session
+ *
+ * Packets are appended in the order they would be written to the output
+ * file. Whenever the buffer grows beyond its byte budget or time span, the
+ * oldest group of pictures is evicted as a whole, so the buffer always
+ * starts with a keyframe.
+ */
+typedef struct _XVC_ReplayBuffer
+{
+    /** \brief oldest packet */
+    XVC_ReplayPacket *head;
+    /** \brief newest packet */
+    XVC_ReplayPacket *tail;
+    /** \brief number of packets buffered */
+    int count;
+    /** \brief number of groups of pictures buffered */
+    int gops;
+    /** \brief number of data bytes buffered */
+    int64_t bytes;
+    /** \brief byte budget */
+    int64_t max_bytes;
+    /** \brief maximum time span buffered in microseconds, 0 for no limit */
+    int64_t max_time;
+    /** \brief number of groups of pictures evicted so far */
+    unsigned long evicted;
+    /** \brief number of packets that could not be buffered at all */
+    unsigned long dropped;
+    /** \brief protects everything above and the packets' refs */
+    pthread_mutex_t mutex;
+} XVC_ReplayBuffer;
+
+XVC_ReplayBuffer *xvc_replay_buffer_new (int64_t max_bytes, int max_secs);
+void xvc_replay_buffer_free (XVC_ReplayBuffer * rb);
+int xvc_replay_buffer_append (XVC_ReplayBuffer * rb, int stream_index,
+                              const uint8_t * data, int size, int64_t time,
+                              int64_t dts, int flags, int gop_start);
+XVC_ReplayPacket **xvc_replay_buffer_snapshot (XVC_ReplayBuffer * rb,
+                                               int *count);
+void xvc_replay_buffer_release (XVC_ReplayBuffer * rb,
+                                XVC_ReplayPacket ** pkts, int count);
+void xvc_replay_buffer_get_status (XVC_ReplayBuffer * rb, int64_t * bytes,
+                                   int *secs, unsigned long *evicted);
+
+#endif     // _xvc_REPLAY_BUFFER_H__
@@ -0,0 +1,441 @@
+/**
+ * \file resampler.c
+ *
+ * This file contains a polyphase windowed-sinc resampler for converting
+ * captured audio to the sample rate and number of channels of the audio
+ * stream encoded. It works on any ratio of sample rates and can have the
+ * ratio fine-tuned while running to compensate for clock drift between
+ * audio devices. The inner loop is a dot product of the input history with
+ * one phase of the filter bank which is done four samples at a time with
+ * SSE if available.
+ */
+/*
+ * Copyright (C) 2003-07 Karl H. Beckers, Frankfurt
+ * EMail: khb@jarre-de-the.net
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif     // HAVE_CONFIG_H
+
+#define DEBUGFILE "resampler.c"
+#endif     // DOXYGEN_SHOULD_SKIP_THIS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif     // __SSE__
+
+#include "resampler.h"
+#include "xvidcap-intl.h"
+
+/** \brief number of input frames the history holds besides the filter */
+#define HIST_CHUNK 4096
+
+/** \brief how far drift correction may change the resampling ratio */
+#define MAX_DRIFT 0.01
+
+/**
+ * \brief filter parameters for the different quality settings
+ */
+static const struct
+{
+    const char *name;
+    int taps;
+    int phases;
+    double beta;
+    double cutoff;
+} qualities[XVC_RESAMPLE_NUM_QUALITIES] = {
+    {"fast", 16, 64, 5.0, 0.85},
+    {"medium", 32, 128, 7.0, 0.91},
+    {"high", 64, 256, 9.0, 0.95}
+};
+
+/**
+ * \brief zeroth order modified Bessel function of the first kind as needed
+ *      for the Kaiser window
+ *
+ * @param x argument
+ * @return I0(x)
+ */
+static double
+bessel_i0 (double x)
+{
+    double sum = 1.0, term = 1.0, half = x / 2.0;
+    int k;
+
+    for (k = 1; k < 50; k++) {
+        term *= (half / k) * (half / k);
+        sum += term;
+        if (term < sum * 1e-12)
+            break;
+    }
+    return sum;
+}
+
+/**
+ * \brief computes the filter bank: a Kaiser windowed sinc lowpass sampled
+ *      at phases + 1 fractional offsets, each phase normalized to unity
+ *      gain
+ *
+ * @param r the resampler whose bank to fill
+ * @param beta Kaiser window parameter
+ * @param cutoff cutoff frequency relative to the lower Nyquist frequency
+ */
+static void
+build_bank (XVC_Resampler * r, double beta, double cutoff)
+{
+    int half = r->taps / 2, p, k;
+    double fc = cutoff, i0_beta = bessel_i0 (beta);
+
+    if (r->out_rate < r->in_rate)
+        fc *= (double) r->out_rate / r->in_rate;
+
+    for (p = 0; p <= r->phases; p++) {
+        float *row = r->bank + p * r->taps;
+        double frac = (double) p / r->phases, sum = 0;
+
+        for (k = 0; k < r->taps; k++) {
+            // distance of the tap's input sample from the output position
+            double x = (k - half + 1) - frac;
+            double t = x / half, h;
+
+            if (fabs (t) >= 1.0) {
+                h = 0;
+            } else {
+                h = (x == 0 ? fc : sin (M_PI * fc * x) / (M_PI * x));
+                h *= bessel_i0 (beta * sqrt (1.0 - t * t)) / i0_beta;
+            }
+            row[k] = (float) h;
+            sum += h;
+        }
+        for (k = 0; k < r->taps; k++)
+            row[k] = (float) (row[k] / sum);
+    }
+}
+
+/**
+ * \brief dot product of n input samples with n filter coefficients
+ *
+ * @param x input samples
+ * @param h filter coefficients, 16 byte aligned
+ * @param n number of taps, a multiple of 4
+ * @return the dot product
+ */
+static inline float
+dot (const float *x, const float *h, int n)
+{
+#ifdef __SSE__
+    __m128 acc0 = _mm_setzero_ps (), acc1 = _mm_setzero_ps ();
+    float res[4];
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm_add_ps (acc0, _mm_mul_ps (_mm_loadu_ps (x + i),
+                                             _mm_load_ps (h + i)));
+        acc1 = _mm_add_ps (acc1, _mm_mul_ps (_mm_loadu_ps (x + i + 4),
+                                             _mm_load_ps (h + i + 4)));
+    }
+    for (; i < n; i += 4)
+        acc0 = _mm_add_ps (acc0, _mm_mul_ps (_mm_loadu_ps (x + i),
+                                             _mm_load_ps (h + i)));
+    _mm_storeu_ps (res, _mm_add_ps (acc0, acc1));
+    return res[0] + res[1] + res[2] + res[3];
+#else
+    float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    int i;
+
+    for (i = 0; i < n; i += 4) {
+        s0 += x[i] * h[i];
+        s1 += x[i + 1] * h[i + 1];
+        s2 += x[i + 2] * h[i + 2];
+        s3 += x[i + 3] * h[i + 3];
+    }
+    return s0 + s1 + s2 + s3;
+#endif     // __SSE__
+}
+
+/**
+ * \brief creates a new resampler
+ *
+ * @param in_rate sample rate of the input
+ * @param out_rate sample rate to convert to
+ * @param in_channels number of channels of the input
+ * @param out_channels number of channels to produce. Mono input is copied to
+ *      all output channels, mono output gets the average of all input
+ *      channels, otherwise channels are mapped in order
+ * @param quality one of XVC_ResampleQuality
+ * @return the new resampler or NULL on failure
+ */
+XVC_Resampler *
+xvc_resampler_new (int in_rate, int out_rate, int in_channels,
+                   int out_channels, int quality)
+{
+#define DEBUGFUNCTION "xvc_resampler_new()"
+    XVC_Resampler *r;
+    void *mem = NULL;
+
+    if (in_rate <= 0 || out_rate <= 0 || in_channels <= 0
+        || out_channels <= 0)
+        return NULL;
+    if (quality < 0 || quality >= XVC_RESAMPLE_NUM_QUALITIES)
+        quality = XVC_RESAMPLE_MEDIUM;
+
+    r = (XVC_Resampler *) malloc (sizeof (XVC_Resampler));
+    if (!r) {
+        fprintf (stderr, _("%s %s: Can't allocate resampler\n"),
+                 DEBUGFILE, DEBUGFUNCTION);
+        return NULL;
+    }
+    memset (r, 0, sizeof (XVC_Resampler));
+
+    r->in_rate = in_rate;
+    r->out_rate = out_rate;
+    r->in_channels = in_channels;
+    r->out_channels = out_channels;
+    r->taps = qualities[quality].taps;
+    r->phases = qualities[quality].phases;
+    r->hist_size = HIST_CHUNK + r->taps;
+    r->base_step = r->step = (double) in_rate / out_rate;
+
+    // the dot product needs the coefficients 16 byte aligned
+    if (posix_memalign (&mem, 16,
+                        (r->phases + 1) * r->taps * sizeof (float)) != 0)
+        mem = NULL;
+    r->bank = (float *) mem;
+    r->hist = (float *) malloc (out_channels * r->hist_size * sizeof (float));
+    if (!r->bank || !r->hist) {
+        fprintf (stderr, _("%s %s: Can't allocate resampler buffers\n"),
+                 DEBUGFILE, DEBUGFUNCTION);
+        xvc_resampler_free (r);
+        return NULL;
+    }
+    build_bank (r, qualities[quality].beta, qualities[quality].cutoff);
+
+    // start with half a filter of silence, so the first output sample is
+    // centered on the first input sample
+    r->hist_frames = r->taps / 2;
+    memset (r->hist, 0, out_channels * r->hist_size * sizeof (float));
+    r->pos = r->taps / 2;
+
+#ifdef DEBUG
+    printf ("%s %s: %i Hz/%i ch -> %i Hz/%i ch, %s quality\n", DEBUGFILE,
+            DEBUGFUNCTION, in_rate, in_channels, out_rate, out_channels,
+            qualities[quality].name);
+#endif     // DEBUG
+
+    return r;
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief frees a resampler
+ *
+ * @param r the resampler to free
+ */
+void
+xvc_resampler_free (XVC_Resampler * r)
+{
+    if (!r)
+        return;
+    if (r->bank)
+        free (r->bank);
+    if (r->hist)
+        free (r->hist);
+    free (r);
+}
+
+/**
+ * \brief tells how many output frames xvc_resampler_process () can produce
+ *      at most for a given number of input frames
+ *
+ * @param r the resampler
+ * @param in_frames number of input frames
+ * @return maximum number of output frames
+ */
+int
+xvc_resampler_max_output (const XVC_Resampler * r, int in_frames)
+{
+    return (int) ((in_frames + r->taps) /
+                  (r->base_step * (1.0 - MAX_DRIFT))) + 2;
+}
+
+/**
+ * \brief appends input frames to the history, mapping channels and
+ *      converting to float
+ *
+ * @param r the resampler
+ * @param in interleaved input samples
+ * @param frames number of frames to append, must fit into the history
+ */
+static void
+append_input (XVC_Resampler * r, const int16_t * in, int frames)
+{
+    int ic = r->in_channels, oc = r->out_channels, c, i;
+
+    for (c = 0; c < oc; c++) {
+        float *row = r->hist + c * r->hist_size + r->hist_frames;
+
+        if (oc == 1 && ic > 1) {
+            float scale = 1.0f / ic;
+
+            for (i = 0; i < frames; i++) {
+                int k, sum = 0;
+
+                for (k = 0; k < ic; k++)
+                    sum += in[i * ic + k];
+                row[i] = sum * scale;
+            }
+        } else {
+            const int16_t *src = in + (c % ic);
+
+            for (i = 0; i < frames; i++)
+                row[i] = src[i * ic];
+        }
+    }
+    r->hist_frames += frames;
+}
+
+/**
+ * \brief resamples a chunk of audio
+ *
+ * The resampler keeps enough input history between calls for the output to
+ * be continuous. The output lags the input by half the filter length.
+ *
+ * @param r the resampler
+ * @param in interleaved signed 16 bit input samples
+ * @param in_frames number of input frames
+ * @param out buffer for the interleaved output samples, large enough for
+ *      xvc_resampler_max_output () frames
+ * @return number of output frames produced
+ */
+int
+xvc_resampler_process (XVC_Resampler * r, const int16_t * in,
+                       int in_frames, int16_t * out)
+{
+    int half = r->taps / 2, oc = r->out_channels, produced = 0;
+
+    while (in_frames > 0) {
+        int chunk = r->hist_size - r->hist_frames, first;
+
+        if (chunk > in_frames)
+            chunk = in_frames;
+        append_input (r, in, chunk);
+        in += chunk * r->in_channels;
+        in_frames -= chunk;
+
+        while ((int) r->pos + half < r->hist_frames) {
+            int ip = (int) r->pos, c;
+            double phase = (r->pos - ip) * r->phases;
+            int p = (int) phase;
+            float a = (float) (phase - p);
+            const float *h0 = r->bank + p * r->taps;
+            const float *h1 = h0 + r->taps;
+
+            for (c = 0; c < oc; c++) {
+                const float *x = r->hist + c * r->hist_size + ip - half + 1;
+                float d0 = dot (x, h0, r->taps);
+                float d1 = dot (x, h1, r->taps);
+                float v = d0 + a * (d1 - d0);
+
+                if (v > 32767.0f)
+                    v = 32767.0f;
+                else if (v < -32768.0f)
+                    v = -32768.0f;
+                out[produced * oc + c] =
+                    (int16_t) (v < 0 ? v - 0.5f : v + 0.5f);
+            }
+            produced++;
+            r->pos += r->step;
+        }
+
+        // drop history no longer needed
+        first = (int) r->pos - half + 1;
+        if (first > r->hist_frames)
+            first = r->hist_frames;
+        if (first > 0) {
+            int c;
+
+            for (c = 0; c < oc; c++) {
+                float *row = r->hist + c * r->hist_size;
+
+                memmove (row, row + first,
+                         (r->hist_frames - first) * sizeof (float));
+            }
+            r->hist_frames -= first;
+            r->pos -= first;
+        }
+    }
+
+    return produced;
+}
+
+/**
+ * \brief fine-tunes the resampling ratio, e. g. to compensate for two
+ *      audio devices' clocks running at slightly different speeds
+ *
+ * @param r the resampler
+ * @param ratio factor for the number of input frames consumed per output
+ *      frame. Values above 1.0 produce less output, values below more.
+ *      Clamped to 1.0 +/- 1%
+ */
+void
+xvc_resampler_set_drift (XVC_Resampler * r, double ratio)
+{
+    if (ratio > 1.0 + MAX_DRIFT)
+        ratio = 1.0 + MAX_DRIFT;
+    else if (ratio < 1.0 - MAX_DRIFT)
+        ratio = 1.0 - MAX_DRIFT;
+    r->step = r->base_step * ratio;
+}
+
+/**
+ * \brief maps the name of a quality setting to the XVC_ResampleQuality value
+ *
+ * @param name "fast", "medium", or "high"
+ * @return the quality value or -1 if the name is unknown
+ */
+int
+xvc_resampler_quality_from_string (const char *name)
+{
+    int q;
+
+    for (q = 0; q < XVC_RESAMPLE_NUM_QUALITIES; q++) {
+        if (strcasecmp (name, qualities[q].name) == 0)
+            return q;
+    }
+    return -1;
+}
+
+/**
+ * \brief gets the name of a quality setting
+ *
+ * @param quality one of XVC_ResampleQuality
+ * @return the name of the setting
+ */
+const char *
+xvc_resampler_quality_name (int quality)
+{
+    if (quality < 0 || quality >= XVC_RESAMPLE_NUM_QUALITIES)
+        return "?";
+    return qualities[quality].name;
+}
@@ -0,0 +1,87 @@
+/**
+ * \file resampler.h
+ */
+/*
+ * Copyright (C) 2003-07 Karl H. Beckers, Frankfurt
+ * EMail: khb@jarre-de-the.net
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef _xvc_RESAMPLER_H__
+#define _xvc_RESAMPLER_H__
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+#include <inttypes.h>
+#endif     // DOXYGEN_SHOULD_SKIP_THIS
+
+/**
+ * \brief quality settings for the resampler, trading filter length for
+ *      CPU time
+ */
+enum XVC_ResampleQuality
+{
+    XVC_RESAMPLE_FAST,
+    XVC_RESAMPLE_MEDIUM,
+    XVC_RESAMPLE_HIGH,
+    XVC_RESAMPLE_NUM_QUALITIES
+};
+
+/**
+ * \brief state of a polyphase windowed-sinc resampler converting signed
+ *      16 bit interleaved PCM between sample rates and channel counts
+ */
+typedef struct _XVC_Resampler
+{
+    /** \brief input sample rate */
+    int in_rate;
+    /** \brief output sample rate */
+    int out_rate;
+    /** \brief number of input channels */
+    int in_channels;
+    /** \brief number of output channels */
+    int out_channels;
+    /** \brief filter length in taps, a multiple of 4 */
+    int taps;
+    /** \brief number of filter phases, the bank holds phases + 1 of them */
+    int phases;
+    /** \brief the filter bank, taps coefficients per phase */
+    float *bank;
+    /** \brief input history, one row of hist_size floats per output
+     *      channel */
+    float *hist;
+    /** \brief capacity of a history row in sample frames */
+    int hist_size;
+    /** \brief number of sample frames in the history */
+    int hist_frames;
+    /** \brief position of the next output sample in the history */
+    double pos;
+    /** \brief input frames per output frame without drift correction */
+    double base_step;
+    /** \brief input frames per output frame currently used */
+    double step;
+} XVC_Resampler;
+
+XVC_Resampler *xvc_resampler_new (int in_rate, int out_rate, int in_channels,
+                                  int out_channels, int quality);
+void xvc_resampler_free (XVC_Resampler * r);
+int xvc_resampler_max_output (const XVC_Resampler * r, int in_frames);
+int xvc_resampler_process (XVC_Resampler * r, const int16_t * in,
+                           int in_frames, int16_t * out);
+void xvc_resampler_set_drift (XVC_Resampler * r, double ratio);
+int xvc_resampler_quality_from_string (const char *name);
+const char *xvc_resampler_quality_name (int quality);
+
+#endif     // _xvc_RESAMPLER_H__
@@ -0,0 +1,501 @@
+/**
+ * \file stats.c
+ *
+ * This file contains the collection of runtime performance statistics of a
+ * capture session, i. e. frame counters, per-stage latencies, audio queue
+ * levels and output bitrate, as reported through dbus.
+ *
+ * Stage durations are taken with a monotonic clock in ns and sorted into
+ * histograms with logarithmic buckets using atomic increments only, so
+ * the timing is cheap enough to be always on and never blocks the capture
+ * or encoder threads.
+ */
+/*
+ * Copyright (C) 2003-07 Karl H. Beckers, Frankfurt
+ * EMail: khb@jarre-de-the.net
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif     // HAVE_CONFIG_H
+
+#define DEBUGFILE "stats.c"
+#endif     // DOXYGEN_SHOULD_SKIP_THIS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "stats.h"
+#include "trace.h"
+#include "xvidcap-intl.h"
+
+/** \brief number of buckets per power of two */
+#define SUB_BUCKETS (1 << XVC_STATS_SUB_BITS)
+
+/**
+ * \brief the latency histogram of one stage
+ *
+ * All members are only ever changed with atomic operations.
+ */
+typedef struct
+{
+    unsigned long count;
+    uint64_t sum;
+    uint64_t max;
+    unsigned long buckets[XVC_STATS_BUCKETS];
+} StageHistogram;
+
+/** \brief the latency histograms of the current or last session, these
+ *      are not protected by stats_mutex */
+static StageHistogram histograms[XVC_STAGE_NUM];
+
+/** \brief the statistics of the current or last session */
+static struct
+{
+    int active;
+    int64_t start;
+    int64_t stop;
+    unsigned long serial;
+    unsigned long frames_captured;
+    unsigned long frames_dropped;
+    unsigned long frames_duplicated;
+    unsigned long x_requests;
+    unsigned long damage_checks;
+    unsigned long damage_mismatches;
+    int damage_disabled;
+    int64_t bytes;
+    int audio_queue_ms;
+    unsigned long audio_overruns;
+    int64_t replay_bytes;
+    double av_drift;
+} stats;
+
+/** \brief protects stats */
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** \brief names of the stages as used in dbus replies */
+static const char *stage_names[XVC_STAGE_NUM] = {
+    "grab",
+    "cursor",
+    "convert",
+    "encode",
+    "mux",
+    "frame",
+    "flush"
+};
+
+/**
+ * \brief gets the name of a stage
+ *
+ * @param stage the stage
+ * @return a short lower case name
+ */
+const char *
+xvc_stats_stage_name (XVC_StatsStage stage)
+{
+    return stage_names[stage];
+}
+
+/**
+ * \brief gets the current time for measuring stage durations
+ *
+ * @return the time in ns from an arbitrary starting point, monotonic if
+ *      the system supports it
+ */
+int64_t
+xvc_stats_clock ()
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+
+    if (clock_gettime (CLOCK_MONOTONIC, &ts) == 0)
+        return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif     // HAVE_CLOCK_GETTIME && CLOCK_MONOTONIC
+    {
+        struct timeval tv;
+
+        gettimeofday (&tv, NULL);
+        return ((int64_t) tv.tv_sec * 1000000 + tv.tv_usec) * 1000;
+    }
+}
+
+/**
+ * \brief finds the histogram bucket for a duration
+ *
+ * Durations below 2^XVC_STATS_SUB_BITS ns get a bucket each, above that
+ * every power of two is split into SUB_BUCKETS buckets of equal width.
+ *
+ * @param ns the duration in ns
+ * @return the index of the bucket
+ */
+static int
+bucket_index (uint64_t ns)
+{
+    int e;
+
+    if (ns < SUB_BUCKETS)
+        return (int) ns;
+    e = 63 - __builtin_clzll (ns);
+    return ((e - XVC_STATS_SUB_BITS + 1) << XVC_STATS_SUB_BITS) +
+        (int) ((ns >> (e - XVC_STATS_SUB_BITS)) & (SUB_BUCKETS - 1));
+}
+
+/**
+ * \brief gets a representative duration for a histogram bucket, i. e. the
+ *      middle of the range of durations sorted into it
+ *
+ * @param index the index of the bucket
+ * @return the duration in ns
+ */
+static uint64_t
+bucket_value (int index)
+{
+    int e;
+    uint64_t lower;
+
+    if (index < SUB_BUCKETS)
+        return index;
+    e = (index >> XVC_STATS_SUB_BITS) + XVC_STATS_SUB_BITS - 1;
+    lower = (uint64_t) (SUB_BUCKETS + (index & (SUB_BUCKETS - 1)))
+        << (e - XVC_STATS_SUB_BITS);
+    return lower + ((1ULL << (e - XVC_STATS_SUB_BITS)) >> 1);
+}
+
+/**
+ * \brief clears all statistics when a recording starts
+ */
+void
+xvc_stats_reset ()
+{
+    unsigned long serial;
+
+    pthread_mutex_lock (&stats_mutex);
+    // the serial keeps counting so a change is noticed across sessions
+    serial = stats.serial;
+    memset (&stats, 0, sizeof (stats));
+    stats.serial = serial + 1;
+    stats.active = 1;
+    stats.start = xvc_stats_clock ();
+    pthread_mutex_unlock (&stats_mutex);
+    // no stage is timed while a recording starts
+    memset (histograms, 0, sizeof (histograms));
+}
+
+/**
+ * \brief marks the end of the recording, the statistics are kept for
+ *      querying until the next recording starts
+ */
+void
+xvc_stats_stop ()
+{
+    pthread_mutex_lock (&stats_mutex);
+    if (stats.active) {
+        stats.active = 0;
+        stats.stop = xvc_stats_clock ();
+        stats.serial++;
+    }
+    pthread_mutex_unlock (&stats_mutex);
+}
+
+/**
+ * \brief records the duration of one run of a stage, also in the trace if
+ *      one is being recorded
+ *
+ * This does not take any locks and may be called from any thread.
+ *
+ * @param stage the stage that was run
+ * @param start the time the stage started as returned by xvc_stats_clock ()
+ */
+void
+xvc_stats_add_stage (XVC_StatsStage stage, int64_t start)
+{
+    int64_t now = xvc_stats_clock ();
+    uint64_t ns = (now > start ? now - start : 0), max;
+    StageHistogram *h = &histograms[stage];
+
+    __sync_fetch_and_add (&h->buckets[bucket_index (ns)], 1);
+    __sync_fetch_and_add (&h->count, 1);
+    __sync_fetch_and_add (&h->sum, ns);
+    max = h->max;
+    while (ns > max && !__sync_bool_compare_and_swap (&h->max, max, ns))
+        max = h->max;
+
+    if (xvc_trace_active)
+        xvc_trace_event (stage_names[stage], start, now);
+}
+
+/**
+ * \brief counts a captured frame
+ *
+ * @param duplicated TRUE if the frame did not change since the last one
+ */
+void
+xvc_stats_add_frame (int duplicated)
+{
+    pthread_mutex_lock (&stats_mutex);
+    stats.frames_captured++;
+    if (duplicated)
+        stats.frames_duplicated++;
+    stats.serial++;
+    pthread_mutex_unlock (&stats_mutex);
+}
+
+/**
+ * \brief counts frame slots missed
+ *
+ * @param frames the number of frames that should have been captured in the
+ *      time the last one took
+ */
+void
+xvc_stats_add_dropped (int frames)
+{
+    if (frames <= 0)
+        return;
+    pthread_mutex_lock (&stats_mutex);
+    stats.frames_dropped += frames;
+    pthread_mutex_unlock (&stats_mutex);
+}
+
+/**
+ * \brief counts requests sent to the X server for capturing a frame
+ *
+ * @param requests the number of requests
+ */
+void
+xvc_stats_add_requests (unsigned long requests)
+{
+    pthread_mutex_lock (&stats_mutex);
+    stats.x_requests += requests;
+    pthread_mutex_unlock (&stats_mutex);
+}
+
+/**
+ * \brief counts a check of an Xdamage capture against a full frame
+ *
+ * @param mismatches the number of stale tiles found
+ * @param disabled true if the check made the session give up on Xdamage
+ */
+void
+xvc_stats_add_damage_check (int mismatches, int disabled)
+{
+    pthread_mutex_lock (&stats_mutex);
+    stats.damage_checks++;
+    stats.damage_mismatches += mismatches;
+    if (disabled)
+        stats.damage_disabled = 1;
+    pthread_mutex_unlock (&stats_mutex);
+}
+
+/**
+ * \brief counts encoded data handed to the output
+ *
+ * @param size number of bytes
+ */
+void
+xvc_stats_add_bytes (int size)
+{
+    pthread_mutex_lock (&stats_mutex);
+    stats.bytes += size;
+    pthread_mutex_unlock (&stats_mutex);
+}
+
+/**
+ * \brief updates the state of the audio pipeline
+ *
+ * @param queue_ms audio buffered between capture and encoder in ms
+ * @param overruns total number of audio ring overruns
+ * @param drift audio timestamp minus video timestamp in ms
+ */
+void
+xvc_stats_set_audio (int queue_ms, unsigned long overruns, double drift)
+{
+    pthread_mutex_lock (&stats_mutex);
+    stats.audio_queue_ms = queue_ms;
+    stats.audio_overruns = overruns;
+    stats.av_drift = drift;
+    pthread_mutex_unlock (&stats_mutex);
+}
+
+/**
+ * \brief updates the fill level of the replay buffer
+ *
+ * @param bytes bytes held by the replay buffer
+ */
+void
+xvc_stats_set_replay (int64_t bytes)
+{
+    pthread_mutex_lock (&stats_mutex);
+    stats.replay_bytes = bytes;
+    pthread_mutex_unlock (&stats_mutex);
+}
+
+/**
+ * \brief finds the duration a given share of the runs of a stage did not
+ *      exceed
+ *
+ * @param buckets a copy of the stage's histogram
+ * @param total the sum of all buckets
+ * @param max the longest duration of the stage
+ * @param percent the share in percent
+ * @return the duration in ns
+ */
+static int64_t
+percentile (const unsigned long *buckets, unsigned long total, uint64_t max,
+            int percent)
+{
+    unsigned long rank = (total * percent + 99) / 100, seen = 0;
+    uint64_t value;
+    int i;
+
+    if (rank < 1)
+        rank = 1;
+    for (i = 0; i < XVC_STATS_BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen >= rank)
+            break;
+    }
+    value = bucket_value (i);
+    return (int64_t) (value > max ? max : value);
+}
+
+/**
+ * \brief computes the latency figures of a stage from its histogram
+ *
+ * The histogram may be updated concurrently, so the figures are computed
+ * from a copy and may be off by the runs completed meanwhile.
+ *
+ * @param h the histogram of the stage
+ * @param out return pointer for the figures
+ */
+static void
+compute_stage (const StageHistogram * h, XVC_StageStats * out)
+{
+    unsigned long buckets[XVC_STATS_BUCKETS], total = 0;
+    int i;
+
+    memcpy (buckets, (const void *) h->buckets, sizeof (buckets));
+    for (i = 0; i < XVC_STATS_BUCKETS; i++)
+        total += buckets[i];
+
+    memset (out, 0, sizeof (XVC_StageStats));
+    out->count = h->count;
+    if (total == 0)
+        return;
+    out->max = h->max;
+    out->mean = h->sum / (h->count > 0 ? h->count : 1);
+    out->p50 = percentile (buckets, total, h->max, 50);
+    out->p90 = percentile (buckets, total, h->max, 90);
+    out->p99 = percentile (buckets, total, h->max, 99);
+}
+
+/**
+ * \brief gets a consistent copy of the current statistics
+ *
+ * @param out return pointer for the statistics
+ */
+void
+xvc_stats_get (XVC_Stats * out)
+{
+    int64_t bytes, end;
+    int i;
+
+    memset (out, 0, sizeof (XVC_Stats));
+
+    // the histograms are read without the lock
+    pthread_mutex_lock (&stats_mutex);
+    out->active = stats.active;
+    end = (stats.active ? xvc_stats_clock () : stats.stop);
+    out->elapsed = (stats.start ? (end - stats.start) / 1000000000.0 : 0);
+    out->frames_captured = stats.frames_captured;
+    out->frames_dropped = stats.frames_dropped;
+    out->frames_duplicated = stats.frames_duplicated;
+    out->x_requests = stats.x_requests;
+    out->damage_checks = stats.damage_checks;
+    out->damage_mismatches = stats.damage_mismatches;
+    out->damage_disabled = stats.damage_disabled;
+    out->audio_queue_ms = stats.audio_queue_ms;
+    out->audio_overruns = stats.audio_overruns;
+    out->replay_bytes = stats.replay_bytes;
+    out->av_drift = stats.av_drift;
+    bytes = stats.bytes;
+    pthread_mutex_unlock (&stats_mutex);
+
+    for (i = 0; i < XVC_STAGE_NUM; i++)
+        compute_stage (&histograms[i], &out->stages[i]);
+    if (out->elapsed > 0)
+        out->bitrate = bytes * 8 / out->elapsed;
+}
+
+/**
+ * \brief gets a counter increased whenever a frame was captured or the
+ *      recording stopped, to find out if the statistics changed
+ *
+ * @return the counter
+ */
+unsigned long
+xvc_stats_serial ()
+{
+    unsigned long serial;
+
+    pthread_mutex_lock (&stats_mutex);
+    serial = stats.serial;
+    pthread_mutex_unlock (&stats_mutex);
+    return serial;
+}
+
+/**
+ * \brief prints a table summing up the statistics of the current or last
+ *      session
+ *
+ * @param fp the stream to print to
+ */
+void
+xvc_stats_print_summary (FILE * fp)
+{
+    XVC_Stats st;
+    int i;
+
+    xvc_stats_get (&st);
+
+    fprintf (fp,
+             _("%lu frames captured in %.1f s, %lu dropped, %lu duplicated\n"),
+             st.frames_captured, st.elapsed, st.frames_dropped,
+             st.frames_duplicated);
+    if (st.frames_captured > 0 && st.x_requests > 0)
+        fprintf (fp, _("%.1f X requests per frame\n"),
+                 (double) st.x_requests / st.frames_captured);
+    if (st.damage_checks > 0)
+        fprintf (fp, _("%lu damage checks, %lu stale tiles repaired%s\n"),
+                 st.damage_checks, st.damage_mismatches,
+                 (st.damage_disabled ? _(", fell back to full frames") : ""));
+    fprintf (fp, _("stage     count     mean      p50      p90      p99      max (ms)\n"));
+    for (i = 0; i < XVC_STAGE_NUM; i++) {
+        XVC_StageStats *s = &st.stages[i];
+
+        if (s->count == 0)
+            continue;
+        fprintf (fp, "%-8s %6lu %8.3f %8.3f %8.3f %8.3f %8.3f\n",
+                 xvc_stats_stage_name (i), s->count, s->mean / 1000000.0,
+                 s->p50 / 1000000.0, s->p90 / 1000000.0, s->p99 / 1000000.0,
+                 s->max / 1000000.0);
+    }
+}
@@ -0,0 +1,141 @@
+/**
+ * \file stats.h
+ */
+/*
+ * Copyright (C) 2003-07 Karl H. Beckers, Frankfurt
+ * EMail: khb@jarre-de-the.net
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef _xvc_STATS_H__
+#define _xvc_STATS_H__
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+#include <stdio.h>
+#include <sys/types.h>
+#include <inttypes.h>
+#endif     // DOXYGEN_SHOULD_SKIP_THIS
+
+/** \brief each power of two of the latency histograms is split into
+ *      2^XVC_STATS_SUB_BITS buckets, i. e. a resolution of about 12 % */
+#define XVC_STATS_SUB_BITS 3
+
+/** \brief number of buckets of a latency histogram, enough for any 64 bit
+ *      duration in ns */
+#define XVC_STATS_BUCKETS ((64 - XVC_STATS_SUB_BITS + 1) << XVC_STATS_SUB_BITS)
+
+/**
+ * \brief the stages a captured frame passes through
+ */
+typedef enum
+{
+    /** \brief reading the frame from the X server */
+    XVC_STAGE_GRAB,
+    /** \brief getting and painting the mouse pointer */
+    XVC_STAGE_CURSOR,
+    /** \brief pixel format conversion and scaling */
+    XVC_STAGE_CONVERT,
+    /** \brief encoding the frame */
+    XVC_STAGE_ENCODE,
+    /** \brief writing the encoded frame to the output */
+    XVC_STAGE_MUX,
+    /** \brief the whole frame, i. e. what the frame rate has to allow for */
+    XVC_STAGE_FRAME,
+    /** \brief waiting for a chunk of output to reach the disk with
+     *      write-behind, not per frame */
+    XVC_STAGE_FLUSH,
+    XVC_STAGE_NUM
+} XVC_StatsStage;
+
+/**
+ * \brief the latency figures of one stage
+ */
+typedef struct _XVC_StageStats
+{
+    /** \brief number of times the stage was run */
+    unsigned long count;
+    /** \brief average duration in ns */
+    int64_t mean;
+    /** \brief median duration in ns */
+    int64_t p50;
+    /** \brief 90th percentile of the durations in ns */
+    int64_t p90;
+    /** \brief 99th percentile of the durations in ns */
+    int64_t p99;
+    /** \brief longest duration in ns */
+    int64_t max;
+} XVC_StageStats;
+
+/**
+ * \brief a consistent copy of the statistics of the current or last
+ *      capture session
+ */
+typedef struct _XVC_Stats
+{
+    /** \brief TRUE while recording */
+    int active;
+    /** \brief seconds since recording started */
+    double elapsed;
+    /** \brief number of frames captured */
+    unsigned long frames_captured;
+    /** \brief number of frame slots missed because capturing a frame took
+     *      too long */
+    unsigned long frames_dropped;
+    /** \brief number of frames encoded again without anything having
+     *      changed on screen (only known with Xdamage) */
+    unsigned long frames_duplicated;
+    /** \brief number of requests sent to the X server for capturing */
+    unsigned long x_requests;
+    /** \brief number of frames an Xdamage capture was checked against a
+     *      full frame */
+    unsigned long damage_checks;
+    /** \brief number of tiles the checks found stale and repaired */
+    unsigned long damage_mismatches;
+    /** \brief true if the session gave up on Xdamage for full frames */
+    int damage_disabled;
+    /** \brief latency figures per stage over the whole session */
+    XVC_StageStats stages[XVC_STAGE_NUM];
+    /** \brief audio buffered between capture and encoder in ms, the
+     *      fullest input counts */
+    int audio_queue_ms;
+    /** \brief number of audio ring overruns across all inputs */
+    unsigned long audio_overruns;
+    /** \brief bytes held by the replay buffer */
+    int64_t replay_bytes;
+    /** \brief audio timestamp minus video timestamp in ms */
+    double av_drift;
+    /** \brief average output bitrate in bits per second */
+    double bitrate;
+} XVC_Stats;
+
+const char *xvc_stats_stage_name (XVC_StatsStage stage);
+int64_t xvc_stats_clock ();
+void xvc_stats_reset ();
+void xvc_stats_stop ();
+void xvc_stats_add_stage (XVC_StatsStage stage, int64_t start);
+void xvc_stats_add_frame (int duplicated);
+void xvc_stats_add_dropped (int frames);
+void xvc_stats_add_requests (unsigned long requests);
+void xvc_stats_add_damage_check (int mismatches, int disabled);
+void xvc_stats_add_bytes (int size);
+void xvc_stats_set_audio (int queue_ms, unsigned long overruns,
+                          double drift);
+void xvc_stats_set_replay (int64_t bytes);
+void xvc_stats_get (XVC_Stats * stats);
+unsigned long xvc_stats_serial ();
+void xvc_stats_print_summary (FILE * fp);
+
+#endif     // _xvc_STATS_H__
@@ -0,0 +1,627 @@
+/**
+ * \file synth.c
+ *
+ * This file contains the test patterns generated in memory, which are used
+ * by --benchmark and by the synth capture source. The frames are XImages
+ * laid out like those an X server delivers, but no X server is needed to
+ * create them.
+ */
+/*
+ * Copyright (C) 2003-07 Karl H. Beckers, Frankfurt
+ * EMail: khb@jarre-de-the.net
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif     // HAVE_CONFIG_H
+
+#define DEBUGFILE "synth.c"
+#endif     // DOXYGEN_SHOULD_SKIP_THIS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <inttypes.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+#include "synth.h"
+#include "app_data.h"
+#include "xvidcap-intl.h"
+
+const char *xvc_synth_pattern_names[XVC_SYNTH_NUM_PATTERNS] = {
+    "static",
+    "text",
+    "noise",
+    "window"
+};
+
+const XVC_SynthLayout xvc_synth_layouts[XVC_SYNTH_NUM_LAYOUTS] = {
+    {8, 8, 0, 0, 0},
+    {16, 16, 0xF800, 0x07E0, 0x001F},
+    {24, 24, 0xFF0000, 0x00FF00, 0x0000FF},
+    {32, 24, 0xFF0000, 0x00FF00, 0x0000FF}
+};
+
+/** \brief rows the text pattern scrolls by per frame */
+#define TEXT_SCROLL 3
+/** \brief height of a line of text including spacing */
+#define TEXT_LINE 16
+/** \brief width of the generated mouse pointer */
+#define POINTER_WIDTH 12
+/** \brief height of the generated mouse pointer */
+#define POINTER_HEIGHT 19
+/** \brief width of the largest mouse pointer painted into the frames, i. e.
+ *      the dummy pointer of capture.c */
+#define POINTER_AREA_WIDTH 16
+/** \brief height of the largest mouse pointer painted into the frames */
+#define POINTER_AREA_HEIGHT 20
+
+/**
+ * \brief a fast and good enough pseudo random number generator
+ *
+ * @param seed the state of the generator which is updated
+ * @return the next random number
+ */
+static inline uint32_t
+synth_random (uint32_t * seed)
+{
+    uint32_t x = *seed;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return (*seed = x);
+}
+
+/**
+ * \brief creates an XImage without a server round trip
+ *
+ * @param l the layout of the image
+ * @param width width of the image
+ * @param height height of the image
+ * @return the image or NULL if it can't be allocated
+ */
+static XImage *
+create_image (const XVC_SynthLayout * l, int width, int height)
+{
+    XImage *image;
+    int one = 1;
+
+    image = (XImage *) calloc (1, sizeof (XImage));
+    if (!image)
+        return NULL;
+
+    image->width = width;
+    image->height = height;
+    image->format = ZPixmap;
+    image->byte_order = (*(char *) &one ? LSBFirst : MSBFirst);
+    image->bitmap_unit = 32;
+    image->bitmap_bit_order = image->byte_order;
+    image->bitmap_pad = 32;
+    image->depth = l->depth;
+    image->bits_per_pixel = l->bits_per_pixel;
+    image->bytes_per_line = ((width * l->bits_per_pixel + 31) / 32) * 4;
+    image->red_mask = l->red_mask;
+    image->green_mask = l->green_mask;
+    image->blue_mask = l->blue_mask;
+    image->data = (char *) calloc (image->bytes_per_line, height);
+
+    if (!image->data || !XInitImage (image)) {
+        free (image->data);
+        free (image);
+        return NULL;
+    }
+    return image;
+}
+
+/**
+ * \brief frees an image created with create_image ()
+ *
+ * @param image the image to free, may be NULL
+ */
+static void
+free_image (XImage * image)
+{
+    if (!image)
+        return;
+    free (image->data);
+    free (image);
+}
+
+/**
+ * \brief scales an 8 bit color value into a color mask
+ *
+ * @param mask the mask of the color in a pixel
+ * @param value the color value from 0 to 255
+ * @return the bits for the color in a pixel
+ */
+static unsigned long
+mask_color (unsigned long mask, int value)
+{
+    int shift = 0, bits = 0;
+
+    if (!mask)
+        return 0;
+    while (!(mask & 1)) {
+        mask >>= 1;
+        shift++;
+    }
+    while (mask & 1) {
+        mask >>= 1;
+        bits++;
+    }
+    return ((unsigned long) value >> (8 - bits)) << shift;
+}
+
+/**
+ * \brief gets the pixel value for a color
+ *
+ * 8 bit images use a palette with 3 bits each for red and green and 2 bits
+ * for blue, as returned by xvc_synth_get_colors ().
+ *
+ * @param image the image the pixel is for
+ * @param r red from 0 to 255
+ * @param g green from 0 to 255
+ * @param b blue from 0 to 255
+ * @return the pixel value
+ */
+static unsigned long
+rgb_pixel (const XImage * image, int r, int g, int b)
+{
+    if (image->bits_per_pixel == 8)
+        return (r & 0xE0) | ((g & 0xE0) >> 3) | (b >> 6);
+    return mask_color (image->red_mask, r) |
+        mask_color (image->green_mask, g) | mask_color (image->blue_mask, b);
+}
+
+/**
+ * \brief fills a rectangle of an image with a color
+ *
+ * @param image the image to draw into
+ * @param x left edge of the rectangle
+ * @param y top edge of the rectangle
+ * @param width width of the rectangle
+ * @param height height of the rectangle
+ * @param r red from 0 to 255
+ * @param g green from 0 to 255
+ * @param b blue from 0 to 255
+ */
+static void
+fill_rect (XImage * image, int x, int y, int width, int height,
+           int r, int g, int b)
+{
+    unsigned long pixel = rgb_pixel (image, r, g, b);
+    int i, j;
+
+    for (j = XVC_MAX (y, 0); j < y + height && j < image->height; j++)
+        for (i = XVC_MAX (x, 0); i < x + width && i < image->width; i++)
+            XPutPixel (image, i, j, pixel);
+}
+
+/**
+ * \brief copies a rectangle between two images of the same layout
+ *
+ * The rectangle must lie within both images.
+ *
+ * @param dst the image to copy to
+ * @param dx left edge of the rectangle in dst
+ * @param dy top edge of the rectangle in dst
+ * @param src the image to copy from
+ * @param sx left edge of the rectangle in src
+ * @param sy top edge of the rectangle in src
+ * @param width width of the rectangle
+ * @param height height of the rectangle
+ */
+static void
+copy_rect (XImage * dst, int dx, int dy, const XImage * src, int sx, int sy,
+           int width, int height)
+{
+    int bpp = dst->bits_per_pixel / 8, j;
+
+    for (j = 0; j < height; j++)
+        memcpy (dst->data + (dy + j) * dst->bytes_per_line + dx * bpp,
+                src->data + (sy + j) * src->bytes_per_line + sx * bpp,
+                width * bpp);
+}
+
+/**
+ * \brief draws lines of text-like blocks
+ *
+ * @param image the image to draw into
+ * @param x left edge of the text
+ * @param y top edge of the text
+ * @param width width of the text
+ * @param height height of the text
+ * @param seed state of the random number generator
+ */
+static void
+draw_text (XImage * image, int x, int y, int width, int height,
+           uint32_t * seed)
+{
+    int line, word, len;
+
+    for (line = y + 4; line + TEXT_LINE <= y + height; line += TEXT_LINE) {
+        // leave some lines short like at the end of a paragraph
+        int end = x + width - 8 - (synth_random (seed) % 4 == 0 ?
+                                   synth_random (seed) % (width / 2 + 1) : 0);
+
+        for (word = x + 8; word < end; word += len + 6) {
+            len = 8 + synth_random (seed) % 40;
+            if (word + len > end)
+                len = end - word;
+            fill_rect (image, word, line, len, 9, 30, 30, 30);
+        }
+    }
+}
+
+/**
+ * \brief draws a desktop background with some icons and a panel
+ *
+ * @param image the image to draw into
+ */
+static void
+draw_desktop (XImage * image)
+{
+    int y, i;
+
+    for (y = 0; y < image->height; y++)
+        fill_rect (image, 0, y, image->width, 1, 40 + 60 * y / image->height,
+                   80 + 80 * y / image->height, 140 + 100 * y / image->height);
+    for (i = 0; i < 6; i++)
+        fill_rect (image, 16, 16 + i * 56, 32, 32, 255 - i * 40, 64 + i * 30,
+                   i * 40);
+    fill_rect (image, 0, image->height - 24, image->width, 24, 200, 200, 200);
+}
+
+/**
+ * \brief finds a layout by its bits per pixel
+ *
+ * @param bpp the bits per pixel
+ * @return the layout or NULL if there is none with that many bits per pixel
+ */
+static const XVC_SynthLayout *
+find_layout (int bpp)
+{
+    int i;
+
+    for (i = 0; i < XVC_SYNTH_NUM_LAYOUTS; i++) {
+        if (xvc_synth_layouts[i].bits_per_pixel == bpp)
+            return &xvc_synth_layouts[i];
+    }
+    return NULL;
+}
+
+/**
+ * \brief parses the name of the synth capture source
+ *
+ * The source is "synth", optionally followed by the pattern, the bits per
+ * pixel of the frames and a factor for the speed of the movement, each
+ * separated by a colon, e. g. "synth:text:16:2". The defaults are the
+ * window pattern, 32 bits per pixel and a speed of 1.
+ *
+ * @param source the name of the capture source
+ * @param pattern return pointer for the pattern, may be NULL
+ * @param layout return pointer for the layout of the frames, may be NULL
+ * @param speed return pointer for the speed, may be NULL
+ * @return 0 if the source is a valid synth source, 1 if it is no synth
+ *      source at all and -1 if it is a synth source with invalid parameters
+ */
+int
+xvc_synth_parse_source (const char *source, XVC_SynthPattern * pattern,
+                        const XVC_SynthLayout ** layout, int *speed)
+{
+#define DEBUGFUNCTION "xvc_synth_parse_source()"
+    size_t n = strlen (XVC_SYNTH_SOURCE), len;
+    XVC_SynthPattern pat = XVC_SYNTH_WINDOW;
+    const XVC_SynthLayout *l = find_layout (32);
+    const char *p;
+    char *end;
+    int spd = 1, i;
+
+    if (!source || strncasecmp (source, XVC_SYNTH_SOURCE, n) != 0 ||
+        (source[n] != '\0' && source[n] != ':'))
+        return 1;
+
+    p = source + n;
+    if (*p == ':') {
+        p++;
+        len = strcspn (p, ":");
+        for (i = 0; i < XVC_SYNTH_NUM_PATTERNS; i++) {
+            if (strlen (xvc_synth_pattern_names[i]) == len &&
+                strncasecmp (p, xvc_synth_pattern_names[i], len) == 0)
+                break;
+        }
+        if (i == XVC_SYNTH_NUM_PATTERNS) {
+            fprintf (stderr,
+                     _("%s %s: Unknown pattern '%.*s', use one of "
+                       "static, text, noise or window\n"), DEBUGFILE,
+                     DEBUGFUNCTION, (int) len, p);
+            return -1;
+        }
+        pat = i;
+        p += len;
+    }
+    if (*p == ':') {
+        p++;
+        l = find_layout (strtol (p, &end, 10));
+        if (end == p || (*end != '\0' && *end != ':') || !l) {
+            fprintf (stderr,
+                     _("%s %s: Invalid bits per pixel '%s', use one of "
+                       "8, 16, 24 or 32\n"), DEBUGFILE, DEBUGFUNCTION, p);
+            return -1;
+        }
+        p = end;
+    }
+    if (*p == ':') {
+        p++;
+        spd = strtol (p, &end, 10);
+        if (end == p || *end != '\0' || spd < 0) {
+            fprintf (stderr, _("%s %s: Invalid speed '%s'\n"), DEBUGFILE,
+                     DEBUGFUNCTION, p);
+            return -1;
+        }
+    }
+
+    if (pattern)
+        *pattern = pat;
+    if (layout)
+        *layout = l;
+    if (speed)
+        *speed = spd;
+    return 0;
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief sets up the frames for a pattern
+ *
+ * @param scene the scene to set up
+ * @param pattern the pattern to generate
+ * @param l the layout of the images
+ * @param speed multiplies all movement, 0 makes every pattern but noise
+ *      stand still
+ * @param width width of the frames
+ * @param height height of the frames
+ * @return 0 on success or -1 if the images can't be allocated
+ */
+int
+xvc_synth_create_scene (XVC_SynthScene * scene, XVC_SynthPattern pattern,
+                        const XVC_SynthLayout * l, int speed, int width,
+                        int height)
+{
+    memset (scene, 0, sizeof (XVC_SynthScene));
+    scene->pattern = pattern;
+    scene->speed = speed;
+    scene->seed = 0x2545F491;
+
+    scene->frame = create_image (l, width, height);
+    scene->back = create_image (l, width, height);
+    if (!scene->frame || !scene->back) {
+        xvc_synth_free_scene (scene);
+        return -1;
+    }
+    draw_desktop (scene->back);
+    copy_rect (scene->frame, 0, 0, scene->back, 0, 0, width, height);
+
+    scene->px = width / 2;
+    scene->py = height / 2;
+    if (pattern != XVC_SYNTH_STATIC) {
+        scene->pdx = 7 * speed;
+        scene->pdy = 4 * speed;
+    }
+
+    switch (pattern) {
+    case XVC_SYNTH_TEXT:
+        // a page four screens high which wraps around
+        scene->extra = create_image (l, width, height * 4);
+        if (!scene->extra) {
+            xvc_synth_free_scene (scene);
+            return -1;
+        }
+        fill_rect (scene->extra, 0, 0, width, height * 4, 255, 255, 255);
+        draw_text (scene->extra, 0, 0, width, height * 4, &scene->seed);
+        copy_rect (scene->frame, 0, 0, scene->extra, 0, 0, width, height);
+        break;
+    case XVC_SYNTH_WINDOW:
+        scene->extra = create_image (l, XVC_MAX (width / 2, 1),
+                                     XVC_MAX (height / 2, 1));
+        if (!scene->extra) {
+            xvc_synth_free_scene (scene);
+            return -1;
+        }
+        fill_rect (scene->extra, 0, 0, width, height, 230, 230, 230);
+        fill_rect (scene->extra, 0, 0, width, 18, 50, 90, 180);
+        draw_text (scene->extra, 0, 18, scene->extra->width,
+                   scene->extra->height - 18, &scene->seed);
+        scene->x = width / 8;
+        scene->y = height / 8;
+        scene->dx = 5 * speed;
+        scene->dy = 3 * speed;
+        copy_rect (scene->frame, scene->x, scene->y, scene->extra, 0, 0,
+                   scene->extra->width, scene->extra->height);
+        break;
+    case XVC_SYNTH_NOISE:
+    case XVC_SYNTH_STATIC:
+    default:
+        break;
+    }
+    return 0;
+}
+
+/**
+ * \brief frees the images of a scene
+ *
+ * @param scene the scene to free
+ */
+void
+xvc_synth_free_scene (XVC_SynthScene * scene)
+{
+    free_image (scene->frame);
+    free_image (scene->back);
+    free_image (scene->extra);
+    memset (scene, 0, sizeof (XVC_SynthScene));
+}
+
+/**
+ * \brief moves a coordinate, bouncing off the edges
+ *
+ * @param pos the coordinate to move
+ * @param delta the movement which is reversed at the edges
+ * @param max the largest value the coordinate may take
+ */
+static void
+move_bouncing (int *pos, int *delta, int max)
+{
+    *pos += *delta;
+    if (*pos < 0 || *pos > max) {
+        *delta = -*delta;
+        *pos = XVC_MAX (0, XVC_MIN (*pos + 2 * *delta, max));
+    }
+}
+
+/**
+ * \brief generates the next frame of a scene into scene->frame
+ *
+ * @param scene the scene
+ */
+void
+xvc_synth_next_frame (XVC_SynthScene * scene)
+{
+    XImage *frame = scene->frame;
+    int old_px = scene->px, old_py = scene->py;
+
+    scene->count++;
+    move_bouncing (&scene->px, &scene->pdx, frame->width - 1);
+    move_bouncing (&scene->py, &scene->pdy, frame->height - 1);
+
+    switch (scene->pattern) {
+    case XVC_SYNTH_TEXT:
+        {
+            int top = (scene->count * TEXT_SCROLL * scene->speed) %
+                scene->extra->height;
+            int rows = XVC_MIN (frame->height, scene->extra->height - top);
+
+            copy_rect (frame, 0, 0, scene->extra, 0, top, frame->width, rows);
+            if (rows < frame->height)
+                copy_rect (frame, 0, rows, scene->extra, 0, 0, frame->width,
+                           frame->height - rows);
+        }
+        break;
+    case XVC_SYNTH_NOISE:
+        {
+            uint32_t *p = (uint32_t *) frame->data;
+            uint32_t *end = p + frame->bytes_per_line * frame->height / 4;
+
+            while (p < end)
+                *p++ = synth_random (&scene->seed);
+        }
+        break;
+    case XVC_SYNTH_WINDOW:
+        // the mouse pointer may have been painted into the last frame
+        copy_rect (frame, old_px, old_py, scene->back, old_px, old_py,
+                   XVC_MIN (POINTER_AREA_WIDTH, frame->width - old_px),
+                   XVC_MIN (POINTER_AREA_HEIGHT, frame->height - old_py));
+        copy_rect (frame, scene->x, scene->y, scene->back, scene->x,
+                   scene->y, scene->extra->width, scene->extra->height);
+        move_bouncing (&scene->x, &scene->dx,
+                       frame->width - scene->extra->width);
+        move_bouncing (&scene->y, &scene->dy,
+                       frame->height - scene->extra->height);
+        copy_rect (frame, scene->x, scene->y, scene->extra, 0, 0,
+                   scene->extra->width, scene->extra->height);
+        break;
+    case XVC_SYNTH_STATIC:
+    default:
+        break;
+    }
+}
+
+/**
+ * \brief gets the mouse pointer of the current frame of a scene
+ *
+ * The pointer is an arrow which moves across the frame, except for the
+ * static pattern where it stays in the middle.
+ *
+ * @param scene the scene
+ * @param pointer return pointer for the mouse pointer, the image belongs to
+ *      this module and must not be freed
+ */
+void
+xvc_synth_pointer (const XVC_SynthScene * scene, XVC_LogPointer * pointer)
+{
+    static unsigned long pixels[POINTER_WIDTH * POINTER_HEIGHT];
+    static int initialized = FALSE;
+
+    if (!initialized) {
+        int x, y;
+
+        // an arrow pointing to the top left, white with a black outline
+        for (y = 0; y < POINTER_HEIGHT; y++) {
+            for (x = 0; x < POINTER_WIDTH; x++) {
+                int w = (y < POINTER_WIDTH ? y + 1 : POINTER_HEIGHT - y);
+                unsigned long p = 0;
+
+                if (x < w)
+                    p = (x == 0 || x == w - 1 || y == POINTER_HEIGHT - 1 ?
+                         0xFF000000 : 0xFFFFFFFF);
+                pixels[y * POINTER_WIDTH + x] = p;
+            }
+        }
+        initialized = TRUE;
+    }
+
+    memset (pointer, 0, sizeof (XVC_LogPointer));
+    pointer->valid = TRUE;
+    pointer->x = scene->px;
+    pointer->y = scene->py;
+    pointer->pixels = pixels;
+    pointer->width = POINTER_WIDTH;
+    pointer->height = POINTER_HEIGHT;
+    pointer->serial = 1;
+}
+
+/**
+ * \brief gets the palette 8 bit frames are drawn with
+ *
+ * @param colors return pointer for the palette, which the caller must free
+ * @return the number of colors or 0 if the palette can't be allocated
+ */
+int
+xvc_synth_get_colors (XColor ** colors)
+{
+    XColor *c;
+    int i;
+
+    c = (XColor *) malloc (256 * sizeof (XColor));
+    if (!c) {
+        *colors = NULL;
+        return 0;
+    }
+    for (i = 0; i < 256; i++) {
+        c[i].pixel = i;
+        c[i].red = (i & 0xE0) * 257;
+        c[i].green = ((i & 0x1C) << 3) * 257;
+        c[i].blue = ((i & 0x03) << 6) * 257;
+        c[i].flags = DoRed | DoGreen | DoBlue;
+        c[i].pad = 0;
+    }
+    *colors = c;
+    return 256;
+}
@@ -0,0 +1,113 @@
+/**
+ * \file synth.h
+ */
+/*
+ * Copyright (C) 2003-07 Karl H. Beckers, Frankfurt
+ * EMail: khb@jarre-de-the.net
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef _xvc_SYNTH_H__
+#define _xvc_SYNTH_H__
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+#include <sys/types.h>
+#include <inttypes.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#endif     // DOXYGEN_SHOULD_SKIP_THIS
+
+#include "capture_log.h"
+
+/** \brief name of the capture source generating frames, optionally
+ *      followed by :pattern[:bpp[:speed]] */
+#define XVC_SYNTH_SOURCE "synth"
+
+/**
+ * \brief the test patterns
+ */
+typedef enum
+{
+    /** \brief a desktop where nothing changes */
+    XVC_SYNTH_STATIC,
+    /** \brief a page of text scrolling up */
+    XVC_SYNTH_TEXT,
+    /** \brief random pixels, i. e. nothing stays the same */
+    XVC_SYNTH_NOISE,
+    /** \brief a window moving across a still desktop */
+    XVC_SYNTH_WINDOW,
+    XVC_SYNTH_NUM_PATTERNS
+} XVC_SynthPattern;
+
+/**
+ * \brief an XImage layout as delivered by an X server
+ */
+typedef struct
+{
+    int bits_per_pixel;
+    int depth;
+    unsigned long red_mask;
+    unsigned long green_mask;
+    unsigned long blue_mask;
+} XVC_SynthLayout;
+
+/** \brief number of entries in xvc_synth_layouts */
+#define XVC_SYNTH_NUM_LAYOUTS 4
+
+/**
+ * \brief the frames generated and what they are made of
+ */
+typedef struct
+{
+    /** \brief the pattern generated */
+    XVC_SynthPattern pattern;
+    /** \brief multiplies all movement */
+    int speed;
+    /** \brief the current frame */
+    XImage *frame;
+    /** \brief the desktop without any window */
+    XImage *back;
+    /** \brief the text page or the window, depending on the pattern */
+    XImage *extra;
+    /** \brief position of the window */
+    int x, y;
+    /** \brief movement of the window per frame */
+    int dx, dy;
+    /** \brief position of the mouse pointer's hot spot */
+    int px, py;
+    /** \brief movement of the mouse pointer per frame */
+    int pdx, pdy;
+    /** \brief number of frames generated so far */
+    int count;
+    /** \brief state of the random number generator */
+    uint32_t seed;
+} XVC_SynthScene;
+
+extern const char *xvc_synth_pattern_names[XVC_SYNTH_NUM_PATTERNS];
+extern const XVC_SynthLayout xvc_synth_layouts[XVC_SYNTH_NUM_LAYOUTS];
+
+int xvc_synth_parse_source (const char *source, XVC_SynthPattern * pattern,
+                            const XVC_SynthLayout ** layout, int *speed);
+int xvc_synth_create_scene (XVC_SynthScene * scene, XVC_SynthPattern pattern,
+                            const XVC_SynthLayout * l, int speed, int width,
+                            int height);
+void xvc_synth_next_frame (XVC_SynthScene * scene);
+void xvc_synth_pointer (const XVC_SynthScene * scene,
+                        XVC_LogPointer * pointer);
+void xvc_synth_free_scene (XVC_SynthScene * scene);
+int xvc_synth_get_colors (XColor ** colors);
+
+#endif     // _xvc_SYNTH_H__
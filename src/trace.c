@@ -0,0 +1,348 @@
+/**
+ * \file trace.c
+ *
+ * This file contains the recording of a timeline of the capture pipeline
+ * for --trace. Every thread records the stages it runs into a buffer of
+ * its own, so no locks are taken while tracing. When recording stops, the
+ * events of all threads are written out in the Chrome trace event format
+ * which chrome://tracing and Perfetto can display.
+ */
+/*
+ * Copyright (C) 2003-07 Karl H. Beckers, Frankfurt
+ * EMail: khb@jarre-de-the.net
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif     // HAVE_CONFIG_H
+
+#define DEBUGFILE "trace.c"
+#endif     // DOXYGEN_SHOULD_SKIP_THIS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "trace.h"
+#include "stats.h"
+#include "xvidcap-intl.h"
+
+/**
+ * \brief one stage run by a thread
+ */
+typedef struct
+{
+    /** \brief name of the stage, must be a string constant */
+    const char *name;
+    /** \brief start time as returned by xvc_stats_clock () */
+    int64_t start;
+    /** \brief duration in ns */
+    int64_t dur;
+} TraceEvent;
+
+/**
+ * \brief the events recorded by one thread
+ */
+typedef struct _TraceBuffer
+{
+    struct _TraceBuffer *next;
+    /** \brief id of the thread in the trace */
+    int tid;
+    /** \brief name of the thread in the trace */
+    char name[64];
+    /** \brief number of events recorded, only the last XVC_TRACE_MAX_EVENTS
+     *      of them are kept */
+    unsigned long count;
+    /** \brief TRUE once the thread has exited */
+    int orphaned;
+    TraceEvent *events;
+} TraceBuffer;
+
+volatile int xvc_trace_active = 0;
+
+/** \brief file to write the trace to */
+static char *trace_file = NULL;
+
+/** \brief time the trace started at */
+static int64_t trace_start = 0;
+
+/** \brief all thread buffers */
+static TraceBuffer *buffers = NULL;
+
+/** \brief id for the next thread buffer */
+static int next_tid = 1;
+
+/** \brief protects buffers and next_tid, but not the buffers' events */
+static pthread_mutex_t buffers_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** \brief key for the calling thread's buffer */
+static pthread_key_t buffer_key;
+
+/** \brief makes sure buffer_key is created once only */
+static pthread_once_t buffer_key_once = PTHREAD_ONCE_INIT;
+
+/**
+ * \brief marks the buffer of an exiting thread, it is freed once its
+ *      events are written
+ *
+ * @param data the thread's buffer
+ */
+static void
+orphan_buffer (void *data)
+{
+    TraceBuffer *buf = (TraceBuffer *) data;
+
+    pthread_mutex_lock (&buffers_mutex);
+    buf->orphaned = 1;
+    pthread_mutex_unlock (&buffers_mutex);
+}
+
+/**
+ * \brief creates the key for the threads' buffers
+ */
+static void
+create_buffer_key ()
+{
+    pthread_key_create (&buffer_key, orphan_buffer);
+}
+
+/**
+ * \brief gets the calling thread's buffer, creating it on first use
+ *
+ * @return the buffer or NULL if it can't be allocated
+ */
+static TraceBuffer *
+get_buffer ()
+{
+#define DEBUGFUNCTION "get_buffer()"
+    TraceBuffer *buf;
+
+    pthread_once (&buffer_key_once, create_buffer_key);
+    buf = (TraceBuffer *) pthread_getspecific (buffer_key);
+    if (buf)
+        return buf;
+
+    buf = (TraceBuffer *) calloc (1, sizeof (TraceBuffer));
+    if (buf)
+        buf->events =
+            (TraceEvent *) malloc (XVC_TRACE_MAX_EVENTS * sizeof (TraceEvent));
+    if (!buf || !buf->events) {
+        fprintf (stderr, _("%s %s: Can't allocate trace buffer\n"),
+                 DEBUGFILE, DEBUGFUNCTION);
+        free (buf);
+        return NULL;
+    }
+
+    pthread_mutex_lock (&buffers_mutex);
+    buf->tid = next_tid++;
+    snprintf (buf->name, sizeof (buf->name), "thread %i", buf->tid);
+    buf->next = buffers;
+    buffers = buf;
+    pthread_mutex_unlock (&buffers_mutex);
+
+    pthread_setspecific (buffer_key, buf);
+    return buf;
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief starts recording a trace
+ *
+ * @param file the file to write the trace to when it is stopped
+ * @return 0 on success or an errno value
+ */
+int
+xvc_trace_start (const char *file)
+{
+    TraceBuffer *buf;
+
+    if (xvc_trace_active)
+        return EBUSY;
+
+    free (trace_file);
+    trace_file = strdup (file);
+    if (!trace_file)
+        return ENOMEM;
+
+    pthread_mutex_lock (&buffers_mutex);
+    for (buf = buffers; buf; buf = buf->next)
+        buf->count = 0;
+    pthread_mutex_unlock (&buffers_mutex);
+
+    trace_start = xvc_stats_clock ();
+    xvc_trace_active = 1;
+    return 0;
+}
+
+/**
+ * \brief writes the events of one thread
+ *
+ * @param fp the file to write to
+ * @param buf the thread's buffer
+ * @param pid the process id
+ * @param first TRUE if no event has been written before
+ */
+static void
+write_buffer (FILE * fp, const TraceBuffer * buf, int pid, int first)
+{
+    unsigned long i, n;
+    const char *c;
+
+    fprintf (fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%i,"
+             "\"tid\":%i,\"args\":{\"name\":\"", (first ? "" : ",\n"), pid,
+             buf->tid);
+    for (c = buf->name; *c; c++) {
+        if (*c == '"' || *c == '\\')
+            fputc ('\\', fp);
+        if ((unsigned char) *c >= 0x20)
+            fputc (*c, fp);
+    }
+    fprintf (fp, "\"}}");
+
+    // if the ring has wrapped, the oldest event kept is at count
+    n = (buf->count < XVC_TRACE_MAX_EVENTS ? buf->count :
+         XVC_TRACE_MAX_EVENTS);
+    for (i = buf->count - n; i < buf->count; i++) {
+        const TraceEvent *ev = &buf->events[i % XVC_TRACE_MAX_EVENTS];
+
+        fprintf (fp, ",\n{\"name\":\"%s\",\"cat\":\"xvidcap\",\"ph\":\"X\","
+                 "\"ts\":%.3f,\"dur\":%.3f,\"pid\":%i,\"tid\":%i}",
+                 ev->name, (ev->start - trace_start) / 1000.0,
+                 ev->dur / 1000.0, pid, buf->tid);
+    }
+    if (buf->count > n)
+        fprintf (stderr,
+                 _("trace: only the last %lu of %lu events of %s were kept\n"),
+                 n, buf->count, buf->name);
+}
+
+/**
+ * \brief stops recording the trace and writes it to the file given to
+ *      xvc_trace_start ()
+ *
+ * This must only be called once the threads traced have stopped or are
+ * guaranteed not to record any more events.
+ *
+ * @return 0 on success or an errno value
+ */
+int
+xvc_trace_stop ()
+{
+#define DEBUGFUNCTION "xvc_trace_stop()"
+    TraceBuffer *buf, **link;
+    FILE *fp;
+    int first = 1, ret = 0, pid = (int) getpid ();
+
+    if (!xvc_trace_active)
+        return 0;
+    xvc_trace_active = 0;
+
+    fp = fopen (trace_file, "w");
+    if (!fp) {
+        ret = errno;
+        fprintf (stderr, _("%s %s: Can't write trace to %s: %s\n"),
+                 DEBUGFILE, DEBUGFUNCTION, trace_file, strerror (ret));
+    }
+
+    pthread_mutex_lock (&buffers_mutex);
+    if (fp) {
+        fprintf (fp, "{\"traceEvents\":[\n");
+        for (buf = buffers; buf; buf = buf->next) {
+            if (buf->count == 0)
+                continue;
+            write_buffer (fp, buf, pid, first);
+            first = 0;
+        }
+        fprintf (fp, "\n],\"displayTimeUnit\":\"ms\"}\n");
+        if (fclose (fp) != 0) {
+            ret = errno;
+            fprintf (stderr, _("%s %s: Can't write trace to %s: %s\n"),
+                     DEBUGFILE, DEBUGFUNCTION, trace_file, strerror (ret));
+        }
+    }
+    // threads that have gone won't record anything again
+    link = &buffers;
+    while (*link) {
+        buf = *link;
+        if (buf->orphaned) {
+            *link = buf->next;
+            free (buf->events);
+            free (buf);
+        } else {
+            link = &buf->next;
+        }
+    }
+    pthread_mutex_unlock (&buffers_mutex);
+
+    return ret;
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief names the calling thread in the trace
+ *
+ * @param name the name, which is copied
+ */
+void
+xvc_trace_thread_name (const char *name)
+{
+    TraceBuffer *buf;
+
+    if (!xvc_trace_active || !(buf = get_buffer ()))
+        return;
+    strncpy (buf->name, name, sizeof (buf->name) - 1);
+    buf->name[sizeof (buf->name) - 1] = '\0';
+}
+
+/**
+ * \brief records a stage run by the calling thread
+ *
+ * @param name the name of the stage, must be a string constant
+ * @param start the time the stage started as returned by xvc_stats_clock ()
+ * @param end the time the stage ended as returned by xvc_stats_clock ()
+ */
+void
+xvc_trace_event (const char *name, int64_t start, int64_t end)
+{
+    TraceBuffer *buf;
+    TraceEvent *ev;
+
+    if (!xvc_trace_active || !(buf = get_buffer ()))
+        return;
+    ev = &buf->events[buf->count % XVC_TRACE_MAX_EVENTS];
+    ev->name = name;
+    ev->start = start;
+    ev->dur = (end > start ? end - start : 0);
+    buf->count++;
+}
+
+/**
+ * \brief records a stage run by the calling thread that ends now
+ *
+ * @param name the name of the stage, must be a string constant
+ * @param start the time the stage started as returned by xvc_stats_clock ()
+ */
+void
+xvc_trace_end (const char *name, int64_t start)
+{
+    if (xvc_trace_active)
+        xvc_trace_event (name, start, xvc_stats_clock ());
+}
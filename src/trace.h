@@ -0,0 +1,45 @@
+/**
+ * \file trace.h
+ */
+/*
+ * Copyright (C) 2003-07 Karl H. Beckers, Frankfurt
+ * EMail: khb@jarre-de-the.net
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef _xvc_TRACE_H__
+#define _xvc_TRACE_H__
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+#include <sys/types.h>
+#include <inttypes.h>
+#endif     // DOXYGEN_SHOULD_SKIP_THIS
+
+/** \brief maximum number of events kept per thread, older events are
+ *      overwritten. An event takes 24 bytes. */
+#define XVC_TRACE_MAX_EVENTS 65536
+
+/** \brief TRUE while a trace is being recorded, checked before doing
+ *      anything else so tracing costs next to nothing when it is off */
+extern volatile int xvc_trace_active;
+
+int xvc_trace_start (const char *file);
+int xvc_trace_stop ();
+void xvc_trace_thread_name (const char *name);
+void xvc_trace_event (const char *name, int64_t start, int64_t end);
+void xvc_trace_end (const char *name, int64_t start);
+
+#endif     // _xvc_TRACE_H__
@@ -0,0 +1,520 @@
+/**
+ * \file write_behind.c
+ *
+ * This file contains the write-behind for long recordings. Output that is
+ * never read again would otherwise pile up as dirty pages until the kernel
+ * flushes gigabytes at once, stalling the capture and pushing everything
+ * else out of the page cache. With write_behind set, the writers report
+ * what they wrote, and every XVC_AppData write_behind_chunk MB of a file
+ * are handed to the kernel for writing with sync_file_range (). A thread
+ * waits for the chunks to reach the disk in order, drops them from the
+ * page cache with posix_fadvise () and records how long that took as the
+ * flush stage of the statistics. Writers only wait if more than
+ * write_behind MB are handed on and not on disk yet.
+ *
+ * Files reported to here are closed through xvc_wb_close (), which closes
+ * them once their last chunk was flushed. The protocol XVC_WB_PROTOCOL
+ * lets libavformat write with write-behind.
+ */
+/*
+ * Copyright (C) 2003-07 Karl H. Beckers, Frankfurt
+ * EMail: khb@jarre-de-the.net
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif     // HAVE_CONFIG_H
+
+// for sync_file_range ()
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif     // _GNU_SOURCE
+
+#define DEBUGFILE "write_behind.c"
+#endif     // DOXYGEN_SHOULD_SKIP_THIS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#ifdef USE_FFMPEG
+#include <ffmpeg/avformat.h>
+#endif     // USE_FFMPEG
+
+#include "write_behind.h"
+#include "app_data.h"
+#include "stats.h"
+#include "trace.h"
+#include "xvidcap-intl.h"
+
+/**
+ * \brief the part of a file written and not handed on yet
+ */
+typedef struct XVC_WbFile
+{
+    /** \brief the file descriptor */
+    int fd;
+    /** \brief file offset of the first byte not handed on */
+    int64_t start;
+    /** \brief file offset after the last byte written */
+    int64_t end;
+    /** \brief next file */
+    struct XVC_WbFile *next;
+} XVC_WbFile;
+
+/**
+ * \brief a chunk handed to the kernel for writing
+ */
+typedef struct XVC_WbRange
+{
+    /** \brief the file descriptor */
+    int fd;
+    /** \brief file offset of the chunk */
+    int64_t offset;
+    /** \brief length of the chunk, may be 0 for a file that is closed */
+    int64_t len;
+    /** \brief TRUE if the file is to be closed after the chunk */
+    int close_fd;
+    /** \brief name of the file for error messages if it is closed */
+    char *name;
+    /** \brief next chunk in the queue */
+    struct XVC_WbRange *next;
+} XVC_WbRange;
+
+/** \brief protects everything below */
+static pthread_mutex_t wb_mutex = PTHREAD_MUTEX_INITIALIZER;
+/** \brief signalled when a chunk was queued */
+static pthread_cond_t wb_queued = PTHREAD_COND_INITIALIZER;
+/** \brief signalled when a chunk was flushed */
+static pthread_cond_t wb_flushed = PTHREAD_COND_INITIALIZER;
+/** \brief TRUE once the thread flushing runs */
+static int wb_running = FALSE;
+/** \brief the files written to */
+static XVC_WbFile *files = NULL;
+/** \brief chunks waiting to be flushed, oldest first */
+static XVC_WbRange *queue_head = NULL, *queue_tail = NULL;
+/** \brief number of chunks queued or being flushed */
+static int num_queued = 0;
+/** \brief bytes handed on and not known to be on disk */
+static int64_t queued_bytes = 0;
+/** \brief limit of queued_bytes in bytes */
+static int64_t dirty_limit = 0;
+/** \brief size of the chunks handed on in bytes */
+static int64_t chunk_size = 0;
+
+/**
+ * \brief waits for the chunks queued to reach the disk and drops them from
+ *      the page cache, this runs in a thread of its own
+ *
+ * @param arg not used
+ * @return NULL
+ */
+static void *
+flush_thread (void *arg)
+{
+#define DEBUGFUNCTION "flush_thread()"
+    XVC_WbRange *r;
+    int64_t start;
+    int err;
+
+    xvc_trace_thread_name ("write-behind");
+    pthread_mutex_lock (&wb_mutex);
+    while (TRUE) {
+        while (!queue_head)
+            pthread_cond_wait (&wb_queued, &wb_mutex);
+        r = queue_head;
+        queue_head = r->next;
+        if (!queue_head)
+            queue_tail = NULL;
+        pthread_mutex_unlock (&wb_mutex);
+
+        if (r->len > 0) {
+            start = xvc_stats_clock ();
+#ifdef HAVE_SYNC_FILE_RANGE
+            err = sync_file_range (r->fd, r->offset, r->len,
+                                   SYNC_FILE_RANGE_WAIT_BEFORE |
+                                   SYNC_FILE_RANGE_WRITE |
+                                   SYNC_FILE_RANGE_WAIT_AFTER);
+#else
+            err = fdatasync (r->fd);
+#endif     // HAVE_SYNC_FILE_RANGE
+            if (err < 0)
+                fprintf (stderr, _("%s %s: Can't flush file %i: %s\n"),
+                         DEBUGFILE, DEBUGFUNCTION, r->fd, strerror (errno));
+#ifdef HAVE_POSIX_FADVISE
+            posix_fadvise (r->fd, r->offset, r->len, POSIX_FADV_DONTNEED);
+#endif     // HAVE_POSIX_FADVISE
+            xvc_stats_add_stage (XVC_STAGE_FLUSH, start);
+        }
+        if (r->close_fd) {
+            if (close (r->fd) < 0)
+                perror (r->name ? r->name : "close");
+            free (r->name);
+        }
+
+        pthread_mutex_lock (&wb_mutex);
+        queued_bytes -= r->len;
+        num_queued--;
+        free (r);
+        pthread_cond_broadcast (&wb_flushed);
+    }
+    return NULL;
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief reads the limits and starts the thread flushing if write-behind
+ *      is wanted, called with wb_mutex held
+ *
+ * @return TRUE if write-behind is used
+ */
+static int
+wb_start ()
+{
+#define DEBUGFUNCTION "wb_start()"
+    XVC_AppData *app = xvc_appdata_ptr ();
+    static int failed = FALSE;
+    pthread_t tid;
+
+    if (app->write_behind <= 0 || failed)
+        return FALSE;
+    chunk_size = (int64_t) (app->write_behind_chunk > 0 ?
+                            app->write_behind_chunk : XVC_WB_CHUNK_MB)
+        * 1024 * 1024;
+    dirty_limit = (int64_t) app->write_behind * 1024 * 1024;
+    if (dirty_limit < chunk_size)
+        dirty_limit = chunk_size;
+    if (wb_running)
+        return TRUE;
+
+    if (pthread_create (&tid, NULL, flush_thread, NULL) != 0) {
+        fprintf (stderr, _("%s %s: Can't start the write-behind thread\n"),
+                 DEBUGFILE, DEBUGFUNCTION);
+        failed = TRUE;
+        return FALSE;
+    }
+    pthread_detach (tid);
+    wb_running = TRUE;
+    return TRUE;
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief hands a chunk to the kernel for writing and queues it for the
+ *      thread flushing, called with wb_mutex held
+ *
+ * @param fd the file descriptor
+ * @param offset file offset of the chunk
+ * @param len length of the chunk
+ * @param close_name name of the file if it is to be closed after the
+ *      chunk, otherwise NULL
+ */
+static void
+queue_range (int fd, int64_t offset, int64_t len, const char *close_name)
+{
+    XVC_WbRange *r;
+
+    r = calloc (1, sizeof (XVC_WbRange));
+    if (!r) {
+        // not written back early, but the file must still be closed
+        if (close_name && close (fd) < 0)
+            perror (close_name);
+        return;
+    }
+#ifdef HAVE_SYNC_FILE_RANGE
+    if (len > 0)
+        sync_file_range (fd, offset, len, SYNC_FILE_RANGE_WRITE);
+#endif     // HAVE_SYNC_FILE_RANGE
+    r->fd = fd;
+    r->offset = offset;
+    r->len = len;
+    r->close_fd = (close_name != NULL);
+    r->name = (close_name ? strdup (close_name) : NULL);
+    if (queue_tail)
+        queue_tail->next = r;
+    else
+        queue_head = r;
+    queue_tail = r;
+    queued_bytes += len;
+    num_queued++;
+    pthread_cond_signal (&wb_queued);
+}
+
+/**
+ * \brief finds the entry of a file, called with wb_mutex held
+ *
+ * @param fd the file descriptor
+ * @param unlink TRUE to take the entry out of the list
+ * @return the entry or NULL if nothing was written to the file
+ */
+static XVC_WbFile *
+find_file (int fd, int unlink)
+{
+    XVC_WbFile **p;
+    XVC_WbFile *f;
+
+    for (p = &files; *p; p = &(*p)->next) {
+        f = *p;
+        if (f->fd == fd) {
+            if (unlink)
+                *p = f->next;
+            return f;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * \brief records that bytes were written to a file and hands them on if a
+ *      chunk is complete, this waits if too many bytes are not on disk yet
+ *
+ * @param fd the file descriptor
+ * @param offset file offset the bytes were written to
+ * @param len number of bytes written
+ */
+void
+xvc_wb_add (int fd, int64_t offset, size_t len)
+{
+    XVC_WbFile *f;
+
+    pthread_mutex_lock (&wb_mutex);
+    if (!wb_start ()) {
+        pthread_mutex_unlock (&wb_mutex);
+        return;
+    }
+    f = find_file (fd, FALSE);
+    if (!f) {
+        f = calloc (1, sizeof (XVC_WbFile));
+        if (!f) {
+            pthread_mutex_unlock (&wb_mutex);
+            return;
+        }
+        f->fd = fd;
+        f->start = f->end = offset;
+        f->next = files;
+        files = f;
+    }
+    // a seek, like a muxer patching a header, ends the chunk early
+    if (offset != f->end) {
+        if (f->end > f->start)
+            queue_range (fd, f->start, f->end - f->start, NULL);
+        f->start = offset;
+    }
+    f->end = offset + len;
+    while (f->end - f->start >= chunk_size) {
+        queue_range (fd, f->start, chunk_size, NULL);
+        f->start += chunk_size;
+    }
+    while (queued_bytes > dirty_limit)
+        pthread_cond_wait (&wb_flushed, &wb_mutex);
+    pthread_mutex_unlock (&wb_mutex);
+}
+
+/**
+ * \brief closes a file written with write-behind once the rest of it was
+ *      flushed, or right away without write-behind
+ *
+ * @param fd the file descriptor, not to be used afterwards
+ * @param name name of the file for error messages
+ * @return 0 on success or -1 if closing the file right away failed
+ */
+int
+xvc_wb_close (int fd, const char *name)
+{
+    XVC_WbFile *f;
+
+    pthread_mutex_lock (&wb_mutex);
+    if (!wb_running) {
+        pthread_mutex_unlock (&wb_mutex);
+        return close (fd);
+    }
+    f = find_file (fd, TRUE);
+    if (f) {
+        queue_range (fd, f->start, f->end - f->start, name);
+        free (f);
+    } else {
+        queue_range (fd, 0, 0, name);
+    }
+    pthread_mutex_unlock (&wb_mutex);
+    return 0;
+}
+
+/**
+ * \brief hands on everything written and waits for it to be flushed and
+ *      for the files closed to be closed
+ */
+void
+xvc_wb_drain ()
+{
+    XVC_WbFile *f;
+
+    pthread_mutex_lock (&wb_mutex);
+    for (f = files; f; f = f->next) {
+        if (f->end > f->start)
+            queue_range (f->fd, f->start, f->end - f->start, NULL);
+        f->start = f->end;
+    }
+    while (num_queued > 0)
+        pthread_cond_wait (&wb_flushed, &wb_mutex);
+    pthread_mutex_unlock (&wb_mutex);
+}
+
+#ifdef USE_FFMPEG
+/**
+ * \brief a file libavformat writes to through XVC_WB_PROTOCOL
+ */
+typedef struct
+{
+    /** \brief the file descriptor */
+    int fd;
+    /** \brief the file offset */
+    int64_t pos;
+    /** \brief name of the file for error messages */
+    char name[1];
+} XVC_WbUrl;
+
+/**
+ * \brief opens a file for libavformat
+ *
+ * @param h the URL context
+ * @param filename XVC_WB_PROTOCOL: followed by the file name
+ * @param flags only URL_WRONLY is supported
+ * @return 0 on success or a negative error code
+ */
+static int
+wb_url_open (URLContext * h, const char *filename, int flags)
+{
+    XVC_WbUrl *u;
+
+    if (flags != URL_WRONLY)
+        return AVERROR (EINVAL);
+    if (strncmp (filename, XVC_WB_PROTOCOL ":",
+                 strlen (XVC_WB_PROTOCOL ":")) == 0)
+        filename += strlen (XVC_WB_PROTOCOL ":");
+    u = malloc (sizeof (XVC_WbUrl) + strlen (filename));
+    if (!u)
+        return AVERROR (ENOMEM);
+    strcpy (u->name, filename);
+    u->pos = 0;
+    u->fd = open (filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (u->fd < 0) {
+        int err = errno;
+
+        free (u);
+        return AVERROR (err);
+    }
+    h->priv_data = u;
+    h->is_streamed = 0;
+    return 0;
+}
+
+/**
+ * \brief writes for libavformat
+ *
+ * @param h the URL context
+ * @param buf what to write
+ * @param size number of bytes to write
+ * @return size or a negative error code
+ */
+static int
+wb_url_write (URLContext * h, unsigned char *buf, int size)
+{
+    XVC_WbUrl *u = (XVC_WbUrl *) h->priv_data;
+    int done = 0;
+    ssize_t n;
+
+    while (done < size) {
+        n = write (u->fd, buf + done, size - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return AVERROR_IO;
+        done += n;
+    }
+    xvc_wb_add (u->fd, u->pos, size);
+    u->pos += size;
+    return size;
+}
+
+/**
+ * \brief seeks for libavformat
+ *
+ * @param h the URL context
+ * @param pos the offset
+ * @param whence SEEK_SET, SEEK_CUR or SEEK_END
+ * @return the new offset or a negative error code
+ */
+static offset_t
+wb_url_seek (URLContext * h, offset_t pos, int whence)
+{
+    XVC_WbUrl *u = (XVC_WbUrl *) h->priv_data;
+    off_t ret;
+
+    ret = lseek (u->fd, pos, whence);
+    if (ret < 0)
+        return AVERROR (errno);
+    u->pos = ret;
+    return ret;
+}
+
+/**
+ * \brief closes a file for libavformat
+ *
+ * @param h the URL context
+ * @return 0 on success or a negative error code
+ */
+static int
+wb_url_close (URLContext * h)
+{
+    XVC_WbUrl *u = (XVC_WbUrl *) h->priv_data;
+    int ret;
+
+    ret = xvc_wb_close (u->fd, u->name);
+    free (u);
+    return (ret < 0 ? AVERROR_IO : 0);
+}
+
+/** \brief the protocol for libavformat */
+static URLProtocol wb_protocol = {
+    XVC_WB_PROTOCOL,
+    wb_url_open,
+    NULL,
+    wb_url_write,
+    wb_url_seek,
+    wb_url_close,
+};
+
+/**
+ * \brief makes XVC_WB_PROTOCOL known to libavformat, only the first call
+ *      does anything
+ */
+void
+xvc_wb_register_protocol ()
+{
+    static int registered = FALSE;
+
+    if (registered)
+        return;
+    register_protocol (&wb_protocol);
+    registered = TRUE;
+}
+#endif     // USE_FFMPEG
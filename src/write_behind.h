@@ -0,0 +1,45 @@
+/**
+ * \file write_behind.h
+ */
+/*
+ * Copyright (C) 2003-07 Karl H. Beckers, Frankfurt
+ * EMail: khb@jarre-de-the.net
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef _xvc_WRITE_BEHIND_H__
+#define _xvc_WRITE_BEHIND_H__
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+#include <sys/types.h>
+#include <inttypes.h>
+#endif     // DOXYGEN_SHOULD_SKIP_THIS
+
+/** \brief default size of the chunks written back at a time in MB */
+#define XVC_WB_CHUNK_MB 8
+/** \brief name of the libavformat protocol writing with write-behind */
+#define XVC_WB_PROTOCOL "xvcwb"
+
+int xvc_wb_active ();
+void xvc_wb_add (int fd, int64_t offset, size_t len);
+int xvc_wb_close (int fd, const char *name);
+void xvc_wb_drain ();
+
+#ifdef USE_FFMPEG
+void xvc_wb_register_protocol ();
+#endif     // USE_FFMPEG
+
+#endif     // _xvc_WRITE_BEHIND_H__
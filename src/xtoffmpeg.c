@@ -41,6 +41,9 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
 #include <sys/time.h>                  /* for timeval struct and related
                                         * functions */
 #include <math.h>
@@ -53,6 +56,13 @@
 #include "colors.h"
 #include "frame.h"
 #include "codecs.h"
+#include "pixels.h"
+#include "replay_buffer.h"
+#include "stats.h"
+#include "trace.h"
+#include "damage_map.h"
+#include "async_io.h"
+#include "write_behind.h"
 #include "xvidcap-intl.h"
 
 // ffmpeg stuff
@@ -139,6 +149,71 @@ static int input_pixfmt;
 /** \brief store current video_pts for a/v sync */
 static double video_pts;
 
+/** \brief set by xvc_ffmpeg_roll_over () to have the next frame encoded
+ *      as a keyframe */
+static int segment_force_key = FALSE;
+
+/** \brief set while we are waiting for the encoder to deliver the keyframe
+ *      starting the next segment */
+static int segment_pending = FALSE;
+
+/** \brief pts of the first video frame of the current segment in the
+ *      video stream's time base, subtracted from all video timestamps */
+static int64_t seg_video_offset = 0;
+
+/** \brief largest share of damaged macroblocks in percent up to which the
+ *      encoder is told which macroblocks didn't move */
+#define SKIP_MAX_DAMAGED 50
+
+/** \brief macroblock types handed to the encoder with p_outpic, all
+ *      predicted from the frame before, NULL if the encoder takes no hints */
+static uint32_t *skip_mb_type = NULL;
+/** \brief zero motion vectors for skip_mb_type in both directions */
+static int16_t (*skip_motion_val)[2] = NULL;
+/** \brief zero reference frame indexes for skip_mb_type */
+static int8_t *skip_ref_index = NULL;
+/** \brief one byte per macroblock, marking the damaged ones */
+static unsigned char *skip_damaged = NULL;
+/** \brief number of macroblocks in a frame */
+static int skip_mbs = 0;
+/** \brief me_threshold to encode with while hinting */
+static int skip_threshold = 0;
+
+/** \brief the most recent encoded packets in replay mode, NULL if writing
+ *      the output file directly */
+static XVC_ReplayBuffer *replay = NULL;
+
+/** \brief most frames B-frames are reordered by that the decoding times
+ *      of replay packets are worked out for */
+#define REPLAY_MAX_DELAY 16
+/** \brief presentation times of the last video packets kept for replay,
+ *      lowest first, for working out their decoding times */
+static int64_t replay_pts_buffer[REPLAY_MAX_DELAY + 1];
+
+/** \brief protects replay from being freed while a replay is being saved */
+static pthread_mutex_t replay_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** \brief id of the thread writing a replay file */
+static pthread_t replay_tid = 0;
+
+/** \brief set while replay_tid is writing a replay file */
+static volatile int replay_saving = FALSE;
+
+/**
+ * \brief a replay being written to a file
+ */
+typedef struct
+{
+    /** \brief format context of the replay file */
+    AVFormatContext *oc;
+    /** \brief the packets to write */
+    XVC_ReplayPacket **pkts;
+    /** \brief number of packets to write */
+    int count;
+    /** \brief be verbose */
+    int verbose;
+} XVC_ReplaySave;
+
 /** \brief buffer memory used during 8bit palette conversion */
 static uint8_t *scratchbuf8bit;
 
@@ -146,6 +221,68 @@ static uint8_t *scratchbuf8bit;
  * active capture mode (which certainly is mf here) */
 static XVC_CapTypeOptions *target = NULL;
 
+/** \brief maximum number of threads encoding single frames */
+#define SF_MAX_WORKERS 8
+/** \brief captured frames per worker that may wait for encoding */
+#define SF_FRAMES_PER_WORKER 2
+
+/**
+ * \brief a thread encoding single frames with its own encoder
+ */
+typedef struct
+{
+    /** \brief the thread */
+    pthread_t tid;
+    /** \brief format context the frames are written with */
+    AVFormatContext *oc;
+    /** \brief the stream of oc with the encoder */
+    AVStream *st;
+    /** \brief wrapper around the captured frame or scratch */
+    AVFrame *inpic;
+    /** \brief the frame converted for the encoder */
+    AVFrame *outpic;
+    /** \brief data buffer for outpic */
+    uint8_t *outpic_buf;
+    /** \brief output buffer for the encoded frame */
+    uint8_t *outbuf;
+    /** \brief buffer for 8bit palette conversion */
+    uint8_t *scratch;
+    /** \brief context for conversion and rescaling */
+    struct SwsContext *sws;
+} XVC_SFWorker;
+
+/**
+ * \brief a captured frame waiting for a worker
+ */
+typedef struct
+{
+    /** \brief a copy of the image data */
+    char *data;
+    /** \brief the number of the frame for the file name */
+    int pic_no;
+} XVC_SFFrame;
+
+/** \brief the threads encoding single frames, none if encoding in the
+ *      capture thread */
+static XVC_SFWorker sf_workers[SF_MAX_WORKERS];
+static int sf_num_workers = 0;
+/** \brief frames waiting for a worker, oldest first from sf_head */
+static XVC_SFFrame *sf_queue = NULL;
+static int sf_queue_size = 0, sf_head = 0, sf_count = 0;
+/** \brief buffers for copies of captured frames not in use */
+static char **sf_free = NULL;
+static int sf_num_free = 0;
+/** \brief set when the workers should finish the frames queued and end */
+static int sf_stop = FALSE;
+/** \brief the captured image the frames queued are copies of */
+static XImage sf_image;
+/** \brief protects the queue and the free buffers */
+static pthread_mutex_t sf_mutex = PTHREAD_MUTEX_INITIALIZER;
+/** \brief signalled when a frame was queued or the workers should end */
+static pthread_cond_t sf_queued = PTHREAD_COND_INITIALIZER;
+/** \brief signalled when a buffer was freed */
+static pthread_cond_t sf_freed = PTHREAD_COND_INITIALIZER;
+
 #ifdef DEBUG
 static void dump8bit (const XImage * image, const u_int32_t * ct);
 static void dump32bit (const XImage * input, const ColorInfo * c_info);
@@ -154,12 +291,89 @@ static void dump32bit (const XImage * input, const ColorInfo * c_info);
 static void x2ffmpeg_dump_ximage_info (XImage * img, FILE * fp);
 #endif     // DEBUG
 
+/**
+ * \brief keeps an encoded packet in the replay buffer instead of writing it
+ *
+ * @param st the output stream the packet belongs to
+ * @param pkt the packet with its pts in the stream's time base
+ * @param gop_start TRUE if the packet is a video keyframe
+ */
+static void
+replay_append (AVStream * st, AVPacket * pkt, int gop_start)
+{
+    AVRational us = { 1, AV_TIME_BASE };
+    int64_t bytes, dts, duration, tmp;
+    int secs, delay, i;
+    unsigned long evicted;
+
+    // nothing is muxed, so keep the stream's pts current ourselves for the
+    // a/v sync of the audio thread
+    if (pkt->pts != AV_NOPTS_VALUE)
+        st->pts.val = pkt->pts;
+
+    // the encoder doesn't tell the decoding time. With B-frames it is the
+    // lowest of the last delay + 1 presentation times, which is what
+    // libavformat works out when muxing, too
+    dts = st->pts.val;
+    delay = FFMIN (st->codec->has_b_frames, REPLAY_MAX_DELAY);
+    if (st->codec->codec_type == CODEC_TYPE_VIDEO && delay > 0) {
+        duration = av_rescale_q (1, st->codec->time_base, st->time_base);
+        replay_pts_buffer[0] = st->pts.val;
+        for (i = 1; i <= delay && replay_pts_buffer[i] == AV_NOPTS_VALUE;
+             i++)
+            replay_pts_buffer[i] = st->pts.val + (i - delay - 1) * duration;
+        for (i = 0; i < delay &&
+             replay_pts_buffer[i] > replay_pts_buffer[i + 1]; i++) {
+            tmp = replay_pts_buffer[i];
+            replay_pts_buffer[i] = replay_pts_buffer[i + 1];
+            replay_pts_buffer[i + 1] = tmp;
+        }
+        dts = replay_pts_buffer[0];
+    }
+
+    xvc_replay_buffer_append (replay, pkt->stream_index, pkt->data,
+                              pkt->size, av_rescale_q (st->pts.val,
+                                                       st->time_base, us),
+                              av_rescale_q (dts, st->time_base, us),
+                              pkt->flags, gop_start);
+    xvc_replay_buffer_get_status (replay, &bytes, &secs, &evicted);
+    xvc_stats_set_replay (bytes);
+}
+
 #ifdef HAVE_FFMPEG_AUDIO
 
 #define MAX_AUDIO_PACKET_SIZE (128 * 1024)
 
-#include <pthread.h>
-#include <signal.h>
+/** \brief amount of captured audio buffered ahead of the encoder in
+ *      milliseconds */
+#define AUDIO_RING_MS 2000
+
+/** \brief interval for printing the audio ring status in verbose mode in
+ *      seconds */
+#define AUDIO_STATUS_INTERVAL 5
+
+/** \brief maximum number of audio inputs recorded at the same time */
+#define MAX_AUDIO_SOURCES 4
+
+/** \brief amount of audio converted to the output format a secondary
+ *      input may hold while waiting to be mixed in milliseconds */
+#define AUDIO_PENDING_MS 500
+
+/** \brief inputs whose capture times differ by less than this are mixed
+ *      as they are (in microseconds) */
+#define AUDIO_ALIGN_TOLERANCE 20000
+
+/** \brief resampling ratio correction per second of drift between a
+ *      secondary input and the master */
+#define AUDIO_DRIFT_GAIN 0.1
+
+/** \brief maximum time in milliseconds the video thread waits for the
+ *      audio to catch up before switching to the next segment */
+#define SEGMENT_AUDIO_WAIT_MS 100
+
+#include "audio_ring.h"
+#include "audio_mixer.h"
+#include "resampler.h"
 
 /**
  * \brief AVOutputStream taken from ffmpeg.c
@@ -220,6 +434,56 @@ typedef struct AVInputStream
                      * discontinuity */
 } AVInputStream;
 
+/**
+ * \brief one audio input and everything needed to capture from it
+ *
+ * Every source has its own capture thread and ring buffer. The samples
+ * captured are stamped with the system time they were read at, which is
+ * what the encode thread uses to line up the sources when mixing.
+ */
+typedef struct _XVC_AudioSource
+{
+    /** \brief device name, "pipe:" for stdin or "tone" */
+    char *device;
+    /** \brief factor applied to the source's samples when mixing */
+    float gain;
+    /** \brief true for file/pipe input which must not lose samples */
+    int block;
+    /** \brief frequency of the sine wave generated in Hz, 0 if the source
+     *      is a device or a pipe */
+    double tone;
+    /** \brief sample rate of the input */
+    int rate;
+    /** \brief number of channels of the input */
+    int channels;
+    /** \brief format context for the input */
+    AVFormatContext *ic;
+    /** \brief input stream */
+    AVInputStream *ist;
+    /** \brief conversion to the output's sample rate and channels. NULL
+     *      for a master input already matching the output */
+    XVC_Resampler *resampler;
+    /** \brief smoothed difference between the capture times of this
+     *      input's and the master's samples mixed (in microseconds) */
+    double drift;
+    /** \brief captured samples not encoded yet, in the input's format */
+    XVC_AudioRing *ring;
+    /** \brief id of the source's capture thread */
+    pthread_t tid;
+    /** \brief TRUE until the source's capture thread is about to end */
+    volatile int running;
+    /** \brief samples converted to the output format, waiting to be mixed */
+    int16_t *pending;
+    /** \brief number of sample frames in pending */
+    int pending_frames;
+    /** \brief capture time of the first sample frame in pending */
+    int64_t pending_pts;
+    /** \brief number of sample frames dropped because pending was full */
+    int64_t pending_dropped;
+    /** \brief set once the ring has been closed and drained */
+    int eof;
+} XVC_AudioSource;
+
 // FIXME: check if this all needs to be static global
 /** \brief audio codec */
 static AVCodec *au_codec = NULL;
@@ -227,15 +491,21 @@ static AVCodec *au_codec = NULL;
 /** \brief audio codec context */
 static AVCodecContext *au_c = NULL;
 
-/** \brief format context for audio input */
-static AVFormatContext *ic = NULL;
+/** \brief the audio inputs. The first one is the master all others are
+ *      aligned to */
+static XVC_AudioSource au_sources[MAX_AUDIO_SOURCES];
+
+/** \brief frequency of a tone audio input if none is given in Hz */
+#define AUDIO_TONE_FREQ 440.0
+/** \brief length of the blocks a tone audio input generates in ms */
+#define AUDIO_TONE_BLOCK_MS 20
+
+/** \brief number of audio inputs in use */
+static int au_num_sources = 0;
 
 /** \brief audio output stream */
 static AVOutputStream *au_out_st = NULL;
 
-/** \brief audio input stream */
-static AVInputStream *au_in_st = NULL;
-
 /** \brief buffer used during audio capture */
 static uint8_t *audio_buf = NULL;
 
@@ -250,51 +520,113 @@ static pthread_attr_t tattr;
  *      capture. This is the mutex lock */
 static pthread_mutex_t mp = PTHREAD_MUTEX_INITIALIZER;
 
-/** \brief thread coordination variables for interleaving audio and video
- *      capture. This is the thread's id */
-static pthread_t tid = 0;
+/** \brief id of the thread mixing and encoding the captured audio */
+static pthread_t enc_tid = 0;
 
-static int audio_thread_running = FALSE;
+/** \brief tells the audio capture threads to finish */
+static volatile int audio_capture_stop = FALSE;
 
 /** \brief store current audio_pts for a/v sync */
 static double audio_pts;
 
+/** \brief pts of the first audio packet of the current segment in the
+ *      audio stream's time base, subtracted from all audio timestamps */
+static int64_t seg_audio_offset = 0;
+
 /*
  * functions ...
  *
  */
 
 /**
- * \brief adds an audio stream to AVFormatContext output_file
+ * \brief splits the sound device setting into the individual sources
  *
- * @param job the current job
- * @return 0 on success or smth. else on failure
+ * The setting is a comma separated list of devices. Each device may be
+ * followed by \@gain to scale its level when mixing, e. g.
+ * "/dev/dsp,/dev/dsp1\@0.5". "-" stands for stdin, "tone" or
+ * "tone:frequency" for a generated sine wave.
+ *
+ * @param list the sound device setting
+ * @return the number of sources found
  */
 static int
-add_audio_stream (Job * job)
+parse_audio_sources (const char *list)
 {
-#define DEBUGFUNCTION "add_audio_stream()"
-    AVInputFormat *grab_iformat = NULL;
-    Boolean grab_audio = TRUE;
-    AVFormatParameters params, *ap = &params;   // audio stream params
-    int err, ret;
+#define DEBUGFUNCTION "parse_audio_sources()"
+    char *copy, *tok, *save = NULL;
+    int n = 0;
+
+    memset (au_sources, 0, sizeof (au_sources));
+    copy = strdup (list);
+    if (!copy)
+        return 0;
 
+    for (tok = strtok_r (copy, ",", &save); tok;
+         tok = strtok_r (NULL, ",", &save)) {
+        XVC_AudioSource *src;
+        char *at = strrchr (tok, '@');
+
+        if (n >= MAX_AUDIO_SOURCES) {
+            fprintf (stderr,
+                     _("%s %s: Only %i audio inputs supported, ignoring %s\n"),
+                     DEBUGFILE, DEBUGFUNCTION, MAX_AUDIO_SOURCES, tok);
+            continue;
+        }
+        src = &au_sources[n];
+        src->gain = 1.0;
+        if (at) {
+            *at = '\0';
+            src->gain = atof (at + 1);
+            if (src->gain < 0)
+                src->gain = 0;
+        }
+        if (!strcmp (tok, "-") || !strcmp (tok, "pipe:")) {
+            src->device = strdup ("pipe:");
+            src->block = TRUE;
+        } else if (!strncmp (tok, "tone", 4) &&
+                   (tok[4] == '\0' || tok[4] == ':')) {
+            src->device = strdup (tok);
+            src->block = FALSE;
+            src->tone = (tok[4] == ':' ? atof (tok + 5) : AUDIO_TONE_FREQ);
+            if (src->tone <= 0)
+                src->tone = AUDIO_TONE_FREQ;
+        } else {
+            src->device = strdup (tok);
+            src->block = FALSE;
+        }
 #ifdef DEBUG
-    printf ("%s %s: Entering\n", DEBUGFILE, DEBUGFUNCTION);
+        printf ("%s %s: audio input %i: %s gain %f\n", DEBUGFILE,
+                DEBUGFUNCTION, n, src->device, src->gain);
 #endif     // DEBUG
-
-    if (!strcmp (job->snd_device, "-")) {
-        job->snd_device = "pipe:";
-        grab_audio = FALSE;
-    } else {
-        grab_audio = TRUE;
+        n++;
     }
+    free (copy);
+
+    return n;
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief opens the device or pipe of an audio input and prepares decoding
+ *      it
+ *
+ * @param src the audio source to open
+ * @return 0 on success or smth. else on failure
+ */
+static int
+open_audio_device (XVC_AudioSource * src)
+{
+#define DEBUGFUNCTION "open_audio_device()"
+    AVInputFormat *grab_iformat = NULL;
+    AVFormatParameters params, *ap = &params;   // audio stream params
+    AVCodecContext *in_c;
+    AVCodec *dec;
+    int err, ret;
 
     // prepare input stream
     memset (ap, 0, sizeof (*ap));
-//    ap->device = job->snd_device;
 
-    if (grab_audio) {
+    if (!src->block) {
         ap->sample_rate = target->sndrate;
         ap->channels = target->sndchannels;
 
@@ -308,43 +640,203 @@ add_audio_stream (Job * job)
 #endif     // DEBUG
     }
 
-    err =
-        av_open_input_file (&ic, job->snd_device,
-                            (grab_audio ? grab_iformat : NULL), 0, ap);
+    err = av_open_input_file (&src->ic, src->device, grab_iformat, 0, ap);
     if (err < 0) {
         fprintf (stderr, _("%s %s: error opening input file %s: %i\n"),
-                 DEBUGFILE, DEBUGFUNCTION, job->snd_device, err);
+                 DEBUGFILE, DEBUGFUNCTION, src->device, err);
+        src->ic = NULL;
         return 1;
     }
-    au_in_st = av_mallocz (sizeof (AVInputStream));
-    if (!au_in_st || !ic) {
+    src->ist = av_mallocz (sizeof (AVInputStream));
+    if (!src->ist) {
         fprintf (stderr,
                  _("%s %s: Could not alloc input stream ... aborting\n"),
                  DEBUGFILE, DEBUGFUNCTION);
         return 1;
     }
-    au_in_st->st = ic->streams[0];
+    src->ist->st = src->ic->streams[0];
 
     // If not enough info to get the stream parameters, we decode
     // the first frames to get it. (used in mpeg case for example)
-    ret = av_find_stream_info (ic);
+    ret = av_find_stream_info (src->ic);
     if (ret < 0) {
         fprintf (stderr, _("%s %s: could not find codec parameters\n"),
                  DEBUGFILE, DEBUGFUNCTION);
-        if (au_in_st) {
-            av_free (au_in_st);
-            au_in_st = NULL;
-        }
         return 1;
     }
     // init pts stuff
-    au_in_st->next_pts = 0;
-    au_in_st->is_start = 1;
+    src->ist->next_pts = 0;
+    src->ist->is_start = 1;
+    src->ist->decoding_needed = 1;
+    in_c = src->ist->st->codec;
+
+#ifdef DEBUG
+    dump_format (src->ic, 0, src->device, 0);
+#endif     // DEBUG
+
+    // This bit is important for inputs other than self-sampled.
+    // The sample rates and no of channels a user asks for
+    // are the ones he/she wants in the encoded mpeg. For self-
+    // sampled audio, these are usually also the values used for
+    // sampling, but a device may not support them. When dubbing from
+    // a pipe or a different file, we might have different sample rates
+    // or no of channels in the input file, too. Since all sources are
+    // mixed, every one of them needs to be brought to the output format.
+    if (target->sndchannels != in_c->channels &&
+        in_c->codec_id == CODEC_ID_AC3) {
+        // Special case for 5:1 AC3 input
+        // and mono or stereo output
+        // Request specific number of channels
+        in_c->channels = target->sndchannels;
+    }
+    // open decoder
+    dec = avcodec_find_decoder (in_c->codec_id);
+    if (!dec) {
+        fprintf (stderr,
+                 _("%s %s: Unsupported codec (id=%d) for input stream\n"),
+                 DEBUGFILE, DEBUGFUNCTION, in_c->codec_id);
+        return 1;
+    }
+    if (avcodec_open (in_c, dec) < 0) {
+        fprintf (stderr,
+                 _("%s %s: Error while opening codec for input stream\n"),
+                 DEBUGFILE, DEBUGFUNCTION);
+        return 1;
+    }
+    src->rate = in_c->sample_rate;
+    src->channels = in_c->channels;
+
+    return 0;
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief opens an audio input and prepares decoding and resampling it to
+ *      the sample rate and number of channels of the output
+ *
+ * @param src the audio source to open
+ * @return 0 on success or smth. else on failure
+ */
+static int
+open_audio_source (XVC_AudioSource * src)
+{
+#define DEBUGFUNCTION "open_audio_source()"
+    XVC_AppData *app = xvc_appdata_ptr ();
+
+    if (src->tone > 0) {
+        // a tone is generated in the output's format
+        src->rate = target->sndrate;
+        src->channels = target->sndchannels;
+    } else if (open_audio_device (src)) {
+        return 1;
+    }
+    // secondary inputs always get a resampler for drift correction
+    if (target->sndchannels != src->channels ||
+        target->sndrate != src->rate || src != &au_sources[0]) {
+        src->resampler =
+            xvc_resampler_new (src->rate, target->sndrate, src->channels,
+                               target->sndchannels, app->resample_quality);
+        if (!src->resampler) {
+            printf (_("%s %s: Can't resample. Aborting.\n"),
+                    DEBUGFILE, DEBUGFUNCTION);
+            return 1;
+        }
+    }
+
+    src->ring = xvc_audio_ring_new (AUDIO_RING_MS, src->rate, src->channels);
+    src->pending =
+        av_malloc (target->sndrate * AUDIO_PENDING_MS / 1000 *
+                   target->sndchannels * sizeof (int16_t));
+    if (!src->ring || !src->pending) {
+        fprintf (stderr,
+                 _("%s %s: Can't allocate audio buffers for %s\n"),
+                 DEBUGFILE, DEBUGFUNCTION, src->device);
+        return 1;
+    }
+
+    return 0;
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief closes an audio input and frees everything attached to it
+ *
+ * @param src the audio source to close
+ */
+static void
+close_audio_source (XVC_AudioSource * src)
+{
+    if (src->ring) {
+        xvc_audio_ring_free (src->ring);
+        src->ring = NULL;
+    }
+    if (src->pending) {
+        av_free (src->pending);
+        src->pending = NULL;
+    }
+    if (src->resampler) {
+        xvc_resampler_free (src->resampler);
+        src->resampler = NULL;
+    }
+    if (src->ist) {
+        if (src->ist->st && src->ist->st->codec &&
+            src->ist->st->codec->codec)
+            avcodec_close (src->ist->st->codec);
+        av_free (src->ist);
+        src->ist = NULL;
+    }
+    if (src->ic) {
+        av_close_input_file (src->ic);
+        src->ic = NULL;
+    }
+    if (src->device) {
+        free (src->device);
+        src->device = NULL;
+    }
+}
+
+/**
+ * \brief closes all audio inputs
+ */
+static void
+close_audio_sources ()
+{
+    int i;
+
+    for (i = 0; i < au_num_sources; i++)
+        close_audio_source (&au_sources[i]);
+    au_num_sources = 0;
+}
+
+/**
+ * \brief adds an audio stream to AVFormatContext output_file
+ *
+ * @param job the current job
+ * @return 0 on success or smth. else on failure
+ */
+static int
+add_audio_stream (Job * job)
+{
+#define DEBUGFUNCTION "add_audio_stream()"
+    int i;
 
 #ifdef DEBUG
-    dump_format (ic, 0, job->snd_device, 0);
+    printf ("%s %s: Entering\n", DEBUGFILE, DEBUGFUNCTION);
 #endif     // DEBUG
 
+    au_num_sources = parse_audio_sources (job->snd_device);
+    if (au_num_sources < 1) {
+        fprintf (stderr, _("%s %s: no audio input given\n"),
+                 DEBUGFILE, DEBUGFUNCTION);
+        return 1;
+    }
+    for (i = 0; i < au_num_sources; i++) {
+        if (open_audio_source (&au_sources[i])) {
+            close_audio_sources ();
+            return 1;
+        }
+    }
+
     // OUTPUT
     // setup output codec
     au_c = avcodec_alloc_context ();
@@ -353,10 +845,7 @@ add_audio_stream (Job * job)
                  _
                  ("%s %s: could not allocate audio output codec context\n"),
                  DEBUGFILE, DEBUGFUNCTION);
-        if (au_in_st) {
-            av_free (au_in_st);
-            au_in_st = NULL;
-        }
+        close_audio_sources ();
         return 1;
     }
     // put sample parameters
@@ -373,20 +862,14 @@ add_audio_stream (Job * job)
         fprintf (stderr,
                  _("%s %s: Could not alloc stream ... aborting\n"),
                  DEBUGFILE, DEBUGFUNCTION);
-        if (au_in_st) {
-            av_free (au_in_st);
-            au_in_st = NULL;
-        }
+        close_audio_sources ();
         return 1;
     }
     au_out_st->st = av_new_stream (output_file, 1);
     if (!au_out_st->st) {
         fprintf (stderr, _("%s %s: Could not alloc stream\n"),
                  DEBUGFILE, DEBUGFUNCTION);
-        if (au_in_st) {
-            av_free (au_in_st);
-            au_in_st = NULL;
-        }
+        close_audio_sources ();
         return 1;
     }
     au_out_st->st->codec = au_c;
@@ -395,72 +878,11 @@ add_audio_stream (Job * job)
         fprintf (stderr,
                  _("%s %s: Can't initialize fifo for audio recording\n"),
                  DEBUGFILE, DEBUGFUNCTION);
-        if (au_in_st) {
-            av_free (au_in_st);
-            au_in_st = NULL;
-        }
+        close_audio_sources ();
         return 1;
     }
-    // This bit is important for inputs other than self-sampled.
-    // The sample rates and no of channels a user asks for
-    // are the ones he/she wants in the encoded mpeg. For self-
-    // sampled audio, these are also the values used for sampling.
-    // Hence there is no resampling necessary (case 1).
-    // When dubbing from a pipe or a different
-    // file, we might have different sample rates or no of
-    // channels
-    // in the input file.....
-    if (au_c->channels == au_in_st->st->codec->channels &&
-        au_c->sample_rate == au_in_st->st->codec->sample_rate) {
-        au_out_st->audio_resample = 0;
-    } else {
-        if (au_c->channels != au_in_st->st->codec->channels &&
-            au_in_st->st->codec->codec_id == CODEC_ID_AC3) {
-            // Special case for 5:1 AC3 input
-            // and mono or stereo output
-            // Request specific number of channels
-            au_in_st->st->codec->channels = au_c->channels;
-            if (au_c->sample_rate == au_in_st->st->codec->sample_rate)
-                au_out_st->audio_resample = 0;
-            else {
-                au_out_st->audio_resample = 1;
-                au_out_st->resample =
-                    audio_resample_init (au_c->channels,
-                                         au_in_st->st->codec->
-                                         channels,
-                                         au_c->sample_rate,
-                                         au_in_st->st->codec->sample_rate);
-                if (!au_out_st->resample) {
-                    printf (_("%s %s: Can't resample. Aborting.\n"),
-                            DEBUGFILE, DEBUGFUNCTION);
-                    if (au_in_st) {
-                        av_free (au_in_st);
-                        au_in_st = NULL;
-                    }
-                    return 1;
-                }
-            }
-            // Request specific number of channels
-            au_in_st->st->codec->channels = au_c->channels;
-        } else {
-            au_out_st->audio_resample = 1;
-            au_out_st->resample =
-                audio_resample_init (au_c->channels,
-                                     au_in_st->st->codec->channels,
-                                     au_c->sample_rate,
-                                     au_in_st->st->codec->sample_rate);
-            if (!au_out_st->resample) {
-                printf (_("%s %s: Can't resample. Aborting.\n"), DEBUGFILE,
-                        DEBUGFUNCTION);
-                if (au_in_st) {
-                    av_free (au_in_st);
-                    au_in_st = NULL;
-                }
-                return 1;
-            }
-        }
-    }
-    au_in_st->decoding_needed = 1;
+    // resampling is done per source before mixing
+    au_out_st->audio_resample = 0;
     au_out_st->encoding_needed = 1;
 
     // open encoder
@@ -469,32 +891,7 @@ add_audio_stream (Job * job)
         fprintf (stderr,
                  _("%s %s: Error while opening codec for output stream\n"),
                  DEBUGFILE, DEBUGFUNCTION);
-        if (au_in_st) {
-            av_free (au_in_st);
-            au_in_st = NULL;
-        }
-        return 1;
-    }
-    // open decoder
-    au_codec = avcodec_find_decoder (ic->streams[0]->codec->codec_id);
-    if (!au_codec) {
-        fprintf (stderr,
-                 _("%s %s: Unsupported codec (id=%d) for input stream\n"),
-                 DEBUGFILE, DEBUGFUNCTION, ic->streams[0]->codec->codec_id);
-        if (au_in_st) {
-            av_free (au_in_st);
-            au_in_st = NULL;
-        }
-        return 1;
-    }
-    if (avcodec_open (ic->streams[0]->codec, au_codec) < 0) {
-        fprintf (stderr,
-                 _("%s %s: Error while opening codec for input stream\n"),
-                 DEBUGFILE, DEBUGFUNCTION);
-        if (au_in_st) {
-            av_free (au_in_st);
-            au_in_st = NULL;
-        }
+        close_audio_sources ();
         return 1;
     }
 #ifdef DEBUG
@@ -505,24 +902,65 @@ add_audio_stream (Job * job)
 #undef DEBUGFUNCTION
 }
 
+/**
+ * \brief writes an encoded audio packet to the output file
+ *
+ * The packet's timestamp is made relative to the start of the current
+ * segment, packets from before the start are dropped. The lock shared with
+ * the video thread is held throughout, so a switch to the next segment
+ * cannot happen in between.
+ *
+ * @param s output format context (output_file)
+ * @param pkt the packet to write with its pts in the stream's time base
+ */
+static void
+write_audio_packet (AVFormatContext * s, AVPacket * pkt)
+{
+#define DEBUGFUNCTION "write_audio_packet()"
+    int64_t start = xvc_stats_clock ();
+
+    pthread_mutex_lock (&mp);
+    if (pkt->pts != AV_NOPTS_VALUE) {
+        // audio still lagging behind when the segment was switched belongs
+        // to the file closed already, moving the offset instead would put
+        // the rest of the segment's audio out of sync
+        if (pkt->pts < seg_audio_offset) {
+            pthread_mutex_unlock (&mp);
+            xvc_trace_end ("audio mux", start);
+            return;
+        }
+        pkt->pts -= seg_audio_offset;
+    }
+    xvc_stats_add_bytes (pkt->size);
+    if (replay) {
+        replay_append (s->streams[pkt->stream_index], pkt, FALSE);
+    } else if (av_interleaved_write_frame (s, pkt) != 0) {
+        fprintf (stderr, _("%s %s: Error while writing audio frame\n"),
+                 DEBUGFILE, DEBUGFUNCTION);
+    }
+    pthread_mutex_unlock (&mp);
+    xvc_trace_end ("audio mux", start);
+#undef DEBUGFUNCTION
+}
+
 /**
  * \brief encode and write audio samples
  *
  * @param s output format context (output_file)
  * @param ost pointer to audio output stream
- * @param ist input stream information
- * @param buf the actual data sampled
- * @param size the size of the data sampled
+ * @param buf the samples in the output's sample rate and channels
+ * @param size the size of the data in bytes
  */
 static void
-do_audio_out (AVFormatContext * s, AVOutputStream * ost,
-              const AVInputStream * ist, unsigned char *buf, int size)
+do_audio_out (AVFormatContext * s, AVOutputStream * ost, unsigned char *buf,
+              int size)
 {
 #define DEBUGFUNCTION "do_audio_out()"
     uint8_t *buftmp;
     const int audio_out_size = 4 * MAX_AUDIO_PACKET_SIZE;
     int size_out, frame_bytes;
     AVCodecContext *enc;
+    int64_t start = xvc_stats_clock ();
 
     // SC: dynamic allocation of buffers
     if (!audio_buf)
@@ -534,17 +972,8 @@ do_audio_out (AVFormatContext * s, AVOutputStream * ost,
 
     enc = ost->st->codec;
 
-    // resampling is only used for pipe input here
-    if (ost->audio_resample) {
-        buftmp = audio_buf;
-        size_out =
-            audio_resample (ost->resample, (short *) buftmp, (short *) buf,
-                            size / (ist->st->codec->channels * 2));
-        size_out = size_out * enc->channels * 2;
-    } else {
-        buftmp = buf;
-        size_out = size;
-    }
+    buftmp = buf;
+    size_out = size;
 
     // now encode as many frames as possible
     if (enc->frame_size > 1) {
@@ -571,23 +1000,9 @@ do_audio_out (AVFormatContext * s, AVOutputStream * ost,
             pkt.stream_index = ost->st->index;
 
             pkt.data = audio_out;
-            if (pthread_mutex_trylock (&mp) == 0) {
-                // write the compressed frame in the media file
-                if (av_interleaved_write_frame (s, &pkt) != 0) {
-                    fprintf (stderr,
-                             _("%s %s: Error while writing audio frame\n"),
-                             DEBUGFILE, DEBUGFUNCTION);
-                    // exit (1);
-                    return;
-                }
-
-                if (pthread_mutex_unlock (&mp) > 0) {
-                    fprintf (stderr,
-                             _
-                             ("%s %s: Couldn't unlock mutex lock for writing audio frame\n"),
-                             DEBUGFILE, DEBUGFUNCTION);
-                }
-            }
+            // this runs on the audio encode thread now, so we can afford
+            // to wait for the video thread instead of losing the packet
+            write_audio_packet (s, &pkt);
         }
     } else {
         AVPacket pkt;
@@ -628,20 +1043,21 @@ do_audio_out (AVFormatContext * s, AVOutputStream * ost,
                 av_rescale_q (enc->coded_frame->pts, enc->time_base,
                               ost->st->time_base);
         pkt.flags |= PKT_FLAG_KEY;
-        av_interleaved_write_frame (s, &pkt);
+        write_audio_packet (s, &pkt);
     }
+    xvc_trace_end ("audio encode", start);
 
 #undef DEBUGFUNCTION
 }
 
 /**
- * \brief signal handler for stopping the audio capture thread which
- *      runs till sent a SIGUSR1 signal
+ * \brief flushes what is left in the audio encoder at the end of a capture
+ *      session and frees the audio encoding buffers
  */
 static void
-cleanup_thread_when_stopped ()
+flush_audio_encoder ()
 {
-#define DEBUGFUNCTION "cleanup_thread_when_stopped()"
+#define DEBUGFUNCTION "flush_audio_encoder()"
     int ret;
     AVPacket pkt;
     int fifo_bytes;
@@ -655,7 +1071,6 @@ cleanup_thread_when_stopped ()
 #endif     // DEBUG
 
     av_init_packet (&pkt);
-//    pkt.stream_index= ost->index;
 
     enc = au_out_st->st->codec;
     samples = av_malloc (AVCODEC_MAX_AUDIO_FRAME_SIZE);
@@ -678,10 +1093,21 @@ cleanup_thread_when_stopped ()
         }
         enc->frame_size = fs_tmp;
     }
-    if (ret <= 0) {
+    if (ret <= 0 && bit_buffer) {
         ret = avcodec_encode_audio (enc, bit_buffer, bit_buffer_size, NULL);
     }
-    pkt.flags |= PKT_FLAG_KEY;
+    if (ret > 0) {
+        pkt.size = ret;
+        pkt.data = bit_buffer;
+        pkt.stream_index = au_out_st->st->index;
+        if (enc->coded_frame && enc->coded_frame->pts != AV_NOPTS_VALUE)
+            pkt.pts =
+                av_rescale_q (enc->coded_frame->pts, enc->time_base,
+                              au_out_st->st->time_base);
+        pkt.flags |= PKT_FLAG_KEY;
+
+        write_audio_packet (output_file, &pkt);
+    }
 
     if (samples) {
         av_free (samples);
@@ -699,177 +1125,630 @@ cleanup_thread_when_stopped ()
         av_free (audio_buf);
         audio_buf = NULL;
     }
-    if (au_in_st) {
-        av_free (au_in_st);
-        au_in_st = NULL;
-    }
-
-    av_close_input_file (ic);
-
 #ifdef DEBUG
     printf ("%s %s: Leaving\n", DEBUGFILE, DEBUGFUNCTION);
 #endif     // DEBUG
 
-    audio_thread_running = FALSE;
-    pthread_exit (&ret);
 #undef DEBUGFUNCTION
 }
 
 /**
- * \brief this function implements the thread doing the audio capture and
- *      interleaving the captured audio frames with the video output
+ * \brief prints fill level and overrun counters of the audio rings
  *
- * @param job the current job
+ * @param when a short description of the point in time the status is
+ *      printed at
  */
 static void
-capture_audio_thread (Job * job)
+print_audio_ring_status (const char *when)
+{
+    int i, fill_ms, max_fill_ms, dropped_ms;
+    unsigned long overruns;
+
+    for (i = 0; i < au_num_sources; i++) {
+        XVC_AudioSource *src = &au_sources[i];
+
+        xvc_audio_ring_get_status (src->ring, &fill_ms, &max_fill_ms,
+                                   &overruns, &dropped_ms);
+        printf (_
+                ("audio ring %s (%s): %i/%i ms buffered, max %i ms, %lu overruns (%i ms dropped)\n"),
+                src->device, when, fill_ms,
+                xvc_audio_ring_size_ms (src->ring), max_fill_ms, overruns,
+                dropped_ms);
+        if (i > 0)
+            printf (_
+                    ("audio input %s: drift %.1f ms, %i ms dropped while aligning\n"),
+                    src->device, src->drift / 1000,
+                    (int) (src->pending_dropped * 1000 / target->sndrate));
+    }
+}
+
+/**
+ * \brief hands the audio queue levels and the a/v drift to the statistics
+ */
+static void
+update_audio_stats ()
+{
+    int i, fill_ms, max_fill_ms, dropped_ms, queue_ms = 0;
+    unsigned long overruns, total_overruns = 0;
+
+    for (i = 0; i < au_num_sources; i++) {
+        xvc_audio_ring_get_status (au_sources[i].ring, &fill_ms,
+                                   &max_fill_ms, &overruns, &dropped_ms);
+        queue_ms = FFMAX (queue_ms, fill_ms);
+        total_overruns += overruns;
+    }
+    xvc_stats_set_audio (queue_ms, total_overruns,
+                         (audio_pts - video_pts) * 1000);
+}
+
+/**
+ * \brief this function implements the thread doing the audio capture for
+ *      one audio input
+ *
+ * It does nothing but drain the audio device, decode what it reads to PCM
+ * and append that to the source's audio ring, so a slow encoder cannot
+ * cause device overruns. The thread runs until audio_capture_stop is set
+ * or the input ends, which for a device means an error other than having
+ * nothing to read at the moment.
+ *
+ * @param src the audio source to capture from
+ */
+static void
+capture_audio_thread (XVC_AudioSource * src)
 {
 #define DEBUGFUNCTION "capture_audio_thread()"
     XVC_AppData *app = xvc_appdata_ptr ();
-    unsigned long start, stop, start_s, stop_s;
+    Job *job = xvc_job_ptr ();
+    AVInputStream *au_in_st = src->ist;
     struct timeval thr_curr_time;
-    long sleep;
+    int64_t now, start;
     int ret, len, data_size;
     uint8_t *ptr, *data_buf;
-    static unsigned int samples_size = 0;
-    static short *samples = NULL;
+    unsigned int samples_size = 0;
+    short *samples = NULL;
     AVPacket pkt;
 
-    audio_thread_running = TRUE;
-    signal (SIGUSR1, cleanup_thread_when_stopped);
+    if (xvc_trace_active) {
+        char name[64];
 
-    while (TRUE) {
-        // get start time
-        gettimeofday (&thr_curr_time, NULL);
-        start_s = thr_curr_time.tv_sec;
-        start = thr_curr_time.tv_usec;
+        snprintf (name, sizeof (name), "audio capture %s", src->device);
+        xvc_trace_thread_name (name);
+    }
 
+    while (!audio_capture_stop) {
         if ((job->state & VC_PAUSE) && !(job->state & VC_STEP)) {
             pthread_mutex_lock (&(app->recording_paused_mutex));
-            pthread_cond_wait (&(app->recording_condition_unpaused),
-                               &(app->recording_paused_mutex));
+            if (!audio_capture_stop)
+                pthread_cond_wait (&(app->recording_condition_unpaused),
+                                   &(app->recording_paused_mutex));
             pthread_mutex_unlock (&(app->recording_paused_mutex));
         } else if (job->state == VC_REC) {
-
-            audio_pts = (double)
-                au_out_st->st->pts.val *
-                au_out_st->st->time_base.num / au_out_st->st->time_base.den;
-            video_pts =
-                (double) out_st->pts.val * out_st->time_base.num /
-                out_st->time_base.den;
-
-            // sometimes we need to pause writing audio packets for a/v
-            // sync (when audio_pts >= video_pts)
-            // now, if we're reading from a file/pipe, we stop sampling or
-            // else the audio track in the video would become choppy (packets
-            // missing where they were read but not written)
-            // for real-time sampling we can't do that because otherwise
-            // the input packets queue up and will eventually be sampled
-            // (only later) and lead to out-of-sync audio (video faster)
-            if (audio_pts < video_pts) {
-                // read a packet from it and output it in the fifo
-                if (av_read_frame (ic, &pkt) < 0) {
+            // read a packet from it and output it in the ring
+            start = xvc_stats_clock ();
+            ret = av_read_frame (src->ic, &pkt);
+            // a device may have nothing to read for a moment, everything
+            // else is the end of the input
+            if (ret == AVERROR (EAGAIN) && !src->block) {
+                usleep (10000);
+                continue;
+            }
+            if (ret < 0) {
+                if (!audio_capture_stop)
                     fprintf (stderr,
-                             _("%s %s: error reading audio packet\n"),
-                             DEBUGFILE, DEBUGFUNCTION);
-                }
-                len = pkt.size;
-                ptr = pkt.data;
-                while (len > 0) {
-                    // decode the packet if needed
-                    data_buf = NULL;   /* fail safe */
-                    data_size = 0;
-
-                    if (au_in_st->decoding_needed) {
-                        samples = av_fast_realloc (samples, &samples_size,
-                                                   FFMAX (pkt.size,
-                                                          AVCODEC_MAX_AUDIO_FRAME_SIZE));
-                        data_size = samples_size;
-                        /* XXX: could avoid copy if PCM 16 bits with same
-                         * endianness as CPU */
-                        ret =
-                            avcodec_decode_audio2 (au_in_st->st->codec, samples,
-                                                   &data_size, ptr, len);
-                        if (ret < 0) {
-                            fprintf (stderr,
-                                     _
-                                     ("%s %s: couldn't decode captured audio packet\n"),
-                                     DEBUGFILE, DEBUGFUNCTION);
-                            break;
-                        }
-                        ptr += ret;
-                        len -= ret;
-                        /* Some bug in mpeg audio decoder gives */
-                        /* data_size < 0, it seems they are overflows */
-                        if (data_size <= 0) {
-                            /* no audio frame */
+                             _("%s %s: no more audio from %s\n"),
+                             DEBUGFILE, DEBUGFUNCTION, src->device);
+                break;
+            }
+            gettimeofday (&thr_curr_time, NULL);
+            now = (int64_t) thr_curr_time.tv_sec * 1000000 +
+                thr_curr_time.tv_usec;
+            xvc_trace_end ("audio read", start);
+            start = xvc_stats_clock ();
+
+            len = pkt.size;
+            ptr = pkt.data;
+            while (len > 0) {
+                // decode the packet if needed
+                data_buf = NULL;       /* fail safe */
+                data_size = 0;
+
+                if (au_in_st->decoding_needed) {
+                    samples = av_fast_realloc (samples, &samples_size,
+                                               FFMAX (pkt.size,
+                                                      AVCODEC_MAX_AUDIO_FRAME_SIZE));
+                    data_size = samples_size;
+                    /* XXX: could avoid copy if PCM 16 bits with same
+                     * endianness as CPU */
+                    ret =
+                        avcodec_decode_audio2 (au_in_st->st->codec, samples,
+                                               &data_size, ptr, len);
+                    if (ret < 0) {
+                        fprintf (stderr,
+                                 _
+                                 ("%s %s: couldn't decode captured audio packet\n"),
+                                 DEBUGFILE, DEBUGFUNCTION);
+                        break;
+                    }
+                    ptr += ret;
+                    len -= ret;
+                    /* Some bug in mpeg audio decoder gives */
+                    /* data_size < 0, it seems they are overflows */
+                    if (data_size <= 0) {
+                        /* no audio frame */
 #ifdef DEBUG
-                            fprintf (stderr, _("%s %s: no audio frame\n"),
-                                     DEBUGFILE, DEBUGFUNCTION);
+                        fprintf (stderr, _("%s %s: no audio frame\n"),
+                                 DEBUGFILE, DEBUGFUNCTION);
 #endif     // DEBUG
-                            continue;
-                        }
-                        data_buf = (uint8_t *) samples;
-                        au_in_st->next_pts +=
-                            ((int64_t) AV_TIME_BASE / 2 * data_size) /
-                            (au_in_st->st->codec->sample_rate *
-                             au_in_st->st->codec->channels);
-                    } else {
-                        // FIXME: dunno about the following
-                        au_in_st->next_pts +=
-                            ((int64_t) AV_TIME_BASE *
-                             au_in_st->st->codec->frame_size) /
-                            (au_in_st->st->codec->sample_rate *
-                             au_in_st->st->codec->channels);
-                        data_buf = ptr;
-                        data_size = len;
-                        ret = len;
-                        len = 0;
+                        continue;
                     }
-
-                    do_audio_out (output_file, au_out_st, au_in_st,
-                                  data_buf, data_size);
+                    data_buf = (uint8_t *) samples;
+                    au_in_st->next_pts +=
+                        ((int64_t) AV_TIME_BASE / 2 * data_size) /
+                        (au_in_st->st->codec->sample_rate *
+                         au_in_st->st->codec->channels);
+                } else {
+                    // FIXME: dunno about the following
+                    au_in_st->next_pts +=
+                        ((int64_t) AV_TIME_BASE *
+                         au_in_st->st->codec->frame_size) /
+                        (au_in_st->st->codec->sample_rate *
+                         au_in_st->st->codec->channels);
+                    data_buf = ptr;
+                    data_size = len;
+                    ret = len;
+                    len = 0;
                 }
-                // discard packet
-                av_free_packet (&pkt);
-            }                          // end outside if pts ...
-            else {
-                if (strcmp (job->snd_device, "pipe:") < 0)
-                    if (av_read_frame (ic, &pkt) < 0) {
-                        fprintf (stderr, _("error reading audio packet\n"));
-                    }
-#ifdef DEBUG
-                printf (_("%s %s: dropping audio frame %f %f\n"),
+
+                // the samples just read end about now
+                xvc_audio_ring_write (src->ring, data_buf, data_size,
+                                      now - ((int64_t) data_size * 1000000) /
+                                      (au_in_st->st->codec->sample_rate *
+                                       au_in_st->st->codec->channels * 2),
+                                      src->block);
+            }
+            // discard packet
+            av_free_packet (&pkt);
+            xvc_trace_end ("audio decode", start);
+        } else {
+            usleep (10000);
+        }
+    }
+
+    if (samples)
+        av_free (samples);
+    // the encode thread takes a closed ring for the end of the source
+    xvc_audio_ring_close (src->ring);
+    src->running = FALSE;
+
+#ifdef DEBUG
+    printf ("%s %s: Leaving\n", DEBUGFILE, DEBUGFUNCTION);
+#endif     // DEBUG
+
+    pthread_exit (NULL);
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief this function implements the thread generating the samples of a
+ *      tone audio input
+ *
+ * It writes a sine wave to the source's audio ring in blocks, paced by the
+ * system clock like a sound card would be. The thread runs until
+ * audio_capture_stop is set.
+ *
+ * @param src the audio source to generate samples for
+ */
+static void
+tone_audio_thread (XVC_AudioSource * src)
+{
+#define DEBUGFUNCTION "tone_audio_thread()"
+    XVC_AppData *app = xvc_appdata_ptr ();
+    Job *job = xvc_job_ptr ();
+    struct timeval thr_curr_time;
+    int frames = src->rate * AUDIO_TONE_BLOCK_MS / 1000;
+    int64_t now, due = 0;
+    double phase = 0, step = 2 * M_PI * src->tone / src->rate;
+    int16_t *samples;
+    int i, c;
+
+    samples = av_malloc (frames * src->channels * sizeof (int16_t));
+    if (!samples) {
+        fprintf (stderr, _("%s %s: Can't allocate audio buffers for %s\n"),
+                 DEBUGFILE, DEBUGFUNCTION, src->device);
+        pthread_exit (NULL);
+    }
+    if (xvc_trace_active) {
+        char name[64];
+
+        snprintf (name, sizeof (name), "audio capture %s", src->device);
+        xvc_trace_thread_name (name);
+    }
+
+    while (!audio_capture_stop) {
+        if ((job->state & VC_PAUSE) && !(job->state & VC_STEP)) {
+            pthread_mutex_lock (&(app->recording_paused_mutex));
+            if (!audio_capture_stop)
+                pthread_cond_wait (&(app->recording_condition_unpaused),
+                                   &(app->recording_paused_mutex));
+            pthread_mutex_unlock (&(app->recording_paused_mutex));
+            due = 0;
+        } else if (job->state == VC_REC) {
+            gettimeofday (&thr_curr_time, NULL);
+            now = (int64_t) thr_curr_time.tv_sec * 1000000 +
+                thr_curr_time.tv_usec;
+            if (due == 0)
+                due = now;
+            if (now < due) {
+                usleep (due - now);
+                continue;
+            }
+
+            for (i = 0; i < frames; i++) {
+                int16_t v = (int16_t) (sin (phase) * 8192);
+
+                for (c = 0; c < src->channels; c++)
+                    samples[i * src->channels + c] = v;
+                phase += step;
+            }
+            phase = fmod (phase, 2 * M_PI);
+
+            xvc_audio_ring_write (src->ring, (uint8_t *) samples,
+                                  frames * src->channels * 2, due, FALSE);
+            due += AUDIO_TONE_BLOCK_MS * 1000;
+        } else {
+            usleep (10000);
+            due = 0;
+        }
+    }
+
+    av_free (samples);
+    pthread_exit (NULL);
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief removes sample frames from the front of a source's pending
+ *      buffer
+ *
+ * @param src the audio source
+ * @param frames number of sample frames to remove
+ */
+static void
+consume_pending (XVC_AudioSource * src, int frames)
+{
+    int channels = target->sndchannels;
+
+    if (frames > src->pending_frames)
+        frames = src->pending_frames;
+    if (frames <= 0)
+        return;
+    src->pending_frames -= frames;
+    if (src->pending_frames > 0)
+        memmove (src->pending, src->pending + frames * channels,
+                 src->pending_frames * channels * sizeof (int16_t));
+    src->pending_pts += ((int64_t) frames * 1000000) / target->sndrate;
+}
+
+/**
+ * \brief converts samples taken from a source's ring to the output format
+ *      and appends them to the source's pending buffer
+ *
+ * @param src the audio source
+ * @param buf samples in the input's format
+ * @param size size of buf in bytes
+ * @param pts capture time of the first sample in buf
+ */
+static void
+feed_audio_source (XVC_AudioSource * src, uint8_t * buf, int size,
+                   int64_t pts)
+{
+    int channels = target->sndchannels;
+    int capacity = target->sndrate * AUDIO_PENDING_MS / 1000;
+    int in_frames = size / (src->channels * 2);
+    int max_out = (src->resampler ?
+                   xvc_resampler_max_output (src->resampler, in_frames) :
+                   in_frames);
+
+    // make room by dropping the oldest samples. This only happens to
+    // secondary sources the master does not keep up with
+    if (src->pending_frames + max_out > capacity) {
+        int drop = src->pending_frames + max_out - capacity;
+
+        src->pending_dropped += FFMIN (drop, src->pending_frames);
+        consume_pending (src, drop);
+    }
+    if (src->pending_frames == 0)
+        src->pending_pts = pts;
+
+    if (src->resampler) {
+        src->pending_frames +=
+            xvc_resampler_process (src->resampler, (int16_t *) buf,
+                                   in_frames,
+                                   src->pending +
+                                   src->pending_frames * channels);
+    } else {
+        memcpy (src->pending + src->pending_frames * channels, buf,
+                in_frames * channels * 2);
+        src->pending_frames += in_frames;
+    }
+}
+
+/**
+ * \brief adds a secondary source's samples for the time span covered by
+ *      the master's samples to the mix
+ *
+ * The sources' capture times are used to line them up: Samples captured
+ * before the span starts are dropped, if the source's samples start later
+ * the beginning of the span is left silent for this source. Smaller
+ * differences are evened out over time by adjusting the source's
+ * resampling ratio, because two sound cards' clocks never run at exactly
+ * the same speed.
+ *
+ * @param src the secondary audio source
+ * @param acc mix accumulator holding frames sample frames
+ * @param frames number of sample frames to mix
+ * @param start capture time of the first sample frame of the span
+ */
+static void
+mix_aligned (XVC_AudioSource * src, float *acc, int frames, int64_t start)
+{
+    int channels = target->sndchannels;
+    int64_t offset;
+    int n;
+
+    if (src->pending_frames == 0)
+        return;
+
+    // if this source's samples are older than the master's, it needs to
+    // be consumed faster, i. e. with a resampling ratio above 1.0
+    src->drift = 0.95 * src->drift + 0.05 * (double) (start - src->pending_pts);
+    xvc_resampler_set_drift (src->resampler,
+                             1.0 + src->drift / 1000000 * AUDIO_DRIFT_GAIN);
+
+    offset = ((src->pending_pts - start) * target->sndrate) / 1000000;
+    if (src->pending_pts < start - AUDIO_ALIGN_TOLERANCE) {
+        // stale samples from before the span, drop them
+        int drop = (int) FFMIN (-offset, src->pending_frames);
+
+        src->pending_dropped += drop;
+        consume_pending (src, drop);
+        offset = 0;
+    } else if (src->pending_pts <= start + AUDIO_ALIGN_TOLERANCE) {
+        offset = 0;
+    }
+    if (offset >= frames)
+        return;
+
+    n = FFMIN (frames - (int) offset, src->pending_frames);
+    xvc_audio_mixer_add (acc + offset * channels, src->pending,
+                         n * channels, src->gain);
+    consume_pending (src, n);
+}
+
+/**
+ * \brief this function implements the thread mixing and encoding the
+ *      captured audio and interleaving the audio frames with the video
+ *      output
+ *
+ * The thread takes the samples from the audio rings filled by the
+ * capture_audio_thread () instances and runs until the master source's
+ * ring is closed and drained. The master source is the first input given,
+ * all other inputs are mixed into the time span covered by its samples.
+ *
+ * @param job the current job
+ */
+static void
+encode_audio_thread (Job * job)
+{
+#define DEBUGFUNCTION "encode_audio_thread()"
+    XVC_AudioSource *master = &au_sources[0];
+    struct timeval thr_curr_time;
+    time_t last_status = 0;
+    uint8_t *chunk = NULL;
+    float *acc = NULL;
+    int16_t *mixed = NULL;
+    int chunk_frames, max_channels = 0, capacity, len, i;
+    int channels = target->sndchannels;
+    int64_t pts;
+
+    // hand the encoder about one of its frames worth of samples at a time
+    chunk_frames = FFMAX (au_c->frame_size, 1024);
+    for (i = 0; i < au_num_sources; i++)
+        max_channels =
+            FFMAX (max_channels, au_sources[i].channels);
+    capacity = target->sndrate * AUDIO_PENDING_MS / 1000;
+    xvc_trace_thread_name ("audio encode");
+
+    chunk = av_malloc (chunk_frames * 2 * max_channels);
+    acc = av_malloc (capacity * channels * sizeof (float));
+    mixed = av_malloc (capacity * channels * sizeof (int16_t));
+    if (!chunk || !acc || !mixed) {
+        fprintf (stderr, _("%s %s: Can't allocate audio encode buffers\n"),
+                 DEBUGFILE, DEBUGFUNCTION);
+        av_free (chunk);
+        av_free (acc);
+        av_free (mixed);
+        pthread_exit (NULL);
+    }
+
+    while (TRUE) {
+        audio_pts = (double)
+            au_out_st->st->pts.val *
+            au_out_st->st->time_base.num / au_out_st->st->time_base.den;
+        video_pts =
+            (double) out_st->pts.val * out_st->time_base.num /
+            out_st->time_base.den;
+
+        // sometimes we need to pause writing audio packets for a/v
+        // sync (when audio_pts >= video_pts)
+        // now, if we're reading from a file/pipe, we stop consuming
+        // samples (and the full ring stops the capture thread) or
+        // else the audio track in the video would become choppy (packets
+        // missing where they were read but not written)
+        // for real-time sampling we can't do that because otherwise
+        // the input packets queue up and will eventually be sampled
+        // (only later) and lead to out-of-sync audio (video faster)
+        if (audio_pts >= video_pts && master->block) {
+            if (audio_capture_stop)
+                break;
+            usleep (5000);
+            continue;
+        }
+        // collect what the sources have captured, waiting for the master
+        // only
+        for (i = 0; i < au_num_sources; i++) {
+            XVC_AudioSource *src = &au_sources[i];
+
+            if (src->eof)
+                continue;
+            len = xvc_audio_ring_read (src->ring, chunk,
+                                       chunk_frames * 2 * src->channels, &pts,
+                                       (i == 0 ? 100 : 0));
+            if (len < 0)
+                src->eof = TRUE;
+            else if (len > 0)
+                feed_audio_source (src, chunk, len, pts);
+        }
+        if (master->eof && master->pending_frames == 0)
+            break;
+        update_audio_stats ();
+
+        if (master->pending_frames > 0) {
+            int frames = master->pending_frames;
+            int16_t *out = master->pending;
+
+            if (au_num_sources > 1 || master->gain != 1.0) {
+                xvc_audio_mixer_clear (acc, frames * channels);
+                xvc_audio_mixer_add (acc, master->pending, frames * channels,
+                                     master->gain);
+                for (i = 1; i < au_num_sources; i++)
+                    mix_aligned (&au_sources[i], acc, frames,
+                                 master->pending_pts);
+                xvc_audio_mixer_store (mixed, acc, frames * channels);
+                out = mixed;
+            }
+
+            if (audio_pts < video_pts) {
+                do_audio_out (output_file, au_out_st, (uint8_t *) out,
+                              frames * channels * 2);
+            }
+#ifdef DEBUG
+            else {
+                printf (_("%s %s: dropping audio frame %f %f\n"),
                         DEBUGFILE, DEBUGFUNCTION, audio_pts, video_pts);
+            }
 #endif     // DEBUG
+            consume_pending (master, frames);
+        }
+
+        if (job->flags & FLG_RUN_VERBOSE) {
+            gettimeofday (&thr_curr_time, NULL);
+            if (thr_curr_time.tv_sec - last_status >= AUDIO_STATUS_INTERVAL) {
+                if (last_status != 0)
+                    print_audio_ring_status (_("recording"));
+                last_status = thr_curr_time.tv_sec;
             }
-        }                              // end if VC_REC
-        // get end time
-        gettimeofday (&thr_curr_time, NULL);
-        stop_s = thr_curr_time.tv_sec;
-        stop = thr_curr_time.tv_usec;
-        stop += ((stop_s - start_s) * 1000000);
-        sleep = (1000000 / target->sndrate) - (stop - start);
-        /**
-         * \todo perhaps this whole stuff is irrelevant. Haven't really
-         *      seen a situation where the encoding was faster than the time
-         *      needed for a decent frame-rate. need to look into more
-         *      details about audio/video sync in libavcodec/-format
-         *      the strange thing, however is: If I leave away the getting of
-         *      start/end time and the usleep stuff, normal audio capture
-         *      works, piped audio doesn't *BLINK*
-         */
-        if (sleep < 0)
-            sleep = 0;
-
-        usleep (sleep);
-    }                                  // end while(TRUE) loop
-    ret = 1;
-    audio_thread_running = FALSE;
-    pthread_exit (&ret);
+        }
+    }
+
+    flush_audio_encoder ();
+    if (job->flags & FLG_RUN_VERBOSE)
+        print_audio_ring_status (_("stopped"));
+
+    av_free (chunk);
+    av_free (acc);
+    av_free (mixed);
+
+#ifdef DEBUG
+    printf ("%s %s: Leaving\n", DEBUGFILE, DEBUGFUNCTION);
+#endif     // DEBUG
+
+    pthread_exit (NULL);
 #undef DEBUGFUNCTION
 }
 
+/**
+ * \brief signal handler doing nothing, so the signal only interrupts a
+ *      blocking read of an audio capture thread
+ *
+ * @param signal the signal number, not used
+ */
+static void
+audio_wakeup_handler (int signal)
+{
+}
+
+/**
+ * \brief stops the audio capture threads and the encode thread
+ *
+ * Capturing is stopped first. Closing the rings wakes up capture threads
+ * waiting for room and lets the encode thread drain what is left before
+ * flushing the encoder.
+ */
+static void
+stop_audio_threads ()
+{
+    XVC_AppData *app = xvc_appdata_ptr ();
+    int i;
+
+    audio_capture_stop = TRUE;
+    for (i = 0; i < au_num_sources; i++) {
+        if (au_sources[i].ring)
+            xvc_audio_ring_close (au_sources[i].ring);
+    }
+    pthread_mutex_lock (&(app->recording_paused_mutex));
+    pthread_cond_broadcast (&(app->recording_condition_unpaused));
+    pthread_mutex_unlock (&(app->recording_paused_mutex));
+
+    for (i = 0; i < au_num_sources; i++) {
+        if (au_sources[i].tid != 0) {
+            // a pipe input may be stuck in a read for as long as nothing is
+            // written to it, the signal makes the read return with EINTR
+            while (au_sources[i].block && au_sources[i].running) {
+                pthread_kill (au_sources[i].tid, SIGUSR2);
+                usleep (10000);
+            }
+            pthread_join (au_sources[i].tid, NULL);
+            au_sources[i].tid = 0;
+        }
+    }
+    if (enc_tid != 0) {
+        pthread_join (enc_tid, NULL);
+        enc_tid = 0;
+    }
+}
+
+/**
+ * \brief gives the audio encode thread a moment to write the audio up to
+ *      the current video position before switching to the next segment
+ *
+ * Otherwise the audio captured right before the switch would be dropped by
+ * write_audio_packet (). We don't wait longer than
+ * SEGMENT_AUDIO_WAIT_MS, though, because this holds up the video capture.
+ */
+static void
+wait_for_segment_audio ()
+{
+    double a_pts, v_pts;
+    int waited;
+
+    for (waited = 0; waited < SEGMENT_AUDIO_WAIT_MS; waited++) {
+        if (audio_capture_stop || enc_tid == 0)
+            break;
+        pthread_mutex_lock (&mp);
+        a_pts = (double)
+            au_out_st->st->pts.val *
+            au_out_st->st->time_base.num / au_out_st->st->time_base.den;
+        v_pts =
+            (double) out_st->pts.val * out_st->time_base.num /
+            out_st->time_base.den;
+        pthread_mutex_unlock (&mp);
+        if (a_pts >= v_pts)
+            break;
+        usleep (1000);
+    }
+}
+
 #endif     // HAVE_FFMPEG_AUDIO
 
 /**
@@ -902,7 +1781,7 @@ do_video_out (AVFormatContext * s, AVStream * ost, unsigned char *buf, int size)
         if (enc->coded_frame->pts != AV_NOPTS_VALUE) {
             pkt.pts =
                 av_rescale_q (enc->coded_frame->pts, enc->time_base,
-                              ost->time_base);
+                              ost->time_base) - seg_video_offset;
         }
         if (enc->coded_frame->key_frame)
             pkt.flags |= PKT_FLAG_KEY;
@@ -912,6 +1791,12 @@ do_video_out (AVFormatContext * s, AVStream * ost, unsigned char *buf, int size)
     pkt.data = buf;
     pkt.size = size;
 
+    xvc_stats_add_bytes (size);
+    if (replay) {
+        replay_append (ost, &pkt, (pkt.flags & PKT_FLAG_KEY));
+        return;
+    }
+
     if (av_interleaved_write_frame (s, &pkt) != 0) {
         fprintf (stderr, _("%s %s: Error while writing video frame\n"),
                  DEBUGFILE, DEBUGFUNCTION);
@@ -925,85 +1810,6 @@ do_video_out (AVFormatContext * s, AVStream * ost, unsigned char *buf, int size)
 #undef DEBUGFUNCTION
 }
 
-/**
- * \brief convert bgra32 to rgba32
- *
- * needed on Solaris/SPARC because the ffmpeg version used doesn't know
- * PIX_FMT_ABGR32, i.e. byte ordering is not taken care of
- * @param image the XImage to convert
- */
-static void
-myABGR32toARGB32 (XImage * image)
-{
-#define DEBUGFUNCTION "myABGR32toARGB32()"
-    char *pdata, *counter;
-
-#ifdef DEBUG
-    printf ("%s %s: Entering with image %p\n", DEBUGFILE, DEBUGFUNCTION, image);
-#endif     // DEBUG
-
-    pdata = image->data;
-
-    for (counter = pdata;
-         counter < (pdata + (image->width * image->height * 4)); counter += 4) {
-        char swap;
-
-        if (image->byte_order) {       // MSBFirst has order argb -> abgr
-            // = rgba32
-            swap = *(counter + 1);
-            *(counter + 1) = *(counter + 3);
-            *(counter + 3) = swap;
-        } else {                       // LSBFirst has order bgra -> rgba
-            swap = *counter;
-            *counter = *(counter + 2);
-            *(counter + 2) = swap;
-        }
-    }
-
-#ifdef DEBUG
-    printf ("%s %s: Leaving\n", DEBUGFILE, DEBUGFUNCTION);
-#endif     // DEBUG
-
-#undef DEBUGFUNCTION
-}
-
-/**
- * \brief convert pal8 to rgba32
- *
- * libswscale does not support pal8 input atm
- * @param image the XImage to convert
- * @param p_inpic pointer to a frame to where the converted output is written
- * @param job the current job
- * \todo very current ffmpeg versions seem to make this unneccessary
- */
-static void
-myPAL8toRGB24 (XImage * image, AVFrame * p_inpic, Job * job)
-{
-#define DEBUGFUNCTION "myABGR32toRGB24()"
-
-    u_int32_t *color_table = job->color_table;
-    int y = 0, x = 0;
-    uint8_t *out_cursor = NULL;
-    uint8_t *out = (uint8_t *) p_inpic->data[0];
-
-    /**
-     * 8bit pseudo-color images may have lines padded by excess bytes
-     * these need to be removed before conversion
-     * \todo other formats might also have this problem
-     */
-    for (y = 0; y < image->height; y++) {
-        out_cursor = (uint8_t *) image->data + (y * image->bytes_per_line);
-        for (x = 0; x < image->width; x++) {
-            *out++ = ((color_table[*out_cursor] & 0x00FF0000) >> 16);
-            *out++ = ((color_table[*out_cursor] & 0x0000FF00) >> 8);
-            *out++ = (color_table[*out_cursor] & 0x000000FF);
-            out_cursor++;
-        }
-    }
-
-#undef DEBUGFUNCTION
-}
-
 /**
  * \brief prepare the color table for pseudo color input to libavcodec's
  *      imgconvert
@@ -1099,6 +1905,11 @@ prepareOutputFile (char *jFileName, AVFormatContext * oc, int number)
         snprintf (oc->filename, sizeof (oc->filename), "pipe:");
         // register_protocol (&pipe_protocol);
     } else {
+        XVC_AppData *app = xvc_appdata_ptr ();
+        const char *protocol = (app->flags & FLG_ASYNC_WRITE ?
+                                XVC_AIO_PROTOCOL :
+                                (app->write_behind > 0 ?
+                                 XVC_WB_PROTOCOL : "file"));
         char first;
         char tmp_buf[PATH_MAX + 1];
 
@@ -1109,9 +1920,10 @@ prepareOutputFile (char *jFileName, AVFormatContext * oc, int number)
         // and we want one for the file URL. If we don't have one, we
         // construct one
         if (first != '/') {
-            sprintf (oc->filename, "file://%s/%s", getenv ("PWD"), tmp_buf);
+            sprintf (oc->filename, "%s://%s/%s", protocol, getenv ("PWD"),
+                     tmp_buf);
         } else {
-            sprintf (oc->filename, "file://%s", tmp_buf);
+            sprintf (oc->filename, "%s://%s", protocol, tmp_buf);
         }
         // register_protocol (&file_protocol);
     }
@@ -1124,6 +1936,73 @@ prepareOutputFile (char *jFileName, AVFormatContext * oc, int number)
 #undef DEBUGFUNCTION
 }
 
+/**
+ * \brief finishes the current output file and continues in the next one
+ *
+ * This is called with the keyframe starting the new segment just encoded
+ * but not yet written. Codecs, scaler and audio threads are left alone, only
+ * the container is closed and reopened. Timestamps in the new file start
+ * from 0 with that keyframe. The caller must hold the lock shared with the
+ * audio thread if recording sound.
+ *
+ * @param job the current job, job->movie_no is the number of the new file
+ */
+static void
+next_segment (Job * job)
+{
+#define DEBUGFUNCTION "next_segment()"
+    AVCodecContext *enc = out_st->codec;
+
+    // av_write_trailer flushes the packets still queued for interleaving
+    // into the old file and frees the muxer's private data
+    av_write_trailer (output_file);
+    url_fclose (output_file->pb);
+
+    if (output_file->oformat->priv_data_size > 0) {
+        output_file->priv_data =
+            av_mallocz (output_file->oformat->priv_data_size);
+        if (!output_file->priv_data) {
+            fprintf (stderr,
+                     _
+                     ("%s %s: Error allocating private data for format context ... aborting\n"),
+                     DEBUGFILE, DEBUGFUNCTION);
+            exit (1);
+        }
+    }
+
+    prepareOutputFile (job->file, output_file, job->movie_no);
+    if (url_fopen (&output_file->pb, output_file->filename, URL_WRONLY) < 0) {
+        fprintf (stderr, _("%s %s: Could not open '%s' ... aborting\n"),
+                 DEBUGFILE, DEBUGFUNCTION, output_file->filename);
+        exit (1);
+    }
+    if (av_write_header (output_file) < 0) {
+        fprintf (stderr,
+                 _
+                 ("%s %s: Could not write header for output file (incorrect codec paramters ?) ... aborting\n"),
+                 DEBUGFILE, DEBUGFUNCTION);
+        exit (1);
+    }
+
+    if (enc->coded_frame && enc->coded_frame->pts != AV_NOPTS_VALUE) {
+        seg_video_offset =
+            av_rescale_q (enc->coded_frame->pts, enc->time_base,
+                          out_st->time_base);
+#ifdef HAVE_FFMPEG_AUDIO
+        if (au_out_st)
+            seg_audio_offset =
+                av_rescale_q (seg_video_offset, out_st->time_base,
+                              au_out_st->st->time_base);
+#endif     // HAVE_FFMPEG_AUDIO
+    }
+    segment_pending = FALSE;
+
+    if (job->flags & FLG_RUN_VERBOSE)
+        printf (_("%s %s: continuing in %s\n"), DEBUGFILE, DEBUGFUNCTION,
+                output_file->filename);
+#undef DEBUGFUNCTION
+}
+
 /**
  * \brief add a video output stream to the output format
  *
@@ -1203,8 +2082,7 @@ add_video_stream (AVFormatContext * oc, const XImage * image,
     // should be identically 1.
     st->codec->time_base.den = target->fps.num;
     st->codec->time_base.num = target->fps.den;
-    // emit one intra frame every fifty frames at most
-    st->codec->gop_size = 50;
+    st->codec->gop_size = XVC_GOP_SIZE;
     st->codec->mb_decision = 2;
     st->codec->me_method = 1;
 
@@ -1273,99 +2151,524 @@ add_video_stream (AVFormatContext * oc, const XImage * image,
 }
 
 /**
- * \brief guess the picture format of the captured image
+ * \brief guess the picture format of the captured image
+ *
+ * @param image captured XImage
+ * @param c_info needed for alpha channel info
+ * @return libavcodec's picture format
+ */
+static int
+guess_input_pix_fmt (const XImage * image, const ColorInfo * c_info)
+{
+#define DEBUGFUNCTION "guess_input_pix_fmt()"
+    int input_pixfmt;
+
+    switch (image->bits_per_pixel) {
+    case 8:
+#ifdef DEBUG
+        printf ("%s %s: 8 bit pallete\n", DEBUGFILE, DEBUGFUNCTION);
+#endif     // DEBUG
+        input_pixfmt = PIX_FMT_PAL8;
+        break;
+    case 16:
+        if (image->red_mask == 0xF800 && image->green_mask == 0x07E0
+            && image->blue_mask == 0x1F) {
+#ifdef DEBUG
+            printf ("%s %s: 16 bit RGB565\n", DEBUGFILE, DEBUGFUNCTION);
+#endif     // DEBUG
+            input_pixfmt = PIX_FMT_BGR565;
+        } else if (image->red_mask == 0x7C00
+                   && image->green_mask == 0x03E0 && image->blue_mask == 0x1F) {
+#ifdef DEBUG
+            printf ("%s %s: 16 bit RGB555\n", DEBUGFILE, DEBUGFUNCTION);
+#endif     // DEBUG
+            input_pixfmt = PIX_FMT_BGR555;
+
+        } else {
+            fprintf (stderr,
+                     _
+                     ("%s %s: rgb ordering at image depth %i not supported ... aborting\n"),
+                     DEBUGFILE, DEBUGFUNCTION, image->bits_per_pixel);
+            fprintf (stderr,
+                     "%s %s: color masks: r 0x%.6lX g 0x%.6lX b 0x%.6lX\n",
+                     DEBUGFILE, DEBUGFUNCTION, image->red_mask,
+                     image->green_mask, image->blue_mask);
+            exit (1);
+        }
+        break;
+    case 24:
+        if (image->red_mask == 0xFF0000 && image->green_mask == 0xFF00
+            && image->blue_mask == 0xFF) {
+            input_pixfmt = PIX_FMT_BGR24;
+        } else if (image->red_mask == 0xFF
+                   && image->green_mask == 0xFF00
+                   && image->blue_mask == 0xFF0000) {
+            input_pixfmt = PIX_FMT_RGB24;
+        } else {
+            fprintf (stderr,
+                     _
+                     ("%s %s: rgb ordering at image depth %i not supported ... aborting\n"),
+                     DEBUGFILE, DEBUGFUNCTION, image->bits_per_pixel);
+            fprintf (stderr,
+                     "%s %s: color masks: r 0x%.6lX g 0x%.6lX b 0x%.6lX\n",
+                     DEBUGFILE, DEBUGFUNCTION, image->red_mask,
+                     image->green_mask, image->blue_mask);
+            exit (1);
+        }
+        break;
+    case 32:
+        if ((c_info->alpha_mask == 0xFF000000 || c_info->alpha_mask == 0) && 
+                (image->red_mask == 0xFF0000 || image->red_mask == 0xFF) &&
+                image->green_mask == 0xFF00) {
+            // byte order is relevant here, not endianness endianness is
+            // handled by avcodec, but atm no such thing as having ABGR,
+            // instead of ARGB in a word. Since we need this for
+            // Solaris/SPARC, but need to do the conversion
+            // for every frame we do it outside of this loop, cf.
+            // below this matches both ARGB32 and ABGR32
+            input_pixfmt = PIX_FMT_ARGB32;
+        } else {
+            fprintf (stderr,
+                     _
+                     ("%s %s: image depth %i not supported ... aborting\n"),
+                     DEBUGFILE, DEBUGFUNCTION, image->bits_per_pixel);
+            exit (1);
+        }
+        break;
+    default:
+        fprintf (stderr,
+                 _("%s %s: image depth %i not supported ... aborting\n"),
+                 DEBUGFILE, DEBUGFUNCTION, image->bits_per_pixel);
+        exit (1);
+    }
+
+    return input_pixfmt;
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief encodes one single frame and writes it to its own file
+ *
+ * This does what xvc_ffmpeg_save_frame () does for single frames, but with
+ * the encoder of a worker.
+ *
+ * @param w the worker encoding the frame
+ * @param image the captured frame
+ * @param pic_no the number of the frame for the file name
+ */
+static void
+sf_encode_frame (XVC_SFWorker * w, XImage * image, int pic_no)
+{
+#define DEBUGFUNCTION "sf_encode_frame()"
+    Job *job = xvc_job_ptr ();
+    int out_size;
+    int64_t stage_start;
+
+    stage_start = xvc_stats_clock ();
+    if (input_pixfmt == PIX_FMT_ARGB32 &&
+        (job->c_info->alpha_mask == 0xFF000000 || job->c_info->alpha_mask == 0)
+        && image->red_mask == 0xFF && image->green_mask == 0xFF00
+        && image->blue_mask == 0xFF0000) {
+        xvc_pixels_abgr32_to_argb32 (image);
+    }
+    if (input_pixfmt == PIX_FMT_PAL8) {
+        xvc_pixels_pal8_to_rgb24 (image, (u_int32_t *) job->color_table,
+                                  w->inpic->data[0]);
+    } else {
+        avpicture_fill ((AVPicture *) w->inpic, (uint8_t *) image->data,
+                        input_pixfmt, image->width, image->height);
+    }
+    if (sws_scale (w->sws, w->inpic->data, w->inpic->linesize, 0,
+                   image->height, w->outpic->data, w->outpic->linesize) < 0) {
+        fprintf (stderr,
+                 _("%s %s: error converting or resampling frame %i\n"),
+                 DEBUGFILE, DEBUGFUNCTION, pic_no);
+        exit (1);
+    }
+    xvc_stats_add_stage (XVC_STAGE_CONVERT, stage_start);
+
+    stage_start = xvc_stats_clock ();
+    out_size = avcodec_encode_video (w->st->codec, w->outbuf, outbuf_size,
+                                     w->outpic);
+    xvc_stats_add_stage (XVC_STAGE_ENCODE, stage_start);
+    if (out_size < 0) {
+        fprintf (stderr, _("%s %s: error encoding frame %i\n"),
+                 DEBUGFILE, DEBUGFUNCTION, pic_no);
+        exit (1);
+    }
+
+    stage_start = xvc_stats_clock ();
+    prepareOutputFile (job->file, w->oc, pic_no);
+    if (url_fopen (&w->oc->pb, w->oc->filename, URL_WRONLY) < 0) {
+        fprintf (stderr, _("%s %s: Could not open '%s' ... aborting\n"),
+                 DEBUGFILE, DEBUGFUNCTION, w->oc->filename);
+        exit (1);
+    }
+    if (av_write_header (w->oc) < 0) {
+        fprintf (stderr,
+                 _
+                 ("%s %s: Could not write header for output file (incorrect codec paramters ?) ... aborting\n"),
+                 DEBUGFILE, DEBUGFUNCTION);
+        exit (1);
+    }
+    if (out_size > 0)
+        do_video_out (w->oc, w->st, w->outbuf, out_size);
+    url_fclose (w->oc->pb);
+    xvc_stats_add_stage (XVC_STAGE_MUX, stage_start);
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief encodes the frames queued until sf_stop is set and the queue is
+ *      empty
+ *
+ * @param w the worker running in this thread
+ */
+static void
+sf_worker_thread (XVC_SFWorker * w)
+{
+    XImage image = sf_image;
+    XVC_SFFrame frame;
+
+    xvc_trace_thread_name ("frame encode");
+    while (TRUE) {
+        pthread_mutex_lock (&sf_mutex);
+        while (sf_count == 0 && !sf_stop)
+            pthread_cond_wait (&sf_queued, &sf_mutex);
+        if (sf_count == 0) {
+            pthread_mutex_unlock (&sf_mutex);
+            break;
+        }
+        frame = sf_queue[sf_head];
+        sf_head = (sf_head + 1) % sf_queue_size;
+        sf_count--;
+        pthread_mutex_unlock (&sf_mutex);
+
+        image.data = frame.data;
+        sf_encode_frame (w, &image, frame.pic_no);
+
+        pthread_mutex_lock (&sf_mutex);
+        sf_free[sf_num_free++] = frame.data;
+        pthread_cond_signal (&sf_freed);
+        pthread_mutex_unlock (&sf_mutex);
+    }
+}
+
+/**
+ * \brief frees what a worker allocated in sf_init_worker ()
+ *
+ * @param w the worker, its thread must have ended
+ */
+static void
+sf_free_worker (XVC_SFWorker * w)
+{
+    if (w->oc) {
+        if (w->st) {
+            avcodec_close (w->st->codec);
+            av_free (w->st->codec);
+            av_free (w->st);
+        }
+        av_free (w->oc->priv_data);
+        av_free (w->oc);
+    }
+    if (w->sws)
+        sws_freeContext (w->sws);
+    av_free (w->inpic);
+    av_free (w->outpic);
+    av_free (w->outpic_buf);
+    free (w->outbuf);
+    free (w->scratch);
+    memset (w, 0, sizeof (XVC_SFWorker));
+}
+
+/**
+ * \brief sets up a worker's encoder like xvc_ffmpeg_save_frame () sets up
+ *      its own
+ *
+ * @param w the worker
+ * @param image the captured image
+ * @param job the current job
+ * @return 0 on success, -1 if the encoder could not be opened
+ */
+static int
+sf_init_worker (XVC_SFWorker * w, const XImage * image, Job * job)
+{
+    int pix_fmt = (input_pixfmt == PIX_FMT_PAL8 ? PIX_FMT_RGB24 :
+                   input_pixfmt);
+
+    memset (w, 0, sizeof (XVC_SFWorker));
+    w->oc = av_alloc_format_context ();
+    if (!w->oc)
+        return -1;
+    w->oc->oformat = file_oformat;
+    if (file_oformat->priv_data_size > 0) {
+        w->oc->priv_data = av_mallocz (file_oformat->priv_data_size);
+        if (!w->oc->priv_data)
+            return -1;
+    }
+    w->st = add_video_stream (w->oc, image, pix_fmt,
+                              xvc_codecs[job->targetCodec].ffmpeg_id, job);
+    if (av_set_parameters (w->oc, NULL) < 0 ||
+        avcodec_open (w->st->codec, codec) < 0) {
+        // not opened, so don't close it
+        av_free (w->st->codec);
+        av_free (w->st);
+        w->st = NULL;
+        return -1;
+    }
+
+    w->inpic = avcodec_alloc_frame ();
+    w->outpic = avcodec_alloc_frame ();
+    w->outpic_buf = av_malloc (image_size);
+    w->outbuf = malloc (outbuf_size);
+    if (!w->inpic || !w->outpic || !w->outpic_buf || !w->outbuf)
+        return -1;
+    if (input_pixfmt == PIX_FMT_PAL8) {
+        w->scratch = malloc (avpicture_get_size (PIX_FMT_RGB24, image->width,
+                                                 image->height));
+        if (!w->scratch)
+            return -1;
+        avpicture_fill ((AVPicture *) w->inpic, w->scratch, PIX_FMT_RGB24,
+                        image->width, image->height);
+    }
+    avpicture_fill ((AVPicture *) w->outpic, w->outpic_buf,
+                    w->st->codec->pix_fmt, w->st->codec->width,
+                    w->st->codec->height);
+    w->sws = sws_getContext (image->width, image->height, pix_fmt,
+                             w->st->codec->width, w->st->codec->height,
+                             w->st->codec->pix_fmt, SWS_FAST_BILINEAR, NULL,
+                             NULL, NULL);
+    return (w->sws ? 0 : -1);
+}
+
+/**
+ * \brief finishes the frames queued, ends the workers and frees all they
+ *      used
+ */
+static void
+sf_stop_workers ()
+{
+    int i;
+
+    pthread_mutex_lock (&sf_mutex);
+    sf_stop = TRUE;
+    pthread_cond_broadcast (&sf_queued);
+    pthread_mutex_unlock (&sf_mutex);
+
+    for (i = 0; i < sf_num_workers; i++) {
+        if (sf_workers[i].tid != 0)
+            pthread_join (sf_workers[i].tid, NULL);
+        sf_free_worker (&sf_workers[i]);
+    }
+    sf_num_workers = 0;
+
+    for (i = 0; i < sf_num_free; i++)
+        free (sf_free[i]);
+    free (sf_free);
+    sf_free = NULL;
+    free (sf_queue);
+    sf_queue = NULL;
+    sf_num_free = sf_queue_size = sf_head = sf_count = 0;
+    sf_stop = FALSE;
+}
+
+/**
+ * \brief starts one worker per processor for encoding single frames in
+ *      parallel
+ *
+ * Every single frame is independent, so with more than one processor they
+ * are encoded and written by a pool of threads with an encoder each rather
+ * than in the capture thread. If anything goes wrong, the frames are
+ * encoded in the capture thread as before.
+ *
+ * @param image the first captured image, all others have the same layout
+ * @param job the current job
+ */
+static void
+sf_start_workers (const XImage * image, Job * job)
+{
+#define DEBUGFUNCTION "sf_start_workers()"
+    long cpus = sysconf (_SC_NPROCESSORS_ONLN);
+    int i, num = XVC_MIN (cpus, SF_MAX_WORKERS);
+    int size = image->bytes_per_line * image->height;
+
+    if (num < 2)
+        return;
+
+    sf_image = *image;
+    sf_image.data = NULL;
+    sf_queue_size = num * SF_FRAMES_PER_WORKER;
+    sf_queue = malloc (sf_queue_size * sizeof (XVC_SFFrame));
+    sf_free = malloc (sf_queue_size * sizeof (char *));
+    if (!sf_queue || !sf_free)
+        goto FAILED;
+    for (sf_num_free = 0; sf_num_free < sf_queue_size; sf_num_free++) {
+        sf_free[sf_num_free] = malloc (size);
+        if (!sf_free[sf_num_free])
+            goto FAILED;
+    }
+
+    // the encoders are opened here because avcodec_open () is not thread
+    // safe
+    for (sf_num_workers = 0; sf_num_workers < num; sf_num_workers++) {
+        if (sf_init_worker (&sf_workers[sf_num_workers], image, job) < 0) {
+            sf_free_worker (&sf_workers[sf_num_workers]);
+            goto FAILED;
+        }
+    }
+    for (i = 0; i < num; i++) {
+        if (pthread_create (&sf_workers[i].tid, NULL,
+                            (void *) sf_worker_thread, &sf_workers[i]) != 0) {
+            sf_workers[i].tid = 0;
+            goto FAILED;
+        }
+    }
+
+    if (job->flags & FLG_RUN_VERBOSE)
+        printf (_("%s %s: encoding single frames with %i threads\n"),
+                DEBUGFILE, DEBUGFUNCTION, num);
+    return;
+
+  FAILED:
+    fprintf (stderr,
+             _("%s %s: Can't start encoder threads, encoding frames one by one\n"),
+             DEBUGFILE, DEBUGFUNCTION);
+    sf_stop_workers ();
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief hands a copy of a captured frame to the workers, waits for a
+ *      buffer if all are in use
+ *
+ * @param image the captured image
+ * @param pic_no the number of the frame for the file name
+ */
+static void
+sf_queue_frame (const XImage * image, int pic_no)
+{
+    char *data;
+
+    pthread_mutex_lock (&sf_mutex);
+    while (sf_num_free == 0)
+        pthread_cond_wait (&sf_freed, &sf_mutex);
+    data = sf_free[--sf_num_free];
+    pthread_mutex_unlock (&sf_mutex);
+
+    memcpy (data, image->data, image->bytes_per_line * image->height);
+
+    pthread_mutex_lock (&sf_mutex);
+    sf_queue[(sf_head + sf_count) % sf_queue_size].data = data;
+    sf_queue[(sf_head + sf_count) % sf_queue_size].pic_no = pic_no;
+    sf_count++;
+    pthread_cond_signal (&sf_queued);
+    pthread_mutex_unlock (&sf_mutex);
+}
+
+/**
+ * \brief frees what skip_init () allocated
+ */
+static void
+skip_free ()
+{
+    av_free (skip_mb_type);
+    skip_mb_type = NULL;
+    av_free (skip_motion_val);
+    skip_motion_val = NULL;
+    av_free (skip_ref_index);
+    skip_ref_index = NULL;
+    av_free (skip_damaged);
+    skip_damaged = NULL;
+    skip_mbs = 0;
+}
+
+/**
+ * \brief prepares telling the encoder which macroblocks didn't change
  *
- * @param image captured XImage
- * @param c_info needed for alpha channel info
- * @return libavcodec's picture format
+ * libavcodec's MPEG-4 and H.263 encoders take a type and motion vectors
+ * for each macroblock with the frame to encode if me_threshold is set. A
+ * macroblock differing from the frame before by less than the threshold
+ * with the vectors given is encoded with them without a motion search, and
+ * as not coded if nothing of the difference is left after quantization.
+ * All other macroblocks are searched as usual, so the bitstream is one the
+ * encoder could have produced on its own. Every macroblock is given a zero
+ * vector, which holds for all but the damaged ones.
+ *
+ * The macroblocks must cover the same pixels as the damaged areas, so this
+ * is done without rescaling only.
+ *
+ * @param image the captured image
+ * @param c the opened video encoder
  */
-static int
-guess_input_pix_fmt (const XImage * image, const ColorInfo * c_info)
+static void
+skip_init (const XImage * image, AVCodecContext * c)
 {
-#define DEBUGFUNCTION "guess_input_pix_fmt()"
-    int input_pixfmt;
+    XVC_AppData *app = xvc_appdata_ptr ();
+    int Bpp = image->bits_per_pixel >> 3;
+    int mb_width = (c->width + 15) / 16, mb_height = (c->height + 15) / 16;
+    int b8_size = (2 * mb_width + 1) * 2 * mb_height, i, q;
 
-    switch (image->bits_per_pixel) {
-    case 8:
-#ifdef DEBUG
-        printf ("%s %s: 8 bit pallete\n", DEBUGFILE, DEBUGFUNCTION);
-#endif     // DEBUG
-        input_pixfmt = PIX_FMT_PAL8;
-        break;
-    case 16:
-        if (image->red_mask == 0xF800 && image->green_mask == 0x07E0
-            && image->blue_mask == 0x1F) {
-#ifdef DEBUG
-            printf ("%s %s: 16 bit RGB565\n", DEBUGFILE, DEBUGFUNCTION);
-#endif     // DEBUG
-            input_pixfmt = PIX_FMT_BGR565;
-        } else if (image->red_mask == 0x7C00
-                   && image->green_mask == 0x03E0 && image->blue_mask == 0x1F) {
-#ifdef DEBUG
-            printf ("%s %s: 16 bit RGB555\n", DEBUGFILE, DEBUGFUNCTION);
-#endif     // DEBUG
-            input_pixfmt = PIX_FMT_BGR555;
+    if (!(app->flags & FLG_USE_XDAMAGE) || app->rescale != 100 || Bpp < 1 ||
+        (c->codec_id != CODEC_ID_MPEG4 && c->codec_id != CODEC_ID_H263 &&
+         c->codec_id != CODEC_ID_H263P))
+        return;
 
-        } else {
-            fprintf (stderr,
-                     _
-                     ("%s %s: rgb ordering at image depth %i not supported ... aborting\n"),
-                     DEBUGFILE, DEBUGFUNCTION, image->bits_per_pixel);
-            fprintf (stderr,
-                     "%s %s: color masks: r 0x%.6lX g 0x%.6lX b 0x%.6lX\n",
-                     DEBUGFILE, DEBUGFUNCTION, image->red_mask,
-                     image->green_mask, image->blue_mask);
-            exit (1);
-        }
-        break;
-    case 24:
-        if (image->red_mask == 0xFF0000 && image->green_mask == 0xFF00
-            && image->blue_mask == 0xFF) {
-            input_pixfmt = PIX_FMT_BGR24;
-        } else if (image->red_mask == 0xFF
-                   && image->green_mask == 0xFF00
-                   && image->blue_mask == 0xFF0000) {
-            input_pixfmt = PIX_FMT_RGB24;
-        } else {
-            fprintf (stderr,
-                     _
-                     ("%s %s: rgb ordering at image depth %i not supported ... aborting\n"),
-                     DEBUGFILE, DEBUGFUNCTION, image->bits_per_pixel);
-            fprintf (stderr,
-                     "%s %s: color masks: r 0x%.6lX g 0x%.6lX b 0x%.6lX\n",
-                     DEBUGFILE, DEBUGFUNCTION, image->red_mask,
-                     image->green_mask, image->blue_mask);
-            exit (1);
-        }
-        break;
-    case 32:
-        if ((c_info->alpha_mask == 0xFF000000 || c_info->alpha_mask == 0) && 
-                (image->red_mask == 0xFF0000 || image->red_mask == 0xFF) &&
-                image->green_mask == 0xFF00) {
-            // byte order is relevant here, not endianness endianness is
-            // handled by avcodec, but atm no such thing as having ABGR,
-            // instead of ARGB in a word. Since we need this for
-            // Solaris/SPARC, but need to do the conversion
-            // for every frame we do it outside of this loop, cf.
-            // below this matches both ARGB32 and ABGR32
-            input_pixfmt = PIX_FMT_ARGB32;
-        } else {
-            fprintf (stderr,
-                     _
-                     ("%s %s: image depth %i not supported ... aborting\n"),
-                     DEBUGFILE, DEBUGFUNCTION, image->bits_per_pixel);
-            exit (1);
-        }
-        break;
-    default:
-        fprintf (stderr,
-                 _("%s %s: image depth %i not supported ... aborting\n"),
-                 DEBUGFILE, DEBUGFUNCTION, image->bits_per_pixel);
-        exit (1);
+    // laid out like libavcodec's own, with an extra column of macroblocks
+    // and blocks
+    skip_mb_type = av_malloc ((mb_width + 1) * mb_height * sizeof (uint32_t));
+    skip_motion_val = av_mallocz (b8_size * sizeof (int16_t) * 2);
+    skip_ref_index = av_mallocz (b8_size);
+    // the damage map may count one column of tiles more for padded lines
+    skip_mbs = ((image->bytes_per_line + 16 * Bpp - 1) / (16 * Bpp)) *
+        ((image->height + 15) / 16);
+    skip_damaged = av_malloc (skip_mbs);
+    if (!skip_mb_type || !skip_motion_val || !skip_ref_index ||
+        !skip_damaged) {
+        skip_free ();
+        return;
     }
+    for (i = 0; i < (mb_width + 1) * mb_height; i++)
+        skip_mb_type[i] = MB_TYPE_16x16 | MB_TYPE_L0;
+
+    // the frame before is the decoded one, so even a macroblock that didn't
+    // change differs from it by the quantization error. The threshold is
+    // the mean squared error per pixel allowed, 2 qscale^2
+    q = XVC_MAX (c->global_quality / FF_QP2LAMBDA, 1);
+    skip_threshold = 2 * q * q + 1;
+}
 
-    return input_pixfmt;
-#undef DEBUGFUNCTION
+/**
+ * \brief hands the macroblock hints to the encoder with the next frame if
+ *      few enough macroblocks were damaged
+ *
+ * If the damage isn't known or most of the frame changed, the motion
+ * search is left to the encoder as without hints.
+ *
+ * @param image the captured image
+ * @param c the video encoder
+ * @param pic the frame to encode next
+ */
+static void
+skip_set_hints (const XImage * image, AVCodecContext * c, AVFrame * pic)
+{
+    int damaged;
+
+    if (!skip_mb_type)
+        return;
+    damaged = xvc_damage_map_tiles (image, 16 * (image->bits_per_pixel >> 3),
+                                    16, skip_damaged);
+    if (damaged >= 0 && damaged * 100 <= skip_mbs * SKIP_MAX_DAMAGED) {
+        c->me_threshold = skip_threshold;
+        pic->mb_type = skip_mb_type;
+        pic->motion_val[0] = pic->motion_val[1] = skip_motion_val;
+        pic->ref_index[0] = pic->ref_index[1] = skip_ref_index;
+        pic->motion_subsample_log2 = 3;
+    } else {
+        c->me_threshold = 0;
+        pic->mb_type = NULL;
+        pic->motion_val[0] = pic->motion_val[1] = NULL;
+        pic->ref_index[0] = pic->ref_index[1] = NULL;
+    }
 }
 
 /**
@@ -1385,6 +2688,10 @@ xvc_ffmpeg_save_frame (FILE * fp, XImage * image)
 
     /* size of the encoded frame to write to file */
     int out_size = -1;
+    /* the encoded frame starts the next segment */
+    int start_segment = FALSE;
+    /* for the per-stage statistics */
+    int64_t stage_start;
 
 #ifdef DEBUG
     printf ("%s %s: Entering\n", DEBUGFILE, DEBUGFUNCTION);
@@ -1437,6 +2744,10 @@ xvc_ffmpeg_save_frame (FILE * fp, XImage * image)
         // register all libav* related stuff
         avdevice_register_all ();
         av_register_all ();
+        if (app->flags & FLG_ASYNC_WRITE)
+            xvc_aio_register_protocol ();
+        else if (app->write_behind > 0)
+            xvc_wb_register_protocol ();
 
         // guess AVOutputFormat
         if (job->target >= CAP_MF)
@@ -1489,6 +2800,31 @@ xvc_ffmpeg_save_frame (FILE * fp, XImage * image)
                 exit (1);
             }
         }
+        // in replay mode nothing is written until a replay is requested,
+        // this must be in place before the audio threads start
+        if (job->target >= CAP_MF && app->replay_time > 0) {
+            int i;
+
+            pthread_mutex_lock (&replay_mutex);
+            replay =
+                xvc_replay_buffer_new ((int64_t) app->replay_mem * 1024 *
+                                       1024, app->replay_time);
+            pthread_mutex_unlock (&replay_mutex);
+            for (i = 0; i <= REPLAY_MAX_DELAY; i++)
+                replay_pts_buffer[i] = AV_NOPTS_VALUE;
+            if (!replay) {
+                fprintf (stderr,
+                         _
+                         ("%s %s: Could not create replay buffer ... aborting\n"),
+                         DEBUGFILE, DEBUGFUNCTION);
+                exit (1);
+            }
+            if (job->flags & FLG_RUN_VERBOSE)
+                printf (_
+                        ("%s %s: keeping the last %i s (at most %i MB) for replay\n"),
+                        DEBUGFILE, DEBUGFUNCTION, app->replay_time,
+                        app->replay_mem);
+        }
         // output_file->packet_size= mux_packet_size;
         // output_file->mux_rate= mux_rate;
         output_file->preload = (int) (0.5 * AV_TIME_BASE);
@@ -1524,6 +2860,7 @@ xvc_ffmpeg_save_frame (FILE * fp, XImage * image)
                      DEBUGFILE, DEBUGFUNCTION);
             exit (1);
         }
+        skip_init (image, out_st->codec);
 #ifdef HAVE_FFMPEG_AUDIO
         if ((job->flags & FLG_REC_SOUND) && (job->au_targetCodec > 0)) {
             int au_ret = add_audio_stream (job);
@@ -1532,16 +2869,43 @@ xvc_ffmpeg_save_frame (FILE * fp, XImage * image)
             pthread_mutex_init (&mp, NULL);
 
             if (au_ret == 0) {
-                int tret;
+                int tret, i;
+
+                struct sigaction wakeup;
+
+                audio_capture_stop = FALSE;
+                // without SA_RESTART, so stop_audio_threads () can interrupt
+                // a read from a pipe
+                memset (&wakeup, 0, sizeof (wakeup));
+                wakeup.sa_handler = audio_wakeup_handler;
+                sigemptyset (&wakeup.sa_mask);
+                sigaction (SIGUSR2, &wakeup, NULL);
 
-                // create and start capture thread
-                // initialized with default attributes
+                // create and start one capture thread per input and the
+                // encode thread, initialized with default attributes
                 tret = pthread_attr_init (&tattr);
 
-                // create the thread
+                // create the threads
                 tret =
-                    pthread_create (&tid, &tattr,
-                                    (void *) capture_audio_thread, job);
+                    pthread_create (&enc_tid, &tattr,
+                                    (void *) encode_audio_thread, job);
+                for (i = 0; i < au_num_sources && tret == 0; i++) {
+                    au_sources[i].running = TRUE;
+                    tret =
+                        pthread_create (&au_sources[i].tid, &tattr,
+                                        (au_sources[i].tone > 0 ?
+                                         (void *) tone_audio_thread :
+                                         (void *) capture_audio_thread),
+                                        &au_sources[i]);
+                    if (tret != 0)
+                        au_sources[i].running = FALSE;
+                }
+                if (tret != 0) {
+                    fprintf (stderr,
+                             _("%s %s: Can't start audio threads\n"),
+                             DEBUGFILE, DEBUGFUNCTION);
+                    stop_audio_threads ();
+                }
             }
         }
 #endif     // HAVE_FFMPEG_AUDIO
@@ -1618,13 +2982,14 @@ xvc_ffmpeg_save_frame (FILE * fp, XImage * image)
                                                 : input_pixfmt),
                                                out_st->codec->width,
                                                out_st->codec->height,
-                                               out_st->codec->pix_fmt, 1,
-                                               NULL, NULL, NULL);
+                                               out_st->codec->pix_fmt,
+                                               SWS_FAST_BILINEAR, NULL, NULL,
+                                               NULL);
             // sws_rgb2rgb_init(SWS_CPU_CAPS_MMX*0);
         }
         // file preparation needs to be done once for multi-frame capture
         // and multiple times for single-frame capture
-        if (job->target >= CAP_MF) {
+        if (job->target >= CAP_MF && !replay) {
             // prepare output filenames and register protocols
             // after this output_file->filename should have the right
             // filename
@@ -1649,6 +3014,10 @@ xvc_ffmpeg_save_frame (FILE * fp, XImage * image)
             }
 
         }
+        // single frames are independent of each other and can be encoded
+        // in parallel
+        if (job->target < CAP_MF)
+            sf_start_workers (image, job);
 #ifdef DEBUG
         printf ("%s %s: leaving xffmpeg init\n", DEBUGFILE, DEBUGFUNCTION);
 
@@ -1674,6 +3043,11 @@ xvc_ffmpeg_save_frame (FILE * fp, XImage * image)
 #endif     // DEBUG
     }
 
+    if (sf_num_workers > 0) {
+        sf_queue_frame (image, job->pic_no);
+        return;
+    }
+
     if (job->target < CAP_MF) {
         // prepare output filenames and register protocols
         // after this output_file->filename should have the right filename
@@ -1707,15 +3081,17 @@ xvc_ffmpeg_save_frame (FILE * fp, XImage * image)
         dump8bit (image, (u_int32_t *) job->color_table);
 #endif     // DEBUG
 
+    stage_start = xvc_stats_clock ();
     /** \todo test if the special image conversion for Solaris is still
      *      necessary */
     if (input_pixfmt == PIX_FMT_ARGB32 && 
         (job->c_info->alpha_mask == 0xFF000000 || job->c_info->alpha_mask == 0)
         && image->red_mask == 0xFF && image->green_mask == 0xFF00
         && image->blue_mask == 0xFF0000) {
-        myABGR32toARGB32 (image);
+        xvc_pixels_abgr32_to_argb32 (image);
     } else if (input_pixfmt == PIX_FMT_PAL8) {
-        myPAL8toRGB24 (image, p_inpic, job);
+        xvc_pixels_pal8_to_rgb24 (image, (u_int32_t *) job->color_table,
+                                  p_inpic->data[0]);
     }
     // img resampling and conversion
     if (sws_scale (img_resample_ctx, p_inpic->data, p_inpic->linesize,
@@ -1728,6 +3104,7 @@ xvc_ffmpeg_save_frame (FILE * fp, XImage * image)
                  input_pixfmt, out_st->codec->pix_fmt);
         exit (1);
     }
+    xvc_stats_add_stage (XVC_STAGE_CONVERT, stage_start);
 
     /*
      * encode the image
@@ -1739,8 +3116,15 @@ xvc_ffmpeg_save_frame (FILE * fp, XImage * image)
          p_outpic);
 #endif     // DEBUG
 
+    // a roll-over needs the next segment to start with a keyframe
+    p_outpic->pict_type = (segment_force_key ? FF_I_TYPE : 0);
+    segment_force_key = FALSE;
+    skip_set_hints (image, out_st->codec, p_outpic);
+
+    stage_start = xvc_stats_clock ();
     out_size =
         avcodec_encode_video (out_st->codec, outbuf, outbuf_size, p_outpic);
+    xvc_stats_add_stage (XVC_STAGE_ENCODE, stage_start);
     if (out_size < 0) {
         fprintf (stderr,
                  _
@@ -1749,8 +3133,14 @@ xvc_ffmpeg_save_frame (FILE * fp, XImage * image)
                  outbuf_size, p_outpic);
         exit (1);
     }
+    // codecs with B-frames may deliver the keyframe a few frames later
+    start_segment = (segment_pending && out_size > 0 &&
+                     out_st->codec->coded_frame &&
+                     out_st->codec->coded_frame->key_frame);
 #ifdef HAVE_FFMPEG_AUDIO
     if (job->flags & FLG_REC_SOUND) {
+        if (start_segment)
+            wait_for_segment_audio ();
         if (pthread_mutex_lock (&mp) > 0) {
             fprintf (stderr,
                      _
@@ -1764,7 +3154,11 @@ xvc_ffmpeg_save_frame (FILE * fp, XImage * image)
      * write frame to file
      */
     if (out_size > 0) {
+        stage_start = xvc_stats_clock ();
+        if (start_segment)
+            next_segment (job);
         do_video_out (output_file, out_st, outbuf, out_size);
+        xvc_stats_add_stage (XVC_STAGE_MUX, stage_start);
     }
 
     if (job->target < CAP_MF)
@@ -1786,6 +3180,448 @@ xvc_ffmpeg_save_frame (FILE * fp, XImage * image)
 #undef DEBUGFUNCTION
 }
 
+/**
+ * \brief frees a replay file's format context created by
+ *      new_replay_context ()
+ *
+ * @param oc the format context to free
+ */
+static void
+free_replay_context (AVFormatContext * oc)
+{
+    int i;
+
+    for (i = 0; i < oc->nb_streams; i++) {
+        // the extradata belongs to the encoder
+        oc->streams[i]->codec->extradata = NULL;
+        av_free (oc->streams[i]->codec);
+        av_free (oc->streams[i]);
+    }
+    av_free (oc->priv_data);
+    av_free (oc);
+}
+
+/**
+ * \brief creates a format context for a replay file with the same streams
+ *      as the output file
+ *
+ * The streams are set up for copying the encoded packets as they are.
+ *
+ * @param job the current job
+ * @return the new format context or NULL on failure
+ */
+static AVFormatContext *
+new_replay_context (Job * job)
+{
+#define DEBUGFUNCTION "new_replay_context()"
+    AVFormatContext *oc;
+    int i;
+
+    oc = av_alloc_format_context ();
+    if (!oc)
+        return NULL;
+    oc->oformat = file_oformat;
+    if (oc->oformat->priv_data_size > 0) {
+        oc->priv_data = av_mallocz (oc->oformat->priv_data_size);
+        if (!oc->priv_data) {
+            av_free (oc);
+            return NULL;
+        }
+    }
+    oc->preload = output_file->preload;
+    oc->max_delay = output_file->max_delay;
+
+    for (i = 0; i < output_file->nb_streams; i++) {
+        AVCodecContext *enc = output_file->streams[i]->codec;
+        AVStream *st = av_new_stream (oc, i);
+
+        if (!st) {
+            free_replay_context (oc);
+            return NULL;
+        }
+        st->codec->codec_id = enc->codec_id;
+        st->codec->codec_type = enc->codec_type;
+        st->codec->bit_rate = enc->bit_rate;
+        st->codec->extradata = enc->extradata;
+        st->codec->extradata_size = enc->extradata_size;
+        st->codec->time_base = enc->time_base;
+        st->codec->flags = enc->flags;
+        if (enc->codec_type == CODEC_TYPE_VIDEO) {
+            st->codec->width = enc->width;
+            st->codec->height = enc->height;
+            st->codec->pix_fmt = enc->pix_fmt;
+            st->codec->has_b_frames = enc->has_b_frames;
+        } else {
+            st->codec->sample_rate = enc->sample_rate;
+            st->codec->channels = enc->channels;
+            st->codec->frame_size = enc->frame_size;
+            st->codec->block_align = enc->block_align;
+        }
+    }
+
+    prepareOutputFile (job->file, oc, job->movie_no);
+
+    return oc;
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief this function implements the thread writing a replay file
+ *
+ * @param rs the replay to write, freed when done
+ */
+static void
+save_replay_thread (XVC_ReplaySave * rs)
+{
+#define DEBUGFUNCTION "save_replay_thread()"
+    AVFormatContext *oc = rs->oc;
+    AVRational us = { 1, AV_TIME_BASE };
+    AVPacket pkt;
+    int64_t start;
+    int i;
+
+    if (av_set_parameters (oc, NULL) < 0 ||
+        url_fopen (&oc->pb, oc->filename, URL_WRONLY) < 0) {
+        fprintf (stderr, _("%s %s: Could not open '%s'\n"), DEBUGFILE,
+                 DEBUGFUNCTION, oc->filename);
+    } else {
+        if (av_write_header (oc) < 0) {
+            fprintf (stderr,
+                     _("%s %s: Could not write header for '%s'\n"),
+                     DEBUGFILE, DEBUGFUNCTION, oc->filename);
+        } else {
+            // audio may start a little before the first keyframe, and
+            // decoding before presenting
+            start = rs->pkts[0]->dts;
+            for (i = 1; i < rs->count; i++)
+                start = FFMIN (start, FFMIN (rs->pkts[i]->time,
+                                             rs->pkts[i]->dts));
+
+            for (i = 0; i < rs->count; i++) {
+                XVC_ReplayPacket *p = rs->pkts[i];
+
+                av_init_packet (&pkt);
+                pkt.stream_index = p->stream_index;
+                pkt.data = p->data;
+                pkt.size = p->size;
+                pkt.flags = p->flags;
+                pkt.pts =
+                    av_rescale_q (p->time - start, us,
+                                  oc->streams[p->stream_index]->time_base);
+                pkt.dts =
+                    av_rescale_q (p->dts - start, us,
+                                  oc->streams[p->stream_index]->time_base);
+                if (av_interleaved_write_frame (oc, &pkt) != 0) {
+                    fprintf (stderr,
+                             _("%s %s: Error while writing to '%s'\n"),
+                             DEBUGFILE, DEBUGFUNCTION, oc->filename);
+                    break;
+                }
+            }
+            av_write_trailer (oc);
+            if (rs->verbose)
+                printf (_("%s %s: saved %i packets to %s\n"), DEBUGFILE,
+                        DEBUGFUNCTION, i, oc->filename);
+        }
+        url_fclose (oc->pb);
+    }
+
+    free_replay_context (oc);
+    xvc_replay_buffer_release (replay, rs->pkts, rs->count);
+    free (rs);
+    replay_saving = FALSE;
+
+    pthread_exit (NULL);
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief saves the contents of the replay buffer to the next output file
+ *      without interrupting the capture
+ *
+ * The file is named after the filename pattern and the current movie
+ * number, which is incremented afterwards. Writing happens in a thread of
+ * its own.
+ *
+ * @param filename buffer to return the name of the file written to
+ * @param size size of the filename buffer
+ * @return 0 on success, ENOENT if not recording in replay mode, ENODATA
+ *      if nothing has been buffered, yet, EBUSY if the last replay is still
+ *      being written, or ENOMEM
+ */
+int
+xvc_ffmpeg_save_replay (char *filename, int size)
+{
+#define DEBUGFUNCTION "xvc_ffmpeg_save_replay()"
+    Job *job = xvc_job_ptr ();
+    XVC_ReplaySave *rs = NULL;
+    int ret = 0;
+
+    pthread_mutex_lock (&replay_mutex);
+    if (!replay) {
+        ret = ENOENT;
+    } else if (replay_saving) {
+        ret = EBUSY;
+    } else {
+        if (replay_tid != 0) {
+            pthread_join (replay_tid, NULL);
+            replay_tid = 0;
+        }
+        rs = (XVC_ReplaySave *) malloc (sizeof (XVC_ReplaySave));
+        if (!rs) {
+            ret = ENOMEM;
+        } else {
+            rs->verbose = (job->flags & FLG_RUN_VERBOSE);
+            rs->pkts = xvc_replay_buffer_snapshot (replay, &rs->count);
+            if (!rs->pkts) {
+                ret = ENODATA;
+            } else if (!(rs->oc = new_replay_context (job))) {
+                xvc_replay_buffer_release (replay, rs->pkts, rs->count);
+                ret = ENOMEM;
+            } else {
+                if (strncmp (rs->oc->filename, "file://", 7) == 0)
+                    snprintf (filename, size, "%s", rs->oc->filename + 7);
+                else
+                    snprintf (filename, size, "%s", rs->oc->filename);
+
+                replay_saving = TRUE;
+                if (pthread_create (&replay_tid, NULL,
+                                    (void *) save_replay_thread, rs) != 0) {
+                    replay_saving = FALSE;
+                    replay_tid = 0;
+                    free_replay_context (rs->oc);
+                    xvc_replay_buffer_release (replay, rs->pkts, rs->count);
+                    ret = ENOMEM;
+                } else {
+                    job->movie_no += 1;
+                    rs = NULL;
+                }
+            }
+        }
+    }
+    pthread_mutex_unlock (&replay_mutex);
+
+    if (rs)
+        free (rs);
+
+#ifdef DEBUG
+    printf ("%s %s: Leaving with %i\n", DEBUGFILE, DEBUGFUNCTION, ret);
+#endif     // DEBUG
+
+    return ret;
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief joins files encoded from consecutive parts of a sequence of frames
+ *      into the output file, copying the video packets as they are
+ *
+ * Each part must start with a keyframe and be encoded with the same codec
+ * settings, like xvc_frame_store_transcode () does. The output file is
+ * named after job->file and job->movie_no like a recording's.
+ *
+ * @param parts the names of the files to join in order
+ * @param first_frames the number of the first frame of each part in the
+ *      whole sequence
+ * @param n the number of parts
+ * @return 0 on success or -1 on error
+ */
+int
+xvc_ffmpeg_join (char **parts, const int *first_frames, int n)
+{
+#define DEBUGFUNCTION "xvc_ffmpeg_join()"
+    Job *job = xvc_job_ptr ();
+    XVC_AppData *app = xvc_appdata_ptr ();
+    XVC_CapTypeOptions *cto = (app->current_mode > 0 ?
+                               &(app->multi_frame) : &(app->single_frame));
+    AVRational frame_time = { cto->fps.den, cto->fps.num };
+    AVFormatContext *ic = NULL, *oc = NULL;
+    AVOutputFormat *fmt;
+    AVStream *ist, *ost = NULL;
+    AVPacket pkt, opkt;
+    int64_t part_start, offset;
+    int i, s, ret = -1, opened = FALSE;
+
+    av_register_all ();
+    if (app->flags & FLG_ASYNC_WRITE)
+        xvc_aio_register_protocol ();
+    else if (app->write_behind > 0)
+        xvc_wb_register_protocol ();
+    fmt = guess_format (xvc_formats[job->target].ffmpeg_name, NULL, NULL);
+    if (!fmt) {
+        fprintf (stderr, _("%s %s: Couldn't determin output format\n"),
+                 DEBUGFILE, DEBUGFUNCTION);
+        return -1;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (av_open_input_file (&ic, parts[i], NULL, 0, NULL) != 0) {
+            ic = NULL;
+            fprintf (stderr, _("%s %s: Could not open '%s'\n"), DEBUGFILE,
+                     DEBUGFUNCTION, parts[i]);
+            goto DONE;
+        }
+        ist = NULL;
+        if (av_find_stream_info (ic) >= 0) {
+            for (s = 0; s < ic->nb_streams && !ist; s++) {
+                if (ic->streams[s]->codec->codec_type == CODEC_TYPE_VIDEO)
+                    ist = ic->streams[s];
+            }
+        }
+        if (!ist) {
+            fprintf (stderr, _("%s %s: No video stream in '%s'\n"),
+                     DEBUGFILE, DEBUGFUNCTION, parts[i]);
+            goto DONE;
+        }
+        // the first part sets up the output file, the others must match it
+        if (!oc) {
+            oc = av_alloc_format_context ();
+            if (!oc)
+                goto DONE;
+            oc->oformat = fmt;
+            if (fmt->priv_data_size > 0) {
+                oc->priv_data = av_mallocz (fmt->priv_data_size);
+                if (!oc->priv_data)
+                    goto DONE;
+            }
+            ost = av_new_stream (oc, 0);
+            if (!ost)
+                goto DONE;
+            ost->codec->codec_id = ist->codec->codec_id;
+            ost->codec->codec_type = CODEC_TYPE_VIDEO;
+            ost->codec->bit_rate = ist->codec->bit_rate;
+            ost->codec->time_base = frame_time;
+            ost->codec->width = ist->codec->width;
+            ost->codec->height = ist->codec->height;
+            ost->codec->pix_fmt = ist->codec->pix_fmt;
+            ost->codec->has_b_frames = ist->codec->has_b_frames;
+            if (ist->codec->extradata_size > 0) {
+                // the input's extradata goes away with the first part
+                ost->codec->extradata =
+                    av_mallocz (ist->codec->extradata_size +
+                                FF_INPUT_BUFFER_PADDING_SIZE);
+                if (!ost->codec->extradata)
+                    goto DONE;
+                memcpy (ost->codec->extradata, ist->codec->extradata,
+                        ist->codec->extradata_size);
+                ost->codec->extradata_size = ist->codec->extradata_size;
+            }
+            if (fmt->flags & AVFMT_GLOBALHEADER)
+                ost->codec->flags |= CODEC_FLAG_GLOBAL_HEADER;
+
+            prepareOutputFile (job->file, oc, job->movie_no);
+            if (av_set_parameters (oc, NULL) < 0 ||
+                url_fopen (&oc->pb, oc->filename, URL_WRONLY) < 0) {
+                fprintf (stderr, _("%s %s: Could not open '%s'\n"),
+                         DEBUGFILE, DEBUGFUNCTION, oc->filename);
+                goto DONE;
+            }
+            opened = TRUE;
+            if (av_write_header (oc) < 0) {
+                fprintf (stderr,
+                         _("%s %s: Could not write header for '%s'\n"),
+                         DEBUGFILE, DEBUGFUNCTION, oc->filename);
+                goto DONE;
+            }
+        } else if (ist->codec->codec_id != ost->codec->codec_id ||
+                   ist->codec->width != ost->codec->width ||
+                   ist->codec->height != ost->codec->height) {
+            fprintf (stderr, _("%s %s: '%s' doesn't match the first part\n"),
+                     DEBUGFILE, DEBUGFUNCTION, parts[i]);
+            goto DONE;
+        }
+
+        offset = av_rescale_q (first_frames[i], frame_time, ost->time_base);
+        part_start = AV_NOPTS_VALUE;
+        while (av_read_frame (ic, &pkt) >= 0) {
+            if (pkt.stream_index == ist->index) {
+                // a part's timestamps needn't start at 0
+                if (part_start == AV_NOPTS_VALUE)
+                    part_start = (pkt.dts != AV_NOPTS_VALUE ? pkt.dts :
+                                  (pkt.pts != AV_NOPTS_VALUE ? pkt.pts : 0));
+
+                av_init_packet (&opkt);
+                opkt.stream_index = 0;
+                opkt.data = pkt.data;
+                opkt.size = pkt.size;
+                opkt.flags = pkt.flags;
+                if (pkt.pts != AV_NOPTS_VALUE)
+                    opkt.pts = offset +
+                        av_rescale_q (pkt.pts - part_start, ist->time_base,
+                                      ost->time_base);
+                if (pkt.dts != AV_NOPTS_VALUE)
+                    opkt.dts = offset +
+                        av_rescale_q (pkt.dts - part_start, ist->time_base,
+                                      ost->time_base);
+                if (av_interleaved_write_frame (oc, &opkt) != 0) {
+                    fprintf (stderr,
+                             _("%s %s: Error while writing to '%s'\n"),
+                             DEBUGFILE, DEBUGFUNCTION, oc->filename);
+                    av_free_packet (&pkt);
+                    goto DONE;
+                }
+            }
+            av_free_packet (&pkt);
+        }
+        av_close_input_file (ic);
+        ic = NULL;
+    }
+    ret = 0;
+
+  DONE:
+    if (ic)
+        av_close_input_file (ic);
+    if (opened) {
+        if (ret == 0)
+            av_write_trailer (oc);
+        url_fclose (oc->pb);
+        // the file closed may still be being written, and nothing else
+        // waits for it before the program ends
+        if (app->flags & FLG_ASYNC_WRITE)
+            xvc_aio_drain ();
+        xvc_wb_drain ();
+    }
+    if (oc) {
+        if (ost) {
+            av_free (ost->codec->extradata);
+            av_free (ost->codec);
+            av_free (ost);
+        }
+        av_free (oc->priv_data);
+        av_free (oc);
+    }
+    return ret;
+#undef DEBUGFUNCTION
+}
+
+/**
+ * \brief continues a multi-frame capture session in the next file
+ *
+ * Unlike going through xvc_ffmpeg_clean () and starting over, this keeps
+ * the encoders, the scaler and the audio capture running. The next frame
+ * is encoded as a keyframe and the current file is finished right before
+ * it, so no frames or audio samples are lost between the files. The next
+ * file is named after job->movie_no at the time the keyframe is written.
+ */
+void
+xvc_ffmpeg_roll_over ()
+{
+#define DEBUGFUNCTION "xvc_ffmpeg_roll_over()"
+    Job *job = xvc_job_ptr ();
+
+    if (job->target < CAP_MF || !output_file || replay)
+        return;
+
+#ifdef DEBUG
+    printf ("%s %s: rolling over to movie number %i\n", DEBUGFILE,
+            DEBUGFUNCTION, job->movie_no);
+#endif     // DEBUG
+
+    segment_force_key = TRUE;
+    segment_pending = TRUE;
+#undef DEBUGFUNCTION
+}
+
 /**
  * \brief cleanup capture session
  */
@@ -1794,32 +3630,35 @@ xvc_ffmpeg_clean ()
 {
 #define DEBUGFUNCTION "FFMPEGClean()"
     Job *job = xvc_job_ptr ();
+    int replayed = FALSE;
 
 #ifdef DEBUG
     printf ("%s %s: Entering\n", DEBUGFILE, DEBUGFUNCTION);
 #endif     // DEBUG
 
-#ifdef HAVE_FFMPEG_AUDIO
-    if (job->flags & FLG_REC_SOUND && tid != 0) {
-        {
-            int tret;
-
-            // wait till audio thread is actually running, or else
-            // the signal might kill xvidcap. we also cannot just
-            // drop sending the signal, because the audio thread
-            // might just be starting
-            while (!audio_thread_running) {
-                usleep (10);
-            }
-            tret = pthread_kill (tid, SIGUSR1);
+    // the frames still queued need the encoder settings
+    if (sf_num_workers > 0)
+        sf_stop_workers ();
 
-            pthread_join (tid, NULL);
-            tid = 0;
-        }
-    }
+#ifdef HAVE_FFMPEG_AUDIO
+    if (job->flags & FLG_REC_SOUND)
+        stop_audio_threads ();
+    close_audio_sources ();
 #endif     // HAVE_FFMPEG_AUDIO
 
-    if (output_file) {
+    if (replay) {
+        // a replay still being saved needs the codec parameters and the
+        // buffered packets
+        pthread_mutex_lock (&replay_mutex);
+        if (replay_tid != 0) {
+            pthread_join (replay_tid, NULL);
+            replay_tid = 0;
+        }
+        xvc_replay_buffer_free (replay);
+        replay = NULL;
+        pthread_mutex_unlock (&replay_mutex);
+        replayed = TRUE;
+    } else if (output_file) {
         /*
          * write trailer
          */
@@ -1832,7 +3671,7 @@ xvc_ffmpeg_clean ()
         /*
          * close file if multi-frame capture ... otherwise closed already
          */
-        if (job->target >= CAP_MF)
+        if (job->target >= CAP_MF && !replayed)
             url_fclose (output_file->pb);
         /*
          * free streams
@@ -1859,6 +3698,10 @@ xvc_ffmpeg_clean ()
         av_free (output_file);
         output_file = NULL;
     }
+    // the files closed may still be being written
+    if (xvc_appdata_ptr ()->flags & FLG_ASYNC_WRITE)
+        xvc_aio_drain ();
+    xvc_wb_drain ();
 
     if (img_resample_ctx) {
         sws_freeContext (img_resample_ctx);
@@ -1877,6 +3720,7 @@ xvc_ffmpeg_clean ()
     outpic_buf = NULL;
     av_free (p_outpic);
     p_outpic = NULL;
+    skip_free ();
 
     if (input_pixfmt == PIX_FMT_PAL8 && scratchbuf8bit) {
         free (scratchbuf8bit);
@@ -1884,8 +3728,11 @@ xvc_ffmpeg_clean ()
     }
 
     codec = NULL;
+    segment_force_key = segment_pending = FALSE;
+    seg_video_offset = 0;
 #ifdef HAVE_FFMPEG_AUDIO
     au_codec = NULL;
+    seg_audio_offset = 0;
 #endif     // HAVE_FFMPEG_AUDIO
 
 #ifdef DEBUG
@@ -1950,53 +3797,29 @@ dump32bit (const XImage * input, const ColorInfo * c_info)
 {
 #define DEBUGFUNCTION "dump32bit()"
 
-    int row, col;
     static char head[256];
 
     static FILE *fp2 = NULL;
-    uint8_t *ptr2, *output;
+    uint8_t *output;
     long size;
 
-    register unsigned int
-        rm = input->red_mask,
-        gm = input->green_mask,
-        bm = input->blue_mask,
-        rs = c_info->red_shift,
-        gs = c_info->green_shift,
-        bs = c_info->blue_shift, *p32 = (unsigned int *) input->data;
-
 #ifdef DEBUG
     printf ("%s %s: Entering with image %p\n", DEBUGFILE, DEBUGFUNCTION, input);
 #endif     // DEBUG
 
     sprintf (head, "P6\n%d %d\n%d\n", input->width, input->height, 255);
-    size = ((input->bytes_per_line * input->height) / 4) * 3;
+    size = input->width * 3 * input->height;
     output = malloc (size);
-    ptr2 = output;
-
-    for (row = 0; row < input->height; row++) {
-        for (col = 0; col < input->width; col++) {
-            *output++ = ((*p32 & rm) >> rs);
-            *output++ = ((*p32 & gm) >> gs);
-            *output++ = ((*p32 & bm) >> bs);
-            p32++;                     // ignore alpha values
-        }
-        //
-        // eat paded bytes, for better speed we use shifting,
-        // (bytes_per_line - bits_per_pixel / 8 * width ) / 4
-        //
-        p32 += (input->bytes_per_line - (input->bits_per_pixel >> 3)
-                * input->width) >> 2;
-    }
+    xvc_pixels_rgb32_to_rgb24 (input, c_info, output);
 
     fp2 = fopen ("/tmp/pic.rgb.pnm", "w");
     fwrite (head, strlen (head), 1, fp2);
     //
     // x2ffmpeg_dump_ximage_info (input, fp2);
     //
-    fwrite (ptr2, size, 1, fp2);
+    fwrite (output, size, 1, fp2);
     fclose (fp2);
-    free (ptr2);
+    free (output);
 
 #ifdef DEBUG
     printf ("%s %s: Leaving\n", DEBUGFILE, DEBUGFUNCTION);
@@ -2019,9 +3842,7 @@ dump8bit (const XImage * image, const u_int32_t * ct)
 
     static char head[256];
     static unsigned int image_size;
-    register unsigned char *line_ptr, *col_ptr;
     unsigned char *pnm_image = NULL;
-    int row, col;
 
     static FILE *fp2 = NULL;
 
@@ -2036,16 +3857,7 @@ dump8bit (const XImage * image, const u_int32_t * ct)
     fp2 = fopen ("/tmp/pic.rgb.pnm", "w");
     fwrite (head, strlen (head), 1, fp2);
 
-    line_ptr = pnm_image;
-    for (row = 0; row < image->height; row++) {
-        col_ptr = (unsigned char *) image->data + (row * image->bytes_per_line);
-        for (col = 0; col < image->width; col++) {
-            *line_ptr++ = ((ct[*col_ptr] & 0x00FF0000) >> 16);
-            *line_ptr++ = ((ct[*col_ptr] & 0x0000FF00) >> 8);
-            *line_ptr++ = (ct[*col_ptr] & 0x000000FF);
-            col_ptr++;
-        }
-    }
+    xvc_pixels_pal8_to_rgb24 (image, ct, pnm_image);
     fwrite (pnm_image, image_size, 1, fp2);
 
     //
@@ -26,5 +26,8 @@
 void xvc_ffmpeg_save_frame (FILE * fp, XImage * image);
 void *xvc_ffmpeg_get_color_table (XColor * colors, int ncolors);
 void xvc_ffmpeg_clean ();
+void xvc_ffmpeg_roll_over ();
+int xvc_ffmpeg_save_replay (char *filename, int size);
+int xvc_ffmpeg_join (char **parts, const int *first_frames, int n);
 
 #endif     // _xvc_X_TO_FFMPEG_H__
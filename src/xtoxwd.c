@@ -36,7 +36,13 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 
 #include <X11/Intrinsic.h>
@@ -45,6 +51,9 @@
 
 #include "job.h"
 #include "app_data.h"
+#include "stats.h"
+#include "trace.h"
+#include "write_behind.h"
 
 /** \brief image size for ZPixmap */
 #define ZImageSize(i) (i->bytes_per_line * i->height)
@@ -128,13 +137,196 @@ xvc_xwd_get_color_table (XColor * colors, int ncolors)
     return (color_table);
 }
 
+/** \brief frames that may wait for the writer thread */
+#define XWD_QUEUE_FRAMES 8
+
+/**
+ * \brief a frame waiting for the writer thread
+ */
+typedef struct
+{
+    /** \brief a copy of the image data */
+    char *data;
+    /** \brief the number of the frame for the file name */
+    int pic_no;
+} XVC_XwdFrame;
+
+/** \brief header, file name and color table, all ready to be written in
+ *      front of every frame */
+static char *prefix = NULL;
+static int prefix_len = 0;
+/** \brief size of the image data of every frame */
+static int frame_size = 0;
+
+/** \brief the thread writing frames if FLG_ASYNC_WRITE is set */
+static pthread_t writer_tid = 0;
+/** \brief frames waiting for the writer thread, oldest first from
+ *      queue_head */
+static XVC_XwdFrame queue[XWD_QUEUE_FRAMES];
+static int queue_head = 0, queue_count = 0;
+/** \brief buffers for copies of frames not in use */
+static char *free_bufs[XWD_QUEUE_FRAMES];
+static int num_free = 0;
+/** \brief set when the writer thread should write the frames queued and
+ *      end */
+static int writer_stop = FALSE;
+/** \brief protects the queue and the free buffers */
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+/** \brief signalled when a frame was queued or the writer should end */
+static pthread_cond_t queued = PTHREAD_COND_INITIALIZER;
+/** \brief signalled when a buffer was freed */
+static pthread_cond_t freed = PTHREAD_COND_INITIALIZER;
+
+/**
+ * \brief writes one frame to its own xwd file with a single system call
+ *
+ * @param data the image data
+ * @param pic_no the number of the frame for the file name
+ */
+static void
+write_frame (char *data, int pic_no)
+{
+    Job *job = xvc_job_ptr ();
+    char file[PATH_MAX + 1];
+    struct iovec iov[2];
+    int fd, iovcnt = 2;
+    ssize_t n;
+    size_t len = prefix_len + frame_size;
+    int64_t start = xvc_stats_clock ();
+
+    snprintf (file, sizeof (file), job->file, pic_no);
+    fd = open (file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        perror (file);
+        return;
+    }
+
+    iov[0].iov_base = prefix;
+    iov[0].iov_len = prefix_len;
+    iov[1].iov_base = data;
+    iov[1].iov_len = frame_size;
+    // writev () may return early, so continue where it stopped
+    while (iovcnt > 0) {
+        n = writev (fd, iov + 2 - iovcnt, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror (file);
+            len = 0;
+            break;
+        }
+        while (iovcnt > 0 && n >= iov[2 - iovcnt].iov_len) {
+            n -= iov[2 - iovcnt].iov_len;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov[2 - iovcnt].iov_base = (char *) iov[2 - iovcnt].iov_base + n;
+            iov[2 - iovcnt].iov_len -= n;
+        }
+    }
+    if (len > 0)
+        xvc_wb_add (fd, 0, len);
+    if (xvc_wb_close (fd, file) < 0)
+        perror (file);
+    xvc_stats_add_stage (XVC_STAGE_MUX, start);
+}
+
+/**
+ * \brief writes the frames queued until writer_stop is set and the queue
+ *      is empty
+ */
+static void
+writer_thread ()
+{
+    XVC_XwdFrame frame;
+
+    xvc_trace_thread_name ("xwd write");
+    while (TRUE) {
+        pthread_mutex_lock (&queue_mutex);
+        while (queue_count == 0 && !writer_stop)
+            pthread_cond_wait (&queued, &queue_mutex);
+        if (queue_count == 0) {
+            pthread_mutex_unlock (&queue_mutex);
+            break;
+        }
+        frame = queue[queue_head];
+        queue_head = (queue_head + 1) % XWD_QUEUE_FRAMES;
+        queue_count--;
+        pthread_mutex_unlock (&queue_mutex);
+
+        write_frame (frame.data, frame.pic_no);
+
+        pthread_mutex_lock (&queue_mutex);
+        free_bufs[num_free++] = frame.data;
+        pthread_cond_signal (&freed);
+        pthread_mutex_unlock (&queue_mutex);
+    }
+}
+
+/**
+ * \brief starts the writer thread with its buffers
+ *
+ * @return 0 on success, -1 if the frames need to be written by the caller
+ */
+static int
+start_writer ()
+{
+    for (num_free = 0; num_free < XWD_QUEUE_FRAMES; num_free++) {
+        free_bufs[num_free] = malloc (frame_size);
+        if (!free_bufs[num_free])
+            break;
+    }
+    writer_stop = FALSE;
+    queue_head = queue_count = 0;
+    if (num_free < XWD_QUEUE_FRAMES ||
+        pthread_create (&writer_tid, NULL, (void *) writer_thread, NULL) != 0) {
+        writer_tid = 0;
+        while (num_free > 0)
+            free (free_bufs[--num_free]);
+        return -1;
+    }
+    return 0;
+}
+
 /**
- * \brief main function to write ximage as individual frame to 'fp'
+ * \brief hands a copy of a frame to the writer thread, this only waits if
+ *      all buffers are in use because the disk is slower than the capture
  *
- * @param fp file handle, this, however, is only used here
+ * @param image the captured XImage
+ * @param pic_no the number of the frame for the file name
+ */
+static void
+queue_frame (XImage * image, int pic_no)
+{
+    char *data;
+
+    pthread_mutex_lock (&queue_mutex);
+    while (num_free == 0)
+        pthread_cond_wait (&freed, &queue_mutex);
+    data = free_bufs[--num_free];
+    pthread_mutex_unlock (&queue_mutex);
+
+    memcpy (data, image->data, frame_size);
+
+    pthread_mutex_lock (&queue_mutex);
+    queue[(queue_head + queue_count) % XWD_QUEUE_FRAMES].data = data;
+    queue[(queue_head + queue_count) % XWD_QUEUE_FRAMES].pic_no = pic_no;
+    queue_count++;
+    pthread_cond_signal (&queued);
+    pthread_mutex_unlock (&queue_mutex);
+}
+
+/**
+ * \brief main function to write ximage as individual frame
+ *
+ * The header, file name and color table are the same for every frame, so
+ * they are prepared once and written together with the image data by one
+ * writev (). With FLG_ASYNC_WRITE set, a thread does the writing, which
+ * opens and closes every file itself, so none of that is left to the
+ * capture thread. async_io.c is for the long lived files.
+ *
+ * @param fp file handle, not used, the files are opened here
  * @param image the captured XImage to save
- * \todo remove fp from outside the save function. It is only needed here
- *      and should be handled here.
  */
 void
 xvc_xwd_save_frame (FILE * fp, XImage * image)
@@ -149,11 +341,10 @@ xvc_xwd_save_frame (FILE * fp, XImage * image)
      * header must be prepared only once ..
      */
     if (job->state & VC_START /* it's the first call */ ) {
-        XWindowAttributes win_attr = app->win_attr;
-
 #ifdef DEBUG
         printf ("Preparing XWD header ... win_attr.x = %i\n", app->win_attr.x);
 #endif
+        memset (&head, 0, sizeof (head));
         file_name_len = strlen (file) + 1;
         head.header_size = (CARD32) (sizeof (head) + file_name_len);
         head.file_version = (CARD32) XWD_FILE_VERSION;
@@ -168,34 +359,99 @@ xvc_xwd_save_frame (FILE * fp, XImage * image)
         head.bitmap_pad = (CARD32) image->bitmap_pad;
         head.bits_per_pixel = (CARD32) image->bits_per_pixel;
         head.bytes_per_line = (CARD32) image->bytes_per_line;
-        head.visual_class = (CARD32) win_attr.visual->class;
-        head.red_mask = (CARD32) win_attr.visual->red_mask;
-        head.green_mask = (CARD32) win_attr.visual->green_mask;
-        head.blue_mask = (CARD32) win_attr.visual->blue_mask;
-        head.bits_per_rgb = (CARD32) win_attr.visual->bits_per_rgb;
-        head.colormap_entries = (CARD32) win_attr.visual->map_entries;
+        if (app->dpy && !(app->flags & (FLG_USE_SYNTH | FLG_USE_REPLAY)) &&
+            image->depth == app->win_attr.depth) {
+            Visual *visual = app->win_attr.visual;
+
+            head.visual_class = (CARD32) visual->class;
+            head.red_mask = (CARD32) visual->red_mask;
+            head.green_mask = (CARD32) visual->green_mask;
+            head.blue_mask = (CARD32) visual->blue_mask;
+            head.bits_per_rgb = (CARD32) visual->bits_per_rgb;
+            head.colormap_entries = (CARD32) visual->map_entries;
+        } else {
+            // generated and replayed frames needn't match the root window,
+            // and there may be no display at all
+            head.visual_class = (CARD32) (image->depth <= 8 && job->ncolors ?
+                                          PseudoColor : TrueColor);
+            head.red_mask = (CARD32) image->red_mask;
+            head.green_mask = (CARD32) image->green_mask;
+            head.blue_mask = (CARD32) image->blue_mask;
+            head.bits_per_rgb = (CARD32) 8;
+            head.colormap_entries =
+                (CARD32) (job->ncolors ? job->ncolors : 256);
+        }
         head.ncolors = (CARD32) job->ncolors;
-        head.window_width = (CARD32) win_attr.width;
-        head.window_height = (CARD32) win_attr.height;
-        head.window_x = (long) win_attr.x;
-        head.window_y = (long) win_attr.y;
-        head.window_bdrwidth = (CARD32) win_attr.border_width;
+        head.window_width = (CARD32) image->width;
+        head.window_height = (CARD32) image->height;
+        if (app->dpy) {
+            head.window_width = (CARD32) app->win_attr.width;
+            head.window_height = (CARD32) app->win_attr.height;
+            head.window_x = (long) app->win_attr.x;
+            head.window_y = (long) app->win_attr.y;
+            head.window_bdrwidth = (CARD32) app->win_attr.border_width;
+        }
 
         if (*(char *) &little_endian)
             swap_n_4byte ((unsigned char *) &head,
                           sizeof (head) / sizeof (uint32_t));
+
+        // the color table is byte swapped by xvc_xwd_get_color_table ()
+        if (prefix)
+            free (prefix);
+        prefix_len = sizeof (head) + file_name_len +
+            sizeof (XWDColor) * job->ncolors;
+        prefix = malloc (prefix_len);
+        if (!prefix) {
+            perror (file);
+            return;
+        }
+        memcpy (prefix, &head, sizeof (head));
+        memcpy (prefix + sizeof (head), file, file_name_len);
+        memcpy (prefix + sizeof (head) + file_name_len, job->color_table,
+                sizeof (XWDColor) * job->ncolors);
+        frame_size = ZImageSize (image);
+
+        if (app->flags & FLG_ASYNC_WRITE && writer_tid == 0 &&
+            start_writer () < 0)
+            fprintf (stderr, "%s: can't start the writer thread\n", file);
     }
-    if (fwrite ((char *) &head, sizeof (head), 1, fp) < 1)
-        perror (file);
-    if (fwrite (file, file_name_len, 1, fp) < 1)
-        perror (file);
-    if (fwrite (job->color_table, sizeof (XWDColor), job->ncolors, fp) < 1)
-        perror (file);
-    if (fwrite (image->data, ZImageSize (image), 1, fp) < 1)
-        perror (file);
+    if (!prefix)
+        return;
+
+    if (writer_tid != 0)
+        queue_frame (image, job->pic_no);
+    else
+        write_frame (image->data, job->pic_no);
 
 #ifdef DEBUG
     printf ("XImageToXWD() header size = %d visual=%d\n",
-            sizeof (XWDFileHeader), app->win_attr.visual->class);
+            sizeof (XWDFileHeader), (int) ntohl (head.visual_class));
 #endif
 }
+
+/**
+ * \brief waits for the frames queued to be written or flushed and frees
+ *      the buffers and the header
+ */
+void
+xvc_xwd_clean ()
+{
+    int i;
+
+    if (writer_tid != 0) {
+        pthread_mutex_lock (&queue_mutex);
+        writer_stop = TRUE;
+        pthread_cond_broadcast (&queued);
+        pthread_mutex_unlock (&queue_mutex);
+        pthread_join (writer_tid, NULL);
+        writer_tid = 0;
+    }
+    for (i = 0; i < num_free; i++)
+        free (free_bufs[i]);
+    num_free = 0;
+    xvc_wb_drain ();
+    if (prefix)
+        free (prefix);
+    prefix = NULL;
+}
@@ -24,5 +24,6 @@
 
 void xvc_xwd_save_frame (FILE * fp, XImage * image);
 void *xvc_xwd_get_color_table (XColor * colors, int ncolors);
+void xvc_xwd_clean ();
 
 #endif     // _xvc_X_TO_XWD_H__
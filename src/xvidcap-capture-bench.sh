@@ -0,0 +1,157 @@
+#!/bin/sh
+#
+# Records a scripted drawing workload on a private Xvfb with each capture
+# source and prints what it achieved. Run through "make capture-bench".
+#
+# usage: xvidcap-capture-bench.sh [xvidcap [xvidcap-capture-load]]
+#
+# The following environment variables change what is run:
+#	XVC_BENCH_TIME		seconds to record per source (10)
+#	XVC_BENCH_FPS		frames per second to capture (25)
+#	XVC_BENCH_SIZE		size of the captured area (640x480)
+#	XVC_BENCH_FILE		output file name without directory (bench.avi)
+#	XVC_BENCH_SOURCES	sources to run (x11 shm shm+xdamage)
+#	XVFB			the Xvfb binary (Xvfb)
+
+XVIDCAP=${1:-./xvidcap}
+LOAD=${2:-./xvidcap-capture-load}
+TIME=${XVC_BENCH_TIME:-10}
+FPS=${XVC_BENCH_FPS:-25}
+SIZE=${XVC_BENCH_SIZE:-640x480}
+FILE=${XVC_BENCH_FILE:-bench.avi}
+SOURCES=${XVC_BENCH_SOURCES:-"x11 shm shm+xdamage"}
+XVFB=${XVFB:-Xvfb}
+
+WIDTH=`echo ${SIZE} | sed 's/x.*//'`
+HEIGHT=`echo ${SIZE} | sed 's/.*x//'`
+
+for prog in "${XVIDCAP}" "${LOAD}" ; do
+	if ( test ! -x "${prog}" ) ; then
+		echo "$0: ${prog} not found, run 'make xvidcap xvidcap-capture-load' first" >&2
+		exit 1
+	fi
+done
+if ( test -z "`which ${XVFB} 2>/dev/null`" ) ; then
+	echo "$0: ${XVFB} not found" >&2
+	exit 1
+fi
+
+TMPDIR=`mktemp -d ${TMPDIR:-/tmp}/xvidcap-capture-bench.XXXXXX` || exit 1
+XVFB_PID=""
+
+cleanup () {
+	if ( test -n "${XVFB_PID}" ) ; then
+		kill ${XVFB_PID} 2>/dev/null
+		wait ${XVFB_PID} 2>/dev/null
+	fi
+	rm -rf "${TMPDIR}"
+}
+trap cleanup 0
+trap 'exit 1' 1 2 15
+
+#
+# start a private X server on the first free display
+#
+
+DPY=99
+while ( test -e /tmp/.X${DPY}-lock || test -e /tmp/.X11-unix/X${DPY} ) ; do
+	DPY=`expr ${DPY} + 1`
+done
+${XVFB} :${DPY} -screen 0 1280x1024x24 -nolisten tcp \
+	+extension MIT-SHM +extension DAMAGE +extension XFIXES \
+	> "${TMPDIR}/xvfb.log" 2>&1 &
+XVFB_PID=$!
+
+n=0
+while ( test ! -e /tmp/.X11-unix/X${DPY} ) ; do
+	n=`expr ${n} + 1`
+	if ( test ${n} -gt 50 ) || ! kill -0 ${XVFB_PID} 2>/dev/null ; then
+		echo "$0: ${XVFB} did not start:" >&2
+		cat "${TMPDIR}/xvfb.log" >&2
+		exit 1
+	fi
+	sleep 0.2
+done
+
+DISPLAY=:${DPY}
+export DISPLAY
+# messages are parsed below
+LC_ALL=C
+export LC_ALL
+
+#
+# cpu time of the children between two outputs of times
+# usage: cpu_diff "<before>" "<after>" 1|2 (user or system time)
+#
+cpu_diff () {
+	echo "$1 $2" | awk -v f=$3 '
+		function secs(t) { split(t, a, /[ms]/) ; return a[1] * 60 + a[2] }
+		{ printf "%.2f", secs($(f + 2)) - secs($f) }'
+}
+
+printf "%-12s %8s %8s %8s %10s %8s %8s %6s\n" \
+	source fps frames dropped "req/frame" "user s" "sys s" "cpu %"
+
+for src in ${SOURCES} ; do
+	case ${src} in
+	x11)		source=x11 ; xdamage=0 ;;
+	shm)		source=shm ; xdamage=0 ;;
+	shm+xdamage)	source=shm ; xdamage=1 ;;
+	*)
+		echo "$0: unknown source ${src}" >&2
+		continue
+		;;
+	esac
+
+	# a private options file, so the user's settings don't interfere
+	mkdir -p "${TMPDIR}/${src}"
+	cat > "${TMPDIR}/${src}/.xvidcaprc" << !EOF
+source: ${source}
+use_xdamage: ${xdamage}
+mf_audio: 0
+!EOF
+
+	"${LOAD}" `expr ${TIME} + 2` ${WIDTH} ${HEIGHT} &
+	LOAD_PID=$!
+	sleep 1
+
+	# the second line of times is the cpu time of all children so far,
+	# times must not run in a subshell for this
+	times > "${TMPDIR}/times"
+	before=`sed -n 2p "${TMPDIR}/times"`
+	HOME="${TMPDIR}/${src}" "${XVIDCAP}" --gui no -v --time ${TIME} \
+		--fps ${FPS} --cap_geometry ${SIZE}+0+0 \
+		--file "${TMPDIR}/${src}/${FILE}" \
+		> "${TMPDIR}/${src}/xvidcap.log" 2>&1
+	rc=$?
+	times > "${TMPDIR}/times"
+	after=`sed -n 2p "${TMPDIR}/times"`
+	kill ${LOAD_PID} 2>/dev/null
+	wait ${LOAD_PID} 2>/dev/null
+
+	if ( test ${rc} -ne 0 ) ; then
+		echo "$0: xvidcap failed with ${src}:" >&2
+		cat "${TMPDIR}/${src}/xvidcap.log" >&2
+		continue
+	fi
+
+	user=`cpu_diff "${before}" "${after}" 1`
+	sys=`cpu_diff "${before}" "${after}" 2`
+
+	# e.g. "250 frames captured in 10.0 s, 0 dropped, 120 duplicated"
+	# and "3.0 X requests per frame" from the summary at the end
+	awk -v src=${src} -v user=${user} -v sys=${sys} '
+		/frames captured in/ {
+			frames = $1 ; secs = $5 ; dropped = $7
+		}
+		/X requests per frame/ { req = $1 }
+		END {
+			if (secs == "")
+				exit 1
+			printf "%-12s %8.2f %8d %8d %10.1f %8.2f %8.2f %6.1f\n", \
+				src, (secs > 0 ? frames / secs : 0), frames, \
+				dropped, req, user, sys, \
+				(secs > 0 ? (user + sys) * 100 / secs : 0)
+		}' "${TMPDIR}/${src}/xvidcap.log" || \
+		echo "$0: no statistics from xvidcap with ${src}" >&2
+done
@@ -0,0 +1,200 @@
+/**
+ * \file xvidcap-capture-load.c
+ *
+ * A small X client drawing a reproducible workload for the capture
+ * benchmark run by "make capture-bench". It keeps cycling through one
+ * second each of scrolling text, nothing, a moving box and nothing, so
+ * that capture sources which only fetch what changed show their benefit
+ * as well as their overhead.
+ */
+/*
+ * Copyright (C) 2003-07 Karl H. Beckers, Frankfurt
+ * EMail: khb@jarre-de-the.net
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif     // HAVE_CONFIG_H
+#endif     // DOXYGEN_SHOULD_SKIP_THIS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+/** \brief drawing steps per second */
+#define STEPS 50
+/** \brief rows scrolled per step */
+#define SCROLL 4
+/** \brief height of a line of text including spacing */
+#define LINE 16
+
+/**
+ * \brief gets the current time
+ *
+ * @return the time in ms
+ */
+static long long
+now_ms ()
+{
+    struct timeval tv;
+
+    gettimeofday (&tv, NULL);
+    return (long long) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+/**
+ * \brief allocates a color
+ *
+ * @param dpy the display
+ * @param name the name of the color
+ * @param fallback the pixel to use if the color can't be allocated
+ * @return the pixel value
+ */
+static unsigned long
+get_color (Display * dpy, const char *name, unsigned long fallback)
+{
+    XColor color, exact;
+
+    if (!XAllocNamedColor (dpy, DefaultColormap (dpy, DefaultScreen (dpy)),
+                           name, &color, &exact))
+        return fallback;
+    return color.pixel;
+}
+
+/**
+ * \brief draws a line of text-like blocks
+ *
+ * @param dpy the display
+ * @param win the window to draw into
+ * @param gc the gc to draw with
+ * @param y the top of the line
+ * @param width the width of the line
+ */
+static void
+draw_line (Display * dpy, Window win, GC gc, int y, int width)
+{
+    int x, len;
+
+    for (x = 8; x < width - 8; x += len + 6) {
+        len = 8 + rand () % 40;
+        if (x + len > width - 8)
+            len = width - 8 - x;
+        XFillRectangle (dpy, win, gc, x, y + 4, len, 9);
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+    Display *dpy;
+    Window win;
+    XSetWindowAttributes attr;
+    XEvent ev;
+    GC text_gc, back_gc, box_gc;
+    unsigned long white, black;
+    int seconds = 10, width = 640, height = 480;
+    int step, box_x = 0, box_y = 0, dx = 6, dy = 4, box = 64;
+    long long start;
+
+    if (argc > 1)
+        seconds = atoi (argv[1]);
+    if (argc > 3) {
+        width = atoi (argv[2]);
+        height = atoi (argv[3]);
+    }
+    if (seconds <= 0 || width < box || height < box) {
+        fprintf (stderr, "usage: %s [seconds [width height]]\n", argv[0]);
+        return 1;
+    }
+
+    dpy = XOpenDisplay (NULL);
+    if (!dpy) {
+        fprintf (stderr, "%s: can't open display\n", argv[0]);
+        return 1;
+    }
+    srand (1);
+    white = WhitePixel (dpy, DefaultScreen (dpy));
+    black = BlackPixel (dpy, DefaultScreen (dpy));
+
+    // no window manager is needed to place the window where it's captured
+    attr.override_redirect = True;
+    attr.background_pixel = white;
+    attr.event_mask = ExposureMask;
+    win = XCreateWindow (dpy, DefaultRootWindow (dpy), 0, 0, width, height,
+                         0, CopyFromParent, InputOutput, CopyFromParent,
+                         CWOverrideRedirect | CWBackPixel | CWEventMask,
+                         &attr);
+    text_gc = XCreateGC (dpy, win, 0, NULL);
+    XSetForeground (dpy, text_gc, get_color (dpy, "gray20", black));
+    back_gc = XCreateGC (dpy, win, 0, NULL);
+    XSetForeground (dpy, back_gc, white);
+    box_gc = XCreateGC (dpy, win, 0, NULL);
+    XSetForeground (dpy, box_gc, get_color (dpy, "steelblue", black));
+    XSetGraphicsExposures (dpy, text_gc, False);
+
+    XMapRaised (dpy, win);
+    XWindowEvent (dpy, win, ExposureMask, &ev);
+    for (step = 0; step < height; step += LINE)
+        draw_line (dpy, win, text_gc, step, width);
+    XSync (dpy, False);
+
+    start = now_ms ();
+    for (step = 0; step < seconds * STEPS; step++) {
+        long long wait;
+
+        switch ((step / STEPS) % 4) {
+        case 0:
+            // scroll up and fill in the bottom
+            XCopyArea (dpy, win, win, text_gc, 0, SCROLL, width,
+                       height - SCROLL, 0, 0);
+            XFillRectangle (dpy, win, back_gc, 0, height - SCROLL, width,
+                            SCROLL);
+            if ((step * SCROLL) % LINE == 0)
+                draw_line (dpy, win, text_gc, height - LINE, width);
+            break;
+        case 2:
+            XFillRectangle (dpy, win, back_gc, box_x, box_y, box, box);
+            box_x += dx;
+            box_y += dy;
+            if (box_x < 0 || box_x + box > width) {
+                dx = -dx;
+                box_x += 2 * dx;
+            }
+            if (box_y < 0 || box_y + box > height) {
+                dy = -dy;
+                box_y += 2 * dy;
+            }
+            XFillRectangle (dpy, win, box_gc, box_x, box_y, box, box);
+            break;
+        default:
+            // idle, nothing changes on screen
+            break;
+        }
+        XFlush (dpy);
+
+        wait = start + (step + 1) * 1000LL / STEPS - now_ms ();
+        if (wait > 0)
+            usleep (wait * 1000);
+    }
+
+    XCloseDisplay (dpy);
+    return 0;
+}
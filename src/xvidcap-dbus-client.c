@@ -33,6 +33,7 @@
 #include <getopt.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <strings.h>
 #include <dbus/dbus-glib-bindings.h>
 
@@ -46,7 +47,9 @@ enum ACTION_TYPES
 {
     ACTION_START,
     ACTION_STOP,
-    ACTION_PAUSE
+    ACTION_PAUSE,
+    ACTION_REPLAY,
+    ACTION_STATS
 };
 
 /**
@@ -60,11 +63,61 @@ usage (char *prog)
     printf (_("Usage: %s, ver %s, khb (c) 2003-07\n"), prog, VERSION);
     printf
         (_
-         ("[--action #]      action to perform (\"start\"|\"stop\"|\"pause\")\n"));
+         ("[--action #]      action to perform (\"start\"|\"stop\"|\"pause\"|\"replay\"|\"stats\")\n"));
+    printf (_
+            ("                  \"stats\" keeps printing updates until interrupted\n"));
 
     exit (1);
 }
 
+/**
+ * \brief collects the keys of a hash table into a list, used with
+ *      g_hash_table_foreach ()
+ */
+static void
+collect_key (gpointer key, gpointer value, gpointer list)
+{
+    *((GSList **) list) = g_slist_prepend (*((GSList **) list), key);
+}
+
+/**
+ * \brief prints a dictionary of statistics on one line, sorted by key
+ *
+ * @param stats the statistics as received from xvidcap
+ */
+static void
+print_stats (GHashTable * stats)
+{
+    GSList *keys = NULL, *k;
+
+    g_hash_table_foreach (stats, collect_key, &keys);
+    keys = g_slist_sort (keys, (GCompareFunc) strcmp);
+    for (k = keys; k; k = k->next) {
+        gchar *value =
+            g_strdup_value_contents ((GValue *) g_hash_table_lookup (stats,
+                                                                     k->data));
+
+        printf ("%s%s=%s", (k == keys ? "" : " "), (char *) k->data, value);
+        g_free (value);
+    }
+    printf ("\n");
+    fflush (stdout);
+    g_slist_free (keys);
+}
+
+/**
+ * \brief handler for the StatsUpdated signal
+ *
+ * @param proxy the proxy the signal was received on
+ * @param stats the statistics
+ * @param data unused
+ */
+static void
+stats_updated (DBusGProxy * proxy, GHashTable * stats, gpointer data)
+{
+    print_stats (stats);
+}
+
 /**
  * \brief main function of the application to do the remote function invocation
  *
@@ -84,6 +137,8 @@ main (int argc, char *argv[])
     DBusGProxy *proxy;
     DBusGConnection *connection;
     GError *error = NULL;
+    gchar *filename = NULL;
+    GHashTable *stats = NULL;
 
     while ((c = getopt_long (argc, argv, "v", options, &opt_index)) != -1) {
         switch (c) {
@@ -96,6 +151,10 @@ main (int argc, char *argv[])
                     action = ACTION_STOP;
                 } else if (strcasecmp (optarg, "pause") == 0) {
                     action = ACTION_PAUSE;
+                } else if (strcasecmp (optarg, "replay") == 0) {
+                    action = ACTION_REPLAY;
+                } else if (strcasecmp (optarg, "stats") == 0) {
+                    action = ACTION_STATS;
                 }
                 break;
             }
@@ -144,6 +203,35 @@ main (int argc, char *argv[])
             g_error_free (error);
         }
         break;
+    case ACTION_REPLAY:
+
+        if (!net_jarre_de_the_Xvidcap_save_replay (proxy, &filename, &error)) {
+            g_warning (_("Could not save replay: %s"), error->message);
+            g_error_free (error);
+        } else {
+            printf ("%s\n", filename);
+            g_free (filename);
+        }
+        break;
+    case ACTION_STATS:
+
+        if (!net_jarre_de_the_Xvidcap_get_stats (proxy, &stats, &error)) {
+            g_warning (_("Could not get statistics from xvidcap: %s"),
+                       error->message);
+            g_error_free (error);
+            break;
+        }
+        print_stats (stats);
+        g_hash_table_destroy (stats);
+
+        // then print whatever xvidcap sends until we're interrupted
+        dbus_g_proxy_add_signal (proxy, "StatsUpdated",
+                                 DBUS_TYPE_G_STRING_VALUE_HASHTABLE,
+                                 G_TYPE_INVALID);
+        dbus_g_proxy_connect_signal (proxy, "StatsUpdated",
+                                     G_CALLBACK (stats_updated), NULL, NULL);
+        g_main_loop_run (g_main_loop_new (NULL, FALSE));
+        break;
     }
 
     // Cleanup
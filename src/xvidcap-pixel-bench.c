@@ -0,0 +1,802 @@
+/**
+ * \file xvidcap-pixel-bench.c
+ *
+ * This file contains a benchmark of the per-pixel routines every captured
+ * frame passes through, i. e. the ones from pixels.c and the conversion
+ * with libswscale as xvc_ffmpeg_save_frame () sets it up. Each runs on
+ * generated images at 720p, 1080p, 1440p and 4K with the pixel layouts
+ * found on X servers, once with warm caches and once after evicting
+ * them. Results are given in GB/s and cycles per pixel and can be
+ * written as JSON for keeping track of them across changes. It is not
+ * built by default, use "make xvidcap-pixel-bench".
+ */
+/*
+ * Copyright (C) 2003-07 Karl H. Beckers, Frankfurt
+ * EMail: khb@jarre-de-the.net
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif     // HAVE_CONFIG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <inttypes.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+#ifdef USE_FFMPEG
+#include <ffmpeg/avcodec.h>
+#include <ffmpeg/swscale.h>
+#endif     // USE_FFMPEG
+
+#include "pixels.h"
+#include "colors.h"
+
+/** \brief minimum time spent on the repetitions of a warm run in ns */
+#define BENCH_MIN_NS 200000000LL
+
+/** \brief maximum number of repetitions of a warm run */
+#define BENCH_MAX_REPS 1000
+
+/** \brief number of repetitions of a cold run, each after evicting the
+ *      caches */
+#define BENCH_COLD_REPS 20
+
+/** \brief bytes written between the repetitions of a cold run, this needs
+ *      to be larger than the last level cache */
+#define BENCH_FLUSH_BYTES (64 * 1024 * 1024)
+
+/** \brief width and height of the generated mouse pointer */
+#define BENCH_CURSOR 64
+
+/** \brief number of places per frame the mouse pointer is painted at */
+#define BENCH_CURSOR_SPOTS 16
+
+/**
+ * \brief a frame size to benchmark
+ */
+typedef struct
+{
+    const char *name;
+    int width;
+    int height;
+} BenchSize;
+
+static const BenchSize sizes[] = {
+    {"720p", 1280, 720},
+    {"1080p", 1920, 1080},
+    {"1440p", 2560, 1440},
+    {"4K", 3840, 2160}
+};
+
+#define NUM_SIZES (sizeof (sizes) / sizeof (BenchSize))
+
+/**
+ * \brief a pixel layout of XImages as delivered by X servers
+ */
+typedef struct
+{
+    int bits_per_pixel;
+    int depth;
+    unsigned long red_mask;
+    unsigned long green_mask;
+    unsigned long blue_mask;
+} BenchLayout;
+
+static const BenchLayout layouts[] = {
+    {8, 8, 0, 0, 0},
+    {16, 16, 0xF800, 0x07E0, 0x001F},
+    {24, 24, 0xFF0000, 0x00FF00, 0x0000FF},
+    {32, 24, 0xFF0000, 0x00FF00, 0x0000FF}
+};
+
+#define NUM_LAYOUTS (sizeof (layouts) / sizeof (BenchLayout))
+
+/**
+ * \brief everything a kernel works on, set up once per size and layout
+ */
+typedef struct
+{
+    /** \brief the captured frame */
+    XImage *image;
+    /** \brief a second frame of the same size used as source of copies */
+    XImage *other;
+    /** \brief output of conversions to packed rgb24 */
+    uint8_t *rgb24;
+    /** \brief the mouse pointer in ARGB as XFixes returns it */
+    unsigned long *cursor;
+    /** \brief color information about image */
+    ColorInfo *c_info;
+    /** \brief rgb332 palette for 8 bit images */
+    u_int32_t palette[256];
+#ifdef USE_FFMPEG
+    /** \brief libswscale context converting image to yuv420p */
+    struct SwsContext *sws;
+    /** \brief the yuv420p output of sws */
+    AVPicture yuv;
+    /** \brief buffer of yuv */
+    uint8_t *yuv_buf;
+#endif     // USE_FFMPEG
+} BenchData;
+
+/**
+ * \brief a kernel to benchmark
+ */
+typedef struct
+{
+    /** \brief name of the kernel in the output */
+    const char *name;
+    /** \brief the bits per pixel values the kernel works with, bit n set
+     *      for the layouts[n] */
+    int layouts;
+    /** \brief runs the kernel once on a frame */
+    void (*run) (BenchData * d);
+    /** \brief number of pixels processed by one run */
+    long (*pixels) (const BenchData * d);
+    /** \brief number of bytes read and written by one run */
+    long (*bytes) (const BenchData * d);
+} BenchKernel;
+
+/** \brief memory written over to evict the caches */
+static char *flush_buf = NULL;
+
+/**
+ * \brief gets the current time
+ *
+ * @return the time of a monotonic clock in ns
+ */
+static long long
+now_ns ()
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+#if defined(__i386__) || defined(__x86_64__)
+#define HAVE_CYCLES 1
+#endif
+
+/**
+ * \brief reads the cpu's time stamp counter
+ *
+ * @return the number of cycles or 0 if there is no counter we can read
+ */
+static inline uint64_t
+read_cycles ()
+{
+#ifdef HAVE_CYCLES
+    uint32_t lo, hi;
+
+    __asm__ __volatile__ ("rdtsc":"=a" (lo), "=d" (hi));
+    return ((uint64_t) hi << 32) | lo;
+#else
+    return 0;
+#endif     // HAVE_CYCLES
+}
+
+/**
+ * \brief a fast and good enough pseudo random number generator
+ *
+ * @param seed the state of the generator which is updated
+ * @return the next random number
+ */
+static inline uint32_t
+bench_random (uint32_t * seed)
+{
+    uint32_t x = *seed;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return (*seed = x);
+}
+
+/**
+ * \brief creates an XImage filled with noise without a server round trip
+ *
+ * @param l the layout of the image
+ * @param width width of the image
+ * @param height height of the image
+ * @param seed seed of the noise
+ * @return the image or NULL if it can't be allocated
+ */
+static XImage *
+create_image (const BenchLayout * l, int width, int height, uint32_t seed)
+{
+    XImage *image;
+    uint32_t *p;
+    long i, n;
+    int one = 1;
+
+    image = (XImage *) calloc (1, sizeof (XImage));
+    if (!image)
+        return NULL;
+
+    image->width = width;
+    image->height = height;
+    image->format = ZPixmap;
+    image->byte_order = (*(char *) &one ? LSBFirst : MSBFirst);
+    image->bitmap_unit = 32;
+    image->bitmap_bit_order = image->byte_order;
+    image->bitmap_pad = 32;
+    image->depth = l->depth;
+    image->bits_per_pixel = l->bits_per_pixel;
+    image->bytes_per_line = ((width * l->bits_per_pixel + 31) / 32) * 4;
+    image->red_mask = l->red_mask;
+    image->green_mask = l->green_mask;
+    image->blue_mask = l->blue_mask;
+    image->data = (char *) malloc (image->bytes_per_line * height);
+
+    if (!image->data || !XInitImage (image)) {
+        free (image->data);
+        free (image);
+        return NULL;
+    }
+
+    // bytes_per_line is a multiple of 4
+    p = (uint32_t *) image->data;
+    n = image->bytes_per_line / 4 * height;
+    for (i = 0; i < n; i++)
+        p[i] = bench_random (&seed);
+    return image;
+}
+
+/**
+ * \brief frees an image created with create_image ()
+ *
+ * @param image the image to free, may be NULL
+ */
+static void
+free_image (XImage * image)
+{
+    if (!image)
+        return;
+    free (image->data);
+    free (image);
+}
+
+/**
+ * \brief frees what setup_data () allocated
+ *
+ * @param d the data to free
+ */
+static void
+free_data (BenchData * d)
+{
+    free_image (d->image);
+    free_image (d->other);
+    free (d->rgb24);
+    free (d->cursor);
+    free (d->c_info);
+#ifdef USE_FFMPEG
+    if (d->sws)
+        sws_freeContext (d->sws);
+    free (d->yuv_buf);
+#endif     // USE_FFMPEG
+    memset (d, 0, sizeof (BenchData));
+}
+
+/**
+ * \brief sets up the frames, the mouse pointer and the converters for one
+ *      size and layout
+ *
+ * @param d the data to set up
+ * @param s the frame size
+ * @param l the pixel layout
+ * @return 0 on success, -1 if memory is short
+ */
+static int
+setup_data (BenchData * d, const BenchSize * s, const BenchLayout * l)
+{
+    int i, x, y;
+
+    memset (d, 0, sizeof (BenchData));
+    d->image = create_image (l, s->width, s->height, 1);
+    d->other = create_image (l, s->width, s->height, 2);
+    d->rgb24 = malloc (s->width * s->height * 3);
+    d->cursor = malloc (BENCH_CURSOR * BENCH_CURSOR * sizeof (unsigned long));
+    if (!d->image || !d->other || !d->rgb24 || !d->cursor) {
+        free_data (d);
+        return -1;
+    }
+    d->c_info = xvc_get_color_info (d->image);
+    // the mouse pointer's alpha is in the top byte as XFixes has it,
+    // whatever the layout of the frame
+    d->c_info->alpha_mask = 0xFF000000;
+    d->c_info->alpha_shift = 24;
+
+    for (i = 0; i < 256; i++)
+        d->palette[i] = ((i & 0xE0) << 16) | ((i & 0x1C) << 11) |
+            ((i & 0x03) << 6);
+
+    // an opaque center fading out to the edges, so both the shortcut for
+    // transparent pixels and the blending are taken
+    for (y = 0; y < BENCH_CURSOR; y++) {
+        for (x = 0; x < BENCH_CURSOR; x++) {
+            int dx = abs (2 * x - BENCH_CURSOR), dy = abs (2 * y - BENCH_CURSOR);
+            int alpha = 255 - (dx > dy ? dx : dy) * 4;
+
+            if (alpha < 0)
+                alpha = 0;
+            d->cursor[y * BENCH_CURSOR + x] = ((unsigned long) alpha << 24) |
+                (x * 4 << 16) | (y * 4 << 8) | 0x80;
+        }
+    }
+
+#ifdef USE_FFMPEG
+    {
+        int in_fmt;
+
+        // as guess_input_pix_fmt () in xtoffmpeg.c decides, pal8 is
+        // converted to rgb24 before
+        switch (l->bits_per_pixel) {
+        case 8:
+            in_fmt = PIX_FMT_RGB24;
+            break;
+        case 16:
+            in_fmt = PIX_FMT_BGR565;
+            break;
+        case 24:
+            in_fmt = PIX_FMT_BGR24;
+            break;
+        default:
+            in_fmt = PIX_FMT_RGBA32;
+        }
+        d->sws = sws_getContext (s->width, s->height, in_fmt, s->width,
+                                 s->height, PIX_FMT_YUV420P,
+                                 SWS_FAST_BILINEAR, NULL, NULL, NULL);
+        d->yuv_buf = malloc (avpicture_get_size (PIX_FMT_YUV420P, s->width,
+                                                 s->height));
+        if (!d->sws || !d->yuv_buf) {
+            free_data (d);
+            return -1;
+        }
+        avpicture_fill (&d->yuv, d->yuv_buf, PIX_FMT_YUV420P, s->width,
+                        s->height);
+    }
+#endif     // USE_FFMPEG
+
+    return 0;
+}
+
+/**
+ * \brief size of a frame in bytes without padding
+ *
+ * @param d the benchmark data
+ * @return the number of bytes
+ */
+static long
+frame_bytes (const BenchData * d)
+{
+    return (long) d->image->width * d->image->height *
+        (d->image->bits_per_pixel >> 3);
+}
+
+/**
+ * \brief the number of pixels of a frame
+ *
+ * @param d the benchmark data
+ * @return the number of pixels
+ */
+static long
+frame_pixels (const BenchData * d)
+{
+    return (long) d->image->width * d->image->height;
+}
+
+/** \brief copies a whole frame into another one as done for damaged
+ *      areas */
+static void
+run_place_image (BenchData * d)
+{
+    xvc_pixels_place_image (d->other->data, 0, 0, d->other->width,
+                            d->other->bytes_per_line, d->other->height,
+                            d->image->data, d->image->width,
+                            d->image->bytes_per_line, d->image->height,
+                            d->image->bits_per_pixel >> 3);
+}
+
+/** \brief bytes read and written by run_place_image () */
+static long
+bytes_place_image (const BenchData * d)
+{
+    return 2 * frame_bytes (d);
+}
+
+/** \brief paints the mouse pointer at BENCH_CURSOR_SPOTS places */
+static void
+run_blend_cursor (BenchData * d)
+{
+    int i;
+
+    // spread over the frame so that it is not always the same lines
+    for (i = 0; i < BENCH_CURSOR_SPOTS; i++) {
+        int x = (d->image->width - BENCH_CURSOR) * i / BENCH_CURSOR_SPOTS;
+        int y = (d->image->height - BENCH_CURSOR) *
+            ((i * 7) % BENCH_CURSOR_SPOTS) / BENCH_CURSOR_SPOTS;
+
+        xvc_pixels_blend_cursor (d->image, x, y, d->cursor, BENCH_CURSOR,
+                                 BENCH_CURSOR, d->c_info, d->palette, 256, 0);
+    }
+}
+
+/** \brief pixels blended by run_blend_cursor () */
+static long
+pixels_blend_cursor (const BenchData * d)
+{
+    return BENCH_CURSOR_SPOTS * BENCH_CURSOR * BENCH_CURSOR;
+}
+
+/** \brief bytes read and written by run_blend_cursor () */
+static long
+bytes_blend_cursor (const BenchData * d)
+{
+    return pixels_blend_cursor (d) *
+        (2 * (d->image->bits_per_pixel >> 3) + sizeof (unsigned long));
+}
+
+/** \brief swaps red and blue of a 32 bit frame */
+static void
+run_abgr32_to_argb32 (BenchData * d)
+{
+    xvc_pixels_abgr32_to_argb32 (d->image);
+}
+
+/** \brief bytes read and written by run_abgr32_to_argb32 () */
+static long
+bytes_abgr32_to_argb32 (const BenchData * d)
+{
+    return 2 * frame_bytes (d);
+}
+
+/** \brief looks up the colors of an 8 bit palette frame */
+static void
+run_pal8_to_rgb24 (BenchData * d)
+{
+    xvc_pixels_pal8_to_rgb24 (d->image, d->palette, d->rgb24);
+}
+
+/** \brief bytes read and written by run_pal8_to_rgb24 () */
+static long
+bytes_pal8_to_rgb24 (const BenchData * d)
+{
+    return frame_pixels (d) * (1 + 3);
+}
+
+/** \brief packs a 32 bit frame to rgb24 */
+static void
+run_rgb32_to_rgb24 (BenchData * d)
+{
+    xvc_pixels_rgb32_to_rgb24 (d->image, d->c_info, d->rgb24);
+}
+
+/** \brief bytes read and written by run_rgb32_to_rgb24 () */
+static long
+bytes_rgb32_to_rgb24 (const BenchData * d)
+{
+    return frame_pixels (d) * (4 + 3);
+}
+
+#ifdef USE_FFMPEG
+/** \brief converts a frame to yuv420p, an 8 bit palette frame from the
+ *      rgb24 run_pal8_to_rgb24 () would have made of it */
+static void
+run_sws_scale (BenchData * d)
+{
+    uint8_t *src[4] = { (uint8_t *) d->image->data, NULL, NULL, NULL };
+    int stride[4] = { d->image->bytes_per_line, 0, 0, 0 };
+
+    if (d->image->bits_per_pixel == 8) {
+        src[0] = d->rgb24;
+        stride[0] = d->image->width * 3;
+    }
+    sws_scale (d->sws, src, stride, 0, d->image->height, d->yuv.data,
+               d->yuv.linesize);
+}
+
+/** \brief bytes read and written by run_sws_scale () */
+static long
+bytes_sws_scale (const BenchData * d)
+{
+    int bpp = (d->image->bits_per_pixel == 8 ? 24 :
+               d->image->bits_per_pixel);
+
+    return frame_pixels (d) * (bpp / 8) + frame_pixels (d) * 3 / 2;
+}
+#endif     // USE_FFMPEG
+
+static const BenchKernel kernels[] = {
+    {"place_image", 0xF, run_place_image, frame_pixels, bytes_place_image},
+    {"blend_cursor", 0xF, run_blend_cursor, pixels_blend_cursor,
+     bytes_blend_cursor},
+    {"abgr32_to_argb32", 0x8, run_abgr32_to_argb32, frame_pixels,
+     bytes_abgr32_to_argb32},
+    {"pal8_to_rgb24", 0x1, run_pal8_to_rgb24, frame_pixels,
+     bytes_pal8_to_rgb24},
+    {"rgb32_to_rgb24", 0x8, run_rgb32_to_rgb24, frame_pixels,
+     bytes_rgb32_to_rgb24},
+#ifdef USE_FFMPEG
+    {"sws_scale", 0xF, run_sws_scale, frame_pixels, bytes_sws_scale},
+#endif     // USE_FFMPEG
+};
+
+#define NUM_KERNELS (sizeof (kernels) / sizeof (BenchKernel))
+
+/**
+ * \brief the timing of one kernel on one frame
+ */
+typedef struct
+{
+    int reps;
+    /** \brief the fastest repetition in ns */
+    long long ns_min;
+    /** \brief the average over all repetitions in ns */
+    double ns_mean;
+    /** \brief the fewest cycles a repetition took, 0 if unknown */
+    uint64_t cycles_min;
+} BenchResult;
+
+/**
+ * \brief evicts frames, tables and palettes from the caches by writing over
+ *      a buffer larger than them
+ *
+ * @param pass changes what is written, so it can't be skipped
+ */
+static void
+evict_caches (int pass)
+{
+    memset (flush_buf, pass & 0xFF, BENCH_FLUSH_BYTES);
+}
+
+/**
+ * \brief times a kernel
+ *
+ * A warm run repeats the kernel for at least BENCH_MIN_NS after one run to
+ * warm up the caches, a cold run evicts the caches before each of its
+ * BENCH_COLD_REPS repetitions. Either stops early once the kernel has
+ * taken more than five times BENCH_MIN_NS.
+ *
+ * @param k the kernel to run
+ * @param d the data to run it on
+ * @param cold TRUE for a cold run
+ * @param r returns the timing
+ */
+static void
+measure (const BenchKernel * k, BenchData * d, int cold, BenchResult * r)
+{
+    long long total = 0;
+
+    memset (r, 0, sizeof (BenchResult));
+    if (!cold)
+        k->run (d);
+
+    while (r->reps < (cold ? BENCH_COLD_REPS : BENCH_MAX_REPS)) {
+        long long start, ns;
+        uint64_t c_start, cycles;
+
+        if (cold)
+            evict_caches (r->reps);
+
+        c_start = read_cycles ();
+        start = now_ns ();
+        k->run (d);
+        ns = now_ns () - start;
+        cycles = read_cycles () - c_start;
+
+        if (r->reps == 0 || ns < r->ns_min)
+            r->ns_min = ns;
+        if (r->reps == 0 || cycles < r->cycles_min)
+            r->cycles_min = cycles;
+        total += ns;
+        r->reps++;
+
+        // slow kernels get by with fewer repetitions
+        if (total >= BENCH_MIN_NS &&
+            ((!cold && r->reps >= 3) || total >= 5 * BENCH_MIN_NS))
+            break;
+    }
+    r->ns_mean = (double) total / r->reps;
+}
+
+/**
+ * \brief prints the result of one kernel on one frame
+ *
+ * @param json TRUE for a JSON object, otherwise a line of the table
+ * @param first TRUE for the first result printed
+ * @param k the kernel
+ * @param s the frame size
+ * @param d the data the kernel ran on
+ * @param cold TRUE if this was a cold run
+ * @param r the timing
+ */
+static void
+print_result (int json, int first, const BenchKernel * k, const BenchSize * s,
+              const BenchData * d, int cold, const BenchResult * r)
+{
+    long pixels = k->pixels (d);
+    long bytes = k->bytes (d);
+    double ns = (r->ns_min > 0 ? r->ns_min : 1);
+    double gbps = bytes / ns;
+    double cpp = (double) r->cycles_min / pixels;
+
+    if (json) {
+        printf ("%s\n    {\"kernel\": \"%s\", \"size\": \"%s\", "
+                "\"width\": %i, \"height\": %i, \"bpp\": %i, "
+                "\"cache\": \"%s\", \"reps\": %i, \"pixels\": %li, "
+                "\"bytes\": %li, \"ns_min\": %lli, \"ns_mean\": %.0f, "
+                "\"gb_per_s\": %.3f, ", (first ? "" : ","), k->name,
+                s->name, s->width, s->height, d->image->bits_per_pixel,
+                (cold ? "cold" : "warm"), r->reps, pixels, bytes,
+                r->ns_min, r->ns_mean, gbps);
+        if (r->cycles_min > 0)
+            printf ("\"cycles_per_pixel\": %.3f}", cpp);
+        else
+            printf ("\"cycles_per_pixel\": null}");
+    } else {
+        printf ("%-17s %-6s %3i %-5s %5i %12lli %8.2f", k->name, s->name,
+                d->image->bits_per_pixel, (cold ? "cold" : "warm"),
+                r->reps, r->ns_min, gbps);
+        if (r->cycles_min > 0)
+            printf (" %8.2f\n", cpp);
+        else
+            printf (" %8s\n", "-");
+    }
+}
+
+/**
+ * \brief checks if a name has been selected on the command line
+ *
+ * @param name the name of a kernel or size
+ * @param names the names given on the command line
+ * @param n the number of names
+ * @param given TRUE if any name of the same kind has been given
+ * @return TRUE if name was given or no name of its kind was given
+ */
+static int
+selected (const char *name, char **names, int n, int given)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (strcmp (name, names[i]) == 0)
+            return 1;
+    }
+    return !given;
+}
+
+int
+main (int argc, char *argv[])
+{
+    int json = 0, first = 1, kernels_given = 0, sizes_given = 0;
+    int nnames = 0;
+    char **names = NULL;
+    int i, s, l, k;
+
+    names = (char **) calloc (argc, sizeof (char *));
+    flush_buf = malloc (BENCH_FLUSH_BYTES);
+    if (!names || !flush_buf) {
+        fprintf (stderr, "out of memory\n");
+        return 1;
+    }
+
+    for (i = 1; i < argc; i++) {
+        int known = 0;
+
+        if (strcmp (argv[i], "--json") == 0) {
+            json = 1;
+            continue;
+        }
+        for (k = 0; k < NUM_KERNELS; k++) {
+            if (strcmp (argv[i], kernels[k].name) == 0)
+                known = kernels_given = 1;
+        }
+        for (s = 0; s < NUM_SIZES; s++) {
+            if (strcmp (argv[i], sizes[s].name) == 0)
+                known = sizes_given = 1;
+        }
+        if (!known) {
+            fprintf (stderr, "usage: %s [--json] [kernel|size ...]\n",
+                     argv[0]);
+            fprintf (stderr, "kernels:");
+            for (k = 0; k < NUM_KERNELS; k++)
+                fprintf (stderr, " %s", kernels[k].name);
+            fprintf (stderr, "\nsizes:");
+            for (s = 0; s < NUM_SIZES; s++)
+                fprintf (stderr, " %s", sizes[s].name);
+            fprintf (stderr, "\n");
+            return 1;
+        }
+        names[nnames++] = argv[i];
+    }
+
+    xvc_pixels_init_blend ();
+
+    if (json) {
+        printf ("{\n  \"benchmark\": \"xvidcap-pixel-bench\",\n");
+#ifdef VERSION
+        printf ("  \"version\": \"%s\",\n", VERSION);
+#endif     // VERSION
+        printf ("  \"cycles\": %s,\n",
+#ifdef HAVE_CYCLES
+                "\"tsc\""
+#else
+                "null"
+#endif     // HAVE_CYCLES
+            );
+        printf ("  \"results\": [");
+    } else {
+        printf ("%-17s %-6s %3s %-5s %5s %12s %8s %8s\n", "kernel", "size",
+                "bpp", "cache", "reps", "best ns", "GB/s", "cyc/px");
+    }
+
+    for (s = 0; s < NUM_SIZES; s++) {
+        if (!selected (sizes[s].name, names, nnames, sizes_given))
+            continue;
+        for (l = 0; l < NUM_LAYOUTS; l++) {
+            BenchData d;
+            int wanted = 0;
+
+            for (k = 0; k < NUM_KERNELS; k++) {
+                if ((kernels[k].layouts & (1 << l)) &&
+                    selected (kernels[k].name, names, nnames, kernels_given))
+                    wanted = 1;
+            }
+            if (!wanted)
+                continue;
+
+            if (setup_data (&d, &sizes[s], &layouts[l]) < 0) {
+                fprintf (stderr, "%s: out of memory at %s %i bpp\n",
+                         argv[0], sizes[s].name, layouts[l].bits_per_pixel);
+                continue;
+            }
+            // what sws_scale gets for 8 bit frames
+            if (layouts[l].bits_per_pixel == 8)
+                xvc_pixels_pal8_to_rgb24 (d.image, d.palette, d.rgb24);
+
+            for (k = 0; k < NUM_KERNELS; k++) {
+                BenchResult r;
+                int cold;
+
+                if (!(kernels[k].layouts & (1 << l)) ||
+                    !selected (kernels[k].name, names, nnames,
+                               kernels_given))
+                    continue;
+                for (cold = 0; cold <= 1; cold++) {
+                    measure (&kernels[k], &d, cold, &r);
+                    print_result (json, first, &kernels[k], &sizes[s], &d,
+                                  cold, &r);
+                    first = 0;
+                }
+                fflush (stdout);
+            }
+            free_data (&d);
+        }
+    }
+
+    if (json)
+        printf ("\n  ]\n}\n");
+
+    free (flush_buf);
+    free (names);
+    return 0;
+}
@@ -0,0 +1,215 @@
+/**
+ * \file xvidcap-resample-bench.c
+ *
+ * This file contains a small benchmark comparing the throughput and the
+ * signal to noise ratio of xvidcap's own audio resampler with the
+ * audio_resample () implementation from libavcodec it replaces. It is not
+ * built by default, use "make xvidcap-resample-bench".
+ */
+/*
+ * Copyright (C) 2003-07 Karl H. Beckers, Frankfurt
+ * EMail: khb@jarre-de-the.net
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif     // HAVE_CONFIG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include <ffmpeg/avcodec.h>
+
+#include "resampler.h"
+
+/** \brief seconds of audio converted per test */
+#define BENCH_SECONDS 20
+
+/** \brief frames handed to the resampler per call, about what the audio
+ *      encode thread uses */
+#define BENCH_CHUNK 1152
+
+/** \brief frequency of the test tone */
+#define TONE_HZ 997.0
+
+/** \brief amplitude of the test tone */
+#define TONE_AMP 12000.0
+
+/**
+ * \brief a conversion to benchmark
+ */
+typedef struct
+{
+    int in_rate;
+    int in_channels;
+    int out_rate;
+    int out_channels;
+} BenchCase;
+
+static const BenchCase cases[] = {
+    {44100, 2, 48000, 2},
+    {48000, 2, 44100, 2},
+    {22050, 1, 48000, 2},
+    {48000, 2, 22050, 1},
+    {32000, 2, 44100, 2}
+};
+
+/**
+ * \brief gets the current time
+ *
+ * @return time in seconds
+ */
+static double
+now ()
+{
+    struct timeval tv;
+
+    gettimeofday (&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/**
+ * \brief estimates the signal to noise ratio of the first output channel by
+ *      fitting the expected tone's amplitude and phase
+ *
+ * @param out the converted samples
+ * @param frames number of frames in out
+ * @param channels number of channels in out
+ * @param rate sample rate of out
+ * @return SNR in dB
+ */
+static double
+snr (const int16_t * out, int frames, int channels, int rate)
+{
+    double ss = 0, sc = 0, sig = 0, err = 0, a, b;
+    int i, skip = rate / 10;
+
+    // least squares fit of a * sin + b * cos, ignoring the filter's
+    // start-up at both ends
+    for (i = skip; i < frames - skip; i++) {
+        double w = 2 * M_PI * TONE_HZ * i / rate;
+
+        ss += out[i * channels] * sin (w);
+        sc += out[i * channels] * cos (w);
+    }
+    a = 2 * ss / (frames - 2 * skip);
+    b = 2 * sc / (frames - 2 * skip);
+    for (i = skip; i < frames - skip; i++) {
+        double w = 2 * M_PI * TONE_HZ * i / rate;
+        double ideal = a * sin (w) + b * cos (w);
+        double e = out[i * channels] - ideal;
+
+        sig += ideal * ideal;
+        err += e * e;
+    }
+    return (err > 0 ? 10 * log10 (sig / err) : 999);
+}
+
+/**
+ * \brief runs one conversion with either resampler and prints the result
+ *
+ * @param c the conversion to run
+ * @param quality one of XVC_ResampleQuality or -1 for libavcodec's
+ *      audio_resample ()
+ */
+static void
+run (const BenchCase * c, int quality)
+{
+    int in_frames = c->in_rate * BENCH_SECONDS;
+    int max_out = (int) ((double) in_frames * c->out_rate / c->in_rate) +
+        4 * BENCH_CHUNK;
+    int16_t *in = malloc (in_frames * c->in_channels * sizeof (int16_t));
+    int16_t *out = malloc (max_out * c->out_channels * sizeof (int16_t));
+    XVC_Resampler *xr = NULL;
+    ReSampleContext *fr = NULL;
+    int i, k, produced = 0;
+    double start, elapsed;
+
+    if (!in || !out) {
+        fprintf (stderr, "out of memory\n");
+        exit (1);
+    }
+    for (i = 0; i < in_frames; i++) {
+        int16_t v = (int16_t) (TONE_AMP *
+                               sin (2 * M_PI * TONE_HZ * i / c->in_rate));
+
+        for (k = 0; k < c->in_channels; k++)
+            in[i * c->in_channels + k] = v;
+    }
+
+    if (quality < 0)
+        fr = audio_resample_init (c->out_channels, c->in_channels,
+                                  c->out_rate, c->in_rate);
+    else
+        xr = xvc_resampler_new (c->in_rate, c->out_rate, c->in_channels,
+                                c->out_channels, quality);
+    if (!fr && !xr) {
+        printf ("%6i/%i -> %6i/%i  %-8s  not supported\n", c->in_rate,
+                c->in_channels, c->out_rate, c->out_channels,
+                (quality < 0 ? "lavc" : xvc_resampler_quality_name (quality)));
+        free (in);
+        free (out);
+        return;
+    }
+
+    start = now ();
+    for (i = 0; i < in_frames; i += BENCH_CHUNK) {
+        int n = (in_frames - i < BENCH_CHUNK ? in_frames - i : BENCH_CHUNK);
+        int16_t *src = in + i * c->in_channels;
+        int16_t *dst = out + produced * c->out_channels;
+
+        if (fr)
+            produced += audio_resample (fr, dst, src, n);
+        else
+            produced += xvc_resampler_process (xr, src, n, dst);
+    }
+    elapsed = now () - start;
+
+    printf ("%6i/%i -> %6i/%i  %-8s  %8.1fx realtime  %6.1f Msamples/s  SNR %5.1f dB\n",
+            c->in_rate, c->in_channels, c->out_rate, c->out_channels,
+            (quality < 0 ? "lavc" : xvc_resampler_quality_name (quality)),
+            BENCH_SECONDS / elapsed,
+            (double) produced * c->out_channels / elapsed / 1000000,
+            snr (out, produced, c->out_channels, c->out_rate));
+
+    if (fr)
+        audio_resample_close (fr);
+    if (xr)
+        xvc_resampler_free (xr);
+    free (in);
+    free (out);
+}
+
+int
+main (int argc, char *argv[])
+{
+    int i, q;
+
+    avcodec_init ();
+
+    printf ("converting %i s of a %.0f Hz tone in chunks of %i frames\n",
+            BENCH_SECONDS, TONE_HZ, BENCH_CHUNK);
+    for (i = 0; i < sizeof (cases) / sizeof (cases[0]); i++) {
+        run (&cases[i], -1);
+        for (q = 0; q < XVC_RESAMPLE_NUM_QUALITIES; q++)
+            run (&cases[i], q);
+    }
+    return 0;
+}